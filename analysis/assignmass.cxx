@@ -28,6 +28,7 @@
 #include "master.h"
 #include "core/aweights.hpp"
 #include "core/gridinfo.hpp"
+#include "core/simd.h"
 using namespace gridinfo;
 
 typedef blitz::Array<float,3> mass_array_t;
@@ -59,7 +60,7 @@ static void assign_mass(mass_array_t &masses, const F r[3], F mass,int iAssignme
     }
 }
 
-static void flush_masses(PKD pkd,int nGrid,const mass_array_t &masses, const shape_t &lower,int fold) {
+static void flush_masses(PKD pkd,int nGrid,const mass_array_t &masses, const shape_t &lower,int fold,int cid=CID_PK) {
     auto big_grid = nGrid * fold;
     auto wrap = [nGrid,big_grid](int i) { if (i>=big_grid) i-=big_grid; else if (i<0) i+=big_grid; return i % nGrid; };
     for (auto i=masses.begin(); i!=masses.end(); ++i) {
@@ -68,7 +69,7 @@ static void flush_masses(PKD pkd,int nGrid,const mass_array_t &masses, const sha
             loc[0] = wrap(loc[0]); loc[1] = wrap(loc[1]); loc[2] = wrap(loc[2]);
             auto id = mdlFFTrId(pkd->mdl,pkd->fft,loc[0],loc[1],loc[2]);
             auto idx = mdlFFTrIdx(pkd->mdl,pkd->fft,loc[0],loc[1],loc[2]);
-            float *p = reinterpret_cast<float *>(mdlVirtualFetch(pkd->mdl,CID_PK,idx,id));
+            float *p = reinterpret_cast<float *>(mdlVirtualFetch(pkd->mdl,cid,idx,id));
             *p += *i;
         }
     }
@@ -172,6 +173,222 @@ int pstAssignMass(PST pst,void *vin,int nIn,void *vout,int nOut) {
     return 0;
 }
 
+/*
+** The assignment weights of AssignmentWeights, but for fvec::width()
+** coordinates at once. Returns the first cell (as a float) in "fi".
+*/
+static inline fvec floor_fvec(const fvec &r) {
+    fvec f = cvt_fvec(cvt_i32v(r)); // Rounded to nearest
+    return f - mask_mov(fvec(0.0f),f>r,fvec(1.0f));
+}
+
+template<int Order>
+static inline void simd_weights(const fvec &r, fvec &fi, fvec *H) {
+    if constexpr (Order==0) {           // NGP
+        fi = floor_fvec(r);
+        H[0] = 1.0f;
+    }
+    else if constexpr (Order==1) {      // CIC
+        fvec rr = r - 0.5f;
+        fi = floor_fvec(rr);
+        fvec h = rr - fi;
+        H[0] = 1.0f - h;
+        H[1] = h;
+    }
+    else if constexpr (Order==2) {      // TSC
+        fi = floor_fvec(r) - 1.0f;
+        fvec h = r - fi - 1.5f;
+        fvec a = 0.5f - h, b = 0.5f + h;
+        H[0] = 0.5f * a*a;
+        H[1] = 0.75f - h*h;
+        H[2] = 0.5f * b*b;
+    }
+    else {                              // PCS
+        auto K0 = [](fvec h) { return (1.0f/6.0f) * (4.0f - 6.0f*h*h + 3.0f*h*h*h); };
+        auto K1 = [](fvec h) { fvec t = 2.0f - h; return (1.0f/6.0f) * t*t*t; };
+        fi = floor_fvec(r - 1.5f);
+        fvec h = r - (fi + 0.5f);
+        H[0] = K1(h);
+        H[1] = K0(h - 1.0f);
+        H[2] = K0(2.0f - h);
+        H[3] = K1(3.0f - h);
+    }
+}
+
+/*
+** Assign the mass to several grids at once with a single pass over the particles.
+** Grid "g" is folded fold[g] times and shifted by fDelta[g] cells. The lanes of
+** the SIMD weight calculation are the three dimensions of every grid.
+*/
+template<int Order>
+static void assign_grids(PKD pkd, uint32_t iLocalRoot, int nGrids, const int *fold, const float *fDelta) {
+    constexpr int pad = (Order+1) / 2;
+    constexpr int nSIMD = fvec::width();
+    const std::size_t maxSize = 100000; // We would like this to remain in L2 cache
+    int nGrid = pkd->fft->rgrid->n1;
+    position_t fPeriod(pkd->fPeriod), ifPeriod = 1.0 / fPeriod;
+    int nLanes = (3*nGrids + nSIMD - 1) / nSIMD * nSIMD;
+
+    // Lane l is dimension l%3 of grid l/3: r = x * dScale + dShift relative to the subcube.
+    // This is done in double precision as the grid coordinate can be large; only the
+    // coordinate within the subcube is small enough for the single precision weights.
+    std::vector<double> dScale(nLanes,0.0), dShift(nLanes,0.0);
+    std::vector<float> fPos(nLanes,0.0f);
+    std::vector<float> fIndex(nLanes), fH((Order+1)*nLanes);
+    std::vector<shape_t> lower(nGrids), shape(nGrids);
+    std::vector<std::size_t> offset(nGrids+1);
+    std::vector<float> data;
+    data.reserve(maxSize);
+    for (auto g=0; g<nGrids; ++g) {
+        for (auto d=0; d<3; ++d) dScale[3*g+d] = ifPeriod[d] * nGrid * fold[g];
+    }
+
+    // Set up the mass subcubes that cover [rlo,rhi] for each grid. False if too large.
+    auto setup = [&](const position_t &rlo, const position_t &rhi) {
+        offset[0] = 0;
+        for (auto g=0; g<nGrids; ++g) {
+            auto grid_point = [&](const position_t &r) {
+                return (r * ifPeriod + 0.5) * nGrid * fold[g] + fDelta[g];
+            };
+            lower[g] = shape_t(blitz::floor(grid_point(rlo))) - pad;
+            shape_t upper = shape_t(blitz::floor(grid_point(rhi))) + pad;
+            shape[g] = upper - lower[g] + 1;
+            offset[g+1] = offset[g] + blitz::product(shape[g]);
+            for (auto d=0; d<3; ++d)
+                dShift[3*g+d] = 0.5 * nGrid * fold[g] + fDelta[g] - lower[g][d];
+        }
+        if (offset[nGrids] > maxSize) return false;
+        data.resize(offset[nGrids]);
+        std::fill(data.begin(),data.end(),0.0f);
+        return true;
+    };
+    auto assign = [&](const position_t &r,float m) {
+        for (auto g=0; g<nGrids; ++g) {
+            for (auto d=0; d<3; ++d) fPos[3*g+d] = r[d] * dScale[3*g+d] + dShift[3*g+d];
+        }
+        for (auto l=0; l<nLanes; l+=nSIMD) {
+            fvec fi, H[Order+1];
+            simd_weights<Order>(fvec(&fPos[l]),fi,H);
+            fi.store(&fIndex[l]);
+            for (auto o=0; o<=Order; ++o) H[o].store(&fH[o*nLanes+l]);
+        }
+        for (auto g=0; g<nGrids; ++g) {
+            int ix = fIndex[3*g+0], iy = fIndex[3*g+1], iz = fIndex[3*g+2];
+            auto nx = shape[g][0], ny = shape[g][1];
+            auto p = data.data() + offset[g];
+            for (auto k=0; k<=Order; ++k) {
+                auto mz = m * fH[k*nLanes+3*g+2];
+                for (auto j=0; j<=Order; ++j) {
+                    auto myz = mz * fH[j*nLanes+3*g+1];
+                    auto q = p + ix + nx * ((iy+j) + ny * (iz+k));
+                    for (auto i=0; i<=Order; ++i) q[i] += fH[i*nLanes+3*g+0] * myz;
+                }
+            }
+        }
+    };
+    auto flush = [&]() {
+        for (auto g=0; g<nGrids; ++g) {
+            mass_array_t masses(data.data()+offset[g],shape[g],blitz::neverDeleteData,RegularArray());
+            flush_masses(pkd,nGrid,masses,lower[g],fold[g],CID_PK_GRIDS+g);
+        }
+    };
+
+    std::vector<std::uint32_t> stack;
+    stack.push_back(iLocalRoot);
+    while ( !stack.empty()) {
+        auto kdn = pkd->tree[stack.back()];
+        stack.pop_back(); // Go to the next node in the tree
+        auto bnd = kdn->bound();
+        if (setup(bnd.lower(),bnd.upper())) {
+            for ( auto &p : *kdn ) assign(p.position(),p.mass());
+            flush();
+        }
+        else if (kdn->is_cell()) { // This cell is too large, so we split it and move on
+            stack.push_back(kdn->rchild());
+            stack.push_back(kdn->lchild());
+        }
+        else { // Huge bucket. Do a particle at a time.
+            for ( auto &p : *kdn) {
+                position_t r = p.position();
+                setup(r,r);
+                assign(r,p.mass());
+                flush();
+            }
+        }
+    }
+}
+
+void pkdAssignMassGrids(PKD pkd, uint32_t iLocalRoot, int iAssignment, int nGrids,
+                        const int *fold, const float *fDelta) {
+    auto fft = pkd->fft;
+    assert(nGrids>0 && nGrids<=PST_MAX_PK_GRIDS);
+    mdlGridCoord first, last;
+    mdlGridCoordFirstLast(pkd->mdl,fft->rgrid,&first,&last,1);
+    for (auto g=0; g<nGrids; ++g) {
+        auto fftData = reinterpret_cast<FFTW3(real) *>(pkd->pLite) + g*fft->rgrid->nLocal;
+        fftData = reinterpret_cast<FFTW3(real) *>(mdlSetArray(pkd->mdl,last.i,sizeof(FFTW3(real)),fftData));
+        for ( int i=first.i; i<last.i; ++i ) fftData[i] = 0.0;
+        mdlCOcache(pkd->mdl,CID_PK_GRIDS+g,NULL,fftData,sizeof(FFTW3(real)),last.i,pkd,initPk,combPk);
+    }
+    switch (iAssignment) {
+    case 0: assign_grids<0>(pkd,iLocalRoot,nGrids,fold,fDelta); break;
+    case 1: assign_grids<1>(pkd,iLocalRoot,nGrids,fold,fDelta); break;
+    case 2: assign_grids<2>(pkd,iLocalRoot,nGrids,fold,fDelta); break;
+    case 3: assign_grids<3>(pkd,iLocalRoot,nGrids,fold,fDelta); break;
+    default: assert(iAssignment>=0 && iAssignment<=3); abort();
+    }
+    for (auto g=0; g<nGrids; ++g) mdlFinishCache(pkd->mdl,CID_PK_GRIDS+g);
+}
+
+int pstAssignMassGrids(PST pst,void *vin,int nIn,void *vout,int nOut) {
+    LCL *plcl = pst->plcl;
+    auto in = reinterpret_cast<struct inAssignMassGrids *>(vin);
+    assert (nIn==sizeof(struct inAssignMassGrids) );
+    if (pstNotCore(pst)) {
+        int rID = pst->mdl->ReqService(pst->idUpper, PST_ASSIGN_MASS_GRIDS, vin, nIn);
+        pstAssignMassGrids(pst->pstLower, vin, nIn, NULL, 0);
+        pst->mdl->GetReply(rID);
+    }
+    else {
+        auto pkd = plcl->pkd;
+        pkdAssignMassGrids(pkd,ROOT,in->iAssignment,in->nGrids,in->fold,in->fDelta);
+        // Transform all of the grids to delta(k) back-to-back
+        for (auto g=0; g<in->nGrids; ++g) pkdDensityContrast(pkd,in->dTotalMass,g,true);
+    }
+    return 0;
+}
+
+/*
+** Assign the mass for each fold (and the half cell shifted grid if interlacing)
+** in one pass, then convert all of the grids to density contrast in k-space.
+** Fold f is in grid f, or grids 2f and 2f+1 when interlacing.
+*/
+void MSR::AssignMassGrids(int iAssignment,const std::vector<int> &folds,bool bInterlace) {
+    static const char *schemes[] = {
+        "Nearest Grid Point (NGP)", "Cloud in Cell (CIC)",
+        "Triangular Shaped Cloud (TSC)", "Piecewise Cubic Spline (PCS)"
+    };
+    struct inAssignMassGrids mass;
+    assert(iAssignment>=0 && iAssignment<=3);
+    assert(folds.size()>0 && folds.size()<=PST_MAX_PK_FOLDS);
+    printf("Assigning mass to %d grids using %s (order %d)\n",
+           int(folds.size()) * (bInterlace?2:1),schemes[iAssignment],iAssignment);
+    mass.iAssignment = iAssignment;
+    mass.nGrids = 0;
+    for (auto fold : folds) {
+        mass.fold[mass.nGrids] = fold;
+        mass.fDelta[mass.nGrids++] = 0.0f;
+        if (bInterlace) {
+            mass.fold[mass.nGrids] = fold;
+            mass.fDelta[mass.nGrids++] = 0.5f;
+        }
+    }
+    mass.dTotalMass = TotalMass();
+    auto sec = MSR::Time();
+    pstAssignMassGrids(pst, &mass, sizeof(mass), NULL, 0);
+    printf("Mass assignment complete, Wallclock: %f secs\n",MSR::Time() - sec);
+}
+
 void MSR::AssignMass(int iAssignment,int iGrid,float fDelta,int fold) {
     static const char *schemes[] = {
         "Nearest Grid Point (NGP)", "Cloud in Cell (CIC)",
@@ -19,7 +19,7 @@
 #include "core/gridinfo.hpp"
 using namespace gridinfo;
 
-static void pkdDensityContrast(PKD pkd,double dTotalMass,int iGrid,bool k=false) {
+void pkdDensityContrast(PKD pkd,double dTotalMass,int iGrid,bool k) {
     auto fft = pkd->fft;
     GridInfo G(pkd->mdl,fft);
     int nGrid = fft->rgrid->n1;
@@ -22,6 +22,7 @@
 #include "pst.h"
 #include "master.h"
 #include "core/gridinfo.hpp"
+#include "core/aweights.hpp"
 #include "ic/whitenoise.hpp"
 using namespace gridinfo;
 
@@ -193,6 +194,145 @@ int pstGridBinK(PST pst,void *vin,int nIn,void *vout,int nOut) {
     return sizeof(struct outGridBinK);
 }
 
+/*
+** A single sweep over k-space for the grids of pkdAssignMassGrids: for each
+** fold interlace grids 2f and 2f+1 (or just take grid f), correct for the
+** assignment window, and bin the power. The corrected field for fold f is
+** left in grid 2f (or f) so that it can be used afterwards.
+*/
+void pkdGridBinKGrids(PKD pkd,int nBins,int iAssignment,int nFolds,bool bInterlace,
+                      double (*fK)[PST_MAX_K_BINS], double (*fPower)[PST_MAX_K_BINS], uint64_t (*nPower)[PST_MAX_K_BINS]) {
+    assert(pkd->fft != NULL);
+    assert(nFolds>0 && nFolds<=PST_MAX_PK_FOLDS);
+    auto fft = pkd->fft;
+    int nGrid = fft->rgrid->n1;
+    auto iNyquist = nGrid / 2;
+    GridInfo G(pkd->mdl,fft);
+    AssignmentWindow W(nGrid,iAssignment);
+    int nGrids = bInterlace ? 2*nFolds : nFolds;
+
+    complex_array_t K[PST_MAX_PK_GRIDS];
+    auto data = reinterpret_cast<real_t *>(mdlSetArray(pkd->mdl,0,0,pkd->pLite));
+    for (auto g=0; g<nGrids; ++g) G.setupArray(data + fft->rgrid->nLocal * g,K[g]);
+
+    for (auto f=0; f<nFolds; ++f) {
+        for ( auto i=0; i<nBins; i++ ) {
+            fK[f][i] = 0.0;
+            fPower[f][i] = 0.0;
+            nPower[f][i] = 0;
+        }
+    }
+#ifdef LINEAR_PK
+    double scale = nBins * 1.0 / iNyquist;
+#else
+    double scale = nBins * 1.0 / log(iNyquist+1);
+#endif
+    for ( auto index=K[0].begin(); index!=K[0].end(); ++index ) {
+        auto pos = index.position();
+        auto i = pos[0]; // i is positive; j and k can be negative
+        auto j = pos[1]>iNyquist ? pos[1] - nGrid : pos[1];
+        auto k = pos[2]>iNyquist ? pos[2] - nGrid : pos[2];
+        auto w = W[i] * W[std::abs(j)] * W[std::abs(k)]; // Correction for mass assignment
+        complex_t shift;
+        if (bInterlace) {
+            float theta = M_PI/nGrid * (i + j + k);
+            shift = complex_t(0.5f*cosf(theta),0.5f*sinf(theta));
+        }
+        auto ak = sqrt(i*i + j*j + k*k);
+        auto ks = int(ak);
+        bool bBin = ks >= 1 && ks <= iNyquist;
+        if (bBin) {
+#ifdef LINEAR_PK
+            ks = floor((ks-1.0) * scale);
+#else
+            ks = floor(log(ks) * scale);
+#endif
+            assert(ks>=0 && ks<nBins);
+        }
+        auto nCount = (i!=0 && i!=iNyquist) ? 2 : 1; // Account for negative Kx values
+        for (auto f=0; f<nFolds; ++f) {
+            complex_t v;
+            if (bInterlace) {
+                auto &v1 = K[2*f](pos);
+                v = (complex_t(0.5f)*v1 + K[2*f+1](pos)*shift) * w;
+                v1 = v;
+            }
+            else {
+                auto &v1 = K[f](pos);
+                v = v1 * w;
+                v1 = v;
+            }
+            if (bBin) {
+                fK[f][ks] += nCount * log(ak);
+                fPower[f][ks] += nCount * std::norm(v);
+                nPower[f][ks] += nCount;
+            }
+        }
+    }
+}
+
+int pstGridBinKGrids(PST pst,void *vin,int nIn,void *vout,int nOut) {
+    LCL *plcl = pst->plcl;
+    auto in = reinterpret_cast<struct inGridBinKGrids *>(vin);
+    auto out = reinterpret_cast<struct outGridBinKGrids *>(vout);
+
+    assert( nIn==sizeof(struct inGridBinKGrids) );
+    assert( nOut==sizeof(struct outGridBinKGrids) );
+    if (pstNotCore(pst)) {
+        auto outUpper = new struct outGridBinKGrids;
+        int rID = pst->mdl->ReqService(pst->idUpper,PST_GRID_BIN_K_GRIDS,vin,nIn);
+        pstGridBinKGrids(pst->pstLower,vin,nIn,vout,nOut);
+        nOut = pst->mdl->GetReply(rID,sizeof(*outUpper),outUpper);
+        assert(nOut==sizeof(struct outGridBinKGrids));
+
+        for (auto f=0; f<in->nFolds; ++f) {
+            for (auto i=0; i<in->nBins; i++) {
+                out->fK[f][i] += outUpper->fK[f][i];
+                out->fPower[f][i] += outUpper->fPower[f][i];
+                out->nPower[f][i] += outUpper->nPower[f][i];
+            }
+        }
+        delete outUpper;
+    }
+    else {
+        pkdGridBinKGrids(plcl->pkd, in->nBins, in->iAssignment, in->nFolds, in->bInterlace,
+                         out->fK, out->fPower, out->nPower);
+    }
+    return sizeof(struct outGridBinKGrids);
+}
+
+std::vector<std::tuple<std::vector<uint64_t>,std::vector<float>,std::vector<float>>> // nPk, fK, fPk for each fold
+MSR::GridBinKGrids(int nBins, int iAssignment, int nFolds, bool bInterlace) {
+    std::vector<std::tuple<std::vector<uint64_t>,std::vector<float>,std::vector<float>>> result;
+    struct inGridBinKGrids in;
+    auto out = new struct outGridBinKGrids;
+    assert(iAssignment>=0 && iAssignment<=3);
+    assert(nFolds>0 && nFolds<=PST_MAX_PK_FOLDS);
+    in.nBins = nBins;
+    in.iAssignment = iAssignment;
+    in.nFolds = nFolds;
+    in.bInterlace = bInterlace;
+
+    assert(PST_MAX_K_BINS>nBins);
+
+    pstGridBinKGrids(pst, &in, sizeof(in), out, sizeof(*out));
+    for (auto f=0; f<nFolds; ++f) {
+        std::vector<uint64_t> nPk(nBins);
+        std::vector<float> fK(nBins), fPk(nBins);
+        for ( int i=0; i<nBins; i++ ) {
+            if ( out->nPower[f][i] == 0 ) fK[i] = fPk[i] = 0;
+            else {
+                nPk[i] = out->nPower[f][i];
+                fK[i] = exp(out->fK[f][i]/out->nPower[f][i]);
+                fPk[i] = out->fPower[f][i]/out->nPower[f][i];
+            }
+        }
+        result.emplace_back(nPk,fK,fPk);
+    }
+    delete out;
+    return result;
+}
+
 std::tuple<std::vector<uint64_t>,std::vector<float>,std::vector<float>> // nPk, fK, fPk
 MSR::GridBinK(int nBins, int iGrid) {
     std::vector<uint64_t> nPk(nBins);
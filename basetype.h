@@ -44,6 +44,7 @@ typedef float  mass_t;
 #define COST_FLOP_PC 215 // +-*: 206 AND/CMP:2 rsqrt:1
 #define COST_FLOP_EWALD 386 // +-*: 306 AND/CMP:3 div:2 rsqrt:1
 #define COST_FLOP_HLOOP 62 // +-*:46  AND/CMP:16 div: rsqrt:0
+#define COST_FLOP_EWALD_TABLE 56 // +-*:50  AND/CMP:6 div: rsqrt:0
 #define COST_FLOP_SOFT 15
 #define COST_FLOP_OPEN 97 // +-*:55  AND/CMP:42
 
@@ -37,9 +37,11 @@ protected:
     static constexpr offset_type field_count = static_cast<offset_type>(FIELD::MAX_FIELD);
     blitz::TinyVector<offset_type,field_count> field_length; // Length of the field
     blitz::TinyVector<offset_type,field_count> field_ialign; // Alignment of the field in log2(align)
+    blitz::TinyVector<offset_type,field_count> field_hot;    // Placement order of hot fields (or zero)
+    offset_type hot_count = 0;
 public:
     using field = FIELD;
-    fields() : field_length(offset_type(0)), field_ialign(offset_type(0)) {}
+    fields() : field_length(offset_type(0)), field_ialign(offset_type(0)), field_hot(offset_type(0)) {}
 
     // This will enlarge an overlay field if necessary
     void enlarge(FIELD f, offset_type size, offset_type alignment) {
@@ -51,6 +53,14 @@ public:
     void clear() {
         field_length = 0;
         field_ialign = 0;
+        field_hot = 0;
+        hot_count = 0;
+    }
+
+    // Hot fields are placed first (directly after the header) in the order they are marked
+    void hot(FIELD f) {
+        auto ifield = static_cast<offset_type>(f);
+        if (field_hot[ifield] == 0) field_hot[ifield] = ++hot_count;
     }
 
     template<typename T>
@@ -71,6 +81,18 @@ public:
         // If the current offset (the start offset) does not match the necessary alignment,
         // then keep padding with a field of the necessary alignment (or nothing) until it does.
         auto offset = start_offset;
+
+        // Hot fields go first, each at its natural alignment, so they share the leading cache line
+        for (offset_type h=1; h<=hot_count; ++h) {
+            int j = blitz::first(field_hot == h);
+            if (j<0 || field_length[j]==0) continue;
+            auto mask = (offset_type(1) << field_ialign[j]) - 1;
+            offset = (offset + mask) & ~mask;
+            field_offset[j] = offset;
+            offset += field_length[j];
+            field_length[j] = 0;
+        }
+
         for (auto i=0; i<alignment; ++i) {
             auto size = 1 << i;
             if ( (2*size-1) & offset) {
@@ -260,6 +282,14 @@ public:
         return Overlay<DATA,FIELD>(*this,f);
     }
 
+    //! Mark a field as "hot". Hot fields are laid out first, immediately after the header
+    //! and in the order they were marked, so the fields touched by the tight loops (kick, drift)
+    //! share the first cache line of the element. Marking a field that is not added has no effect.
+    //! \param f The field id
+    void hot(FIELD f) {
+        fields<FIELD>::hot(f);
+    }
+
 public:
     //! Returns the offset (in bytes) of the specified field or zero if it not present
     //! \param f The field id
@@ -65,6 +65,8 @@ class GridInfo {
     dimension_t m_grid; // full dimensions of the grid
     int m_sz, m_nz;           // Start and number of of "z" slabs
     int m_sy, m_ny;           // Ditto for y after transpose
+    int m_syr, m_nyr;         // Start and number of "y" pencils in r-space
+    int m_sxk, m_nxk;         // Ditto for "x" in k-space
     int m_nlocal;             // Size of local array in elements    
     int m_iCore, m_nCore;
 public:
@@ -78,6 +80,12 @@ public:
     inline int ny()             const { return m_ny; }
     inline int ey()             const { return m_sy+m_ny; }
 
+    // With slabs these are the complete dimension
+    inline int syr()            const { return m_syr; }
+    inline int nyr()            const { return m_nyr; }
+    inline int sxk()            const { return m_sxk; }
+    inline int nxk()            const { return m_nxk; }
+
     inline int n1r()            const { return grid()[0]; }
     inline int n1k()            const { return n1r()/2 + 1; }
     inline int n2()             const { return grid()[1]; }
@@ -348,6 +348,8 @@ enum PKD_FIELD {
     oRungDest, /* Destination processor for each rung */
     oParticleID,
     oGlobalGid, /* global group id, uint64 */
+    oWork, /* One float: measured cost of the evaluations so far this step */
+    oLastWork, /* One float: measured cost of the evaluations in the last full step */
 
     MAX_FIELD
 };
@@ -442,6 +444,10 @@ public:
     const auto &ball(         const PARTICLE *p ) const {return get<float>(p,PKD_FIELD::oBall);}
     auto       &global_gid(         PARTICLE *p ) const {return get<int64_t>(p,PKD_FIELD::oGlobalGid);}
     const auto &global_gid(   const PARTICLE *p ) const {return get<int64_t>(p,PKD_FIELD::oGlobalGid);}
+    auto       &work(               PARTICLE *p ) const {return get<float>(p,PKD_FIELD::oWork);}
+    const auto &work(         const PARTICLE *p ) const {return get<float>(p,PKD_FIELD::oWork);}
+    auto       &last_work(          PARTICLE *p ) const {return get<float>(p,PKD_FIELD::oLastWork);}
+    const auto &last_work(    const PARTICLE *p ) const {return get<float>(p,PKD_FIELD::oLastWork);}
     auto       &ParticleID(         PARTICLE *p ) const {return get<uint64_t>(p,PKD_FIELD::oParticleID);}
     const auto &ParticleID(   const PARTICLE *p ) const {return get<uint64_t>(p,PKD_FIELD::oParticleID);}
     auto       &RungDest(           PARTICLE *p ) const {return get<uint16_t[8]>(p,PKD_FIELD::oRungDest);}
@@ -610,6 +616,7 @@ public:
         bool have_rung_dest()    const {return have(PKD_FIELD::oRungDest);}
         bool have_particle_id()  const {return have(PKD_FIELD::oParticleID);}
         bool have_global_gid()   const {return have(PKD_FIELD::oGlobalGid);}
+        bool have_work()         const {return have(PKD_FIELD::oWork);}
 
         auto position()          const {return store().position(p); }
         auto position(int d)     const {return store().position(p,d); }
@@ -649,6 +656,8 @@ public:
         auto &density()             const {return store().density(p);}
         auto &ball()                const {return store().ball(p);}
         auto &global_gid()          const {return store().global_gid(p); }
+        auto &work()                const {return store().work(p); }
+        auto &last_work()           const {return store().last_work(p); }
         auto &ParticleID()          const {return store().ParticleID(p); }
         auto &RungDest()            const {return store().RungDest(p); }
         auto &VelSmooth()           const {return store().VelSmooth(p); }
@@ -0,0 +1,49 @@
+/*  This file is part of PKDGRAV3 (http://www.pkdgrav.org/).
+ *  Copyright (c) 2001-2018 Joachim Stadel & Douglas Potter
+ *
+ *  PKDGRAV3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  PKDGRAV3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with PKDGRAV3.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef CORE_RUNTHREADS_H
+#define CORE_RUNTHREADS_H
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+#ifdef __linux__
+    #include <sched.h>
+    #include <unistd.h>
+#endif
+
+/// @brief Run fn(t) for t in [0,nThreads), with t=0 on the calling thread.
+template<class F>
+inline void RunThreads(int nThreads, F fn) {
+    std::vector<std::thread> threads;
+    threads.reserve(nThreads-1);
+    for (auto t=1; t<nThreads; ++t) threads.emplace_back(fn,t);
+    fn(0);
+    for (auto &thread : threads) thread.join();
+}
+
+/// @brief Limit nThreads so that each of the nCores cores of this process can run that
+/// many threads at once without oversubscribing the processors available to the process.
+inline int ThreadsPerCore(int nThreads, int nCores) {
+    int nCpus = std::thread::hardware_concurrency();
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(getpid(),sizeof(set),&set) == 0) nCpus = CPU_COUNT(&set);
+#endif
+    return std::max(1,std::min(nThreads,nCpus / std::max(1,nCores)));
+}
+
+#endif
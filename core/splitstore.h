@@ -19,6 +19,8 @@
 #define CORE_SPLITSTORE_H
 
 #include "datafields.h"
+#include <mutex>
+#include <algorithm>
 
 //! \brief A generic contiguous array of fixed-length elements.
 //!
@@ -51,6 +53,7 @@ protected:
 
 public:
     auto Nodes() const { return nNodes; }
+    auto TileBits() const { return nBitsLo; } //!< Each tile holds 1<<TileBits() elements
 
     void SetNodeCount(int n) {
         nNodes = n;
@@ -97,6 +100,33 @@ public:
         if (tiles.empty()) extend(); // Make sure that we have at least one tile
     }
 
+    //! \brief A block of elements reserved from the store for one thread.
+    //!
+    //! Threads that fill parts of the store concurrently (e.g., building subtrees)
+    //! each allocate from their own pool. Only refilling a pool touches the store,
+    //! and this is serialized with the given mutex. The tiles vector is reserved
+    //! in setStore, so extending it does not move existing tiles.
+    class Pool {
+        splitStore &store;
+        std::mutex &mutex;
+        int nBlock;
+        int iNext = 0;
+        int iEnd = 0;
+    public:
+        Pool(splitStore &store,std::mutex &mutex,int nBlock=1024)
+            : store(store), mutex(mutex), nBlock(nBlock) {}
+        auto AllocNode(int n=1) {
+            if (iNext + n > iEnd) {
+                std::lock_guard<std::mutex> guard(mutex);
+                iNext = store.AllocNode(std::max(n,nBlock));
+                iEnd = iNext + std::max(n,nBlock);
+            }
+            auto iNode = iNext;
+            iNext += n;
+            return iNode;
+        }
+    };
+
     DATA *Element(int iNode) const { return this->Element(tiles[iNode>>nBitsLo],iNode&iMask); }
     // int FreeStore() const { return nStore; }
     // int Local() const { return nLocal; }
@@ -256,9 +256,10 @@ public:
         /// Particles below "i" will be in the left child and particles
         /// above and including "i" will be in the right child. The children
         /// are initialized as buckets (but can be later split).
-        auto split(int i) {
+        /// @param iChildren The pair of nodes (already allocated) to use for the children
+        auto split(int i,int iChildren) {
             assert(i>lower() && i<=upper());
-            p->iLower = store().AllocNode(2);
+            p->iLower = iChildren;
             NodePointer pLeft(store(),lchild());
             pLeft->set_local(lower(),i-1);
             pLeft->set_depth(depth()+1);
@@ -269,6 +270,9 @@ public:
             pRight->set_split_dim(3);
             return std::make_tuple(pLeft,pRight);
         }
+        auto split(int i) {
+            return split(i,store().AllocNode(2));
+        }
 
         auto get_child_cells(int id) {
             int idxLower = lchild();            // This is always true
@@ -117,6 +117,9 @@ public:
     int queuePP(workParticle *work, ilpTile &tile, bool bGravStep) {
         return queue(pp,freePP,work,tile,bGravStep);
     }
+    int queuePP(workParticle *work, ilpgTile &tile, bool bGravStep) {
+        return queue(pp,freePP,work,tile,bGravStep);
+    }
 
     int queuePC(workParticle *work, ilcTile &tile, bool bGravStep) {
         return queue(pc,freePC,work,tile,bGravStep);
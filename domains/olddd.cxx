@@ -89,7 +89,7 @@ int ServiceDomainDecomp::Recurse(PST pst,void *vin,int nIn,void *vout,int nOut)
     assert(d >= 0);
 
     mdlPrintTimer(pst->mdl,"TIME Mass Check done in pstDomainDecomp",&t);
-    RootSplit(pst,d,in->bDoRootFind,in->bDoSplitDimFind);
+    RootSplit(pst,d,in->bDoRootFind,in->bDoSplitDimFind,in->bSplitWork);
     mdlPrintTimer(pst->mdl,"TIME RootSplit done in pstDomainDecomp",&t);
 
     mdlPrintTimer(pst->mdl,"TIME Mass Check done in pstDomainDecomp",&t);
@@ -154,7 +154,7 @@ int ServiceDomainDecomp::Service(PST pst,void *vin,int nIn,void *vout,int nOut)
     return 0;
 }
 
-void ServiceDomainDecomp::RootSplit(PST pst,int iSplitDim,int bDoRootFind,int bDoSplitDimFind) {
+void ServiceDomainDecomp::RootSplit(PST pst,int iSplitDim,int bDoRootFind,int bDoSplitDimFind,int bSplitWork) {
     auto mdl = static_cast<mdl::mdlClass *>(pst->mdl);
     int NUM_SAFETY = 4;         /* slop space when filling up memory */
     uint64_t nSafeTot;          /* total slop space we have to play with */
@@ -231,6 +231,7 @@ void ServiceDomainDecomp::RootSplit(PST pst,int iSplitDim,int bDoRootFind,int bD
         inWt.ittr = 0;
         inWt.iSplitSide = 1;
         inWt.pFlag = 1;
+        inWt.bWork = 0;
         rID = mdl->ReqService(pst->idUpper,PST_WEIGHT,&inWt,sizeof(inWt));
         inWt.iSplitSide = 0;
         Traverse(PST_WEIGHT,pst->pstLower,&inWt,sizeof(inWt),&outWtLow,sizeof(outWtLow));
@@ -239,6 +240,12 @@ void ServiceDomainDecomp::RootSplit(PST pst,int iSplitDim,int bDoRootFind,int bD
                        + outWtLow.nHigh + outWtHigh.nHigh;
         mdlassert(pst->mdl,nActiveOrder == nTotalActive);
         pFlag = 1;
+        /*
+        ** When balancing the measured work, the weight of each active particle
+        ** is its predicted cost. At a substep only rungs from the active rung
+        ** up are evaluated, and a particle on rung r costs in proportion to its
+        ** 2^r evaluations, so the inactive particles do not count here either.
+        */
         if (nTotalActive <=1) {
             pFlag = 0;          /* Divide them all */
             rID = mdl->ReqService(pst->idUpper,PST_WEIGHT,&inWt,sizeof(inWt));
@@ -261,6 +268,7 @@ void ServiceDomainDecomp::RootSplit(PST pst,int iSplitDim,int bDoRootFind,int bD
             inWt.ittr = ittr;
             inWt.iSplitSide = 1;
             inWt.pFlag = pFlag;
+            inWt.bWork = bSplitWork;
             rID = mdl->ReqService(pst->idUpper,PST_WEIGHT,&inWt,sizeof(inWt));
             inWt.iSplitSide = 0;
             Traverse(PST_WEIGHT,pst->pstLower,&inWt,sizeof(inWt),&outWtLow,sizeof(outWtLow));
@@ -277,18 +285,10 @@ void ServiceDomainDecomp::RootSplit(PST pst,int iSplitDim,int bDoRootFind,int bD
             */
             if (nLow == 1 && nHigh == 1) /* break on trivial case */
                 break;
-            if (pFlag) {            /* split on work */
-                if (fLow/pst->nLower > fHigh/pst->nUpper) fu = fm;
-                else if (fLow/pst->nLower < fHigh/pst->nUpper) fl = fm;
-                else break;
-            }
-            else {              /* split on number */
-                if (nLow/(double)pst->nLower >
-                        nHigh/(double)pst->nUpper) fu = fm;
-                else if (nLow/(double)pst->nLower <
-                         nHigh/(double)pst->nUpper) fl = fm;
-                else break;
-            }
+            /* The weight is the number of particles unless bSplitWork */
+            if (fLow/pst->nLower > fHigh/pst->nUpper) fu = fm;
+            else if (fLow/pst->nLower < fHigh/pst->nUpper) fl = fm;
+            else break;
             fmm = (fl + fu)/2;
             ++ittr;
         }
@@ -1073,7 +1073,7 @@ int ServiceWeight::Service(PST pst,void *vin,int nIn,void *vout,int nOut) {
     double fLow,fHigh;
     plcl->iPart = pkdWeight(pkd,in->iSplitDim,fSplit,iSplitSide,
                             plcl->iWtFrom,plcl->iWtTo,
-                            &nLow,&nHigh,&fLow,&fHigh);
+                            &nLow,&nHigh,&fLow,&fHigh,in->bWork);
     out->nLow = nLow;
     out->nHigh = nHigh;
     out->fLow = fLow + plcl->fWtLow;
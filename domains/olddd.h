@@ -77,6 +77,7 @@ public:
         int nBndWrap[3];
         int bDoRootFind;
         int bDoSplitDimFind;
+        int bSplitWork;     /* Balance the measured work rather than the particles */
         uint64_t nActive;
         uint64_t nTotal;
     };
@@ -87,7 +88,7 @@ protected:
     virtual int Recurse(PST pst,void *vin,int nIn,void *vout,int nOut) override;
     virtual int Service(PST pst,void *vin,int nIn,void *vout,int nOut) override;
 private:
-    void RootSplit(PST pst,int iSplitDim,int bDoRootFind,int bDoSplitDimFind);
+    void RootSplit(PST pst,int iSplitDim,int bDoRootFind,int bDoSplitDimFind,int bSplitWork);
 };
 
 #ifndef NEW_REORDER
@@ -136,6 +137,7 @@ public:
         int iSplitSide;
         int ittr;
         int pFlag;
+        int bWork;
     };
     struct output {
         uint64_t nLow;
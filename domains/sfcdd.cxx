@@ -0,0 +1,206 @@
+/*  This file is part of PKDGRAV3 (http://www.pkdgrav.org/).
+ *  Copyright (c) 2001-2018 Joachim Stadel & Douglas Potter
+ *
+ *  PKDGRAV3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  PKDGRAV3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with PKDGRAV3.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "sfcdd.h"
+#include <algorithm>
+#include <numeric>
+#include <limits>
+
+namespace NewDD {
+
+// Make sure that the communication structure is "trivial" so that it
+// can be moved around with "memcpy" which is required for MDL.
+static_assert(std::is_void<ServiceSFCSample::input>()  || std::is_standard_layout<ServiceSFCSample::input>());
+static_assert(std::is_void<ServiceSFCSample::output>() || std::is_trivial<ServiceSFCSample::output>());
+static_assert(std::is_void<ServiceSFCExchange::input>()  || std::is_standard_layout<ServiceSFCExchange::input>());
+static_assert(std::is_void<ServiceSFCExchange::output>() || std::is_standard_layout<ServiceSFCExchange::output>());
+
+/*
+** Peano-Hilbert key of a position inside the cube of side 1/fScale at lower.
+** hilbert3d() requires coordinates in [1,2).
+*/
+static inline uint64_t sfcKey(const blitz::TinyVector<double,3> &r,
+                              const blitz::TinyVector<double,3> &lower,double fScale) {
+    constexpr float fMin = 1.0f, fMax = 0x1.fffffep0f; // Largest float below 2
+    float x = std::clamp(float(1.0 + (r[0]-lower[0])*fScale),fMin,fMax);
+    float y = std::clamp(float(1.0 + (r[1]-lower[1])*fScale),fMin,fMax);
+    float z = std::clamp(float(1.0 + (r[2]-lower[2])*fScale),fMin,fMax);
+    return hilbert3d(x,y,z);
+}
+
+/*
+** Sort the local particles by key, and return the sorted keys.
+** After a swap the particles are a few runs that are already in key order
+** (one from each sender), so the runs are merged rather than re-sorted.
+*/
+static void sfcSort(PKD pkd,const Bound &bnd,std::vector<uint64_t> &keys) {
+    auto nLocal = pkd->Local();
+    auto lower = bnd.lower();
+    double fScale = 1.0 / bnd.maxside();
+    std::vector<std::pair<uint64_t,uint32_t>> order(nLocal);
+    std::vector<size_t> runs {0};
+    for (auto i=0; i<nLocal; ++i) {
+        order[i] = {sfcKey(pkd->particles[i].position(),lower,fScale),i};
+        if (i && order[i].first < order[i-1].first) runs.push_back(i);
+    }
+    runs.push_back(nLocal);
+    // Merge neighbouring runs pairwise until only one is left
+    while (runs.size() > 2) {
+        std::vector<size_t> merged {0};
+        for (size_t r=2; r<runs.size(); r+=2) {
+            std::inplace_merge(order.begin()+runs[r-2],order.begin()+runs[r-1],order.begin()+runs[r]);
+            merged.push_back(runs[r]);
+        }
+        if (runs.size() % 2 == 0) merged.push_back(runs.back());
+        runs.swap(merged);
+    }
+    keys.resize(nLocal);
+    std::vector<uint32_t> index(nLocal);
+    for (auto i=0; i<nLocal; ++i) {
+        keys[i] = order[i].first;
+        index[i] = order[i].second;
+    }
+    /*
+    ** Apply the permutation by following each cycle. The particle that
+    ** belongs at "cur" is at index[cur]; swapping it in moves the particle
+    ** that started the cycle along to the next position.
+    */
+    for (uint32_t i=0; i<index.size(); ++i) {
+        if (index[i]==i) continue;
+        auto cur = i;
+        while (index[cur] != i) {
+            auto next = index[cur];
+            auto p = pkd->particles[cur];
+            auto q = pkd->particles[next];
+            swap(p,q);
+            index[cur] = cur;
+            cur = next;
+        }
+        index[cur] = cur;
+    }
+}
+
+/*****************************************************************************\
+* ServiceSFCSample
+\*****************************************************************************/
+
+int ServiceSFCSample::Service(PST pst,void *vin,int nIn,void *vout,int nOut) {
+    auto pkd = pst->plcl->pkd;
+    auto in = static_cast<input *>(vin);
+    auto out = static_cast<output *>(vout);
+    assert(nIn == sizeof(input));
+    assert(nOut >= sizeof(output));
+    auto nLocal = pkd->Local();
+    auto lower = in->bnd.lower();
+    double fScale = 1.0 / in->bnd.maxside();
+    bool bWork = in->bWork && pkd->particles.present(PKD_FIELD::oWork);
+
+    std::vector<std::pair<uint64_t,float>> keys;
+    keys.reserve(nLocal);
+    double fWeight = 0.0;
+    for (auto &p : pkd->particles) {
+        float w = bWork ? pkdPredictedWork(p.last_work(),p.rung()) : 1.0f;
+        keys.emplace_back(sfcKey(p.position(),lower,fScale),w);
+        fWeight += w;
+    }
+    std::sort(keys.begin(),keys.end());
+
+    out->nStore = pkd->FreeStore();
+    out->nLocal = nLocal;
+    out->fWeight = fWeight;
+    out->nSamples = 0;
+    /*
+    ** Cut the sorted keys into segments of equal weight. Each sample
+    ** is the last key of a segment along with its weight and count.
+    */
+    double fSum = 0.0, fSegment = 0.0;
+    uint32_t nSegment = 0;
+    int iSample = 1;
+    for (auto &k : keys) {
+        fSum += k.second;
+        fSegment += k.second;
+        ++nSegment;
+        if (fSum >= fWeight * iSample / SFC_SAMPLES || &k == &keys.back()) {
+            auto &s = out->samples[out->nSamples++];
+            s.uKey = k.first;
+            s.fWeight = fSegment;
+            s.nCount = nSegment;
+            fSegment = 0.0;
+            nSegment = 0;
+            while (iSample < SFC_SAMPLES && fSum >= fWeight * iSample / SFC_SAMPLES) ++iSample;
+            if (out->nSamples == SFC_SAMPLES) break;
+        }
+    }
+    assert(out->nSamples <= SFC_SAMPLES);
+    return sizeof(output);
+}
+
+/*****************************************************************************\
+* ServiceSFCExchange
+\*****************************************************************************/
+
+int ServiceSFCExchange::Recurse(PST pst,void *vin,int nIn,void *vout,int nOut) {
+    auto mdl = static_cast<mdl::mdlClass *>(pst->mdl);
+    auto out = static_cast<output *>(vout);
+    output outUpper;
+    auto rID = ReqService(pst,vin,nIn);
+    Traverse(pst->pstLower,vin,nIn,out,nOut);
+    mdl->GetReply(rID,outUpper);
+    /* The top tree is built from these bounds */
+    pst->bnd = out->combine(outUpper);
+    *out = pst->bnd;
+    return sizeof(output);
+}
+
+int ServiceSFCExchange::Service(PST pst,void *vin,int nIn,void *vout,int nOut) {
+    auto in = static_cast<input *>(vin);
+    auto out = static_cast<output *>(vout);
+    auto split = reinterpret_cast<uint64_t *>(in+1);
+    auto pkd = pst->plcl->pkd;
+    auto mdl = static_cast<mdl::mdlClass *>(pst->mdl);
+    assert(nIn == sizeof(input) + (mdl->Threads()+1)*sizeof(uint64_t));
+    std::vector<uint64_t> keys;
+
+    // Count the (sorted) particles whose keys are in [split[iFirst],split[iLast])
+    auto count = [&keys,split](int iFirst,int iLast) {
+        return std::lower_bound(keys.begin(),keys.end(),split[iLast])
+               - std::lower_bound(keys.begin(),keys.end(),split[iFirst]);
+    };
+
+    // Phase 1: exchange particles with the correct process
+    sfcSort(pkd,in->bnd,keys);
+    std::vector<dd_offset_type> counts(mdl->Procs());
+    for (auto i=0; i<mdl->Procs(); ++i) counts[i] = count(mdl->ProcToThread(i),mdl->ProcToThread(i+1));
+    pkd->SetLocal(mdl->swapglobal(pkd->particles,pkd->FreeStore(),pkd->particles.ElementSize(),counts.data()));
+
+    // Phase 2: exchange particles with the correct core on this process
+    sfcSort(pkd,in->bnd,keys);
+    auto iThread = mdl->ProcToThread(mdl->Proc());
+    counts.resize(mdl->Cores());
+    for (auto i=0; i<mdl->Cores(); ++i) counts[i] = count(iThread+i,iThread+i+1);
+    pkd->SetLocal(mdl->swaplocal(pkd->particles,pkd->FreeStore(),pkd->particles.ElementSize(),counts.data()));
+
+    // Phase 3: leave the particles in key order; this helps the tree build
+    sfcSort(pkd,in->bnd,keys);
+    assert(keys.empty() || (keys.front() >= split[mdl->Self()] && keys.back() < split[mdl->Self()+1]));
+
+    pkd->bnd = pkd->particles.bound();
+    pst->bnd = pkd->bnd;
+    *out = pkd->bnd;
+    return sizeof(output);
+}
+
+} // namespace NewDD
@@ -0,0 +1,72 @@
+/*  This file is part of PKDGRAV3 (http://www.pkdgrav.org/).
+ *  Copyright (c) 2001-2018 Joachim Stadel & Douglas Potter
+ *
+ *  PKDGRAV3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  PKDGRAV3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with PKDGRAV3.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DOMAINS_SFCDD_H
+#define DOMAINS_SFCDD_H
+
+#include "TraversePST.h"
+#include "sfcsplits.h"
+#include <vector>
+
+/*
+** Peano-Hilbert domain decomposition.
+**
+** Each thread owns a contiguous range of Peano-Hilbert keys [split[i],split[i+1])
+** and the threads are in key order. Since the threads below any PST node are
+** contiguous, each node of the top tree also covers a contiguous key range.
+**
+** The splits are found with a sample sort: each thread sorts its particles by key
+** and returns SFC_SAMPLES keys at equal intervals of (count or work) weight. The
+** master merges these and cuts the key line into equal pieces. The particles are
+** then moved to their domains with the MDL swap, first between processes and then
+** between the cores of each process. Once the domains are established, a thread
+** holds mostly particles from its own key range so the samples are accurate and
+** the splits can be kept (or shifted) from step to step; only particles near the
+** boundaries then change domain.
+*/
+namespace NewDD {
+
+class ServiceSFCSample : public TraverseGatherPST<SFCSampleOutput> {
+public:
+    struct input {
+        Bound bnd;      // Global bound used to compute the keys
+        int bWork;      // Weight particles by their measured work
+    };
+    explicit ServiceSFCSample(PST pst)
+        : TraverseGatherPST(pst,PST_SFCSAMPLE,sizeof(input),sizeof(output)*pst->mdl->Threads(),"SFCSample") {}
+protected:
+    virtual int Service(PST pst,void *vin,int nIn,void *vout,int nOut) final;
+};
+
+class ServiceSFCExchange : public TraversePST {
+public:
+    using dd_offset_type = mdl::mdlClass::dd_offset_type;
+    struct input {
+        Bound bnd;      // Global bound used to compute the keys
+        // uint64_t split[nThreads+1]; follows this structure
+    };
+    typedef Bound output;
+    explicit ServiceSFCExchange(PST pst)
+        : TraversePST(pst,PST_SFCEXCHANGE,sizeof(input) + (pst->mdl->Threads()+1)*sizeof(uint64_t),
+                      sizeof(output),"SFCExchange") {}
+protected:
+    virtual int Recurse(PST pst,void *vin,int nIn,void *vout,int nOut) override;
+    virtual int Service(PST pst,void *vin,int nIn,void *vout,int nOut) override;
+};
+
+} // namespace NewDD
+
+#endif // DOMAINS_SFCDD_H
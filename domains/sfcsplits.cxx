@@ -0,0 +1,91 @@
+/*  This file is part of PKDGRAV3 (http://www.pkdgrav.org/).
+ *  Copyright (c) 2001-2018 Joachim Stadel & Douglas Potter
+ *
+ *  PKDGRAV3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  PKDGRAV3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with PKDGRAV3.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "sfcsplits.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace NewDD {
+
+bool SFCSplits(const SFCSampleOutput *samples,int nThreads,double fImbalance,std::vector<uint64_t> &split) {
+    using sample = SFCSampleOutput::sample;
+    std::vector<sample> all;
+    double fWeight = 0.0;
+    uint64_t nStore = std::numeric_limits<uint64_t>::max();
+    for (auto i=0; i<nThreads; ++i) {
+        all.insert(all.end(),samples[i].samples,samples[i].samples+samples[i].nSamples);
+        fWeight += samples[i].fWeight;
+        nStore = std::min(nStore,samples[i].nStore);
+    }
+    std::sort(all.begin(),all.end(),[](const sample &a,const sample &b) {return a.uKey < b.uKey;});
+    double fTarget = fWeight / nThreads;
+
+    /*
+    ** If we already have splits, see how well balanced they are. They are
+    ** kept if the most loaded domain is within fImbalance of the average,
+    ** and then only particles that have crossed a boundary will move.
+    */
+    if (split.size() == size_t(nThreads+1)) {
+        std::vector<double> fLoad(nThreads,0.0);
+        std::vector<uint64_t> nLoad(nThreads,0);
+        for (auto &s : all) {
+            auto d = std::upper_bound(split.begin(),split.end(),s.uKey) - split.begin() - 1;
+            fLoad[d] += s.fWeight;
+            nLoad[d] += s.nCount;
+        }
+        if (*std::max_element(fLoad.begin(),fLoad.end()) <= (1.0 + fImbalance) * fTarget
+                && *std::max_element(nLoad.begin(),nLoad.end()) <= nStore) return false;
+    }
+
+    /*
+    ** Cut the sorted samples where the cumulative weight best matches each target,
+    ** but never give a domain more particles than it can store. Domain d gets
+    ** samples [cut[d],cut[d+1]).
+    */
+    std::vector<size_t> cut(nThreads+1);
+    cut.front() = 0;
+    cut.back() = all.size();
+    double fSum = 0.0;
+    uint64_t nCount = 0;
+    size_t i = 0;
+    for (auto d=1; d<nThreads; ++d) {
+        while (i < all.size() && fSum + 0.5*all[i].fWeight < fTarget * d && nCount + all[i].nCount <= nStore) {
+            fSum += all[i].fWeight;
+            nCount += all[i].nCount;
+            ++i;
+        }
+        cut[d] = i;
+        nCount = 0;
+    }
+    /*
+    ** The last domain takes whatever is left. If that is too much, walk back
+    ** and shift the excess to the preceding domains.
+    */
+    for (auto d=nThreads-1; d>=0; --d) {
+        nCount = 0;
+        for (auto j=cut[d]; j<cut[d+1]; ++j) nCount += all[j].nCount;
+        while (nCount > nStore && d > 0 && cut[d] < cut[d+1]) nCount -= all[cut[d]++].nCount;
+        if (nCount > nStore) throw std::overflow_error("SFCSplits: particles do not fit in the domains");
+    }
+
+    split.resize(nThreads+1);
+    for (auto d=0; d<nThreads; ++d) split[d] = cut[d] ? all[cut[d]-1].uKey + 1 : 0;
+    split.back() = std::numeric_limits<uint64_t>::max();
+    return true;
+}
+
+} // namespace NewDD
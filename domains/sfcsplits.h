@@ -0,0 +1,51 @@
+/*  This file is part of PKDGRAV3 (http://www.pkdgrav.org/).
+ *  Copyright (c) 2001-2018 Joachim Stadel & Douglas Potter
+ *
+ *  PKDGRAV3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  PKDGRAV3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with PKDGRAV3.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DOMAINS_SFCSPLITS_H
+#define DOMAINS_SFCSPLITS_H
+
+#include <cstdint>
+#include <vector>
+
+namespace NewDD {
+
+constexpr int SFC_SAMPLES = 32;
+
+struct SFCSampleOutput {
+    struct sample {
+        uint64_t uKey;      // Largest key of this segment
+        float fWeight;      // Weight of this segment
+        uint32_t nCount;    // Particles in this segment
+    };
+    uint64_t nStore;
+    uint32_t nLocal;
+    uint32_t nSamples;
+    double fWeight;
+    sample samples[SFC_SAMPLES];
+};
+
+/*
+** Given the samples from every thread, choose the key splits so that each
+** thread has the same weight. If the existing splits (if any) are within
+** fImbalance of perfect balance then they are kept. Returns true if the
+** splits were changed. No thread is given more particles than the smallest
+** nStore; std::overflow_error is thrown if that is not possible.
+*/
+bool SFCSplits(const SFCSampleOutput *samples,int nThreads,double fImbalance,std::vector<uint64_t> &split);
+
+} // namespace NewDD
+
+#endif // DOMAINS_SFCSPLITS_H
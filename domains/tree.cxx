@@ -30,6 +30,7 @@
 #include <assert.h>
 #include "pkd.h"
 #include "gravity/moments.h"
+#include "core/runthreads.h"
 #include "../SPH/SPHOptions.h"
 
 #ifdef HAVE_SYS_TIME_H
@@ -41,6 +42,11 @@
 #include <vector>
 #include <numeric>
 #include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <array>
+#include <type_traits>
 
 uint32_t pkdDistribTopTree(PKD pkd, uint32_t uRoot, uint32_t nTop, KDN *pTop, int allocateMemory) {
     int i, iTop;
@@ -160,27 +166,62 @@ static int PartPart(PKD pkd,int pLower,int pUpper,int d,pivot_t pivot) {
     return std::partition(pi,pj+1,[pivot,d](auto &p) {return p.template raw_position<pivot_t>(d) < pivot;}) - pkd->particles.begin();
 }
 
-/// @brief Build tree.
+/// @brief Partition particles with several threads.
 ///
-/// This function assumes that the root node is correctly set up (particularly the bounds).
-/// @param pkd pkdContext object.
-/// @param iNode index of node in pkd->tree[]
-/// @param bucketSize Maximum number of particles a node can have to be considered a bucket.
-/// @param nGroup Maximum number of particles a node can have to be considered a group.
-/// @param maxBucketWidth Hacky parameter to control that the size of bucket is not too large.
-///        Was used because sometimes the tree would not build correctly without this.
-void BuildTemp(PKD pkd, int iNode, int bucketSize, int nGroup, double maxBucketWidth) {
-    auto pNode = pkd->tree[iNode]; // Current node of the larger tree that spans across nodes.
-
-    pNode->set_depth(0);
-
-    // Single bucket? We are done.
-    if (pNode->count() <= bucketSize) {
-        // splitDim == 3 is a sentinel value for this beeing a leave node.
-        pNode->set_split_dim(3);
-        return;
-    };
+/// Each thread partitions a contiguous chunk, then the right-hand particles that ended
+/// up below the split are swapped with the left-hand particles above it. The split is the
+/// same as with PartPart, but the order of particles on each side can differ.
+/// @return The index of the split.
+template<class pivot_t>
+static int PartPartParallel(PKD pkd,int pLower,int pUpper,int d,pivot_t pivot,int nThreads) {
+    std::vector<int> start(nThreads+1), split(nThreads);
+    for (auto t=0; t<nThreads; ++t) start[t] = pLower + int64_t(pUpper + 1 - pLower) * t / nThreads;
+    start[nThreads] = pUpper + 1;
+    RunThreads(nThreads,[&](int t) {split[t] = PartPart(pkd,start[t],start[t+1]-1,d,pivot);});
+
+    int iSplit = pLower;
+    for (auto t=0; t<nThreads; ++t) iSplit += split[t] - start[t];
+
+    // Misplaced particles as ranges [first,second): right-hand below the split and left-hand above it.
+    std::vector<std::pair<int,int>> R, L;
+    for (auto t=0; t<nThreads; ++t) {
+        if (split[t] < std::min(start[t+1],iSplit)) R.emplace_back(split[t],std::min(start[t+1],iSplit));
+        if (std::max(start[t],iSplit) < split[t]) L.emplace_back(std::max(start[t],iSplit),split[t]);
+    }
+    int64_t nSwap = 0;
+    for (auto &r : R) nSwap += r.second - r.first;
+
+    // Each thread swaps an equal share. A cursor walks the k'th misplaced particle of a range list.
+    RunThreads(nThreads,[&](int t) {
+        auto k0 = nSwap * t / nThreads, k1 = nSwap * (t+1) / nThreads;
+        auto seek = [k0](const std::vector<std::pair<int,int>> &ranges) {
+            auto k = k0;
+            auto it = ranges.begin();
+            while (it != ranges.end() && k >= it->second - it->first) {
+                k -= it->second - it->first;
+                ++it;
+            }
+            return std::make_pair(it,it==ranges.end() ? 0 : it->first + int(k));
+        };
+        auto [ir,i] = seek(R);
+        auto [il,j] = seek(L);
+        for (auto k=k0; k<k1; ++k) {
+            if (i == ir->second) i = (++ir)->first;
+            if (j == il->second) j = (++il)->first;
+            std::iter_swap(pkd->particles.begin() + i++,pkd->particles.begin() + j++);
+        }
+    });
+    return iSplit;
+}
 
+/// @brief Build the tree below a node that is already set up.
+///
+/// The particles of a node are partitioned with "partition", pairs of child nodes are allocated
+/// with "alloc", and a non-bucket child for which "defer" returns true is left for later.
+template<class PARTITION,class ALLOC,class DEFER>
+static void BuildTempSubtree(PKD pkd, int iNode, int bucketSize, int nGroup, double maxBucketWidth,
+                             PARTITION partition, ALLOC alloc, DEFER defer) {
+    auto pNode = pkd->tree[iNode];
     std::vector<int> stack;
     stack.reserve(100); // Start with a sensible stack size
     auto bnd = pNode->bound();
@@ -198,18 +239,18 @@ void BuildTemp(PKD pkd, int iNode, int bucketSize, int nGroup, double maxBucketW
         int i; // Partition index.
         if (pkd->bIntegerPosition) {
             int32_t split = pkd->convert(bnd.center(d));
-            i = PartPart(pkd, pNode->lower(), pNode->upper(), d, split);
+            i = partition(pNode, d, split);
         }
         else {
             double split = bnd.center(d);
-            i = PartPart(pkd, pNode->lower(), pNode->upper(), d, split);
+            i = partition(pNode, d, split);
         }
 
         int nl = i - pNode->lower();     // Number of particles in the left partition.
         int nr = pNode->upper() + 1 - i; // Number of particles in the right partition.
         if (nl > 0 && nr > 0) { // Both sides non empty.
             // Split this node into two children
-            auto [pLeft, pRight] = pNode->split(i);
+            auto [pLeft, pRight] = pNode->split(i,alloc());
 
             pNode->set_group(pNode->count() <= nGroup);
             pLeft->set_bound(lbnd);
@@ -218,8 +259,12 @@ void BuildTemp(PKD pkd, int iNode, int bucketSize, int nGroup, double maxBucketW
             // Figure out which sub-tree to process next.
             bool left_is_bucket = (nodeSize <= maxBucketWidth && nl <= bucketSize);
             bool right_is_bucket = (nodeSize <= maxBucketWidth && nr <= bucketSize);
+            if (left_is_bucket) pLeft->set_group(true);
+            if (right_is_bucket) pRight->set_group(true);
+            bool left_next = !left_is_bucket && !defer(pNode->lchild());
+            bool right_next = !right_is_bucket && !defer(pNode->rchild());
 
-            if (!right_is_bucket && !left_is_bucket) {
+            if (left_next && right_next) {
                 // Process smaller subtree first. This keeps the stack size as small as possible.
                 if (nr > nl) {
                     stack.push_back(pNode->rchild()); // push right subtree.
@@ -230,19 +275,14 @@ void BuildTemp(PKD pkd, int iNode, int bucketSize, int nGroup, double maxBucketW
                     iNode = pNode->rchild();          // process right sub-tree.
                 }
             }
-            else if (!left_is_bucket) {
+            else if (left_next) {
                 iNode = pNode->lchild(); // process left sub-tree
-                pRight->set_group(true);
             }
-            else if (!right_is_bucket) {
+            else if (right_next) {
                 iNode = pNode->rchild(); // process right sub-tree
-                pLeft->set_group(true);
             }
             else {
-                // Both are buckets. We need to pop from the stack to get the next sub-tree.
-                pLeft->set_group(true);
-                pRight->set_group(true);
-
+                // Both are done. We need to pop from the stack to get the next sub-tree.
                 if (stack.empty()) break;
                 iNode = stack.back();
                 stack.pop_back();
@@ -277,6 +317,261 @@ void BuildTemp(PKD pkd, int iNode, int bucketSize, int nGroup, double maxBucketW
     }
 }
 
+/// @brief Build tree.
+///
+/// This function assumes that the root node is correctly set up (particularly the bounds).
+/// @param pkd pkdContext object.
+/// @param iNode index of node in pkd->tree[]
+/// @param bucketSize Maximum number of particles a node can have to be considered a bucket.
+/// @param nGroup Maximum number of particles a node can have to be considered a group.
+/// @param maxBucketWidth Hacky parameter to control that the size of bucket is not too large.
+///        Was used because sometimes the tree would not build correctly without this.
+void BuildTemp(PKD pkd, int iNode, int bucketSize, int nGroup, double maxBucketWidth) {
+    auto pNode = pkd->tree[iNode]; // Current node of the larger tree that spans across nodes.
+
+    pNode->set_depth(0);
+
+    // Single bucket? We are done.
+    if (pNode->count() <= bucketSize) {
+        // splitDim == 3 is a sentinel value for this beeing a leave node.
+        pNode->set_split_dim(3);
+        return;
+    };
+
+    BuildTempSubtree(pkd,iNode,bucketSize,nGroup,maxBucketWidth,
+    [pkd](auto &pNode,int d,auto pivot) {return PartPart(pkd,pNode->lower(),pNode->upper(),d,pivot);},
+    [pkd]() {return pkd->tree.AllocNode(2);},
+    [](int iChild) {return false;});
+}
+
+/// @brief Calculate the tree keys of the particles in [pLower,pUpper].
+///
+/// Bit 63-L of the key records on which side of the level L split the particle lies.
+/// Every node at level L is the root bound halved L times (along a sequence of dimensions
+/// that depends only on the shape of the bound) so this uses the same bound arithmetic and
+/// comparison as BuildTempSubtree, and the keys reproduce its partitions exactly.
+template<class pivot_t>
+static void TreeKeys(PKD pkd, Bound root, int pLower, int pUpper, uint64_t *keys) {
+    // Bounds go through a node, as they do in the tree (integer bounds are rounded).
+    std::vector<char> scratch(pkd->tree.ElementSize());
+    auto pScratch = reinterpret_cast<KDN *>(scratch.data());
+    for (auto i=pLower; i<=pUpper; ++i) {
+        auto p = pkd->particles[i];
+        auto bnd = root;
+        uint64_t key = 0;
+        for (auto level=0; level<64; ++level) {
+            int d = bnd.maxdim();
+            auto [lbnd, rbnd] = bnd.split(d);
+            pivot_t split;
+            if constexpr (std::is_same_v<pivot_t,int32_t>) split = pkd->convert(bnd.center(d));
+            else split = bnd.center(d);
+            bool right = !(p.template raw_position<pivot_t>(d) < split);
+            key = (key << 1) | right;
+            pkd->tree.set_bound(pScratch,right ? rbnd : lbnd);
+            bnd = pkd->tree.bound(pScratch);
+        }
+        keys[i-pLower] = key;
+    }
+}
+
+/// @brief Parallel LSD radix sort of (key,index) pairs, eight bits per pass.
+///
+/// Passes where every key has the same digit are skipped.
+static void RadixSort(std::vector<std::pair<uint64_t,int>> &a, int nThreads) {
+    const int n = a.size();
+    std::vector<std::pair<uint64_t,int>> b(n);
+    std::vector<std::array<int,256>> count(nThreads);
+    std::vector<int> start(nThreads+1);
+    for (auto t=0; t<=nThreads; ++t) start[t] = int64_t(n) * t / nThreads;
+    for (auto shift=0; shift<64; shift+=8) {
+        RunThreads(nThreads,[&](int t) {
+            count[t].fill(0);
+            for (auto i=start[t]; i<start[t+1]; ++i) ++count[t][(a[i].first >> shift) & 0xff];
+        });
+        // Convert the counts to offsets: by digit, then by thread.
+        int offset = 0;
+        bool bSkip = false;
+        for (auto digit=0; digit<256; ++digit) {
+            int nDigit = 0;
+            for (auto t=0; t<nThreads; ++t) {
+                auto c = count[t][digit];
+                count[t][digit] = offset;
+                offset += c;
+                nDigit += c;
+            }
+            if (nDigit == n) bSkip = true;
+        }
+        if (bSkip) continue;
+        RunThreads(nThreads,[&](int t) {
+            auto &offsets = count[t];
+            for (auto i=start[t]; i<start[t+1]; ++i) b[offsets[(a[i].first >> shift) & 0xff]++] = a[i];
+        });
+        a.swap(b);
+    }
+}
+
+/// @brief Build tree by sorting the particles on their tree keys.
+///
+/// The keys are computed and radix sorted in parallel and the particles are permuted once.
+/// The tree is then derived from the sorted keys: the split of a node is found with a binary
+/// search instead of a partition of the particles. The tree has the same structure and node
+/// layout as BuildTemp, and the particles within each bucket are in key order. Nodes more
+/// than 64 levels deep (beyond the key) are partitioned as usual.
+static void BuildTempSorted(PKD pkd, int iRoot, int bucketSize, int nGroup, double maxBucketWidth, int nThreads) {
+    auto pRoot = pkd->tree[iRoot];
+    pRoot->set_depth(0);
+    if (pRoot->count() <= bucketSize) {
+        pRoot->set_split_dim(3);
+        return;
+    };
+
+    const int pLower = pRoot->lower();
+    const int n = pRoot->count();
+    const auto root = pRoot->bound();
+    std::vector<uint64_t> keys(n);
+    RunThreads(nThreads,[&](int t) {
+        int i0 = pLower + int64_t(n) * t / nThreads, i1 = pLower + int64_t(n) * (t+1) / nThreads - 1;
+        if (pkd->bIntegerPosition) TreeKeys<int32_t>(pkd,root,i0,i1,keys.data() + i0 - pLower);
+        else TreeKeys<double>(pkd,root,i0,i1,keys.data() + i0 - pLower);
+    });
+    std::vector<std::pair<uint64_t,int>> order(n);
+    for (auto i=0; i<n; ++i) order[i] = std::make_pair(keys[i],i);
+    RadixSort(order,nThreads);
+
+    // Move the particles into key order by following the cycles of the permutation.
+    const auto nSize = pkd->particles.ElementSize();
+    std::vector<char> temp(nSize);
+    std::vector<bool> bDone(n,false);
+    for (auto i=0; i<n; ++i) {
+        keys[i] = order[i].first;
+        if (bDone[i] || order[i].second == i) continue;
+        memcpy(temp.data(),pkd->particles.Element(pLower + i),nSize);
+        auto j = i;
+        while (order[j].second != i) {
+            memcpy(pkd->particles.Element(pLower + j),pkd->particles.Element(pLower + order[j].second),nSize);
+            bDone[j] = true;
+            j = order[j].second;
+        }
+        memcpy(pkd->particles.Element(pLower + j),temp.data(),nSize);
+        bDone[j] = true;
+    }
+    order.clear();
+    order.shrink_to_fit();
+
+    BuildTempSubtree(pkd,iRoot,bucketSize,nGroup,maxBucketWidth,
+    [pkd,pLower,&keys](auto &pNode,int d,auto pivot) {
+        auto level = pNode->depth();
+        if (level >= 64) return PartPart(pkd,pNode->lower(),pNode->upper(),d,pivot);
+        uint64_t bit = uint64_t(1) << (63 - level);
+        auto first = keys.begin() + pNode->lower() - pLower;
+        auto last  = keys.begin() + pNode->upper() + 1 - pLower;
+        return pNode->lower() + int(std::partition_point(first,last,[bit](uint64_t key) {return (key & bit) == 0;}) - first);
+    },
+    [pkd]() {return pkd->tree.AllocNode(2);},
+    [](int iChild) {return false;});
+}
+
+/// @brief Renumber the nodes below iRoot in the order that BuildTemp allocates them.
+///
+/// The nodes built by several threads are scattered through blocks (with unused tails)
+/// starting at nBase. They are moved so the layout is exactly that of the serial build.
+static void RenumberTree(PKD pkd, int iRoot, int nBase) {
+    auto &tree = pkd->tree;
+    const auto nSize = tree.ElementSize();
+    std::vector<int> newIndex(tree.Nodes() - nBase, 0);
+    std::vector<int> order; // old index of each new node
+    order.reserve(tree.Nodes() - nBase);
+
+    // Follow the processing order of BuildTempSubtree: smaller subtree first.
+    std::vector<int> stack;
+    int iNode = iRoot;
+    while (true) {
+        auto pNode = tree[iNode];
+        int iNext = -1;
+        if (pNode->is_cell()) {
+            auto iLower = pNode->lchild();
+            newIndex[iLower - nBase] = nBase + order.size();
+            order.push_back(iLower);
+            newIndex[iLower + 1 - nBase] = nBase + order.size();
+            order.push_back(iLower + 1);
+            auto pLeft = tree[iLower], pRight = tree[iLower + 1];
+            if (pLeft->is_cell() && pRight->is_cell()) {
+                if (pRight->count() > pLeft->count()) {
+                    stack.push_back(iLower + 1);
+                    iNext = iLower;
+                }
+                else {
+                    stack.push_back(iLower);
+                    iNext = iLower + 1;
+                }
+            }
+            else if (pLeft->is_cell()) iNext = iLower;
+            else if (pRight->is_cell()) iNext = iLower + 1;
+        }
+        if (iNext < 0) {
+            if (stack.empty()) break;
+            iNext = stack.back();
+            stack.pop_back();
+        }
+        iNode = iNext;
+    }
+
+    std::vector<char> buffer(order.size() * nSize);
+    for (auto i=0; i<order.size(); ++i) {
+        auto p = reinterpret_cast<KDN *>(buffer.data() + i * nSize);
+        memcpy(p,tree.Element(order[i]),nSize);
+        if (p->iLower) p->iLower = newIndex[p->iLower - nBase];
+    }
+    auto pRoot = tree.Element(iRoot);
+    if (pRoot->iLower) pRoot->iLower = newIndex[pRoot->iLower - nBase];
+    for (auto i=0; i<order.size(); ++i) memcpy(tree.Element(nBase + i),buffer.data() + i * nSize,nSize);
+    tree.SetNodeCount(nBase + order.size());
+}
+
+static constexpr int nParallelPartition = 1<<16; // Smaller partitions are done by one thread
+
+/// @brief Build tree with several threads.
+///
+/// The top of the tree is built by the calling thread using parallel partitions. Subtrees
+/// that are small enough are handed to the worker threads, largest first, and each thread
+/// allocates nodes from its own pool. Finally, the nodes are renumbered so that the tree
+/// layout is the same as BuildTemp would produce.
+static void BuildTempParallel(PKD pkd, int iRoot, int bucketSize, int nGroup, double maxBucketWidth, int nThreads) {
+    auto &tree = pkd->tree;
+    auto pRoot = tree[iRoot];
+    const int nTaskMax = std::max(bucketSize,pRoot->count() / (8*nThreads));
+    if (pRoot->count() <= nTaskMax) return BuildTemp(pkd,iRoot,bucketSize,nGroup,maxBucketWidth);
+
+    const int nBase = tree.Nodes();
+    pRoot->set_depth(0);
+    std::vector<int> tasks;
+    BuildTempSubtree(pkd,iRoot,bucketSize,nGroup,maxBucketWidth,
+    [pkd,nThreads](auto &pNode,int d,auto pivot) {
+        return (pNode->count() <= nParallelPartition) ? PartPart(pkd,pNode->lower(),pNode->upper(),d,pivot)
+               : PartPartParallel(pkd,pNode->lower(),pNode->upper(),d,pivot,nThreads);
+    },
+    [pkd]() {return pkd->tree.AllocNode(2);},
+    [pkd,nTaskMax,&tasks](int iChild) {
+        if (pkd->tree[iChild]->count() > nTaskMax) return false;
+        tasks.push_back(iChild);
+        return true;
+    });
+
+    std::sort(tasks.begin(),tasks.end(),[pkd](int a,int b) {return pkd->tree[a]->count() > pkd->tree[b]->count();});
+    std::atomic<int> iTask {0};
+    std::mutex mutex;
+    RunThreads(nThreads,[&](int t) {
+        treeStore::Pool pool(tree,mutex);
+        for (int i; (i=iTask++) < int(tasks.size()); ) {
+            BuildTempSubtree(pkd,tasks[i],bucketSize,nGroup,maxBucketWidth,
+            [pkd](auto &pNode,int d,auto pivot) {return PartPart(pkd,pNode->lower(),pNode->upper(),d,pivot);},
+            [&pool]() {return pool.AllocNode(2);},
+            [](int iChild) {return false;});
+        }
+    });
+    RenumberTree(pkd,iRoot,nBase);
+}
+
 /*
 ** With more than a single tree, we must be careful to make sure
 ** that they match or the P-P, P-C and hence checklists will explode.
@@ -727,7 +1022,7 @@ void pkdCombineCells2(PKD pkd,treeStore::NodePointer pkdn,treeStore::NodePointer
     }
 }
 
-void pkdTreeBuild(PKD pkd,int nBucket, int nGroup, uint32_t uRoot,uint32_t uTemp, double ddHonHLimit) {
+void pkdTreeBuild(PKD pkd,int nBucket, int nGroup, uint32_t uRoot,uint32_t uTemp, double ddHonHLimit, int nThreads, int bSort) {
 #ifdef USE_ITT
     __itt_domain *domain = __itt_domain_create("MyTraces.MyDomain");
     __itt_string_handle *shMyTask = __itt_string_handle_create("Tree Build");
@@ -742,18 +1037,23 @@ void pkdTreeBuild(PKD pkd,int nBucket, int nGroup, uint32_t uRoot,uint32_t uTemp
     ** For more information look a pkdDumpTrees and the Initialize*() routines above.
     */
 
-    if (uTemp==0) BuildTemp(pkd,uRoot,nBucket,nGroup,HUGE_VAL);
+    if (uTemp==0) {
+        nThreads = ThreadsPerCore(nThreads,mdlCores(pkd->mdl)); // Every core is doing the same
+        if (bSort) BuildTempSorted(pkd,uRoot,nBucket,nGroup,HUGE_VAL,nThreads);
+        else if (nThreads > 1) BuildTempParallel(pkd,uRoot,nBucket,nGroup,HUGE_VAL,nThreads);
+        else BuildTemp(pkd,uRoot,nBucket,nGroup,HUGE_VAL);
+    }
     else  BuildFromTemplate(pkd,uRoot,nBucket,nGroup,uTemp);
     Create(pkd,uRoot,ddHonHLimit);
 
     if (uRoot == FIXROOT) {
 #ifndef SINGLE_CACHES
-        mdlROcache(pkd->mdl,CID_CELL2,pkdTreeNodeGetElement,pkd,pkd->NodeSize(),pkd->Nodes());
+        mdlROcacheTiled(pkd->mdl,CID_CELL2,pkdTreeNodeGetElement,pkd,pkd->NodeSize(),pkd->Nodes(),pkd->tree.TileBits());
         mdlROcache(pkd->mdl,CID_PARTICLE2,NULL,pkd->particles,pkd->particles.ParticleSize(),pkd->Local());
 #endif
     }
     else {
-        mdlROcache(pkd->mdl,CID_CELL,pkdTreeNodeGetElement,pkd,pkd->NodeSize(),pkd->Nodes());
+        mdlROcacheTiled(pkd->mdl,CID_CELL,pkdTreeNodeGetElement,pkd,pkd->NodeSize(),pkd->Nodes(),pkd->tree.TileBits());
     }
 
 #ifdef USE_ITT
@@ -933,8 +1233,8 @@ void pkdTreeBuildByGroup(PKD pkd, int nBucket, int nGroup) {
     /*
     ** Finally activate a read only cache for remote access.
     */
-    mdlROcache(pkd->mdl,CID_CELL,pkdTreeNodeGetElement,pkd,
-               pkd->NodeSize(),pkd->Nodes());
+    mdlROcacheTiled(pkd->mdl,CID_CELL,pkdTreeNodeGetElement,pkd,
+                    pkd->NodeSize(),pkd->Nodes(),pkd->tree.TileBits());
 
 }
 
@@ -989,5 +1289,5 @@ void pkdTreeUpdateFlagBoundsRecurse(PKD pkd,uint32_t uRoot,SPHOptions *SPHoption
 void pkdTreeUpdateFlagBounds(PKD pkd,uint32_t uRoot,SPHOptions *SPHoptions) {
     if (mdlCacheStatus(pkd->mdl,CID_CELL)) mdlFinishCache(pkd->mdl,CID_CELL);
     pkdTreeUpdateFlagBoundsRecurse(pkd, uRoot,SPHoptions);
-    mdlROcache(pkd->mdl,CID_CELL,pkdTreeNodeGetElement,pkd,pkd->NodeSize(),pkd->Nodes());
+    mdlROcacheTiled(pkd->mdl,CID_CELL,pkdTreeNodeGetElement,pkd,pkd->NodeSize(),pkd->Nodes(),pkd->tree.TileBits());
 }
@@ -31,6 +31,9 @@ template <int n> struct Blk<n,ilcTile> : pcBlk<n> {};
 inline double getFlops(workParticle *wp,ilpTile &tile) {
     return COST_FLOP_PP*wp->nP*tile.count();
 }
+inline double getFlops(workParticle *wp,ilpgTile &tile) {
+    return COST_FLOP_PP*wp->nP*tile.count();
+}
 inline double getFlops(workParticle *wp,ilcTile &tile) {
     return COST_FLOP_PC*wp->nP*tile.count();
 }
@@ -51,6 +54,21 @@ inline int copyBLKs(ppInteract *out, ilpTile &in) {
     return nBlk;
 }
 
+// The compact gravity list has exactly the fields that the P-P kernel uses.
+inline int copyBLKs(ppInteract *out, ilpgTile &in) {
+    auto n = in.width;
+    auto nIlp = in.count();
+    int i, nBlk = (nIlp+n-1) / n;
+    for (i=0; i<nBlk; ++i) {
+        memcpy(&out[i].dx,    &in[i].dx,    sizeof(out[i].dx));
+        memcpy(&out[i].dy,    &in[i].dy,    sizeof(out[i].dy));
+        memcpy(&out[i].dz,    &in[i].dz,    sizeof(out[i].dz));
+        memcpy(&out[i].m,     &in[i].m,     sizeof(out[i].m));
+        memcpy(&out[i].fourh2,&in[i].fourh2,sizeof(out[i].fourh2));
+    }
+    return nBlk;
+}
+
 inline int copyBLKs(pcInteract *out, ilcTile &in) {
     auto n = in.width;
     auto nIlp = in.count();
@@ -118,7 +136,9 @@ public:
         requestBufferCount = resultsBufferCount = 0;
         nTotalInteractionBlocks = nTotalParticles = 0;
     }
-    bool queue(workParticle *wp, TILE &tile, bool bGravStep) {
+    // The source tile can be any list layout that has the fields of TILE used by the kernel
+    template<class SRCTILE>
+    bool queue(workParticle *wp, SRCTILE &tile, bool bGravStep) {
         typedef Blk<WIDTH,TILE> BLK;
         if (work.size() == wp_max_buffer) return false;  // Too many work packages so send the work
         this->bGravStep = bGravStep;
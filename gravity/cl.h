@@ -25,6 +25,10 @@
     #define CL_PART_PER_BLK 16
 #endif
 
+// The particle count (nc) given to remote and top tree cells. Their particles are not
+// known locally, so the count is large enough that the cell is never taken as a bucket.
+constexpr int32_t CL_NC_NOT_LOCAL = 1000000000;
+
 // These are the fields and their types found in the interaction list
 #define CL_FIELDS_PARAMS_SEQ\
     ((int32_t,iCache))((int32_t,idCell))((int32_t,iCell))((int32_t,idLower))((int32_t,iLower))((int32_t,idUpper))((int32_t,iUpper))\
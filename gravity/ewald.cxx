@@ -26,6 +26,9 @@
     #include <malloc.h>
 #endif
 #include <new>
+#include <vector>
+#include <array>
+#include <algorithm>
 #include <math.h>
 #include <assert.h>
 #include "ewald.h"
@@ -123,8 +126,37 @@ double evalEwaldSIMD( PKD pkd,ewaldSIMD *ews,
 }
 #endif
 
+/*
+** Second order Taylor expansion of the tabulated correction about the
+** nearest grid node. Returns false if the point is not covered by the table.
+*/
+static bool evalEwaldTable(const pkdContext::EwaldGrid &ewg,double dx,double dy,double dz,
+                           float *pa,float *pPot) {
+    int ix = floor((dx - ewg.r0[0])*ewg.ih + 0.5);
+    int iy = floor((dy - ewg.r0[1])*ewg.ih + 0.5);
+    int iz = floor((dz - ewg.r0[2])*ewg.ih + 0.5);
+    if (ix < 1 || ix > ewg.n[0]-2 || iy < 1 || iy > ewg.n[1]-2 || iz < 1 || iz > ewg.n[2]-2) return false;
+    double x = dx - (ewg.r0[0] + ix*ewg.h);
+    double y = dy - (ewg.r0[1] + iy*ewg.h);
+    double z = dz - (ewg.r0[2] + iz*ewg.h);
+    const float *t = &ewg.data[10*((size_t(ix)*ewg.n[1] + iy)*ewg.n[2] + iz)];
+    double jx = t[4]*x + t[5]*y + t[6]*z;
+    double jy = t[5]*x + t[7]*y + t[8]*z;
+    double jz = t[6]*x + t[8]*y + t[9]*z;
+    /* a = -grad(Pot), so the potential expansion uses -a and -J */
+    *pPot += t[0] - (t[1]*x + t[2]*y + t[3]*z) - 0.5*(jx*x + jy*y + jz*z);
+    pa[0] += t[1] + jx;
+    pa[1] += t[2] + jy;
+    pa[2] += t[3] + jz;
+    return true;
+}
+
 double pkdParticleEwald(PKD pkd,double *r, float *pa, float *pPot,double *pdFlopSingle, double *pdFlopDouble) {
     struct EwaldVariables &ew = pkd->ew;
+    if (pkd->ewg.n[0] && evalEwaldTable(pkd->ewg,r[0]-ew.r[0],r[1]-ew.r[1],r[2]-ew.r[2],pa,pPot)) {
+        *pdFlopDouble += COST_FLOP_EWALD_TABLE;
+        return COST_FLOP_EWALD_TABLE;
+    }
     EwaldTable *ewt = &pkd->ewt;
     const MOMC &restrict mom = ew.mom;
     double L,Pot,ax,ay,az,dx,dy,dz,x,y,z,r2;
@@ -328,7 +360,134 @@ double pkdParticleEwald(PKD pkd,double *r, float *pa, float *pPot,double *pdFlop
     return dFlopDouble + dFlopSingle;
 }
 
-void pkdEwaldInit(PKD pkd,int nReps,double fEwCut,double fhCut,bool bGPU) {
+/*
+** Worst relative force error of the installed table at a handful of cell
+** centres (the worst case for the expansion), against the direct sum.
+*/
+static double pkdEwaldTableError(PKD pkd) {
+    auto &ewg = pkd->ewg;
+    const auto &ew = pkd->ew;
+    double dFlopSingle = 0, dFlopDouble = 0; /* ignored in Flop count! */
+    const int nCheck = 64;
+    const int n0 = ewg.n[0];
+    double aMax = 0, daMax = 0;
+    for (auto i=0; i<nCheck; ++i) {
+        int ix = 1 + (i*7) % std::max(1,ewg.n[0]-3);
+        int iy = 1 + (i*11) % std::max(1,ewg.n[1]-3);
+        int iz = 1 + (i*13) % std::max(1,ewg.n[2]-3);
+        double r[3] = {ew.r[0] + ewg.r0[0] + (ix+0.49)*ewg.h,
+                       ew.r[1] + ewg.r0[1] + (iy+0.49)*ewg.h,
+                       ew.r[2] + ewg.r0[2] + (iz+0.49)*ewg.h
+                      };
+        float at[3] = {0,0,0}, a[3] = {0,0,0}, pot = 0;
+        if (!evalEwaldTable(ewg,r[0]-ew.r[0],r[1]-ew.r[1],r[2]-ew.r[2],at,&pot)) continue;
+        ewg.n[0] = 0; /* direct sum */
+        pkdParticleEwald(pkd,r,a,&pot,&dFlopSingle,&dFlopDouble);
+        ewg.n[0] = n0;
+        double d2 = 0, a2 = 0;
+        for (auto j=0; j<3; ++j) {
+            d2 += (at[j]-a[j])*(at[j]-a[j]);
+            a2 += a[j]*a[j];
+        }
+        daMax = std::max(daMax,sqrt(d2));
+        aMax = std::max(aMax,sqrt(a2));
+    }
+    return aMax > 0 ? daMax / aMax : 0;
+}
+
+/*
+** Tabulate the correction on a grid of spacing L/nTable covering the
+** local domain (relative to the box centre of mass) so that particles
+** can use evalEwaldTable instead of the direct sum. The box multipole
+** moments break the reflection symmetry of the pure monopole case, so
+** we do not fold the table; restricting it to our own particles keeps
+** the cost per thread proportional to the local volume instead.
+**
+** The table is kept from call to call while it has the same spacing, still
+** covers the domain and its error has not doubled since it was built (the
+** box moments and centre of mass drift slowly as the particles move).
+*/
+static void pkdEwaldTableInit(PKD pkd,int nTable) {
+    auto &ewg = pkd->ewg;
+    const auto &ew = pkd->ew;
+    double dFlopSingle = 0, dFlopDouble = 0; /* ignored in Flop count! */
+    int n[3];
+    double r0[3], h, ih;
+
+    if (nTable <= 0 || pkd->Local() == 0) {
+        ewg.n[0] = ewg.n[1] = ewg.n[2] = 0;
+        ewg.dMaxError = 0;
+        ewg.data.clear();
+        return;
+    }
+    h = ew.Lbox / nTable;
+    ih = 1.0 / h;
+    auto bnd = pkd->tree[ROOT]->bound();
+    auto lower = bnd.lower();
+    auto upper = bnd.upper();
+    if (ewg.n[0] && ewg.h == h) {
+        bool bCovered = true;
+        for (auto j=0; j<3; ++j) {
+            bCovered = bCovered && lower[j] - ew.r[j] >= ewg.r0[j] + h
+                       && upper[j] - ew.r[j] <= ewg.r0[j] + (ewg.n[j]-2)*h;
+        }
+        if (bCovered) {
+            ewg.dMaxError = pkdEwaldTableError(pkd);
+            if (ewg.dMaxError <= 2.0 * ewg.dBuildError) return;
+        }
+    }
+
+    ewg.n[0] = ewg.n[1] = ewg.n[2] = 0; /* direct sum while we build */
+    for (auto j=0; j<3; ++j) {
+        /* One padding node on each side for the central differences */
+        r0[j] = lower[j] - ew.r[j] - h;
+        n[j] = ceil((upper[j] - lower[j])*ih) + 3;
+    }
+    std::vector<float> data(10*size_t(n[0])*n[1]*n[2],0.0f);
+    auto node = [&](int ix,int iy,int iz) {
+        return &data[10*((size_t(ix)*n[1] + iy)*n[2] + iz)];
+    };
+    for (auto ix=0; ix<n[0]; ++ix) {
+        for (auto iy=0; iy<n[1]; ++iy) {
+            for (auto iz=0; iz<n[2]; ++iz) {
+                double r[3] = {ew.r[0] + r0[0] + ix*h, ew.r[1] + r0[1] + iy*h, ew.r[2] + r0[2] + iz*h};
+                float *t = node(ix,iy,iz);
+                pkdParticleEwald(pkd,r,t+1,t,&dFlopSingle,&dFlopDouble);
+            }
+        }
+    }
+    /*
+    ** The Jacobian da_i/dx_j from central differences of the tabulated
+    ** forces. It is symmetric (a is a gradient) so we average both halves.
+    */
+    const double ih2 = 0.5 * ih, ih4 = 0.25 * ih;
+    for (auto ix=1; ix<n[0]-1; ++ix) {
+        for (auto iy=1; iy<n[1]-1; ++iy) {
+            for (auto iz=1; iz<n[2]-1; ++iz) {
+                float *t = node(ix,iy,iz);
+                const float *xm = node(ix-1,iy,iz), *xp = node(ix+1,iy,iz);
+                const float *ym = node(ix,iy-1,iz), *yp = node(ix,iy+1,iz);
+                const float *zm = node(ix,iy,iz-1), *zp = node(ix,iy,iz+1);
+                t[4] = ih2*(xp[1] - xm[1]);
+                t[5] = ih4*(yp[1] - ym[1] + xp[2] - xm[2]);
+                t[6] = ih4*(zp[1] - zm[1] + xp[3] - xm[3]);
+                t[7] = ih2*(yp[2] - ym[2]);
+                t[8] = ih4*(zp[2] - zm[2] + yp[3] - ym[3]);
+                t[9] = ih2*(zp[3] - zm[3]);
+            }
+        }
+    }
+    ewg.data.swap(data);
+    for (auto j=0; j<3; ++j) {
+        ewg.n[j] = n[j];
+        ewg.r0[j] = r0[j];
+    }
+    ewg.h = h;
+    ewg.ih = ih;
+    ewg.dMaxError = ewg.dBuildError = pkdEwaldTableError(pkd);
+}
+
+void pkdEwaldInit(PKD pkd,int nReps,double fEwCut,double fhCut,int nTable,bool bGPU) {
     struct EwaldVariables *const ew = &pkd->ew;
     EwaldTable *const ewt = &pkd->ewt;
     const MOMC *restrict mom = &ew->mom;
@@ -506,6 +665,10 @@ void pkdEwaldInit(PKD pkd,int nReps,double fEwCut,double fhCut,bool bGPU) {
         ewt->hSfac.f[i] = 0;
         ++i;
     }
+#ifdef USE_CUDA
+    if (bGPU) nTable = 0; /* The correction is evaluated on the device */
+#endif
+    pkdEwaldTableInit(pkd,nTable);
     if (bGPU) {
 #ifdef USE_CL
         clEwaldInit(pkd->mdl->clCtx,ew,ewt);
@@ -21,6 +21,6 @@
 #include "pkd.h"
 
 double pkdParticleEwald(PKD pkd, double *r, float *pa, float *pPot,double *pdFlopSingle, double *pdFlopDouble);
-void pkdEwaldInit(PKD pkd,int nReps,double fEwCut,double fhCut,bool bGPU);
+void pkdEwaldInit(PKD pkd,int nReps,double fEwCut,double fhCut,int nTable,bool bGPU);
 
 #endif
@@ -510,21 +510,39 @@ void pkdParticleWorkDone(workParticle *wp) {
             q = p;
             mdlReleaseWrite(pkd->mdl,CID_PARTICLE,&q);
         }
-        delete [] wp->pPart;
-        delete [] wp->iPart;
-        delete [] wp->pInfoIn;
-        delete [] wp->pInfoOut;
 #ifdef USE_CUDA
         if (wp->SPHoptions->doDensity && wp->bGPU) {
             delete wp->ilp;
         }
 #endif
         --pkd->nWpPending;
-        delete wp;
+        pkd->wpArena.release(wp);
     }
 }
 
-static void queuePP( PKD pkd, workParticle *wp, ilpList &ilp, int bGravStep, bool bGPU=true) {
+/*
+** A work unit and its per-particle arrays are a single chunk from the pool.
+*/
+static workParticle *newWorkParticle(PKD pkd,int nP) {
+    auto align = [](size_t n) {return (n + workArena::ALIGN - 1) & ~(workArena::ALIGN - 1);};
+    auto oPart     = align(sizeof(workParticle));
+    auto oIPart    = oPart    + align(nP * sizeof(PARTICLE *));
+    auto oInfoIn   = oIPart   + align(nP * sizeof(uint32_t));
+    auto oInfoOut  = oInfoIn  + align(nP * sizeof(PINFOIN));
+    auto nBytes    = oInfoOut + align(nP * sizeof(PINFOOUT));
+    auto p = static_cast<char *>(pkd->wpArena.acquire(nBytes));
+    auto wp = new (p) workParticle;
+    wp->pPart    = reinterpret_cast<PARTICLE **>(p + oPart);
+    wp->iPart    = reinterpret_cast<uint32_t *>(p + oIPart);
+    wp->pInfoIn  = reinterpret_cast<PINFOIN *>(p + oInfoIn);
+    wp->pInfoOut = reinterpret_cast<PINFOOUT *>(p + oInfoOut);
+    std::uninitialized_default_construct_n(wp->pInfoIn,nP);
+    std::uninitialized_default_construct_n(wp->pInfoOut,nP);
+    return wp;
+}
+
+template<class ILP>
+static void queuePP( PKD pkd, workParticle *wp, ILP &ilp, int bGravStep, bool bGPU=true) {
     for ( auto &tile : ilp ) {
         ++pkd->nTilesTotal;
         if (bGPU) {
@@ -537,7 +555,7 @@ static void queuePP( PKD pkd, workParticle *wp, ilpList &ilp, int bGravStep, boo
         }
         ++pkd->nTilesCPU;
         for (auto i=0; i<wp->nP; ++i) {
-            pkdGravEvalPP(wp->pInfoIn[i],tile,wp->pInfoOut[i]);
+            pkdGravEvalPP(wp->pInfoIn[i],tile,wp->pInfoOut[i],pkd->fPMi2rs);
             wp->dFlopSingleCPU += COST_FLOP_PP*tile.size();
         }
     }
@@ -643,7 +661,7 @@ static void queuePC( PKD pkd,  workParticle *wp, ilcList &ilc, int bGravStep, bo
         }
         ++pkd->nTilesCPU;
         for (auto i=0; i<wp->nP; ++i) {
-            pkdGravEvalPC(wp->pInfoIn[i],tile,wp->pInfoOut[i]);
+            pkdGravEvalPC(wp->pInfoIn[i],tile,wp->pInfoOut[i],pkd->fPMi2rs);
             wp->dFlopSingleCPU += COST_FLOP_PC*tile.size();
         }
     }
@@ -773,12 +791,12 @@ static void extensiveILPTest(PKD pkd, workParticle *wp, ilpList &ilp) {
 ** v_sqrt's and such.
 ** Returns nActive.
 */
-
-int pkdGravInteract(PKD pkd,
-                    struct pkdKickParameters *kick,struct pkdLightconeParameters *lc,struct pkdTimestepParameters *ts,
-                    treeStore::NodePointer pkdn,LOCR *pLoc,ilpList &ilp,ilcList &ilc,
-                    float dirLsum,float normLsum,int bEwald,double *pdFlop,
-                    SMX smx,SMF *smf,int iRoot1,int iRoot2,SPHOptions *SPHoptions,bool bGPU) {
+template<class ILP>
+static int gravInteract(PKD pkd,
+                        struct pkdKickParameters *kick,struct pkdLightconeParameters *lc,struct pkdTimestepParameters *ts,
+                        treeStore::NodePointer pkdn,LOCR *pLoc,ILP &ilp,ilcList &ilc,
+                        float dirLsum,float normLsum,int bEwald,double *pdFlop,
+                        SMX smx,SMF *smf,int iRoot1,int iRoot2,SPHOptions *SPHoptions,bool bGPU) {
     float fBall;
     int i,nSoft,nActive;
     int nP;
@@ -792,8 +810,8 @@ int pkdGravInteract(PKD pkd,
     nSoft = 0;
 
     /* Collect the bucket particle information */
-    auto wp = new workParticle;
-    assert(wp!=NULL);
+    nP = pkdn->count();
+    auto wp = newWorkParticle(pkd,nP);
     ++pkd->nWpPending;
     wp->nRefs = 1; /* I am using it currently */
     wp->ctx = pkd;
@@ -803,11 +821,6 @@ int pkdGravInteract(PKD pkd,
     wp->dFlopDoubleCPU = wp->dFlopDoubleGPU = 0.0;
     wp->nP = 0;
 
-    nP = pkdn->count();
-    wp->pPart = new PARTICLE *[nP];
-    wp->iPart = new uint32_t[nP];
-    wp->pInfoIn = new PINFOIN[nP];
-    wp->pInfoOut = new PINFOOUT[nP];
     wp->c[0] = ilp.getReference(0); assert(wp->c[0] == ilc.getReference(0));
     wp->c[1] = ilp.getReference(1); assert(wp->c[1] == ilc.getReference(1));
     wp->c[2] = ilp.getReference(2); assert(wp->c[2] == ilc.getReference(2));
@@ -913,24 +926,39 @@ int pkdGravInteract(PKD pkd,
     ** If CUDA is used, and we are doing density on the GPU,
     ** we need to clone the ilp,
     ** otherwise we use the reference to the global ilp.
+    ** The compact gravity list is never requeued so it is not kept.
     */
-#ifdef USE_CUDA
-    if (SPHoptions->doDensity && bGPU) {
-        wp->ilp = new ilpList;
-        wp->ilp->clone(pkd->ilp);
-        wp->ilp->setReference(pkd->ilp.getReference());
-    }
+    if constexpr (ILP::gravity_only) wp->ilp = nullptr;
     else {
+#ifdef USE_CUDA
+        if (SPHoptions->doDensity && bGPU) {
+            wp->ilp = new ilpList;
+            wp->ilp->clone(pkd->ilp);
+            wp->ilp->setReference(pkd->ilp.getReference());
+        }
+        else {
 #endif
-        wp->ilp = &ilp;
+            wp->ilp = &ilp;
 #ifdef USE_CUDA
-    }
+        }
 #endif
+    }
 
     nActive += wp->nP;
 
-    if (SPHoptions->doExtensiveILPTest && !(SPHoptions->doSetDensityFlags || SPHoptions->doSetNNflags)) {
-        extensiveILPTest(pkd, wp, pkd->ilp);
+    /*
+    ** Record the work of each particle for the domain decomposition.
+    */
+    if (pkd->particles.present(PKD_FIELD::oWork)) {
+        float fWork = ilp.count()*COST_FLOP_PP + ilc.count()*COST_FLOP_PC;
+        if (bEwald) fWork += COST_FLOP_EWALD;
+        for (i=0; i<wp->nP; ++i) pkd->particles.work(wp->pPart[i]) += fWork;
+    }
+
+    if constexpr (!ILP::gravity_only) {
+        if (SPHoptions->doExtensiveILPTest && !(SPHoptions->doSetDensityFlags || SPHoptions->doSetNNflags)) {
+            extensiveILPTest(pkd, wp, pkd->ilp);
+        }
     }
 
     /*
@@ -968,30 +996,32 @@ int pkdGravInteract(PKD pkd,
         /*
         ** Evaluate the P-P interactions
         */
-        queuePP( pkd, wp, pkd->ilp, ts->bGravStep, bGPU);
+        queuePP( pkd, wp, ilp, ts->bGravStep, bGPU);
     }
 
-    if (SPHoptions->doDensity) {
-        /*
-        ** Evaluate the Density on the P-P interactions
-        */
-        queueDensity( pkd, wp, pkd->ilp, bGPU);
-    }
+    if constexpr (!ILP::gravity_only) {
+        if (SPHoptions->doDensity) {
+            /*
+            ** Evaluate the Density on the P-P interactions
+            */
+            queueDensity( pkd, wp, ilp, bGPU);
+        }
 
-    if (SPHoptions->doDensityCorrection) {
-        /*
-        ** Evaluate the weighted averages of P and T
-        */
-        queueDensityCorrection( pkd, wp, pkd->ilp, bGPU);
-    }
+        if (SPHoptions->doDensityCorrection) {
+            /*
+            ** Evaluate the weighted averages of P and T
+            */
+            queueDensityCorrection( pkd, wp, ilp, bGPU);
+        }
 
-    if (SPHoptions->doSPHForces) {
-        /*
-        ** Evaluate the SPH forces on the P-P interactions
-        */
-        queueSPHForces( pkd, wp, pkd->ilp, bGPU);
-        if (SPHoptions->doCentrifugal) {
-            addCentrifugalAcceleration(pkd, wp);
+        if (SPHoptions->doSPHForces) {
+            /*
+            ** Evaluate the SPH forces on the P-P interactions
+            */
+            queueSPHForces( pkd, wp, ilp, bGPU);
+            if (SPHoptions->doCentrifugal) {
+                addCentrifugalAcceleration(pkd, wp);
+            }
         }
     }
 
@@ -1084,10 +1114,28 @@ int pkdGravInteract(PKD pkd,
 
     pkdParticleWorkDone(wp);
 
-    *pdFlop += nActive*(pkd->ilp.count()*COST_FLOP_PP + pkd->ilc.count()*COST_FLOP_PC) + nSoft*15;
+    *pdFlop += nActive*(ilp.count()*COST_FLOP_PP + ilc.count()*COST_FLOP_PC) + nSoft*15;
     return (nActive);
 }
 
+int pkdGravInteract(PKD pkd,
+                    struct pkdKickParameters *kick,struct pkdLightconeParameters *lc,struct pkdTimestepParameters *ts,
+                    treeStore::NodePointer pkdn,LOCR *pLoc,ilpList &ilp,ilcList &ilc,
+                    float dirLsum,float normLsum,int bEwald,double *pdFlop,
+                    SMX smx,SMF *smf,int iRoot1,int iRoot2,SPHOptions *SPHoptions,bool bGPU) {
+    return gravInteract(pkd,kick,lc,ts,pkdn,pLoc,ilp,ilc,dirLsum,normLsum,bEwald,pdFlop,
+                        smx,smf,iRoot1,iRoot2,SPHoptions,bGPU);
+}
+
+int pkdGravInteract(PKD pkd,
+                    struct pkdKickParameters *kick,struct pkdLightconeParameters *lc,struct pkdTimestepParameters *ts,
+                    treeStore::NodePointer pkdn,LOCR *pLoc,ilpgList &ilp,ilcList &ilc,
+                    float dirLsum,float normLsum,int bEwald,double *pdFlop,
+                    SMX smx,SMF *smf,int iRoot1,int iRoot2,SPHOptions *SPHoptions,bool bGPU) {
+    return gravInteract(pkd,kick,lc,ts,pkdn,pLoc,ilp,ilc,dirLsum,normLsum,bEwald,pdFlop,
+                        smx,smf,iRoot1,iRoot2,SPHoptions,bGPU);
+}
+
 #ifdef TIMESTEP_CRITICAL
 /*
 ** Gravitational scattering regime (iTimeStepCrit=1)
@@ -24,23 +24,33 @@
     #define ILP_PART_PER_BLK 32 /* Don't mess with this: see CUDA */
 #endif
 
-// These are the fields and their types found in the interaction list
-#define ILP_FIELDS_SEQ\
-    ((float,dx))((float,dy))((float,dz))((float,m))((float,fourh2))\
+// These are the fields and their types found in the interaction list.
+// The gravity fields are all that the P-P kernel needs; the rest are for SPH.
+#define ILP_FIELDS_GRAVITY_SEQ\
+    ((float,dx))((float,dy))((float,dz))((float,m))((float,fourh2))
+#define ILP_FIELDS_SPH_SEQ\
     ((float,vx))((float,vy))((float,vz))((float,fBall))((float,Omega))\
     ((float,rho))((float,P))((float,c))((int32_t,species))((float,uRung))((float,iMat))\
     ((float,T))((float,expImb2))((float,isGas))\
     ((float,Sxx))((float,Syy))((float,Sxy))((float,Sxz))((float,Syz))
+#define ILP_FIELDS_SEQ ILP_FIELDS_GRAVITY_SEQ ILP_FIELDS_SPH_SEQ
 
 ILIST_DECLARE(PP,ILP_FIELDS_SEQ)
 #define ILP_FIELD_TYPES ILIST_FIELD_VALUES(ILP_FIELDS_SEQ,0)
 #define ILP_FIELD_NAMES ILIST_FIELD_VALUES(ILP_FIELDS_SEQ,1)
 #define ILP_FIELD_PROTOS ILIST_FIELD_PROTOS(ILP_FIELDS_SEQ)
 
+// Compact list for gravity only walks (no SPH). Each interaction is 20 bytes instead of 96.
+ILIST_DECLARE(PPG,ILP_FIELDS_GRAVITY_SEQ)
+
 using ilpBlock = BlockPP<ILP_PART_PER_BLK>;
 using ilpTile = TilePP<ILP_PART_PER_BLK,8>;
+using ilpgBlock = BlockPPG<ILP_PART_PER_BLK>;
+using ilpgTile = TilePPG<ILP_PART_PER_BLK,8>;
+
 class ilpList : public ListPP<ILP_PART_PER_BLK,8>, public ilist::ilCenterReference {
 public:
+    static constexpr bool gravity_only = false;
     void append(float dx,float dy,float dz,float m,float fourh2,
                 float vx,float vy,float vz,float fBall,float Omega,
                 float rho,float P,float c,int32_t species,float uRung,float iMat,
@@ -60,4 +70,18 @@ public:
                m,fourh2,vx,vy,vz,fBall,Omega,rho,P,c,species,(float)uRung,(float)iMat,T,expImb2,isGas,Sxx,Syy,Sxy,Sxz,Syz);
     }
 };
+
+class ilpgList : public ListPPG<ILP_PART_PER_BLK,8>, public ilist::ilCenterReference {
+public:
+    static constexpr bool gravity_only = true;
+    void append(float dx,float dy,float dz,float m,float fourh2) {
+        BlockPPG<ILP_PART_PER_BLK> *b;
+        int i;
+        std::tie(b,i) = ListPPG<ILP_PART_PER_BLK,8>::create();
+        ILIST_ASSIGN_FIELDS(ILP_FIELDS_GRAVITY_SEQ,PPG,b,i,)
+    }
+    void append(double x,double y,double z,float m,float fourh2) {
+        append((float)(getReference(0)-x),(float)(getReference(1)-y),(float)(getReference(2)-z),m,fourh2);
+    }
+};
 #endif
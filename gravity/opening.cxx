@@ -209,6 +209,14 @@ void iOpenOutcomeBlock(PKD pkd,treeStore::NodePointer k,int n,clBlock &blk,float
         T4 = (minbnd2 > fourh2) & ~intersect1 & ~intersect2;
         T6 = cOpen > k_Open;
         T7 = k_notgrp;
+        /*
+        ** TreePM: cells entirely beyond the short-range cut-off are dropped
+        ** and cell-cell expansions (which assume 1/r) are never accepted.
+        */
+        if (pkd->fPMCut2 > 0.0f) {
+            T0 = T0 & ~((minbnd2 > fvec(pkd->fPMCut2)) & ~intersect1 & ~intersect2);
+            T1 = 0;
+        }
         iOpenA = mask_mov(i32v(3),T2,i32v(1));
         iOpenB = mask_mov(mask_mov(iOpenA,T4,i32v(4)),T3,iOpenA);
         P1 = mask_mov(i32v(3),T2,i32v(2));
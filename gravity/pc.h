@@ -15,6 +15,7 @@
  *  along with PKDGRAV3.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "treepm.h"
 #ifdef __CUDACC__
     #define PC_CUDA_BOTH __host__ __device__
 #else
@@ -35,7 +36,12 @@ struct ResultPC {
         return *this;
     }
 };
-template<class F,class M,bool bGravStep>
+/*
+** With bShortRange the TreePM short-range factors for 1/(2r_s) = i2rs are
+** applied. They are exact for the monopole and use the value at the cell
+** centre for the higher order terms.
+*/
+template<class F,class M,bool bGravStep,bool bShortRange=false>
 PC_CUDA_BOTH ResultPC<F> EvalPC(
     F Pdx, F Pdy, F Pdz, F Psmooth2, // Particle
     F Idx, F Idy, F Idz, F Im, F Iu, // Interaction(s)
@@ -44,7 +50,7 @@ PC_CUDA_BOTH ResultPC<F> EvalPC(
 #ifdef USE_DIAPOLE
     F Ix, F Iy, F Iz,
 #endif
-    F Pax, F Pay, F Paz,F imaga) {
+    F Pax, F Pay, F Paz,F imaga,F i2rs=0.0f) {
     ResultPC<F> result;
     const F onethird = 1.0f/3.0f;
     F dx = Idx + Pdx;
@@ -179,6 +185,14 @@ PC_CUDA_BOTH ResultPC<F> EvalPC(
     result.ax *= dir;
     result.ay *= dir;
     result.az *= dir;
+    if (bShortRange) {
+        F fPot, fAcc;
+        TreePMShortRange(d2,i2rs,fPot,fAcc);
+        result.ax *= fAcc;
+        result.ay *= fAcc;
+        result.az *= fAcc;
+        result.pot *= fPot;
+    }
 
     /* Calculations for determining the timestep. */
     if (bGravStep) {
@@ -235,6 +235,69 @@ int pstSetLinGrid(PST pst,void *vin,int nIn,void *vout,int nOut) {
     return 0;
 }
 
+/*
+** TreePM long-range force. Grid 0 must hold the density contrast in k-space
+** (AssignMass followed by DensityContrast). The three components of the
+** mesh acceleration, filtered by exp(-k^2 r_s^2), are left in real space in
+** grids 0, 1 and 2 in the same layout used by pkdLinearKick. The assignment
+** window is deconvolved twice: once for the mass assignment and once for the
+** interpolation back to the particles.
+*/
+void pkdSetPMGrid(PKD pkd, double dTotalMass, double dRs, int iAssignment) {
+    MDLFFT fft = pkd->fft;
+    int nGrid = fft->rgrid->n1;
+    auto iNyquist = nGrid / 2;
+    double L = pkd->fPeriod[0];
+    double dNormalization = 4*M_PI * dTotalMass / (L*L*L);
+    double iLbox = 2*M_PI / L;
+
+    GridInfo G(pkd->mdl,fft);
+    AssignmentWindow W(nGrid,iAssignment);
+    complex_array_t KX, KY, KZ;
+    auto data = reinterpret_cast<real_t *>(mdlSetArray(pkd->mdl,0,0,pkd->pLite));
+    G.setupArray(data,KX);
+    G.setupArray(data + fft->rgrid->nLocal,KY);
+    G.setupArray(data + 2*fft->rgrid->nLocal,KZ);
+
+    for ( auto index=KX.begin(); index!=KX.end(); ++index ) {
+        auto pos = index.position();
+        int i = pos[0];
+        int j = pos[1]>iNyquist ? pos[1] - nGrid : pos[1];
+        int k = pos[2]>iNyquist ? pos[2] - nGrid : pos[2];
+        auto delta = *index;
+        if ((i==0 && j==0 && k==0) || i==iNyquist || j==iNyquist || k==iNyquist) {
+            *index = KY(pos) = KZ(pos) = 0.0;
+            continue;
+        }
+        double kx = i*iLbox, ky = j*iLbox, kz = k*iLbox;
+        double k2 = kx*kx + ky*ky + kz*kz;
+        double win = W[i] * W[std::abs(j)] * W[std::abs(k)];
+        double g = dNormalization * exp(-k2*dRs*dRs) / k2 * win*win;
+        complex_t ig(0.0,g); // a(k) = i k 4 pi rho_bar delta(k) / k^2
+        *index   = ig * real_t(kx) * delta;
+        KY(pos)  = ig * real_t(ky) * delta;
+        KZ(pos)  = ig * real_t(kz) * delta;
+    }
+    mdlIFFT(pkd->mdl, fft, reinterpret_cast<FFTW3(complex) *>(data));
+    mdlIFFT(pkd->mdl, fft, reinterpret_cast<FFTW3(complex) *>(data + fft->rgrid->nLocal));
+    mdlIFFT(pkd->mdl, fft, reinterpret_cast<FFTW3(complex) *>(data + 2*fft->rgrid->nLocal));
+}
+
+int pstSetPMGrid(PST pst,void *vin,int nIn,void *vout,int nOut) {
+    LCL *plcl = pst->plcl;
+    auto in = reinterpret_cast<struct inSetPMGrid *>(vin);
+    assert (nIn==sizeof(struct inSetPMGrid) );
+    if (pstNotCore(pst)) {
+        int rID = pst->mdl->ReqService(pst->idUpper, PST_SETPMGRID, vin, nIn);
+        pstSetPMGrid(pst->pstLower, vin, nIn, NULL, 0);
+        pst->mdl->GetReply(rID);
+    }
+    else {
+        pkdSetPMGrid(plcl->pkd,in->dTotalMass,in->dRs,in->iAssignment);
+    }
+    return 0;
+}
+
 typedef blitz::Array<float,3> force_array_t;
 typedef blitz::TinyVector<int,3> shape_t;
 typedef blitz::TinyVector<double,3> position_t;
@@ -333,7 +396,7 @@ void pkdLinearKick(PKD pkd,vel_t dtOpen,vel_t dtClose, int iAssignment=3) {
             fetch_forces(pkd,CID_GridLinFy,nGrid,forcesY,ilower);
             fetch_forces(pkd,CID_GridLinFz,nGrid,forcesZ,ilower);
             for ( auto &p : *kdn) { // All particles in this tree cell
-                auto v = p.velocity();
+                auto &v = p.velocity();
                 float3_t r = p.position();
                 r = (r * ifPeriod + 0.5) * nGrid - flower; // Scale and shift to fit in subcube
                 v[0] += (dtOpen + dtClose) * force_interpolate(forcesX, r.data(), iAssignment);
@@ -358,7 +421,7 @@ int pstLinearKick(PST pst,void *vin,int nIn,void *vout,int nOut) {
         pst->mdl->GetReply(rID);
     }
     else {
-        pkdLinearKick(plcl->pkd,in->dtOpen,in->dtClose);
+        pkdLinearKick(plcl->pkd,in->dtOpen,in->dtClose,in->iAssignment);
     }
     return 0;
 }
@@ -30,10 +30,11 @@
 template<typename BLOCK> struct ilist::EvalBlock<ResultPP<fvec>,BLOCK> {
     typedef ResultPP<fvec> result_type;
     const fvec fx,fy,fz,pSmooth2,Pax,Pay,Paz,imaga;
+    const float i2rs; // TreePM short-range split (0 for the full force)
 
     EvalBlock() = default;
-    EvalBlock(fvec fx, fvec fy,fvec fz,fvec pSmooth2,fvec Pax,fvec Pay,fvec Paz,fvec imaga)
-        : fx(fx),fy(fy),fz(fz),pSmooth2(pSmooth2),Pax(Pax),Pay(Pay),Paz(Paz),imaga(imaga) {}
+    EvalBlock(fvec fx, fvec fy,fvec fz,fvec pSmooth2,fvec Pax,fvec Pay,fvec Paz,fvec imaga,float i2rs=0.0f)
+        : fx(fx),fy(fy),fz(fz),pSmooth2(pSmooth2),Pax(Pax),Pay(Pay),Paz(Paz),imaga(imaga),i2rs(i2rs) {}
 
     result_type operator()(int n,BLOCK &blk) {
         // Sentinal values
@@ -46,19 +47,28 @@ template<typename BLOCK> struct ilist::EvalBlock<ResultPP<fvec>,BLOCK> {
         n /= fvec::width(); // Now number of blocks
         result_type result;
         result.zero();
-        for (auto i=0; i<n; ++i) {
-            result += EvalPP<fvec,fmask>(fx,fy,fz,pSmooth2,blk.dx.v[i],blk.dy.v[i],blk.dz.v[i],blk.fourh2.v[i],blk.m.v[i],Pax,Pay,Paz,imaga);
+        if (i2rs > 0.0f) {
+            for (auto i=0; i<n; ++i) {
+                result += EvalPP<fvec,fmask,true>(fx,fy,fz,pSmooth2,blk.dx.v[i],blk.dy.v[i],blk.dz.v[i],blk.fourh2.v[i],blk.m.v[i],Pax,Pay,Paz,imaga,i2rs);
+            }
+        }
+        else {
+            for (auto i=0; i<n; ++i) {
+                result += EvalPP<fvec,fmask>(fx,fy,fz,pSmooth2,blk.dx.v[i],blk.dy.v[i],blk.dz.v[i],blk.fourh2.v[i],blk.m.v[i],Pax,Pay,Paz,imaga);
+            }
         }
         return result;
     }
 };
 
-void pkdGravEvalPP(const PINFOIN &Part, ilpTile &tile,  PINFOOUT &Out ) {
+// The P-P kernel only reads the gravity fields so it works with either list layout
+template<typename TILE>
+static void evalPP(const PINFOIN &Part, TILE &tile,  PINFOOUT &Out, float i2rs ) {
     float a2 = blitz::dot(Part.a,Part.a);
     fvec imaga = a2 > 0.0f ? 1.0f / sqrtf(a2) : 0.0f;
 
-    ilist::EvalBlock<ResultPP<fvec>,ilpBlock> eval(
-        Part.r[0],Part.r[1],Part.r[2],Part.fSmooth2,Part.a[0],Part.a[1],Part.a[2],imaga);;
+    ilist::EvalBlock<ResultPP<fvec>,typename TILE::block_type> eval(
+        Part.r[0],Part.r[1],Part.r[2],Part.fSmooth2,Part.a[0],Part.a[1],Part.a[2],imaga,i2rs);
     auto result = EvalTile(tile,eval);
     Out.a[0] += hadd(result.ax);
     Out.a[1] += hadd(result.ay);
@@ -68,6 +78,14 @@ void pkdGravEvalPP(const PINFOIN &Part, ilpTile &tile,  PINFOOUT &Out ) {
     Out.normsum += hadd(result.norm);
 }
 
+void pkdGravEvalPP(const PINFOIN &Part, ilpTile &tile,  PINFOOUT &Out, float i2rs ) {
+    evalPP(Part,tile,Out,i2rs);
+}
+
+void pkdGravEvalPP(const PINFOIN &Part, ilpgTile &tile,  PINFOOUT &Out, float i2rs ) {
+    evalPP(Part,tile,Out,i2rs);
+}
+
 template<typename BLOCK> struct ilist::EvalBlock<ResultDensity<fvec>,BLOCK> {
     typedef ResultDensity<fvec> result_type;
     const fvec fx,fy,fz,fBall,iMat,isGas;
@@ -15,6 +15,7 @@
  *  along with PKDGRAV3.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "treepm.h"
 #ifdef __CUDACC__
     #define PP_CUDA_BOTH __host__ __device__
 #else
@@ -36,10 +37,12 @@ struct ResultPP {
         return *this;
     }
 };
-template<class F,class M>
+// With bShortRange the TreePM short-range factors for 1/(2r_s) = i2rs are applied
+template<class F,class M,bool bShortRange=false>
 PP_CUDA_BOTH ResultPP<F> EvalPP(
     F Pdx, F Pdy, F Pdz, F Psmooth2,       // Particle
-    F Idx, F Idy, F Idz, F fourh2, F Im) { // Interaction(s)
+    F Idx, F Idy, F Idz, F fourh2, F Im,   // Interaction(s)
+    F i2rs=0.0f) {
     ResultPP<F> result;
     constexpr float minSoftening = 1e-18f;
     F dx = Idx + Pdx;
@@ -62,22 +65,28 @@ PP_CUDA_BOTH ResultPP<F> EvalPP(
         dir2 *= 1.0f + td2*(1.5f + td2*(135.0f/16.0f));
     }
     dir2 *= -Im;
+    result.pot = -Im*dir;
+    if (bShortRange) {
+        F fPot, fAcc;
+        TreePMShortRange(d2,i2rs,fPot,fAcc);
+        dir2 *= fAcc;
+        result.pot *= fPot;
+    }
     result.ax = dx * dir2;
     result.ay = dy * dir2;
     result.az = dz * dir2;
-    result.pot = -Im*dir;
     result.ir = dir;
     result.norm = d2;
     return result;
 }
 
 // Calculate additional terms for GravStep
-template<class F,class M>
+template<class F,class M,bool bShortRange=false>
 PP_CUDA_BOTH ResultPP<F> EvalPP(
     F Pdx, F Pdy, F Pdz, F Psmooth2,     // Particle
     F Idx, F Idy, F Idz, F fourh2, F Im, // Interaction(s)
-    F Pax, F Pay, F Paz, F imaga) {
-    ResultPP<F> result = EvalPP<F,M>(Pdx,Pdy,Pdz,Psmooth2,Idx,Idy,Idz,fourh2,Im);
+    F Pax, F Pay, F Paz, F imaga, F i2rs=0.0f) {
+    ResultPP<F> result = EvalPP<F,M,bShortRange>(Pdx,Pdy,Pdz,Psmooth2,Idx,Idy,Idz,fourh2,Im,i2rs);
     F adotai = Pax*result.ax + Pay*result.ay + Paz*result.az;
     adotai = maskz_mov((adotai>0.0f) & (result.norm>=Psmooth2),adotai) * imaga;
     result.norm = adotai * adotai;
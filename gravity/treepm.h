@@ -0,0 +1,53 @@
+/*  This file is part of PKDGRAV3 (http://www.pkdgrav.org/).
+ *  Copyright (c) 2001-2018 Joachim Stadel & Douglas Potter
+ *
+ *  PKDGRAV3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  PKDGRAV3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with PKDGRAV3.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TREEPM_H
+#define TREEPM_H
+#ifdef __CUDACC__
+    #define TREEPM_CUDA_BOTH __host__ __device__
+#else
+    #define TREEPM_CUDA_BOTH
+#endif
+
+/*
+** Short-range factors of the TreePM force split. The Newtonian potential
+** and force of a point mass at distance r are multiplied by
+**     fPot = erfc(x)
+**     fAcc = erfc(x) + 2x/sqrt(pi) exp(-x^2)
+** with x = r/(2 r_s) and i2rs = 1/(2 r_s). The mesh supplies the rest,
+** which is the Newtonian force filtered by exp(-k^2 r_s^2).
+**
+** Only basic arithmetic is used so that this works unchanged for the SIMD
+** types and the GPU kernels. exp(-y) is exp(-y/16)^16 using a 10th order
+** series for the base followed by 4 squarings, and erfc(x) is the rational
+** approximation 7.1.26 of Abramowitz & Stegun (absolute error < 1.5e-7).
+** Beyond x=4 both factors are below 1e-6 so we clamp there.
+*/
+template<class F>
+TREEPM_CUDA_BOTH void TreePMShortRange(F d2, F i2rs, F &fPot, F &fAcc) {
+    F x2 = min(d2*i2rs*i2rs,F(16.0f));
+    F x = sqrt(x2);
+    F z = x2 * (-1.0f/16.0f);
+    F e = 1.0f + z*(1.0f + z*(1.0f/2 + z*(1.0f/6 + z*(1.0f/24 + z*(1.0f/120 + z*(1.0f/720
+          + z*(1.0f/5040 + z*(1.0f/40320 + z*(1.0f/362880 + z*(1.0f/3628800))))))))));
+    e *= e; e *= e; e *= e; e *= e;
+    F t = 1.0f / (1.0f + 0.3275911f*x);
+    fPot = t*(0.254829592f + t*(-0.284496736f + t*(1.421413741f + t*(-1.453152027f + t*1.061405429f)))) * e;
+    fAcc = fPot + 1.1283791671f*x*e;
+}
+
+#undef TREEPM_CUDA_BOTH
+#endif
@@ -52,21 +52,63 @@
 static void addChild(PKD pkd, int iCache, clList *cl, int iChild, int id, blitz::TinyVector<float,3> fOffset) {
     auto c = (id == pkd->Self()) ? pkd->tree[iChild] :
              pkd->tree[static_cast<KDN *>(mdlFetch(pkd->mdl,iCache,iChild,id))];
-    auto nc = (c->is_remote()||c->is_top_tree()) ? 1000000000 : c->count();
+    auto nc = (c->is_remote()||c->is_top_tree()) ? CL_NC_NOT_LOCAL : c->count();
     auto cOpen = c->bMax() * pkd->fiCritTheta;
     auto c_r = c->position();
     auto cbnd = c->bound();
     auto [iLower, idLower, iUpper, idUpper] = c->get_child_cells(id);
+    // A bucket has no children, so we keep where its particles start (see prefetchCheckList)
+    if (c->is_bucket() && !c->is_remote() && !c->is_top_tree()) iUpper = c->lower();
     const auto &SPHbob = c->have_BOB() ? c->BOB() : SPHBOB();
     cl->append(iCache,id,iChild,idLower,iLower,idUpper,iUpper,nc,cOpen,
                c->mass(),4.0f*c->fSoft2(),c_r,fOffset,cbnd,
                SPHbob);
 
 }
+
+/*
+** Once the opening outcome of a tile is known we request the remote cells and particles
+** that will be needed (children of opened cells and the particles of buckets) as one batch.
+** Nothing here waits on a remote node. The replies arrive while we process the rest of the
+** checklist, so the fetches below will usually find them in the cache. For a bucket the
+** checklist has its particle range; other cells added to the P-P list are prefetched
+** themselves (their particles are then fetched as usual).
+*/
+static void prefetchCheckList(PKD pkd, clTile &tile) {
+    auto nBlocks = tile.count() / tile.width;
+    for (auto iBlock=0; iBlock<=nBlocks; ++iBlock) {
+        int n = iBlock<nBlocks ? tile.width : tile.count() - nBlocks*tile.width;
+        auto &blk = tile[iBlock];
+        for (auto jTile=0; jTile<n; ++jTile) {
+            int id = blk.idCell[jTile];
+            int iCidPart = blk.iCache[jTile]==CID_CELL ? CID_PARTICLE : CID_PARTICLE2;
+            switch (blk.iOpen[jTile]) {
+            case 1:
+            case 2:
+                if (id == pkd->Self()) break;
+                if (blk.iCell[jTile] < 0) mdlPrefetch(pkd->mdl,iCidPart,-1 - blk.iCell[jTile],id);
+                else {
+                    mdlPrefetch(pkd->mdl,blk.iCache[jTile],blk.iCell[jTile],id);
+                    if (blk.iLower[jTile] == 0 && blk.nc[jTile] != CL_NC_NOT_LOCAL) {
+                        for (auto pj=blk.iUpper[jTile]; pj<blk.iUpper[jTile]+blk.nc[jTile]; ++pj) mdlPrefetch(pkd->mdl,iCidPart,pj,id);
+                    }
+                }
+                break;
+            case 3:
+                if (blk.idLower[jTile] != pkd->Self()) mdlPrefetch(pkd->mdl,blk.iCache[jTile],blk.iLower[jTile],blk.idLower[jTile]);
+                if (blk.idUpper[jTile] != pkd->Self()) mdlPrefetch(pkd->mdl,blk.iCache[jTile],blk.iUpper[jTile],blk.idUpper[jTile]);
+                break;
+            }
+        }
+    }
+}
 /*
 ** Returns total number of active particles for which gravity was calculated.
+** The P-P interactions are collected in ilp which is either the full list
+** or the compact gravity only list (ILP::gravity_only).
 */
-static int processCheckList(PKD pkd, SMX smx, SMF smf, int iRoot, int iRoot2,
+template<class ILP>
+static int processCheckList(PKD pkd, ILP &ilp, SMX smx, SMF smf, int iRoot, int iRoot2,
                             struct pkdKickParameters *kick,struct pkdLightconeParameters *lc,struct pkdTimestepParameters *ts,
                             double dTime,int bEwald,bool bGPU,
                             double dThetaMin, double *pdFlop, double *pdPartSum,double *pdCellSum,SPHOptions *SPHoptions) {
@@ -139,11 +181,11 @@ static int processCheckList(PKD pkd, SMX smx, SMF smf, int iRoot, int iRoot2,
         printf("%d: TREE ERROR\n", pkd->Self());
         assert(0); /* We didn't find an active particle */
 found_it:
-        reference -= pkd->ilp->getReference();
+        reference -= ilp.getReference();
         d2c = blitz::dot(reference,reference);
         if ( d2c > 1e-5 ) {
             // Correct all remaining PP/PC interactions to this new center.
-            pkd->ilp.recenter(reference);
+            ilp.recenter(reference);
             pkd->ilc.recenter(reference);
         }
         bReferenceFound = 1;
@@ -174,7 +216,9 @@ found_it:
             do {
                 for (auto &tile : *pkd->cl) {
                     iOpenOutcomeSIMD(pkd,k,tile,dThetaMin,SPHoptions);
+                    prefetchCheckList(pkd,tile);
                 }
+                mdlPrefetchFlush(pkd->mdl);
                 pkd->clNew->clear();
                 for (auto &tile : *pkd->cl) {
                     auto nBlocks = tile.count() / tile.width;
@@ -211,10 +255,17 @@ found_it:
                                         r = p.position();
                                         if (!bReferenceFound) {
                                             bReferenceFound=1;
-                                            pkd->ilp.setReference(r);
+                                            ilp.setReference(r);
                                             pkd->ilc.setReference(r);
                                         }
-                                        if (pkd->particles.present(PKD_FIELD::oNewSph)) {
+                                        if constexpr (ILP::gravity_only) {
+                                            ilp.append(
+                                                r[0] + blk.xOffset[jTile],
+                                                r[1] + blk.yOffset[jTile],
+                                                r[2] + blk.zOffset[jTile],
+                                                blk.m[jTile], blk.fourh2[jTile]);
+                                        }
+                                        else if (pkd->particles.present(PKD_FIELD::oNewSph)) {
                                             const auto &NewSph = p.newsph();
                                             float Omega = pkdIsGas(pkd, &p) ? NewSph.Omega : 1.0f;
                                             float P = 0.0f;
@@ -227,7 +278,7 @@ found_it:
                                             float Sxz = 0.0f;
                                             float Syz = 0.0f;
                                             SPHpredictOnTheFly(pkd, p, kick, SPHoptions->nPredictRung, vpred, &P, &cs, &T, &Sxx, &Syy, &Sxy, &Sxz, &Syz, SPHoptions);
-                                            pkd->ilp.append(
+                                            ilp.append(
                                                 r[0] + blk.xOffset[jTile],
                                                 r[1] + blk.yOffset[jTile],
                                                 r[2] + blk.zOffset[jTile],
@@ -238,7 +289,7 @@ found_it:
                                         }
                                         else {
                                             auto v = p.velocity();
-                                            pkd->ilp.append(
+                                            ilp.append(
                                                 r[0] + blk.xOffset[jTile],
                                                 r[1] + blk.yOffset[jTile],
                                                 r[2] + blk.zOffset[jTile],
@@ -257,7 +308,7 @@ found_it:
                                         bReferenceFound=1;
                                         auto p = (id == pkd->Self()) ? pkd->particles[c->lower()] : ((SPHoptions->doSetDensityFlags || SPHoptions->doSetNNflags) ? pkd->particles[static_cast<PARTICLE *>(mdlAcquire(pkd->mdl,iCidPart,c->lower(),id))] : pkd->particles[static_cast<PARTICLE *>(mdlFetch(pkd->mdl,iCidPart,c->lower(),id))]);
                                         r = p.position();
-                                        pkd->ilp.setReference(r);
+                                        ilp.setReference(r);
                                         pkd->ilc.setReference(r);
                                         if ((id != pkd->Self()) && (SPHoptions->doSetDensityFlags || SPHoptions->doSetNNflags)) mdlRelease(pkd->mdl,iCidPart,&p);
                                     }
@@ -274,7 +325,14 @@ found_it:
                                             fMass = p.mass();
                                             fSoft = p.soft();
                                             r = p.position();
-                                            if (p.have_newsph()) {
+                                            if constexpr (ILP::gravity_only) {
+                                                ilp.append(
+                                                    r[0] + blk.xOffset[jTile],
+                                                    r[1] + blk.yOffset[jTile],
+                                                    r[2] + blk.zOffset[jTile],
+                                                    fMass, 4*fSoft*fSoft);
+                                            }
+                                            else if (p.have_newsph()) {
                                                 const auto &NewSph = p.newsph();
                                                 float Omega = pkdIsGas(pkd, &p) ? NewSph.Omega : 1.0f;
                                                 float P = 0.0f;
@@ -287,7 +345,7 @@ found_it:
                                                 float Sxz = 0.0f;
                                                 float Syz = 0.0f;
                                                 SPHpredictOnTheFly(pkd, p, kick, SPHoptions->nPredictRung, vpred, &P, &cs, &T, &Sxx, &Syy, &Sxy, &Sxz, &Syz, SPHoptions);
-                                                pkd->ilp.append(
+                                                ilp.append(
                                                     r[0] + blk.xOffset[jTile],
                                                     r[1] + blk.yOffset[jTile],
                                                     r[2] + blk.zOffset[jTile],
@@ -298,7 +356,7 @@ found_it:
                                             }
                                             else {
                                                 auto v = p.velocity();
-                                                pkd->ilp.append(
+                                                ilp.append(
                                                     r[0] + blk.xOffset[jTile],
                                                     r[1] + blk.yOffset[jTile],
                                                     r[2] + blk.zOffset[jTile],
@@ -382,7 +440,7 @@ found_it:
                                     r[2] = blk.z[jTile] + blk.zOffset[jTile];
                                     if (!bReferenceFound) {
                                         bReferenceFound=1;
-                                        pkd->ilp.setReference(r);
+                                        ilp.setReference(r);
                                         pkd->ilc.setReference(r);
                                     }
                                     pkd->ilc.append(r[0],r[1],r[2],&c->moment(),c->bMax());
@@ -539,7 +597,7 @@ found_it:
                     */
                     //ilpCheckPt(pkd->ilp,&pkd->S[iStack].PartChkPt);
                     //ilcCheckPt(pkd->ilc,&pkd->S[iStack].CellChkPt);
-                    assert(pkd->ilp.count()==0);
+                    assert(ilp.count()==0);
                     assert(pkd->ilc.count()==0);
                     /*
                     ** Note here we already have the correct elements in S[iStack] (iStack+1 was used previously), just need to add one.
@@ -579,7 +637,7 @@ found_it:
         ** Bucket!
         */
         nActive = pkdGravInteract(pkd,kick,lc,ts,
-                                  k,&L,pkd->ilp,pkd->ilc,dirLsum,normLsum,bEwald,pdFlop,
+                                  k,&L,ilp,pkd->ilc,dirLsum,normLsum,bEwald,pdFlop,
                                   smx, &smf, iRoot, iRoot2, SPHoptions, bGPU);
         /*
         ** Update the limit for a shift of the center here based on the opening radius of this
@@ -590,7 +648,7 @@ found_it:
             ** Here we used to set the weights of particles based on the work done, but now we just assume that
             ** all particles cost the same in domain decomposition, so we really don't need to set anything here.
             */
-            *pdPartSum += nActive * pkd->ilp.count();
+            *pdPartSum += nActive * ilp.count();
             *pdCellSum += nActive * pkd->ilc.count();
             nTotActive += nActive;
         }
@@ -604,7 +662,7 @@ found_it:
         */
         //ilpRestore(pkd->ilp,&pkd->S[iStack].PartChkPt);
         //ilcRestore(pkd->ilc,&pkd->S[iStack].CellChkPt);
-        pkd->ilp.clear();
+        ilp.clear();
         pkd->ilc.clear();
         /*
         ** Grab the checklist from the stack.
@@ -665,6 +723,9 @@ static void initGravWalk(PKD pkd,double dTime,double dThetaMin,int bPeriodic,int
 
     pkd->fiCritTheta = 1.0f / dThetaMin;
 
+    /* All work units from the previous walk have completed; reuse their storage. */
+    pkd->wpArena.reset();
+
     assert(pkd->tree.present(KDN_FIELD::oNodeMass));
     if (bGravStep) {
         assert(pkd->tree.present(KDN_FIELD::oNodeAcceleration));
@@ -726,7 +787,7 @@ int pkdGravWalkHop(PKD pkd,double dTime, double dThetaMin,double *pdFlop,double
 ** Returns total number of active particles for which gravity was calculated.
 */
 int pkdGravWalk(PKD pkd,struct pkdKickParameters *kick,struct pkdLightconeParameters *lc,struct pkdTimestepParameters *ts,
-                double dTime,int nReps,int bEwald,bool bGPU,
+                double dTime,int nReps,int bEwald,bool bGPU,bool bCompactILP,
                 int iLocalRoot1, int iLocalRoot2,int iVARoot,
                 double dThetaMin,double *pdFlop,double *pdPartSum,double *pdCellSum,SPHOptions *SPHoptions) {
     int id;
@@ -753,6 +814,7 @@ int pkdGravWalk(PKD pkd,struct pkdKickParameters *kick,struct pkdLightconeParame
         ** point to the top tree.
         */
         pkd->ilp.clear();
+        pkd->ilpg.clear();
         pkd->ilc.clear();
         pkd->cl->clear();
 
@@ -775,8 +837,19 @@ int pkdGravWalk(PKD pkd,struct pkdKickParameters *kick,struct pkdLightconeParame
                 }
             }
         }
-        nActive += processCheckList(pkd, smx, smf, iLocalRoot1, iLocalRoot2, kick,lc,ts,
-                                    dTime,bEwald, bGPU, dThetaMin, pdFlop, pdPartSum, pdCellSum, SPHoptions);
+        /*
+        ** If only gravity is calculated then the P-P kernel needs just the position,
+        ** mass and softening of each interaction so we use the compact list.
+        */
+        bool bGravityOnly = bCompactILP && SPHoptions->doGravity && !pkd->particles.present(PKD_FIELD::oNewSph)
+                            && !(SPHoptions->doDensity || SPHoptions->doDensityCorrection || SPHoptions->doSPHForces
+                                 || SPHoptions->doSetDensityFlags || SPHoptions->doSetNNflags);
+        if (bGravityOnly)
+            nActive += processCheckList(pkd, pkd->ilpg, smx, smf, iLocalRoot1, iLocalRoot2, kick,lc,ts,
+                                        dTime,bEwald, bGPU, dThetaMin, pdFlop, pdPartSum, pdCellSum, SPHoptions);
+        else
+            nActive += processCheckList(pkd, pkd->ilp, smx, smf, iLocalRoot1, iLocalRoot2, kick,lc,ts,
+                                        dTime,bEwald, bGPU, dThetaMin, pdFlop, pdPartSum, pdCellSum, SPHoptions);
     }
 #if 0
     /*
@@ -0,0 +1,102 @@
+/*  This file is part of PKDGRAV3 (http://www.pkdgrav.org/).
+ *  Copyright (c) 2001-2018 Joachim Stadel & Douglas Potter
+ *
+ *  PKDGRAV3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  PKDGRAV3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with PKDGRAV3.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pkd_config.h"
+#include <algorithm>
+#include "workarena.h"
+
+workArena::block::block(size_t nSize) : data(new char[nSize+ALIGN-1]), nSize(nSize) {
+    base = data.get() + ((ALIGN - reinterpret_cast<uintptr_t>(data.get())) & (ALIGN-1));
+}
+
+/*
+** Carve n bytes from the current block, or start a new block at least twice
+** as large as the last one.
+*/
+void *workArena::bytes(size_t n) {
+    if (iBlock < blocks.size() && nUsed + n <= blocks[iBlock].nSize) {
+        auto p = blocks[iBlock].base + nUsed;
+        nUsed += n;
+        return p;
+    }
+    size_t nSize = std::max(MIN_BLOCK,n);
+    if (!blocks.empty()) nSize = std::max(nSize,2*blocks.back().nSize);
+    blocks.emplace_back(nSize);
+    ++nGrow;
+    iBlock = blocks.size() - 1;
+    nUsed = n;
+    return blocks[iBlock].base;
+}
+
+void *workArena::acquire(size_t n) {
+    static_assert(sizeof(chunk) <= ALIGN);
+    int iClass = MIN_CLASS;
+    while ((size_t(1)<<iClass) < n) ++iClass;
+    if (freeList.size() <= size_t(iClass)) freeList.resize(iClass+1,nullptr);
+    auto c = freeList[iClass];
+    if (c) freeList[iClass] = c->next;
+    else {
+        c = static_cast<chunk *>(bytes(ALIGN + (size_t(1)<<iClass)));
+        c->iClass = iClass;
+    }
+    ++nLive;
+    ++nUnits;
+    nLiveBytes += size_t(1)<<iClass;
+    nPeakBytes = std::max(nPeakBytes,nLiveBytes);
+    return reinterpret_cast<char *>(c) + ALIGN;
+}
+
+void workArena::release(void *p) {
+    assert(nLive>0);
+    auto c = reinterpret_cast<chunk *>(static_cast<char *>(p) - ALIGN);
+    c->next = freeList[c->iClass];
+    freeList[c->iClass] = c;
+    nLiveBytes -= size_t(1)<<c->iClass;
+    if (--nLive == 0) rewind();
+}
+
+size_t workArena::capacity() const {
+    size_t n = 0;
+    for (auto &b : blocks) n += b.nSize;
+    return n;
+}
+
+/*
+** Nothing is live so all of the memory can be handed out again. If more than
+** one block was needed, merge them so that next time everything fits in one.
+*/
+void workArena::rewind() {
+    assert(nLive==0);
+    std::fill(freeList.begin(),freeList.end(),nullptr);
+    if (blocks.size() > 1) {
+        auto nSize = capacity();
+        blocks.clear();
+        blocks.emplace_back(nSize);
+        ++nGrow;
+    }
+    iBlock = 0;
+    nUsed = 0;
+}
+
+/*
+** Start of a walk: all work units from the previous walk must have completed.
+*/
+void workArena::reset() {
+    rewind();
+    nUnits = nGrow = 0;
+    nPeakBytes = 0;
+}
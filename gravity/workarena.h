@@ -0,0 +1,76 @@
+/*  This file is part of PKDGRAV3 (http://www.pkdgrav.org/).
+ *  Copyright (c) 2001-2018 Joachim Stadel & Douglas Potter
+ *
+ *  PKDGRAV3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  PKDGRAV3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with PKDGRAV3.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WORKARENA_H
+#define WORKARENA_H
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+#include <memory>
+#include <vector>
+
+/*
+** Pool for the per-bucket work units (workParticle and its arrays), one per
+** thread. Each unit is a single chunk rounded up to a power of two. When the
+** last reference to a unit is dropped, on either the CPU or GPU completion path,
+** the chunk goes on a free list for its size and is reused by the next unit.
+** Whenever no unit is live (after every bucket on the CPU path) the whole pool
+** is rewound. Memory is therefore bounded by the units in flight, and is kept
+** from walk to walk so that normally no system allocation is made.
+*/
+class workArena {
+public:
+    static constexpr size_t ALIGN = 64;
+    static constexpr size_t MIN_BLOCK = 1<<20;
+    static constexpr int MIN_CLASS = 10;    // Smallest chunk is 1 KB
+protected:
+    struct block {
+        std::unique_ptr<char[]> data;
+        char *base;     // data rounded up to ALIGN
+        size_t nSize;
+        explicit block(size_t nSize);
+    };
+    struct chunk {      // Precedes the memory given out; padded to ALIGN
+        chunk *next;
+        int iClass;
+    };
+    std::vector<block> blocks;
+    std::vector<chunk *> freeList;
+    size_t iBlock = 0;  // Block we are currently allocating from
+    size_t nUsed = 0;   // Bytes used in that block
+    size_t nLive = 0;   // Work units that have not yet been released
+    size_t nLiveBytes = 0;
+    // Statistics since the last reset
+    uint64_t nUnits = 0;
+    uint64_t nGrow = 0;
+    size_t nPeakBytes = 0;
+protected:
+    void *bytes(size_t n);
+    void rewind();
+public:
+    void *acquire(size_t n);
+    void release(void *p);
+    void reset();
+
+    size_t live()        const { return nLive; }
+    uint64_t units()     const { return nUnits; }
+    uint64_t grown()     const { return nGrow; }
+    size_t peakBytes()   const { return nPeakBytes; }
+    size_t capacity()    const;
+};
+
+#endif
@@ -28,8 +28,12 @@
 #include "blitz/array.h"
 #include "../SPH/SPHOptions.h"
 #include "core/remote.h"
+#include "core/runthreads.h"
 
 #include <algorithm>
+#include <atomic>
+#include <unordered_set>
+#include <vector>
 
 using blitz::TinyVector;
 using blitz::sum;
@@ -95,7 +99,7 @@ NoIntersect:
     return (iTail);
 }
 
-static void iOpenRemoteFof(PKD pkd,treeStore::NodePointer k,clTile &tile,float dTau2) {
+static void iOpenRemoteFof(PKD pkd,treeStore::NodePointer k,clTile &tile,float dTau2,int bSymmetric) {
     float dx,minbnd2,kOpen;
     int i,iOpen;
 
@@ -107,7 +111,7 @@ static void iOpenRemoteFof(PKD pkd,treeStore::NodePointer k,clTile &tile,float d
         int n = iBlock<nBlocks ? tile.width : tile.count() - nBlocks*tile.width;
         clBlock &blk = tile[iBlock];
         for (i=0; i<n; ++i) {
-            if (blk.idCell[i] > pkd->Self()) iOpen = 10;  /* ignore this cell, but this never ignores the top tree */
+            if (!bSymmetric && blk.idCell[i] > pkd->Self()) iOpen = 10;  /* ignore this cell, but this never ignores the top tree */
             else {
                 minbnd2 = 0;
                 dx = kbnd.lower(0) -  blk.xCenter[i] - blk.xOffset[i] - blk.xMax[i];
@@ -147,7 +151,11 @@ static void addChildFof(PKD pkd, remoteTree &tree, clList *cl, int iChild, int i
                c->mass(),4.0f*c->fSoft2(),c_r,fOffset,cbnd,SPHbob);
 }
 
-void pkdFofRemoteSearch(PKD pkd,double dTau2,int bPeriodic,int nReplicas,int nBucket) {
+/*
+** Find the links from local groups to remote groups. Normally a link is only recorded
+** by the processor with the higher id; if bSymmetric then both sides record it.
+*/
+void pkdFofRemoteSearch(PKD pkd,double dTau2,int bPeriodic,int nReplicas,int nBucket,int bSymmetric) {
     double d2;
     int npi;
     uint32_t pjGroup;
@@ -236,7 +244,7 @@ NextCell:
             pkd->S[iStack+1].cl->clear();
             do {
                 for (auto &tile : *pkd->cl) {
-                    iOpenRemoteFof(pkd,k,tile,dTau2);
+                    iOpenRemoteFof(pkd,k,tile,dTau2,bSymmetric);
                 }
                 pkd->clNew->clear();
                 for (auto &tile : *pkd->cl) {
@@ -405,18 +413,288 @@ void updateInteriorBound(Bound &ibnd,const Bound &bnd) {
 }
 #endif
 
-void pkdNewFof(PKD pkd,double dTau2,int nMinMembers,int bPeriodic,int nReplicas,int nBucket) {
+/*
+** Grow each local group in turn from an ungrouped particle using a FIFO.
+** Returns the number of local groups.
+*/
+static uint32_t fofLocalFifo(PKD pkd,double dTau2,int nMinMembers,
+                             const TinyVector<double,3> &fMinFofContained,const TinyVector<double,3> &fMaxFofContained) {
     uint32_t iGroup;
-    int pn,i,j;
+    int pn,j;
     uint32_t iHead;
     uint32_t iTail;
     const uint32_t uGroupMax = (pkd->bNoParticleOrder)?IGROUPMAX:0xffffffff;
     uint32_t *Fifo;
     int bCurrFofContained;
 
-    assert(pkd->particles.present(PKD_FIELD::oGroup) || pkd->bNoParticleOrder); /* Validate memory model */
     auto S = new int[1024]; assert(S);
     /*
+    ** Clear the group numbers!
+    */
+    for (auto &p : pkd->particles) {
+        p.set_group(0);
+    }
+    /*
+    ** The following *just* fits into ephemeral storage of 4 bytes/particle.
+    */
+    assert(pkd->EphemeralBytes() >= 4);
+    Fifo = (uint32_t *)(pkd->pLite);
+    iGroup = 1;
+    for (pn=0; pn<pkd->Local(); ++pn) {
+        auto p = pkd->particles[pn];
+        if (p.group()) continue;
+        /*
+        ** Mark particle and add it to the do-fifo
+        */
+        iHead = iTail = 0;
+        Fifo[iTail++] = pn;
+        assert(iGroup < uGroupMax);
+        p.set_group(iGroup);
+        bCurrFofContained = 1;
+        auto p_r = p.position();
+        for (j=0; j<3; ++j) {
+            if (p_r[j] < fMinFofContained[j]) {
+                bCurrFofContained = 0;
+                break;
+            }
+            else if (p_r[j] > fMaxFofContained[j]) {
+                bCurrFofContained = 0;
+                break;
+            }
+        }
+        while (iHead < iTail) {
+            p_r = pkd->particles[Fifo[iHead++]].position();
+            iTail = pkdFofGatherLocal(pkd,S,dTau2,p_r,iGroup,iTail,Fifo,
+                                      &bCurrFofContained,fMinFofContained,fMaxFofContained);
+        }
+        assert(iTail <= pkd->Local());
+        /*
+        ** Now check if this fof group is contained and has fewer than nMinFof particles.
+        */
+        if (bCurrFofContained && iTail < nMinMembers) {
+            /*
+            ** In this case mark the group particles as belonging to a removed group.
+            */
+            for (iHead=0; iHead<iTail; ++iHead) {
+                pkd->particles[Fifo[iHead]].set_group(uGroupMax);
+            }
+        }
+        else {
+            ++iGroup;
+        }
+    }
+    /*
+    ** Clear group ids for removed small groups.
+    */
+    for (auto &p : pkd->particles) {
+        if (p.group() == uGroupMax) p.set_group(0);
+    }
+    delete [] S;  /* this stack is no longer needed */
+    Fifo = NULL;  /* done with the Fifo, can use the storage for other stuff now */
+    return iGroup-1;
+}
+
+/*
+** Concurrent union-find over the local particles. The root of a set is always its
+** lowest index, so a link always points to a smaller index and is made with a single
+** compare and swap; find uses path halving. No locks are needed.
+*/
+class FofUnionFind {
+    std::atomic<uint32_t> *parent;
+public:
+    FofUnionFind(void *pData,uint32_t n) : parent(static_cast<std::atomic<uint32_t> *>(pData)) {
+        static_assert(sizeof(std::atomic<uint32_t>)==sizeof(uint32_t));
+        for (uint32_t i=0; i<n; ++i) parent[i].store(i,std::memory_order_relaxed);
+    }
+    uint32_t find(uint32_t i) {
+        while (true) {
+            auto p = parent[i].load(std::memory_order_relaxed);
+            if (p == i) return i;
+            auto g = parent[p].load(std::memory_order_relaxed);
+            if (g == p) return p;
+            parent[i].compare_exchange_weak(p,g,std::memory_order_relaxed); // Failure is harmless
+            i = g;
+        }
+    }
+    void unite(uint32_t a,uint32_t b) {
+        while (true) {
+            a = find(a);
+            b = find(b);
+            if (a == b) return;
+            if (a < b) std::swap(a,b);
+            if (parent[a].compare_exchange_strong(a,b,std::memory_order_relaxed)) return;
+        }
+    }
+};
+
+static inline double fofMinDist2(const Bound &a,const Bound &b) {
+    double d2 = 0.0;
+    for (auto j=0; j<3; ++j) {
+        double d = fabs(a.center(j) - b.center(j)) - a.apothem(j) - b.apothem(j);
+        if (d > 0) d2 += d*d;
+    }
+    return d2;
+}
+
+static inline double fofMaxDist2(const Bound &a,const Bound &b) {
+    double d2 = 0.0;
+    for (auto j=0; j<3; ++j) {
+        double d = fabs(a.center(j) - b.center(j)) + a.apothem(j) + b.apothem(j);
+        d2 += d*d;
+    }
+    return d2;
+}
+
+static void fofLinkBuckets(PKD pkd,FofUnionFind &uf,treeStore::NodePointer a,treeStore::NodePointer b,double dTau2) {
+    bool bSelf = a->lower() == b->lower();
+    for (auto pi=a->lower(); pi<=a->upper(); ++pi) {
+        auto ri = pkd->particles[pi].position();
+        for (auto pj=bSelf ? pi+1 : b->lower(); pj<=b->upper(); ++pj) {
+            auto r = pkd->particles[pj].position() - ri;
+            if (dot(r,r) <= dTau2) uf.unite(pi,pj);
+        }
+    }
+}
+
+/*
+** Dual tree walk that links all particle pairs of cells iA and iB (or within cell iA).
+** Cell pairs that are entirely within the linking length are linked without
+** looking at the individual pairs.
+*/
+static void fofLinkCells(PKD pkd,FofUnionFind &uf,uint32_t iA,uint32_t iB,double dTau2) {
+    auto a = pkd->tree[iA];
+    auto b = pkd->tree[iB];
+    auto abnd = a->bound();
+    if (iA == iB) {
+        if (4*dot(abnd.apothem(),abnd.apothem()) <= dTau2) {
+            for (auto pi=a->lower()+1; pi<=a->upper(); ++pi) uf.unite(a->lower(),pi);
+        }
+        else if (a->is_bucket()) fofLinkBuckets(pkd,uf,a,a,dTau2);
+        else {
+            auto iLower = a->lchild(), iUpper = a->rchild();
+            fofLinkCells(pkd,uf,iLower,iLower,dTau2);
+            fofLinkCells(pkd,uf,iUpper,iUpper,dTau2);
+            fofLinkCells(pkd,uf,iLower,iUpper,dTau2);
+        }
+        return;
+    }
+    auto bbnd = b->bound();
+    if (fofMinDist2(abnd,bbnd) > dTau2) return;
+    if (fofMaxDist2(abnd,bbnd) <= dTau2) {
+        for (auto pi=a->lower()+1; pi<=a->upper(); ++pi) uf.unite(a->lower(),pi);
+        for (auto pj=b->lower(); pj<=b->upper(); ++pj) uf.unite(a->lower(),pj);
+    }
+    else if (a->is_bucket() && b->is_bucket()) fofLinkBuckets(pkd,uf,a,b,dTau2);
+    else if (b->is_bucket() || (a->is_cell() && a->count() >= b->count())) {
+        fofLinkCells(pkd,uf,a->lchild(),iB,dTau2);
+        fofLinkCells(pkd,uf,a->rchild(),iB,dTau2);
+    }
+    else {
+        fofLinkCells(pkd,uf,iA,b->lchild(),dTau2);
+        fofLinkCells(pkd,uf,iA,b->rchild(),dTau2);
+    }
+}
+
+/*
+** The same walk as fofLinkCells, but stops at cell pairs with at most nMax particles
+** which are then linked independently by separate threads.
+*/
+static void fofCollectTasks(PKD pkd,uint32_t iA,uint32_t iB,double dTau2,uint32_t nMax,
+                            std::vector<std::pair<uint32_t,uint32_t>> &tasks) {
+    auto a = pkd->tree[iA];
+    auto b = pkd->tree[iB];
+    if (iA == iB) {
+        if (a->is_bucket() || a->count() <= nMax) tasks.emplace_back(iA,iB);
+        else {
+            auto iLower = a->lchild(), iUpper = a->rchild();
+            fofCollectTasks(pkd,iLower,iLower,dTau2,nMax,tasks);
+            fofCollectTasks(pkd,iUpper,iUpper,dTau2,nMax,tasks);
+            fofCollectTasks(pkd,iLower,iUpper,dTau2,nMax,tasks);
+        }
+        return;
+    }
+    if (fofMinDist2(a->bound(),b->bound()) > dTau2) return;
+    if ((a->is_bucket() && b->is_bucket()) || a->count() + b->count() <= nMax) tasks.emplace_back(iA,iB);
+    else if (b->is_bucket() || (a->is_cell() && a->count() >= b->count())) {
+        fofCollectTasks(pkd,a->lchild(),iB,dTau2,nMax,tasks);
+        fofCollectTasks(pkd,a->rchild(),iB,dTau2,nMax,tasks);
+    }
+    else {
+        fofCollectTasks(pkd,iA,b->lchild(),dTau2,nMax,tasks);
+        fofCollectTasks(pkd,iA,b->rchild(),dTau2,nMax,tasks);
+    }
+}
+
+/*
+** Find the local groups with union-find over all particle pairs within the linking
+** length. The group numbering is the same as fofLocalFifo: groups are numbered in
+** order of their lowest particle index. Returns the number of local groups.
+*/
+static uint32_t fofLocalUnionFind(PKD pkd,double dTau2,int nMinMembers,int nThreads,
+                                  const TinyVector<double,3> &fMinFofContained,const TinyVector<double,3> &fMaxFofContained) {
+    const uint32_t uGroupMax = (pkd->bNoParticleOrder)?IGROUPMAX:0xffffffff;
+    const uint32_t ROOT_FLAG = 0x80000000u, OPEN_FLAG = 0x40000000u, COUNT_MASK = 0x3fffffffu;
+    uint32_t n = pkd->Local();
+
+    /*
+    ** The parent of each particle fits into ephemeral storage of 4 bytes/particle.
+    */
+    assert(pkd->EphemeralBytes() >= sizeof(uint32_t));
+    assert(n < OPEN_FLAG);
+    FofUnionFind uf(pkd->pLite,n);
+    nThreads = ThreadsPerCore(nThreads,mdlCores(pkd->mdl)); // Every core is doing the same
+    if (nThreads > 1) {
+        std::vector<std::pair<uint32_t,uint32_t>> tasks;
+        fofCollectTasks(pkd,ROOT,ROOT,dTau2,n / (16*nThreads) + 1,tasks);
+        std::atomic<std::size_t> iTask {0};
+        RunThreads(nThreads,[&](int t) {
+            for (auto i=iTask++; i<tasks.size(); i=iTask++)
+                fofLinkCells(pkd,uf,tasks[i].first,tasks[i].second,dTau2);
+        });
+    }
+    else fofLinkCells(pkd,uf,ROOT,ROOT,dTau2);
+
+    /*
+    ** Single threaded from here on. Each root has the lowest index of its set, so one
+    ** ascending pass points every particle directly to its root. A second pass counts
+    ** the members in the root entry, and flags groups that are not certainly contained.
+    */
+    auto parent = static_cast<uint32_t *>(pkd->pLite);
+    for (uint32_t i=0; i<n; ++i) parent[i] = parent[parent[i]];
+    for (uint32_t i=0; i<n; ++i) {
+        auto p_r = pkd->particles[i].position();
+        bool bOpen = any(p_r < fMinFofContained) || any(p_r > fMaxFofContained);
+        auto r = parent[i];
+        if (r == i) parent[i] = ROOT_FLAG | (bOpen ? OPEN_FLAG : 0) | 1;
+        else {
+            if ((parent[r] & COUNT_MASK) < COUNT_MASK) ++parent[r];
+            if (bOpen) parent[r] |= OPEN_FLAG;
+        }
+    }
+    /*
+    ** Number the groups, removing the small groups that are contained.
+    */
+    uint32_t iGroup = 1;
+    for (uint32_t i=0; i<n; ++i) {
+        auto p = pkd->particles[i];
+        auto r = parent[i];
+        if (r & ROOT_FLAG) {
+            if ((r & OPEN_FLAG) || (r & COUNT_MASK) >= uint32_t(nMinMembers)) {
+                assert(iGroup < uGroupMax);
+                p.set_group(iGroup++);
+            }
+            else p.set_group(0);
+        }
+        else p.set_group(pkd->particles[r].group());
+    }
+    return iGroup-1;
+}
+
+void pkdNewFof(PKD pkd,double dTau2,int nMinMembers,int bPeriodic,int nReplicas,int nBucket,int bUnionFind,int nThreads,int bDomainSFC) {
+    int pn,i;
+
+    assert(pkd->particles.present(PKD_FIELD::oGroup) || pkd->bNoParticleOrder); /* Validate memory model */
+    /*
     ** Set up the bounds for the FOF groups that are certainly contained in the domain.
     ** This is a little trickier for domains which could potentially overlap a bit.
     ** For now I assume that the domains do NOT overlap, but the calculation for overlapping
@@ -497,70 +775,19 @@ NextCell:
     TinyVector<double,3> fMinFofContained = bndSelf.lower() + sqrt(dTau2);
     TinyVector<double,3> fMaxFofContained = bndSelf.upper() - sqrt(dTau2);
     /*
-    ** Clear the group numbers!
-    */
-    for (auto &p : pkd->particles) {
-        p.set_group(0);
-    }
-    /*
-    ** The following *just* fits into ephemeral storage of 4 bytes/particle.
+    ** Space filling curve domains overlap, so a group well inside our bound can
+    ** still have friends in another domain. Treat every group as open.
     */
-    assert(pkd->EphemeralBytes() >= 4);
-    Fifo = (uint32_t *)(pkd->pLite);
-    iGroup = 1;
-    for (pn=0; pn<pkd->Local(); ++pn) {
-        auto p = pkd->particles[pn];
-        if (p.group()) continue;
-        /*
-        ** Mark particle and add it to the do-fifo
-        */
-        iHead = iTail = 0;
-        Fifo[iTail++] = pn;
-        assert(iGroup < uGroupMax);
-        p.set_group(iGroup);
-        bCurrFofContained = 1;
-        auto p_r = p.position();
-        for (j=0; j<3; ++j) {
-            if (p_r[j] < fMinFofContained[j]) {
-                bCurrFofContained = 0;
-                break;
-            }
-            else if (p_r[j] > fMaxFofContained[j]) {
-                bCurrFofContained = 0;
-                break;
-            }
-        }
-        while (iHead < iTail) {
-            p_r = pkd->particles[Fifo[iHead++]].position();
-            iTail = pkdFofGatherLocal(pkd,S,dTau2,p_r,iGroup,iTail,Fifo,
-                                      &bCurrFofContained,fMinFofContained,fMaxFofContained);
-        }
-        assert(iTail <= pkd->Local());
-        /*
-        ** Now check if this fof group is contained and has fewer than nMinFof particles.
-        */
-        if (bCurrFofContained && iTail < nMinMembers) {
-            /*
-            ** In this case mark the group particles as belonging to a removed group.
-            */
-            for (iHead=0; iHead<iTail; ++iHead) {
-                pkd->particles[Fifo[iHead]].set_group(uGroupMax);
-            }
-        }
-        else {
-            ++iGroup;
-        }
+    if (bDomainSFC) {
+        fMinFofContained = HUGE_VAL;
+        fMaxFofContained = -HUGE_VAL;
     }
     /*
-    ** Clear group ids for removed small groups.
+    ** Find the local groups, either by growing each group in turn or with union-find.
     */
-    for (auto &p : pkd->particles) {
-        if (p.group() == uGroupMax) p.set_group(0);
-    }
-    pkd->nLocalGroups = iGroup-1;
+    if (bUnionFind) pkd->nLocalGroups = fofLocalUnionFind(pkd,dTau2,nMinMembers,nThreads,fMinFofContained,fMaxFofContained);
+    else pkd->nLocalGroups = fofLocalFifo(pkd,dTau2,nMinMembers,fMinFofContained,fMaxFofContained);
     pkd->nGroups = pkd->nLocalGroups + 1;
-    delete [] S;  /* this stack is no longer needed */
-    Fifo = NULL;  /* done with the Fifo, can use the storage for other stuff now */
     /*
     ** Create initial group table. The assert below is a very minimal requirement as it doesn't account for remote
     ** links (tmpFofRemote). However, we check this again everytime we add a new remote link.
@@ -601,7 +828,7 @@ NextCell:
     ** a group.
     */
     pkd->mdl->CacheInitialize(CID_PARTICLE,NULL,pkd->particles,pkd->Local(),pkd->particles.ParticleSize());
-    pkdFofRemoteSearch(pkd,dTau2,bPeriodic,nReplicas,nBucket);
+    pkdFofRemoteSearch(pkd,dTau2,bPeriodic,nReplicas,nBucket,bUnionFind);
     pkd->mdl->FinishCache(CID_PARTICLE);
 }
 
@@ -768,6 +995,113 @@ int pkdFofPhases(PKD pkd) {
     return (bMadeProgress);
 }
 
+/*
+** Name the groups that span domains in one pass, instead of iterating pkdFofPhases.
+** The links from a symmetric remote search are exported through two read-only
+** caches: where the links of each group start (CID_GROUP) and the links themselves
+** (CID_FOF_LINKS). A component is named after its smallest (iPid,iIndex), so only the
+** processor that owns that group walks the whole component; a walk from any other
+** group stops at the first smaller group it finds. The owner then sends the name to
+** the other members with a combiner cache, as in pkdFofPhases.
+*/
+void pkdFofResolveLinks(PKD pkd) {
+    MDL mdl = pkd->mdl;
+    int idSelf = pkd->Self();
+    uint32_t nLinks = pkd->iRemoteGroup - 1;
+    int i;
+
+    /*
+    ** Pack the linked lists into arrays after the remote link table.
+    */
+    auto pOffset = reinterpret_cast<uint32_t *>(&pkd->tmpFofRemote[pkd->iRemoteGroup]);
+    auto pLinks = reinterpret_cast<remoteID *>(pOffset + pkd->nGroups + 1);
+    assert(reinterpret_cast<char *>(pLinks + nLinks)
+           <= reinterpret_cast<char *>(pkd->pLite) + 1ul*pkd->EphemeralBytes()*pkd->FreeStore());
+    uint32_t nPacked = 0;
+    for (i=0; i<pkd->nGroups; ++i) {
+        pOffset[i] = nPacked;
+        for (auto iLink=pkd->ga[i].iLink; iLink; iLink=pkd->tmpFofRemote[iLink].iLink) {
+            pLinks[nPacked++] = pkd->tmpFofRemote[iLink].key;
+        }
+    }
+    pOffset[pkd->nGroups] = nPacked;
+    assert(nPacked == nLinks);
+
+    mdlROcache(mdl,CID_GROUP,NULL,pOffset,sizeof(uint32_t),pkd->nGroups+1);
+    mdlROcache(mdl,CID_FOF_LINKS,NULL,pLinks,sizeof(remoteID),nLinks);
+    auto key = [](const remoteID &g) {
+        return (uint64_t(uint32_t(g.iPid)) << 32) | uint32_t(g.iIndex);
+    };
+    std::vector<bool> bDone(pkd->nGroups,false);
+    std::unordered_set<uint64_t> visited;
+    std::vector<remoteID> stack, members;
+    std::vector<std::pair<remoteID,remoteID>> remoteNames; // member, name
+    for (i=1; i<pkd->nGroups; ++i) {
+        if (bDone[i] || pOffset[i]==pOffset[i+1]) continue;
+        const remoteID name = pkd->ga[i].id;
+        assert(name.iPid == idSelf && name.iIndex == i);
+        bool bSmallest = true;
+        visited.clear();
+        members.clear();
+        stack.clear();
+        stack.push_back(name);
+        members.push_back(name);
+        visited.insert(key(name));
+        while (!stack.empty() && bSmallest) {
+            auto g = stack.back();
+            stack.pop_back();
+            uint32_t iStart, iEnd;
+            if (g.iPid == idSelf) {
+                iStart = pOffset[g.iIndex];
+                iEnd = pOffset[g.iIndex+1];
+            }
+            else {
+                iStart = *static_cast<uint32_t *>(mdlFetch(mdl,CID_GROUP,g.iIndex,g.iPid));
+                iEnd = *static_cast<uint32_t *>(mdlFetch(mdl,CID_GROUP,g.iIndex+1,g.iPid));
+            }
+            for (auto iLink=iStart; iLink<iEnd; ++iLink) {
+                remoteID h = g.iPid == idSelf ? pLinks[iLink]
+                             : *static_cast<remoteID *>(mdlFetch(mdl,CID_FOF_LINKS,iLink,g.iPid));
+                if (h.iPid < name.iPid || (h.iPid == name.iPid && h.iIndex < name.iIndex)) {
+                    bSmallest = false; // Named by the owner of the smaller group
+                    break;
+                }
+                if (visited.insert(key(h)).second) {
+                    stack.push_back(h);
+                    members.push_back(h);
+                }
+            }
+        }
+        /*
+        ** Every group we reached is in this component, so none of our own needs another walk.
+        */
+        for (auto &g : members) {
+            if (g.iPid != idSelf) {
+                if (bSmallest) remoteNames.emplace_back(g,name);
+            }
+            else {
+                if (bSmallest) pkd->ga[g.iIndex].id = name;
+                bDone[g.iIndex] = true;
+            }
+        }
+    }
+    mdlFinishCache(mdl,CID_FOF_LINKS);
+    mdlFinishCache(mdl,CID_GROUP);
+
+    /*
+    ** Our own groups already have their names (ours, or another processor will send it).
+    */
+    pkd->mdl->CacheInitialize(CID_GROUP,NULL,pkd->ga,pkd->nGroups,std::make_shared<PropagateNames>());
+    for (auto &[g,name] : remoteNames) {
+        auto pRemote = static_cast<struct smGroupArray *>(mdlVirtualFetch(mdl,CID_GROUP,g.iIndex,g.iPid));
+        assert(pRemote);
+        if (name.iPid < pRemote->id.iPid || (name.iPid == pRemote->id.iPid && name.iIndex < pRemote->id.iIndex)) {
+            pRemote->id = name;
+        }
+    }
+    pkd->mdl->FinishCache(CID_GROUP);
+}
+
 uint64_t pkdFofFinishUp(PKD pkd,int nMinGroupSize) {
     int i;
 
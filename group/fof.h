@@ -20,8 +20,9 @@
 
 #include "pkd.h"
 
-void pkdNewFof(PKD pkd,double dTau2,int nMinMembers,int bPeriodic,int nReplicas,int nBucket);
+void pkdNewFof(PKD pkd,double dTau2,int nMinMembers,int bPeriodic,int nReplicas,int nBucket,int bUnionFind,int nThreads,int bDomainSFC);
 int pkdFofPhases(PKD pkd);
+void pkdFofResolveLinks(PKD pkd);
 uint64_t pkdFofFinishUp(PKD pkd,int nMinGroupSize);
 
 #endif
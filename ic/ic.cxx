@@ -42,11 +42,11 @@ static basicParticleArray getOutputArray(PKD pkd,GridInfo &G,real_array_t &R) {
     if (blitz::product(R.shape())) {
         basicParticleArray fullOutput(
             reinterpret_cast<basicParticle *>(pData),
-            blitz::shape(G.n1r(),G.n2(),G.nz()), blitz::neverDeleteData,
+            blitz::shape(G.n1r(),G.nyr(),G.nz()), blitz::neverDeleteData,
             RegularArray(G.sz()));
         basicParticleArray output = fullOutput(
                                         blitz::Range::all(),
-                                        blitz::Range(R.base(1),R.base(1)+R.extent(1)-1),
+                                        blitz::Range(R.base(1)-G.syr(),R.base(1)-G.syr()+R.extent(1)-1),
                                         blitz::Range(G.sz(),G.ez()-1));
         output.reindexSelf(dimension_t(0,R.base(1),G.sz()));
         return output;
@@ -1084,6 +1084,7 @@ int pltMoveIC(PST pst,void *vin,int nIn,void *vout,int nOut) {
             if (pkd->bNoParticleOrder) p.set_group(0);
             else p.set_new_rung(0);
             if (pkd->particles.present(PKD_FIELD::oPotential)) p.potential() = 0;
+            if (pkd->particles.present(PKD_FIELD::oWork)) p.work() = p.last_work() = 0;
             if (in->bICgas) {
                 auto pgas = pkd->particles[i+in->nMove];
                 pgas = p;
@@ -1218,12 +1219,12 @@ int pstMoveIC(PST pst,void *vin,int nIn,void *vout,int nOut) {
         assert(fft != NULL);
 
         uint64_t nPerNode = (uint64_t)mdl->Cores() * pkd->FreeStore();
-        uint64_t nLocal = (int64_t)fft->rgrid->rn[myProc] * in->nGrid*in->nGrid;
+        uint64_t nLocal = (int64_t)fft->rgrid->rn[myProc] * fft->rgrid->rn2[myProc] * in->nGrid;
 
         /* Calculate how many slots are free (under) and how many need to be sent (over) before my rank */
         iUnderBeg = iOverBeg = 0;
         for (iProc=0; iProc<myProc; ++iProc) {
-            uint64_t nOnNode = fft->rgrid->rn[iProc] * in->nGrid*in->nGrid;
+            uint64_t nOnNode = (uint64_t)fft->rgrid->rn[iProc] * fft->rgrid->rn2[iProc] * in->nGrid;
             if (nOnNode>nPerNode) iOverBeg += nOnNode - nPerNode;
             else iUnderBeg += nPerNode - nOnNode;
         }
@@ -1238,7 +1239,7 @@ int pstMoveIC(PST pst,void *vin,int nIn,void *vout,int nOut) {
             iOverEnd = iOverBeg + nLocal - nPerNode;
             for (iProc=0; iProc<mdl->Procs(); ++iProc) {
                 rcount[iProc] = rdisps[iProc] = 0; // We cannot receive anything
-                uint64_t nOnNode = fft->rgrid->rn[iProc] * in->nGrid*in->nGrid;
+                uint64_t nOnNode = (uint64_t)fft->rgrid->rn[iProc] * fft->rgrid->rn2[iProc] * in->nGrid;
                 if (nOnNode<nPerNode) {
                     iUnderEnd = iUnderBeg + nPerNode - nOnNode;
                     /* The transfer condition */
@@ -1262,7 +1263,7 @@ int pstMoveIC(PST pst,void *vin,int nIn,void *vout,int nOut) {
             iUnderEnd = iUnderBeg + nPerNode - nLocal;
             for (iProc=0; iProc<mdl->Procs(); ++iProc) {
                 scount[iProc] = sdisps[iProc] = 0; // We have nothing to send
-                uint64_t nOnNode = fft->rgrid->rn[iProc] * in->nGrid*in->nGrid;
+                uint64_t nOnNode = (uint64_t)fft->rgrid->rn[iProc] * fft->rgrid->rn2[iProc] * in->nGrid;
                 if (nOnNode>nPerNode) {
                     iOverEnd = iOverBeg + nOnNode - nPerNode;
                     if (iOverEnd>iUnderBeg && iOverBeg<iUnderEnd) {
@@ -1390,12 +1391,14 @@ int pstGenerateIC(PST pst,void *vin,int nIn,void *vout,int nOut) {
         pltGenerateIC(pst,&tin,sizeof(tin),vout,nOut);
 
         int myProc = mdlProc(pst->mdl);
-        uint64_t nLocal = (int64_t)fft->rgrid->rn[myProc] * in->nGrid*in->nGrid;
+        uint64_t nLocal = (int64_t)fft->rgrid->rn[myProc] * fft->rgrid->rn2[myProc] * in->nGrid;
 
         /* Expand the particles by adding an iOrder */
         assert(sizeof(expandParticle) >= sizeof(basicParticle));
         overlayedParticle   *pbBase = (overlayedParticle *)pkd->particles.Element(0);
-        blitz::TinyVector<int,3> index(0,0,fft->rgrid->rs[myProc] + fft->rgrid->rn[myProc]);
+        /* With pencils we have only part of "y" */
+        int sy = fft->rgrid->rs2[myProc], ey = sy + fft->rgrid->rn2[myProc];
+        blitz::TinyVector<int,3> index(0,sy,fft->rgrid->rs[myProc] + fft->rgrid->rn[myProc]);
         float inGrid = 1.0 / in->nGrid;
         for (i=nLocal-1; i>=0; --i) {
             basicParticle  *b = &pbBase->b + i;
@@ -1404,9 +1407,9 @@ int pstGenerateIC(PST pst,void *vin,int nIn,void *vout,int nOut) {
             if (index[0]>0) --index[0];
             else {
                 index[0] = in->nGrid-1;
-                if (index[1]>0) --index[1];
+                if (index[1]>sy) --index[1];
                 else {
-                    index[1] = in->nGrid-1;
+                    index[1] = ey-1;
                     --index[2];
                     assert(index[2]>=0);
                 }
@@ -1427,7 +1430,7 @@ int pstGenerateIC(PST pst,void *vin,int nIn,void *vout,int nOut) {
                 p->iz = index[2];
             }
         }
-        assert(index[0]==0 && index[1]==0 && index[2]==fft->rgrid->rs[myProc]);
+        assert(index[0]==0 && index[1]==sy && index[2]==fft->rgrid->rs[myProc]);
         /* Now we need to move excess particles between nodes so nStore is obeyed. */
         pkd->fft = fft; /* This is freed in pstMoveIC() */
     }
@@ -120,10 +120,16 @@ void NoiseGenerator::update(complex_vector_t &pencil,complex_vector_t &noise,int
 */
 void NoiseGenerator::FillNoise(complex_array_t &K,int nGrid,double *mean,double *csq) {
     const int iNyquist = nGrid / 2;
-    complex_vector_t noise(K.domain()[0]);
-    complex_slice_t pencils = K(0,K.domain()[1],K.domain()[2]);
     if (mean) *mean = 0.0;
     if (csq) *csq = 0.0;
+    if (K.size() == 0) return;
+    // The noise is always generated for the complete pencil (the random sequence depends on it),
+    // but with a pencil decomposition we only have part of the x range.
+    complex_vector_t noise(iNyquist+1);
+    auto rx = K.domain()[0];
+    complex_vector_t local = noise(rx);
+    local.reindexSelf(rx.first());
+    complex_slice_t pencils = K(rx.first(),K.domain()[1],K.domain()[2]);
     // Iterate over each pencil of our part of the array, generate white noise and call update().
     // The default behaviour of update() is to set the output pencil to the white noise.
     for ( auto pindex=pencils.begin(); pindex!=pencils.end(); ++pindex ) {
@@ -132,13 +138,13 @@ void NoiseGenerator::FillNoise(complex_array_t &K,int nGrid,double *mean,double
         complex_vector_t pencil = K(blitz::Range::all(),j,k);
         pencilNoise(noise, nGrid, j, k);
         if (mean) {
-            auto s = sum(noise);
+            auto s = sum(local);
             *mean += std::real(s) + std::imag(s);
         }
         if (csq) {
-            auto r = sum(norm(noise));
+            auto r = sum(norm(local));
             *csq += r;
         }
-        update(pencil,noise,j<=iNyquist?j:j-nGrid,k<=iNyquist?k:k-nGrid);
+        update(pencil,local,j<=iNyquist?j:j-nGrid,k<=iNyquist?k:k-nGrid);
     }
 }
\ No newline at end of file
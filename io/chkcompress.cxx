@@ -0,0 +1,426 @@
+/*  This file is part of PKDGRAV3 (http://www.pkdgrav.org/).
+ *  Copyright (c) 2001-2018 Joachim Stadel & Douglas Potter
+ *
+ *  PKDGRAV3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  PKDGRAV3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with PKDGRAV3.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FILE_OFFSET_BITS
+    #define _FILE_OFFSET_BITS 64
+#endif
+#ifndef _LARGEFILE_SOURCE
+    #define _LARGEFILE_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+#include "chkcompress.h"
+#include "iochunk.h"
+
+namespace chkcompress {
+namespace {
+
+constexpr char file_magic[8] = "PKDCHKZ";
+constexpr uint32_t file_version = 2; // Version 1 had no incremental files (nBaseName was zero)
+
+enum plane_mode : uint8_t {
+    PLANE_RAW      = 0, // stored as is
+    PLANE_CONSTANT = 1, // every byte is the same
+    PLANE_RANS     = 2, // static order-0 rANS
+};
+
+// The data cannot be decoded. This is not an assert: files come from outside.
+[[noreturn]] void corrupt(const char *what) {
+    fprintf(stderr,"Corrupt compressed data: %s\n",what);
+    abort();
+}
+
+// rANS with 32-bit state and byte-wise renormalization
+constexpr uint32_t prob_bits  = 12;
+constexpr uint32_t prob_scale = 1u << prob_bits;
+constexpr uint32_t rans_lower = 1u << 23;
+
+// Scale the symbol counts so they sum to prob_scale, keeping every used symbol
+void normalize(const uint32_t *counts,uint64_t n,uint16_t *freq) {
+    uint32_t total = 0;
+    int iMax = 0;
+    for (auto s=0; s<256; ++s) {
+        if (counts[s]==0) freq[s] = 0;
+        else freq[s] = std::max<uint64_t>(1,uint64_t(counts[s]) * prob_scale / n);
+        total += freq[s];
+        if (freq[s] > freq[iMax]) iMax = s;
+    }
+    if (total < prob_scale) freq[iMax] += prob_scale - total;
+    // Forcing rare symbols to one may have overshot; take it back from the largest
+    while (total > prob_scale) {
+        for (auto s=0; s<256; ++s) if (freq[s] > freq[iMax]) iMax = s;
+        --freq[iMax];
+        --total;
+    }
+}
+
+void rans_encode(const uint8_t *in,size_t n,std::vector<uint8_t> &out) {
+    uint32_t counts[256] = {0};
+    for (size_t i=0; i<n; ++i) ++counts[in[i]];
+    uint16_t freq[256];
+    uint32_t cum[256];
+    normalize(counts,n,freq);
+    for (auto s=0, c=0; s<256; c+=freq[s++]) cum[s] = c;
+
+    // A symbol costs at most prob_bits bits so this cannot overflow
+    std::vector<uint8_t> buffer(2*n + 16);
+    auto end = buffer.data() + buffer.size();
+    auto p = end;
+    uint32_t x = rans_lower;
+    for (auto i=n; i-->0;) {
+        uint32_t f = freq[in[i]];
+        uint32_t x_max = ((rans_lower >> prob_bits) << 8) * f;
+        while (x >= x_max) {
+            *--p = uint8_t(x);
+            x >>= 8;
+        }
+        x = ((x / f) << prob_bits) + (x % f) + cum[in[i]];
+    }
+    p -= 4;
+    for (auto i=0; i<4; ++i) p[i] = uint8_t(x >> (8*i));
+
+    auto pFreq = reinterpret_cast<const uint8_t *>(freq);
+    out.assign(pFreq,pFreq+sizeof(freq));
+    out.insert(out.end(),p,end);
+}
+
+void rans_decode(const uint8_t *in,const uint8_t *end,uint8_t *out,size_t n) {
+    uint16_t freq[256];
+    uint32_t cum[256];
+    uint8_t symbol[prob_scale];
+    if (end - in < ptrdiff_t(sizeof(freq) + 4)) corrupt("truncated rANS header");
+    memcpy(freq,in,sizeof(freq));
+    in += sizeof(freq);
+    uint32_t total = 0;
+    for (auto s=0; s<256; ++s) total += freq[s];
+    if (total != prob_scale) corrupt("bad rANS frequencies");
+    for (auto s=0, c=0; s<256; c+=freq[s++]) {
+        cum[s] = c;
+        memset(symbol+c,s,freq[s]);
+    }
+    uint32_t x = 0;
+    for (auto i=0; i<4; ++i) x |= uint32_t(*in++) << (8*i);
+    for (size_t i=0; i<n; ++i) {
+        auto slot = x & (prob_scale-1);
+        auto s = symbol[slot];
+        out[i] = s;
+        x = freq[s] * (x >> prob_bits) + slot - cum[s];
+        while (x < rans_lower) {
+            if (in == end) corrupt("truncated rANS stream");
+            x = (x << 8) | *in++;
+        }
+    }
+}
+
+inline uint32_t zigzag(int32_t v)   { return (uint32_t(v) << 1) ^ uint32_t(v >> 31); }
+inline int32_t  unzigzag(uint32_t u) { return int32_t(u >> 1) ^ -int32_t(u & 1); }
+
+inline uint32_t get_plane_word(const uint8_t *planes,size_t m,uint32_t j,size_t i) {
+    uint32_t v = 0;
+    for (auto b=0; b<4; ++b) v |= uint32_t(planes[(j+b)*m + i]) << (8*b);
+    return v;
+}
+inline void put_plane_word(uint8_t *planes,size_t m,uint32_t j,size_t i,uint32_t v) {
+    for (auto b=0; b<4; ++b) planes[(j+b)*m + i] = uint8_t(v >> (8*b));
+}
+
+void encode_block(const char *pData,size_t m,uint32_t nElementSize,uint32_t oDelta,
+                  std::vector<uint8_t> &planes,std::vector<uint8_t> &rans,std::vector<char> &out) {
+    planes.resize(m * nElementSize);
+    for (size_t i=0; i<m; ++i)
+        for (uint32_t j=0; j<nElementSize; ++j)
+            planes[j*m + i] = pData[i*nElementSize + j];
+    if (oDelta) {
+        for (auto j=oDelta; j<oDelta+3*sizeof(int32_t); j+=sizeof(int32_t)) {
+            uint32_t prev = 0;
+            for (size_t i=0; i<m; ++i) {
+                auto v = get_plane_word(planes.data(),m,j,i);
+                put_plane_word(planes.data(),m,j,i,zigzag(int32_t(v-prev)));
+                prev = v;
+            }
+        }
+    }
+    out.clear();
+    for (uint32_t j=0; j<nElementSize; ++j)
+        encode_plane(planes.data()+j*m,m,rans,out);
+}
+
+void decode_block(const char *in,const char *end,char *pOut,size_t m,uint32_t nElementSize,uint32_t oDelta,
+                  std::vector<uint8_t> &planes) {
+    planes.resize(m * nElementSize);
+    for (uint32_t j=0; j<nElementSize; ++j)
+        in = decode_plane(in,end,planes.data()+j*m,m);
+    if (oDelta) {
+        for (auto j=oDelta; j<oDelta+3*sizeof(int32_t); j+=sizeof(int32_t)) {
+            uint32_t prev = 0;
+            for (size_t i=0; i<m; ++i) {
+                prev += uint32_t(unzigzag(get_plane_word(planes.data(),m,j,i)));
+                put_plane_word(planes.data(),m,j,i,prev);
+            }
+        }
+    }
+    for (size_t i=0; i<m; ++i)
+        for (uint32_t j=0; j<nElementSize; ++j)
+            pOut[i*nElementSize + j] = planes[j*m + i];
+}
+
+} // namespace
+
+// Each plane is: mode (1 byte), payload length (4 bytes), payload
+void encode_plane(const uint8_t *in,size_t n,std::vector<uint8_t> &rans,std::vector<char> &out) {
+    auto put = [&out](plane_mode mode,const void *data,uint32_t nBytes) {
+        auto p = static_cast<const char *>(data);
+        out.push_back(mode);
+        out.insert(out.end(),reinterpret_cast<const char *>(&nBytes),reinterpret_cast<const char *>(&nBytes+1));
+        out.insert(out.end(),p,p+nBytes);
+    };
+    if (std::all_of(in,in+n,[in](uint8_t v) {return v==in[0];})) put(PLANE_CONSTANT,in,1);
+    else {
+        rans_encode(in,n,rans);
+        if (rans.size() < n) put(PLANE_RANS,rans.data(),rans.size());
+        else put(PLANE_RAW,in,n);
+    }
+}
+
+const char *decode_plane(const char *in,const char *end,uint8_t *out,size_t n) {
+    uint32_t nBytes;
+    if (end - in < ptrdiff_t(1 + sizeof(nBytes))) corrupt("truncated plane header");
+    auto mode = static_cast<plane_mode>(*in++);
+    memcpy(&nBytes,in,sizeof(nBytes));
+    in += sizeof(nBytes);
+    if (nBytes > uint64_t(end - in)) corrupt("truncated plane");
+    auto p = reinterpret_cast<const uint8_t *>(in);
+    switch (mode) {
+    case PLANE_RAW:
+        if (nBytes != n) corrupt("raw plane has the wrong size");
+        memcpy(out,p,n);
+        break;
+    case PLANE_CONSTANT:
+        if (nBytes < 1) corrupt("empty constant plane");
+        memset(out,p[0],n);
+        break;
+    case PLANE_RANS:
+        rans_decode(p,p+nBytes,out,n);
+        break;
+    default:
+        corrupt("unknown plane mode");
+    }
+    return in + nBytes;
+}
+
+void pwrite_all(int fd,const char *filename,const void *buffer,uint64_t nBytes,uint64_t iOffset) {
+    auto p = static_cast<const char *>(buffer);
+    while (nBytes) {
+        auto nWrote = pwrite(fd,p,nBytes,iOffset);
+        if (nWrote <= 0) {
+            fprintf(stderr,"Short write: ");
+            perror(filename);
+            abort();
+        }
+        p += nWrote;
+        iOffset += nWrote;
+        nBytes -= nWrote;
+    }
+}
+
+bool pread_all(int fd,void *buffer,uint64_t nBytes,uint64_t iOffset) {
+    auto p = static_cast<char *>(buffer);
+    while (nBytes) {
+        auto nRead = pread(fd,p,nBytes,iOffset);
+        if (nRead <= 0) return false;
+        p += nRead;
+        iOffset += nRead;
+        nBytes -= nRead;
+    }
+    return true;
+}
+
+bool read_header(const std::string &filename,header &hdr) {
+    auto fd = open(filename.c_str(),O_RDONLY);
+    if (fd<0) return false;
+    bool bCompressed = pread_all(fd,&hdr,sizeof(hdr),0) && memcmp(hdr.magic,file_magic,sizeof(file_magic))==0;
+    close(fd);
+    if (bCompressed && (hdr.nVersion < 1 || hdr.nVersion > file_version)) {
+        fprintf(stderr,"%s: unsupported compressed checkpoint version %u\n",filename.c_str(),hdr.nVersion);
+        abort();
+    }
+    return bCompressed;
+}
+
+namespace {
+
+// The base of an incremental file is recorded without its directory when the two
+// share one, so that a set of checkpoints can be moved together.
+std::string base_path(const std::string &filename,const std::string &base) {
+    if (base.find('/') != std::string::npos) return base;
+    auto i = filename.rfind('/');
+    return i==std::string::npos ? base : filename.substr(0,i+1) + base;
+}
+
+std::string base_name(const std::string &filename,const std::string &base) {
+    auto i = filename.rfind('/'), j = base.rfind('/');
+    auto dir = i==std::string::npos ? std::string() : filename.substr(0,i+1);
+    auto base_dir = j==std::string::npos ? std::string() : base.substr(0,j+1);
+    return dir==base_dir ? base.substr(base_dir.size()) : base;
+}
+
+// An incremental file can only refer to a full checkpoint with the same layout
+bool same_layout(const header &a,const header &b) {
+    return a.nElements==b.nElements && a.nElementSize==b.nElementSize && a.nBlockElements==b.nBlockElements;
+}
+
+// Decode elements [iBeg,iEnd) of the blocks themselves (without applying any base)
+void read_blocks(const std::string &filename,const header &hdr,char *pDest,uint64_t iBeg,uint64_t iEnd) {
+    uint64_t B = hdr.nBlockElements;
+    uint64_t iBlockBeg = iBeg / B, iBlockEnd = (iEnd-1) / B + 1;
+
+    // Offsets of the blocks we need, then all of their data in one read
+    std::vector<uint64_t> offsets(iBlockEnd-iBlockBeg+1);
+    auto fd = open(filename.c_str(),O_RDONLY);
+    if (fd<0 || !pread_all(fd,offsets.data(),offsets.size()*sizeof(uint64_t),sizeof(hdr)+iBlockBeg*sizeof(uint64_t))) {
+        perror(filename.c_str());
+        abort();
+    }
+    close(fd);
+    if (!std::is_sorted(offsets.begin(),offsets.end())) corrupt("block offsets are not in order");
+    std::vector<char> data(offsets.back()-offsets.front());
+    io_chunk_read(filename.c_str(),data.data(),data.size(),offsets.front());
+
+    std::vector<uint8_t> planes;
+    std::vector<char> partial;
+    for (auto iBlock=iBlockBeg; iBlock<iBlockEnd; ++iBlock) {
+        auto iFirst = iBlock * B;
+        auto m = std::min(B,hdr.nElements-iFirst);
+        auto in = data.data() + offsets[iBlock-iBlockBeg] - offsets.front();
+        auto end = data.data() + offsets[iBlock-iBlockBeg+1] - offsets.front();
+        auto iCopyBeg = std::max(iBeg,iFirst), iCopyEnd = std::min(iEnd,iFirst+m);
+        auto nBytes = (iCopyEnd-iCopyBeg) * hdr.nElementSize;
+        if (iCopyBeg==iFirst && iCopyEnd==iFirst+m) // Whole block goes straight to the store
+            decode_block(in,end,pDest,m,hdr.nElementSize,hdr.oDelta,planes);
+        else {
+            partial.resize(m * hdr.nElementSize);
+            decode_block(in,end,partial.data(),m,hdr.nElementSize,hdr.oDelta,planes);
+            memcpy(pDest,partial.data() + (iCopyBeg-iFirst)*hdr.nElementSize,nBytes);
+        }
+        pDest += nBytes;
+    }
+}
+
+} // namespace
+
+void write(const char *filename,const void *pData,uint64_t nElements,uint32_t nElementSize,
+           uint32_t oDelta,const char *baseFile,uint32_t nBlockElements) {
+    header hdr;
+    memset(&hdr,0,sizeof(hdr));
+    memcpy(hdr.magic,file_magic,sizeof(file_magic));
+    hdr.nVersion = file_version;
+    hdr.nElementSize = nElementSize;
+    hdr.nElements = nElements;
+    hdr.nBlockElements = nBlockElements;
+    hdr.nBlocks = (nElements + nBlockElements - 1) / nBlockElements;
+    assert(oDelta==0 || oDelta + 3*sizeof(int32_t) <= nElementSize);
+
+    std::string baseName;
+    if (baseFile && *baseFile) {
+        header base;
+        if (read_header(baseFile,base) && base.nBaseName==0 && same_layout(base,hdr))
+            baseName = base_name(filename,baseFile);
+        else fprintf(stderr,"%s: %s is not a matching full checkpoint; writing a full checkpoint\n",filename,baseFile);
+    }
+    hdr.nBaseName = baseName.size();
+    hdr.oDelta = baseName.empty() ? oDelta : 0; // Positions are XORed with the base instead
+
+    auto fd = open(filename,O_WRONLY | O_CREAT | O_TRUNC,0666);
+    if (fd<0) {
+        perror(filename);
+        abort();
+    }
+    std::vector<uint64_t> offsets(hdr.nBlocks+1);
+    std::vector<uint8_t> planes, rans;
+    std::vector<char> block, ref;
+    auto pBase = static_cast<const char *>(pData);
+    uint64_t iOffset = sizeof(hdr) + offsets.size() * sizeof(uint64_t) + hdr.nBaseName;
+    for (uint32_t iBlock=0; iBlock<hdr.nBlocks; ++iBlock) {
+        uint64_t iBeg = uint64_t(iBlock) * nBlockElements;
+        uint64_t m = std::min<uint64_t>(nBlockElements,nElements-iBeg);
+        auto pBlock = pBase + iBeg*nElementSize;
+        if (hdr.nBaseName) { // Fields that did not change become zero
+            ref.resize(m*nElementSize);
+            read(baseFile,ref.data(),iBeg,iBeg+m);
+            for (size_t i=0; i<ref.size(); ++i) ref[i] ^= pBlock[i];
+            pBlock = ref.data();
+        }
+        encode_block(pBlock,m,nElementSize,hdr.oDelta,planes,rans,block);
+        offsets[iBlock] = iOffset;
+        pwrite_all(fd,filename,block.data(),block.size(),iOffset);
+        iOffset += block.size();
+    }
+    offsets[hdr.nBlocks] = iOffset;
+    pwrite_all(fd,filename,&hdr,sizeof(hdr),0);
+    pwrite_all(fd,filename,offsets.data(),offsets.size()*sizeof(uint64_t),sizeof(hdr));
+    pwrite_all(fd,filename,baseName.data(),baseName.size(),sizeof(hdr)+offsets.size()*sizeof(uint64_t));
+    close(fd);
+}
+
+void read(const std::string &filename,void *pOut,uint64_t iBeg,uint64_t iEnd) {
+    header hdr;
+    if (!read_header(filename,hdr)) {
+        fprintf(stderr,"%s: not a compressed checkpoint\n",filename.c_str());
+        abort();
+    }
+    if (hdr.nBlockElements==0 || hdr.nBlocks != (hdr.nElements + hdr.nBlockElements - 1) / hdr.nBlockElements)
+        corrupt("inconsistent header");
+    assert(iBeg<=iEnd && iEnd<=hdr.nElements);
+    if (iBeg==iEnd) return;
+    auto pDest = static_cast<char *>(pOut);
+    read_blocks(filename,hdr,pDest,iBeg,iEnd);
+    if (hdr.nBaseName == 0) return;
+
+    // An incremental file: XOR with the full checkpoint, a few blocks at a time
+    std::string baseName(hdr.nBaseName,'\0');
+    auto fd = open(filename.c_str(),O_RDONLY);
+    if (fd<0 || !pread_all(fd,&baseName[0],baseName.size(),sizeof(hdr)+(hdr.nBlocks+1)*sizeof(uint64_t))) {
+        perror(filename.c_str());
+        abort();
+    }
+    close(fd);
+    auto baseFile = base_path(filename,baseName);
+    header base;
+    if (!read_header(baseFile,base) || base.nBaseName!=0 || !same_layout(base,hdr)) {
+        fprintf(stderr,"%s: the full checkpoint %s is missing or does not match\n",filename.c_str(),baseFile.c_str());
+        abort();
+    }
+    std::vector<char> ref;
+    uint64_t nPiece = 16 * uint64_t(hdr.nBlockElements);
+    for (auto i=iBeg; i<iEnd; i+=nPiece) {
+        auto n = std::min(nPiece,iEnd-i);
+        ref.resize(n * hdr.nElementSize);
+        read_blocks(baseFile,base,ref.data(),i,i+n);
+        auto p = pDest + (i-iBeg)*hdr.nElementSize;
+        for (size_t j=0; j<ref.size(); ++j) p[j] ^= ref[j];
+    }
+}
+
+} // namespace chkcompress
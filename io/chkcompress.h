@@ -0,0 +1,81 @@
+#ifndef BF2ED9DC_585F_4E83_95AF_0C0333D236C2
+#define BF2ED9DC_585F_4E83_95AF_0C0333D236C2
+/*  This file is part of PKDGRAV3 (http://www.pkdgrav.org/).
+ *  Copyright (c) 2001-2018 Joachim Stadel & Douglas Potter
+ *
+ *  PKDGRAV3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  PKDGRAV3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with PKDGRAV3.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Lossless compressed checkpoint files.
+//
+// The particles are split into blocks of a fixed number of elements. Each block is
+// byte-shuffled so that byte "j" of every particle is stored together (one plane per
+// byte of the particle), and each plane is stored raw, as a single repeated byte, or
+// entropy coded with a static order-0 rANS coder. Integer positions are delta encoded
+// along the particle order (which follows the tree) before shuffling so the high bytes
+// become mostly zero. The file starts with a header and a table of block offsets so
+// that any range of particles can be restored independently.
+//
+// An incremental file refers to a full checkpoint file with the same layout. Each of its
+// blocks is the XOR with the same block of the full checkpoint (and positions are not
+// delta encoded), so fields that did not change become constant zero planes. This only
+// pays if the particles are in the same order in both files (e.g., sorted by iOrder).
+namespace chkcompress {
+
+struct header {
+    char     magic[8];       // "PKDCHKZ"
+    uint32_t nVersion;
+    uint32_t nElementSize;   // Size of a particle in bytes
+    uint64_t nElements;      // Number of particles in the file
+    uint32_t nBlockElements; // Number of particles per block
+    uint32_t nBlocks;
+    uint32_t oDelta;         // Offset of int32_t[3] delta encoded positions (0 if none)
+    uint32_t nBaseName;      // Length of the name of the full checkpoint (0 if this is one)
+};
+// The header is followed by uint64_t offsets[nBlocks+1] of each block in the file,
+// then by the name of the full checkpoint for an incremental file.
+
+constexpr uint32_t default_block_elements = 64*1024;
+
+// Returns true (and the header) if the file is a compressed checkpoint
+bool read_header(const std::string &filename,header &hdr);
+
+// Compress nElements of nElementSize bytes and write them to filename. If baseFile is given
+// an incremental file is written (or a full one if baseFile does not have the same layout).
+void write(const char *filename,const void *pData,uint64_t nElements,uint32_t nElementSize,
+           uint32_t oDelta,const char *baseFile=nullptr,uint32_t nBlockElements=default_block_elements);
+
+// Decompress elements [iBeg,iEnd) into pOut. The full checkpoint of an incremental file is
+// also read. Corrupt data is reported and aborts.
+void read(const std::string &filename,void *pOut,uint64_t iBeg,uint64_t iEnd);
+
+// Append n bytes (one byte plane) to out as: mode (1 byte), payload length (4 bytes), payload.
+// The rans vector is scratch space. This is also used by the packed light cone format.
+void encode_plane(const uint8_t *in,size_t n,std::vector<uint8_t> &rans,std::vector<char> &out);
+
+// Decode one plane of n bytes into out and return the start of the next plane
+const char *decode_plane(const char *in,const char *end,uint8_t *out,size_t n);
+
+// Write all nBytes at iOffset; a short write is reported and aborts
+void pwrite_all(int fd,const char *filename,const void *buffer,uint64_t nBytes,uint64_t iOffset);
+
+// Read all nBytes at iOffset; returns false on error or end of file
+bool pread_all(int fd,void *buffer,uint64_t nBytes,uint64_t iOffset);
+
+} // namespace chkcompress
+
+#endif /* BF2ED9DC_585F_4E83_95AF_0C0333D236C2 */
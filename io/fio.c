@@ -414,6 +414,101 @@ static enum FIO_SPECIES fioNoSpecies(FIO UNUSED(fio)) {
     return FIO_SPECIES_UNKNOWN;
 }
 
+/******************************************************************************\
+** Bulk reading support
+\******************************************************************************/
+
+static int fioHostIsLittleEndian(void) {
+    const uint16_t one = 1;
+    return *(const uint8_t *)&one;
+}
+
+static inline uint32_t fioSwap32(uint32_t v) {
+#ifdef __GNUC__
+    return __builtin_bswap32(v);
+#else
+    return (v>>24) | ((v>>8)&0xff00) | ((v<<8)&0xff0000) | (v<<24);
+#endif
+}
+
+static inline uint64_t fioSwap64(uint64_t v) {
+#ifdef __GNUC__
+    return __builtin_bswap64(v);
+#else
+    return ((uint64_t)fioSwap32((uint32_t)v) << 32) | fioSwap32((uint32_t)(v>>32));
+#endif
+}
+
+/*
+** Gather n float or double values spaced "stride" bytes apart, optionally
+** byte swapping, and convert them to the output type. These loops are kept
+** simple so that the compiler can vectorize the swap and conversion.
+*/
+static void fioGatherFloat(float *out,const char *in,size_t stride,int n,int bSwap) {
+    uint32_t u;
+    int i;
+    for (i=0; i<n; ++i) {
+        memcpy(&u,in+i*stride,sizeof(u));
+        if (bSwap) u = fioSwap32(u);
+        memcpy(out+i,&u,sizeof(u));
+    }
+}
+
+static void fioGatherDouble(double *out,const char *in,size_t stride,int n,int bDouble,int bSwap) {
+    uint64_t u;
+    uint32_t v;
+    float f;
+    int i;
+    if (bDouble) {
+        for (i=0; i<n; ++i) {
+            memcpy(&u,in+i*stride,sizeof(u));
+            if (bSwap) u = fioSwap64(u);
+            memcpy(out+i,&u,sizeof(u));
+        }
+    }
+    else {
+        for (i=0; i<n; ++i) {
+            memcpy(&v,in+i*stride,sizeof(v));
+            if (bSwap) v = fioSwap32(v);
+            memcpy(&f,&v,sizeof(v));
+            out[i] = f;
+        }
+    }
+}
+
+/* A view of a block starting at particle i */
+static fioDarkBlock fioDarkBlockAt(const fioDarkBlock *blk,int i) {
+    fioDarkBlock sub;
+    int d;
+    sub.piParticleID = blk->piParticleID + i;
+    for (d=0; d<3; ++d) {
+        sub.pdPos[d] = blk->pdPos[d] + i;
+        sub.pdVel[d] = blk->pdVel[d] + i;
+    }
+    sub.pfMass = blk->pfMass + i;
+    sub.pfSoft = blk->pfSoft + i;
+    sub.pfPot  = blk->pfPot + i;
+    sub.pfDen  = blk->pfDen + i;
+    return sub;
+}
+
+/*
+** Formats without a native bulk reader read one particle at a time.
+*/
+static int fioGenericReadDarkN(FIO fio,int n,fioDarkBlock *blk) {
+    double r[3], v[3];
+    int i, d;
+    for (i=0; i<n && fioSpecies(fio)==FIO_SPECIES_DARK; ++i) {
+        if (!fioReadDark(fio,blk->piParticleID+i,r,v,blk->pfMass+i,blk->pfSoft+i,
+                         blk->pfPot+i,blk->pfDen+i)) break;
+        for (d=0; d<3; ++d) {
+            blk->pdPos[d][i] = r[d];
+            blk->pdVel[d][i] = v[d];
+        }
+    }
+    return i;
+}
+
 /******************************************************************************\
 ** Generic Initialization - Provide default functions where possible
 \******************************************************************************/
@@ -438,6 +533,7 @@ static void fioInitialize(FIO fio, FIO_FORMAT eFormat, FIO_MODE eMode, int mFlag
     fio->fcnReadDark  = fioNoReadDark;
     fio->fcnReadSph   = fioNoReadSph;
     fio->fcnReadStar  = fioNoReadStar;
+    fio->fcnReadDarkN = fioGenericReadDarkN;
     fio->fcnWriteDark = fioNoWriteDark;
     fio->fcnWriteSph  = fioNoWriteSph;
     fio->fcnWriteStar = fioNoWriteStar;
@@ -514,6 +610,24 @@ static int listReadDark(FIO fio,
     return rc;
 }
 
+static int listReadDarkN(FIO fio,int n,fioDarkBlock *blk) {
+    fioList *vio = (fioList *)fio;
+    int nRead = 0;
+    assert(fio->eFormat == FIO_FORMAT_MULTIPLE);
+
+    while (nRead<n && fioSpecies(vio->fioCurrent) == FIO_SPECIES_DARK) {
+        uint64_t nLeft = fio->fileList.fileInfo[fio->fileList.iFile].nSpecies[vio->eSpecies] - vio->iSpecies;
+        int nWant = n-nRead < nLeft ? n-nRead : nLeft;
+        fioDarkBlock sub = fioDarkBlockAt(blk,nRead);
+        int m = fioReadDarkN(vio->fioCurrent,nWant,&sub);
+        if (m==0) break;
+        nRead += m;
+        vio->iSpecies += m-1;
+        if (listNextSpecies(fio)) break;
+    }
+    return nRead;
+}
+
 static int listReadSph(
     FIO fio,uint64_t *piParticleID,double *pdPos,double *pdVel,
     float *pfMass,float *pfSoft,float *pfPot,float *pfDen,
@@ -661,6 +775,7 @@ static FIO listOpen(fioFileList *fileList, FIO (*baseOpen)(const char *fname,int
     vio->fio.fcnReadSph  = listReadSph;
     vio->fio.fcnReadStar = listReadStar;
     vio->fio.fcnReadBH   = listReadBH;
+    vio->fio.fcnReadDarkN= listReadDarkN;
     vio->fio.fcnGetAttr  = listGetAttr;
     vio->fio.fcnSpecies  = listSpecies;
 
@@ -1383,9 +1498,58 @@ static int tipsySeekStandard(FIO fio,uint64_t iPart,enum FIO_SPECIES eSpecies) {
     return rc;
 }
 
+/*
+** Read a block of dark particles with a single fread. Standard files are XDR
+** (big-endian) and are decoded in bulk rather than value by value.
+*/
+static int tipsyReadDarkN(FIO fio,int n,fioDarkBlock *blk) {
+    fioTipsy *tio = (fioTipsy *)fio;
+    size_t nPos = tio->bDoublePos ? sizeof(double) : sizeof(float);
+    size_t nVel = tio->bDoubleVel ? sizeof(double) : sizeof(float);
+    size_t nRecord = TIPSY_DARK_SIZE(1,3*tio->bDoublePos+3*tio->bDoubleVel);
+    int bSwap = fioTipsyIsStandard(fio) && fioHostIsLittleEndian();
+    uint64_t iEnd;
+    char *pBuffer, *p;
+    int i, d;
+
+    assert(fio->eFormat == FIO_FORMAT_TIPSY && fio->eMode==FIO_MODE_READING);
+    if (tipsySpecies(fio) != FIO_SPECIES_DARK) return 0;
+    if (tipsySwitchFile(fio,0)) return 0;
+
+    /* Stop at the end of the dark particles or the end of this file */
+    iEnd = tio->fio.nSpecies[FIO_SPECIES_SPH] + tio->fio.nSpecies[FIO_SPECIES_DARK];
+    if (iEnd > fio->fileList.fileInfo[fio->fileList.iFile+1].iFirst)
+        iEnd = fio->fileList.fileInfo[fio->fileList.iFile+1].iFirst;
+    if (n > iEnd - tio->iOrder) n = iEnd - tio->iOrder;
+    if (n <= 0) return 0;
+
+    pBuffer = malloc(n*nRecord);
+    assert(pBuffer!=NULL);
+    if (fread(pBuffer,nRecord,n,tio->fp) != n) {
+        free(pBuffer);
+        return 0;
+    }
+    p = pBuffer;
+    fioGatherFloat(blk->pfMass,p,nRecord,n,bSwap);
+    p += sizeof(float);
+    for (d=0; d<3; ++d, p+=nPos) fioGatherDouble(blk->pdPos[d],p,nRecord,n,tio->bDoublePos,bSwap);
+    for (d=0; d<3; ++d, p+=nVel) fioGatherDouble(blk->pdVel[d],p,nRecord,n,tio->bDoubleVel,bSwap);
+    fioGatherFloat(blk->pfSoft,p,nRecord,n,bSwap);
+    p += sizeof(float);
+    fioGatherFloat(blk->pfPot,p,nRecord,n,bSwap);
+    for (i=0; i<n; ++i) {
+        blk->piParticleID[i] = tio->iOrder + i;
+        blk->pfDen[i] = 0.0f;
+    }
+    tio->iOrder += n;
+    free(pBuffer);
+    return n;
+}
+
 static void tipsySetFunctions(fioTipsy *tio, int mFlags, int bStandard) {
     tio->fio.fcnGetAttr = tipsyGetAttr;
     tio->fio.fcnSpecies = tipsySpecies;
+    tio->fio.fcnReadDarkN = tipsyReadDarkN;
 
     tio->bDoubleVel = (mFlags&(FIO_FLAG_DOUBLE_VEL|FIO_FLAG_CHECKPOINT)) != 0;
     tio->bDoublePos = (mFlags&(FIO_FLAG_DOUBLE_POS|FIO_FLAG_CHECKPOINT)) != 0 || tio->bDoubleVel;
@@ -1891,6 +2055,24 @@ static void byteSwap(void *pvData,size_t size, size_t nmemb) {
     int i,j;
 
     assert(n*2==size);
+    if (size==sizeof(uint32_t)) {
+        uint32_t u;
+        for (i=0; i<nmemb; ++i) {
+            memcpy(&u,pData+i*size,size);
+            u = fioSwap32(u);
+            memcpy(pData+i*size,&u,size);
+        }
+        return;
+    }
+    else if (size==sizeof(uint64_t)) {
+        uint64_t u;
+        for (i=0; i<nmemb; ++i) {
+            memcpy(&u,pData+i*size,size);
+            u = fioSwap64(u);
+            memcpy(pData+i*size,&u,size);
+        }
+        return;
+    }
     for (i=0; i<nmemb; ++i) {
         for (j=0; j<n; ++j) {
             c = pData[j];
@@ -2275,6 +2457,78 @@ static int gadgetReadDark(FIO fio,
     return 1;
 }
 
+/*
+** Read a run of dark particles. Each GADGET block (IDs, positions, velocities,
+** masses) is read with a single fread for all of the particles of one type.
+*/
+static int gadgetReadDarkN(FIO fio,int n,fioDarkBlock *blk) {
+    fioGADGET *gio = (fioGADGET *)fio;
+    int nRead = 0, i, d, m;
+    void *pBuffer;
+
+    assert(fio->eFormat == FIO_FORMAT_GADGET2 && fio->eMode==FIO_MODE_READING);
+    pBuffer = malloc(3*sizeof(double)*n);
+    assert(pBuffer!=NULL);
+    while (nRead<n && gio->eCurrent==FIO_SPECIES_DARK && gio->eType<GADGET2_NTYPES) {
+        uint64_t nLeft = gio->hdr.Npart[gio->eType] - gio->iType;
+        double *dBuf = pBuffer;
+        float *fBuf = pBuffer;
+        uint32_t *iBuf = pBuffer;
+        fioDarkBlock sub = fioDarkBlockAt(blk,nRead);
+        m = n-nRead < nLeft ? n-nRead : nLeft;
+
+        if ( gio->fp_id.iDouble == sizeof(uint64_t)) {
+            if (freadSwap(sub.piParticleID, sizeof(uint64_t), m, gio->fp_id.fp,gio->bSwap)!=m) abort();
+        }
+        else if ( gio->fp_id.iDouble == sizeof(uint32_t)) {
+            if (freadSwap(iBuf, sizeof(uint32_t), m, gio->fp_id.fp,gio->bSwap)!=m) abort();
+            for (i=0; i<m; ++i) sub.piParticleID[i] = iBuf[i];
+        }
+        if (freadSwap(pBuffer, gio->fp_pos.iDouble, 3*m, gio->fp_pos.fp,gio->bSwap) != 3*m) abort();
+        for (d=0; d<3; ++d) {
+            if (gio->fp_pos.iDouble == sizeof(double)) for (i=0; i<m; ++i) sub.pdPos[d][i] = dBuf[3*i+d];
+            else for (i=0; i<m; ++i) sub.pdPos[d][i] = fBuf[3*i+d];
+        }
+        if (freadSwap(pBuffer, gio->fp_vel.iDouble, 3*m, gio->fp_vel.fp,gio->bSwap) != 3*m) abort();
+        for (d=0; d<3; ++d) {
+            if (gio->fp_vel.iDouble == sizeof(double)) for (i=0; i<m; ++i) sub.pdVel[d][i] = dBuf[3*i+d];
+            else for (i=0; i<m; ++i) sub.pdVel[d][i] = fBuf[3*i+d];
+        }
+        if ( gio->hdr.BoxSize > 0.0 ) {
+            for (d=0; d<3; ++d) {
+                for (i=0; i<m; ++i) {
+                    sub.pdPos[d][i] = sub.pdPos[d][i] * gio->pos_fac + gio->pos_off;
+                    sub.pdVel[d][i] = sub.pdVel[d][i] * gio->vel_fac;
+                }
+            }
+        }
+        if ( gio->hdr.Massarr[gio->eType] != 0.0 ) {
+            for (i=0; i<m; ++i) sub.pfMass[i] = gio->hdr.Massarr[gio->eType];
+        }
+        else {
+            if (freadSwap(pBuffer, gio->fp_mass.iDouble, m, gio->fp_mass.fp,gio->bSwap) != m) abort();
+            if ( gio->fp_mass.iDouble == sizeof(double)) for (i=0; i<m; ++i) sub.pfMass[i] = dBuf[i];
+            else for (i=0; i<m; ++i) sub.pfMass[i] = fBuf[i];
+        }
+        for (i=0; i<m; ++i) {
+            sub.pfMass[i] *= gio->mass_fac;
+            sub.pfSoft[i] = pow(gio->hdr.Omega0 / sub.pfMass[i],-1.0/3.0) / 50.0;
+            sub.pfPot[i] = 0.0f;
+            sub.pfDen[i] = 0.0f;
+        }
+        nRead += m;
+        gio->iType += m;
+        if ( gio->iType >= gio->hdr.Npart[gio->eType] ) {
+            while ( ++gio->eType < GADGET2_NTYPES)
+                if ( gio->hdr.Npart[gio->eType] ) break;
+            gio->iType = 0;
+            gio->eCurrent = FIO_SPECIES_DARK;
+        }
+    }
+    free(pBuffer);
+    return nRead;
+}
+
 static int gadgetReadSph(
     FIO fio,uint64_t *piParticleID,double *pdPos,double *pdVel,
     float *pfMass,float *pfSoft, float *pfPot,float *pfDen,
@@ -2525,6 +2779,7 @@ static FIO gadgetOpenOne(const char *fname,int iFile) {
     gio->fio.fcnSeek     = gadgetSeek;
     gio->fio.fcnReadDark = gadgetReadDark;
     gio->fio.fcnReadSph  = gadgetReadSph;
+    gio->fio.fcnReadDarkN= gadgetReadDarkN;
     /*gio->fio.fcnReadStar = gadgetReadStar;*/
     gio->fio.fcnGetAttr  = gadgetGetAttr;
     gio->fio.fcnSpecies  = gadgetSpecies;
@@ -3616,6 +3871,63 @@ static int hdf5ReadDark(
     return 1;
 }
 
+/*
+** Copy dark particles straight out of the buffered HDF5 chunks.
+*/
+static int hdf5ReadDarkN(FIO fio,int n,fioDarkBlock *blk) {
+    fioHDF5 *hio = (fioHDF5 *)(fio);
+    IOBASE *base = &hio->base[FIO_SPECIES_DARK];
+    IOFIELD *fldPos = &base->fldFields[DARK_POSITION];
+    IOFIELD *fldVel = &base->fldFields[DARK_VELOCITY];
+    IOFIELD *fldPot = &base->fldFields[DARK_POTENTIAL];
+    IOFIELD *fldDen = &base->fldFields[DARK_DENSITY];
+    int nRead = 0, i, d, m;
+
+    assert(fio->eFormat == FIO_FORMAT_HDF5);
+    if (hio->eCurrent != FIO_SPECIES_DARK) return 0;
+    assert(fldPos->memType == H5T_NATIVE_DOUBLE && fldVel->memType == H5T_NATIVE_DOUBLE);
+
+    while (nRead < n) {
+        if (base->iIndex == base->nBuffered && !base_read(hio,base)) break;
+        fioDarkBlock sub = fioDarkBlockAt(blk,nRead);
+        const double *pPos = (const double *)fldPos->pBuffer + 3*base->iIndex;
+        const double *pVel = (const double *)fldVel->pBuffer + 3*base->iIndex;
+        m = base->nBuffered - base->iIndex;
+        if (m > n-nRead) m = n-nRead;
+
+        for (d=0; d<3; ++d) {
+            for (i=0; i<m; ++i) {
+                sub.pdPos[d][i] = pPos[3*i+d];
+                sub.pdVel[d][i] = pVel[3*i+d];
+            }
+        }
+        if (field_isopen(fldPot)) memcpy(sub.pfPot,(const float *)fldPot->pBuffer + base->iIndex,m*sizeof(float));
+        else for (i=0; i<m; ++i) sub.pfPot[i] = 0.0f;
+        if (field_isopen(fldDen)) memcpy(sub.pfDen,(const float *)fldDen->pBuffer + base->iIndex,m*sizeof(float));
+        else for (i=0; i<m; ++i) sub.pfDen[i] = 0.0f;
+        for (i=0; i<m; ++i) {
+            sub.piParticleID[i] = ioorder_get(&base->ioOrder,base->iOffset,base->iIndex+i);
+            class_get(sub.pfMass+i,sub.pfSoft+i,&base->ioClass,sub.piParticleID[i],base->iIndex+i);
+        }
+        base->iIndex += m;
+        nRead += m;
+
+        /* At the end of the dark particles advance to the next species */
+        if ((base->iIndex+base->iOffset)==base->nTotal) {
+            for ( i=FIO_SPECIES_DARK+1; i<FIO_SPECIES_LAST; i++) {
+                IOBASE *next = &hio->base[i];
+                if ( next->nTotal ) {
+                    hio->eCurrent = i;
+                    next->iOffset = next->iIndex = next->nBuffered = 0;
+                    break;
+                }
+            }
+            break;
+        }
+    }
+    return nRead;
+}
+
 static int hdf5ReadSph(
     FIO fio,uint64_t *piParticleID,double *pdPos,double *pdVel,
     float *pfMass,float *pfSoft,float *pfPot,float *pfDen,
@@ -4344,6 +4656,7 @@ static FIO hdf5OpenOne(const char *fname,int iFile) {
     hio->fio.fcnClose    = hdf5Close;
     hio->fio.fcnSeek     = hdf5Seek;
     hio->fio.fcnReadDark = hdf5ReadDark;
+    hio->fio.fcnReadDarkN= hdf5ReadDarkN;
     hio->fio.fcnReadSph  = hdf5ReadSph;
     hio->fio.fcnReadStar = hdf5ReadStar;
     hio->fio.fcnReadBH   = hdf5ReadBH  ;
@@ -34,6 +34,7 @@
 **   fioReadDark - Reads a dark particle
 **   fioReadSph  - Reads an SPH particle
 **   fioReadStar - Reads a star particle
+**   fioReadDarkN- Reads a block of dark particles into arrays
 **
 ** Example (sequential read of all particles):
 **
@@ -151,6 +152,21 @@ typedef struct {
     fioSpeciesList nSpecies;    /* # of each species in this file */
 } fioFileInfo;
 
+/*
+** Structure of arrays filled by fioReadDarkN. Each array must have room for
+** the number of particles requested. Positions and velocities are stored by
+** component, so pdPos[1][i] is the y coordinate of particle i.
+*/
+typedef struct {
+    uint64_t *piParticleID;
+    double   *pdPos[3];
+    double   *pdVel[3];
+    float    *pfMass;
+    float    *pfSoft;
+    float    *pfPot;
+    float    *pfDen;
+} fioDarkBlock;
+
 typedef struct {
     int iFile;                /* Current file */
     int nFiles;               /* Total number of files */
@@ -188,6 +204,7 @@ typedef struct fioInfo {
                        uint64_t *piParticleID,double *pdPos,double *pdVel,
                        float *pfMass,float *pfSoft,float *pfPot,float *pfDen,
                        float *pfOtherData,float *pfTform);
+    int  (*fcnReadDarkN) (struct fioInfo *fio,int n,fioDarkBlock *blk);
 
     int  (*fcnWriteDark) (struct fioInfo *fio,
                           uint64_t iParticleID,const double *pdPos,const double *pdVel,
@@ -301,6 +318,13 @@ static inline int fioReadBH(
                              pfOtherData,pfTform);
 }
 /*
+** Read up to n dark particles starting at the current position. Reading stops
+** early when the dark particles are exhausted; the number read is returned.
+*/
+static inline int fioReadDarkN(FIO fio,int n,fioDarkBlock *blk) {
+    return (*fio->fcnReadDarkN)(fio,n,blk);
+}
+/*
 ** Write a particle.  Must already be positioned at the appropriate particle.
 */
 static inline int fioWriteDark(
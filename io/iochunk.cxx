@@ -26,6 +26,8 @@
 #include <sys/types.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <string.h>
 #include <algorithm>
 #include "iochunk.h"
 #include "iomodule.h"
@@ -44,6 +46,118 @@ void io_chunk_read(const char *filename, void *buffer, uint64_t nBytes, uint64_t
     io_free(&info);
 }
 
+// The destination is about to be completely overwritten, so ask for transparent huge pages
+// to cut down on the number of page faults (and TLB misses later on).
+static void advise_huge(void *buffer, uint64_t nBytes, uint64_t nPageSize) {
+#ifdef MADV_HUGEPAGE
+    auto iBeg = (reinterpret_cast<uintptr_t>(buffer) + nPageSize - 1) & ~(nPageSize-1);
+    auto iEnd = (reinterpret_cast<uintptr_t>(buffer) + nBytes) & ~(nPageSize-1);
+    if (iEnd > iBeg) madvise(reinterpret_cast<void *>(iBeg),iEnd-iBeg,MADV_HUGEPAGE);
+#endif
+}
+
+static void pread_all(int fd, const char *filename, char *p, uint64_t nBytes, uint64_t iOffset) {
+    while (nBytes) {
+        auto nRead = pread(fd,p,nBytes,iOffset);
+        if (nRead <= 0) {
+            fprintf(stderr,"Short read: ");
+            perror(filename);
+            abort();
+        }
+        p += nRead;
+        iOffset += nRead;
+        nBytes -= nRead;
+    }
+}
+
+void io_chunk_read_direct(const char *filename, void *buffer, uint64_t nBytes, uint64_t iOffset) {
+    constexpr uint64_t chunk = 64*1024*1024; // Number of bytes per request
+    uint64_t nPageSize = sysconf(_SC_PAGESIZE);
+    auto p = static_cast<char *>(buffer);
+
+    // O_DIRECT transfers must be aligned in memory and in the file. If the buffer and the
+    // file offset are not congruent then we cannot avoid a copy; use the buffered path.
+    if ((reinterpret_cast<uintptr_t>(p) - iOffset) % nPageSize) {
+        io_chunk_read(filename,buffer,nBytes,iOffset);
+        return;
+    }
+    advise_huge(buffer,nBytes,nPageSize);
+
+    // The partial pages at each end are read normally
+    uint64_t nHead = std::min(nBytes,(nPageSize - iOffset % nPageSize) % nPageSize);
+    uint64_t nTail = (nBytes - nHead) % nPageSize;
+    uint64_t nBody = nBytes - nHead - nTail;
+    if (nHead || nTail) {
+        auto fd = open(filename,O_RDONLY);
+        if (fd<0) {
+            perror(filename);
+            abort();
+        }
+        if (nHead) pread_all(fd,filename,p,nHead,iOffset);
+        if (nTail) pread_all(fd,filename,p+nHead+nBody,nTail,iOffset+nHead+nBody);
+        close(fd);
+    }
+    if (nBody==0) return;
+
+    // The aligned middle goes straight from storage to the destination with several requests in flight
+    asyncFileInfo info;
+    io_init(&info, IO_MAX_ASYNC_COUNT, 0, IO_AIO|IO_LIBAIO);
+    auto fd = io_open(&info,filename);
+    if (fd<0) {
+        perror(filename);
+        abort();
+    }
+    info.iFilePosition = iOffset + nHead;
+    if (lseek(fd,info.iFilePosition,SEEK_SET) != info.iFilePosition) {
+        perror("Seek error");
+        abort();
+    }
+    for (uint64_t i=0; i<nBody; i+=chunk) {
+        io_read(&info,p+nHead+i,std::min(chunk,nBody-i));
+    }
+    io_close(&info);
+    io_free(&info);
+}
+
+void io_chunk_read_mmap(const char *filename, void *buffer, uint64_t nBytes, uint64_t iOffset) {
+    constexpr uint64_t window = 64*1024*1024; // Number of bytes to map at a time
+    uint64_t nPageSize = sysconf(_SC_PAGESIZE);
+    auto p = static_cast<char *>(buffer);
+    auto fd = open(filename,O_RDONLY);
+    if (fd<0) {
+        perror(filename);
+        abort();
+    }
+    advise_huge(buffer,nBytes,nPageSize);
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd,iOffset,nBytes,POSIX_FADV_SEQUENTIAL);
+#endif
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    flags |= MAP_POPULATE;
+#endif
+    while (nBytes) {
+        auto nSkip = iOffset % nPageSize;
+        auto nCopy = std::min(nBytes,window);
+#ifdef POSIX_FADV_WILLNEED
+        // Start reading the next window while this one is copied
+        if (nBytes > nCopy) posix_fadvise(fd,iOffset+nCopy,std::min(nBytes-nCopy,window),POSIX_FADV_WILLNEED);
+#endif
+        auto map = mmap(nullptr,nCopy+nSkip,PROT_READ,flags,fd,iOffset-nSkip);
+        if (map==MAP_FAILED) {
+            perror(filename);
+            abort();
+        }
+        madvise(map,nCopy+nSkip,MADV_SEQUENTIAL);
+        memcpy(p,static_cast<char *>(map)+nSkip,nCopy);
+        munmap(map,nCopy+nSkip);
+        p += nCopy;
+        iOffset += nCopy;
+        nBytes -= nCopy;
+    }
+    close(fd);
+}
+
 void io_chunk_write(const char *filename, const void *buffer, uint64_t nBytes, bool bAppend) {
     auto fd = open(filename,O_WRONLY | (bAppend?O_APPEND:O_CREAT | O_TRUNC),0666);
     if (fd<0) {
@@ -3,6 +3,10 @@
 #include <stdint.h>
 
 void io_chunk_read(const char *filename, void *buffer, uint64_t nBytes, uint64_t iOffset=0);
+// Read directly into the buffer with O_DIRECT (no bounce buffer) when the buffer and file offset agree modulo the page size
+void io_chunk_read_direct(const char *filename, void *buffer, uint64_t nBytes, uint64_t iOffset=0);
+// Read by mapping the file a window at a time (prefaulted, sequential readahead)
+void io_chunk_read_mmap(const char *filename, void *buffer, uint64_t nBytes, uint64_t iOffset=0);
 void io_chunk_write(const char *filename, const void *buffer, uint64_t nBytes, bool bAppend=false);
 
 #endif /* A5ADF993_BA19_4C3E_B6C9_7FE3E709953D */
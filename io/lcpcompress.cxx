@@ -0,0 +1,240 @@
+/*  This file is part of PKDGRAV3 (http://www.pkdgrav.org/).
+ *  Copyright (c) 2001-2018 Joachim Stadel & Douglas Potter
+ *
+ *  PKDGRAV3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  PKDGRAV3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with PKDGRAV3.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FILE_OFFSET_BITS
+    #define _FILE_OFFSET_BITS 64
+#endif
+#ifndef _LARGEFILE_SOURCE
+    #define _LARGEFILE_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <numeric>
+#include "lcpcompress.h"
+#include "chkcompress.h"
+extern "C" {
+#include "core/healpix.h"
+}
+
+namespace lcpcompress {
+namespace {
+
+constexpr char file_magic[8] = "PKDLCPZ";
+constexpr uint32_t file_version = 1;
+constexpr uint32_t max_block_particles = 64*1024;
+
+// A particle as it is stored in a block, before the bytes are split into planes
+struct row {
+    uint64_t dId;       // Difference from the previous ID in the block
+    uint32_t q[3];      // Quantized position
+    float vel[3];
+    float pot;
+};
+static_assert(sizeof(row)==sizeof(particle));
+
+// Pack particles p[order[0..m)] (all in the same pixel) into out
+void encode_block(const particle *p,const uint32_t *order,uint32_t m,int64_t iPixel,double dQuantum,
+                  std::vector<row> &rows,std::vector<uint8_t> &planes,std::vector<uint8_t> &rans,std::vector<char> &out) {
+    block_header bh;
+    memset(&bh,0,sizeof(bh));
+    bh.iPixel = iPixel;
+    bh.nParticles = m;
+    double dRange = 0.0;
+    for (auto j=0; j<3; ++j) {
+        float fMin = p[order[0]].pos[j], fMax = fMin;
+        for (uint32_t i=1; i<m; ++i) {
+            fMin = std::min(fMin,p[order[i]].pos[j]);
+            fMax = std::max(fMax,p[order[i]].pos[j]);
+        }
+        bh.origin[j] = fMin;
+        dRange = std::max(dRange,double(fMax) - fMin);
+    }
+    bh.quantum = std::max(dQuantum,dRange / 4294967295.0);
+
+    rows.resize(m);
+    uint64_t iPrev = 0;
+    for (uint32_t i=0; i<m; ++i) {
+        auto &q = p[order[i]];
+        auto &r = rows[i];
+        r.dId = q.id - iPrev;
+        iPrev = q.id;
+        for (auto j=0; j<3; ++j) {
+            auto v = llround((q.pos[j] - bh.origin[j]) / bh.quantum);
+            r.q[j] = uint32_t(std::clamp<long long>(v,0,0xffffffffll));
+            r.vel[j] = q.vel[j];
+        }
+        r.pot = q.pot;
+    }
+
+    // One plane per byte of each column
+    constexpr auto nPlanes = sizeof(row);
+    auto pRows = reinterpret_cast<const uint8_t *>(rows.data());
+    planes.resize(size_t(m) * nPlanes);
+    for (uint32_t i=0; i<m; ++i)
+        for (uint32_t j=0; j<nPlanes; ++j)
+            planes[j*m + i] = pRows[i*nPlanes + j];
+    auto pHeader = reinterpret_cast<const char *>(&bh);
+    out.assign(pHeader,pHeader+sizeof(bh));
+    for (uint32_t j=0; j<nPlanes; ++j)
+        chkcompress::encode_plane(planes.data()+j*m,m,rans,out);
+}
+
+// Unpack a block and append the particles to out
+void decode_block(const char *in,const char *end,std::vector<uint8_t> &planes,std::vector<particle> &out) {
+    block_header bh;
+    if (end - in < ptrdiff_t(sizeof(bh))) {
+        fprintf(stderr,"Corrupt packed light cone block\n");
+        abort();
+    }
+    memcpy(&bh,in,sizeof(bh));
+    in += sizeof(bh);
+    auto m = bh.nParticles;
+    constexpr auto nPlanes = sizeof(row);
+    planes.resize(size_t(m) * nPlanes);
+    for (uint32_t j=0; j<nPlanes; ++j)
+        in = chkcompress::decode_plane(in,end,planes.data()+j*m,m);
+    row r;
+    auto pRow = reinterpret_cast<uint8_t *>(&r);
+    uint64_t iId = 0;
+    for (uint32_t i=0; i<m; ++i) {
+        for (uint32_t j=0; j<nPlanes; ++j) pRow[j] = planes[j*m + i];
+        particle q;
+        q.id = iId += r.dId;
+        for (auto j=0; j<3; ++j) {
+            q.pos[j] = bh.origin[j] + bh.quantum * r.q[j];
+            q.vel[j] = r.vel[j];
+        }
+        q.pot = r.pot;
+        out.push_back(q);
+    }
+}
+
+} // namespace
+
+writer::writer(const char *filename,int nSide,double dQuantum) : filename(filename) {
+    memset(&hdr,0,sizeof(hdr));
+    memcpy(hdr.magic,file_magic,sizeof(file_magic));
+    hdr.nVersion = file_version;
+    hdr.nSide = nSide;
+    hdr.dQuantum = dQuantum;
+    hdr.iIndexOffset = sizeof(hdr); // The blocks follow the header, then the index
+    fd = open(filename,O_WRONLY | O_CREAT | O_TRUNC,0666);
+    if (fd<0) {
+        perror(filename);
+        abort();
+    }
+}
+
+writer::~writer() {
+    if (thread.joinable()) thread.join();
+    if (fd>=0) ::close(fd);
+}
+
+// Sort the particles by pixel and ID, and write a block for each pixel
+void writer::write(particle *p,size_t n) {
+    std::vector<int64_t> pixel(n);
+    for (size_t i=0; i<n; ++i) {
+        double r[3] = {p[i].pos[0],p[i].pos[1],p[i].pos[2]};
+        pixel[i] = vec2pix_ring64(hdr.nSide,r);
+    }
+    std::vector<uint32_t> order(n);
+    std::iota(order.begin(),order.end(),0);
+    std::sort(order.begin(),order.end(),[&pixel,p](uint32_t a,uint32_t b) {
+        return pixel[a] < pixel[b] || (pixel[a] == pixel[b] && p[a].id < p[b].id);
+    });
+
+    std::vector<row> rows;
+    std::vector<uint8_t> planes, rans;
+    std::vector<char> out;
+    for (size_t i=0; i<n;) {
+        auto iPixel = pixel[order[i]];
+        uint32_t m = 0;
+        while (i+m < n && m < max_block_particles && pixel[order[i+m]] == iPixel) ++m;
+        encode_block(p,order.data()+i,m,iPixel,hdr.dQuantum,rows,planes,rans,out);
+        chkcompress::pwrite_all(fd,filename.c_str(),out.data(),out.size(),hdr.iIndexOffset);
+        blocks.push_back({iPixel,m,uint32_t(out.size()),hdr.iIndexOffset});
+        hdr.iIndexOffset += out.size();
+        hdr.nParticles += m;
+        i += m;
+    }
+}
+
+void writer::flush(particle *p,size_t n) {
+    if (thread.joinable()) thread.join();
+    if (n) thread = std::thread([this,p,n]() { write(p,n); });
+}
+
+void writer::close(particle *p,size_t n) {
+    flush(p,n);
+    if (thread.joinable()) thread.join();
+    // Blocks of the same pixel from different buffers stay in file order
+    std::stable_sort(blocks.begin(),blocks.end(),[](const index &a,const index &b) {return a.iPixel < b.iPixel;});
+    hdr.nBlocks = blocks.size();
+    chkcompress::pwrite_all(fd,filename.c_str(),blocks.data(),blocks.size()*sizeof(index),hdr.iIndexOffset);
+    chkcompress::pwrite_all(fd,filename.c_str(),&hdr,sizeof(hdr),0);
+    ::close(fd);
+    fd = -1;
+}
+
+bool read_header(const std::string &filename,header &hdr) {
+    auto fd = open(filename.c_str(),O_RDONLY);
+    if (fd<0) return false;
+    bool bPacked = chkcompress::pread_all(fd,&hdr,sizeof(hdr),0) && memcmp(hdr.magic,file_magic,sizeof(file_magic))==0;
+    close(fd);
+    if (bPacked && hdr.nVersion != file_version) {
+        fprintf(stderr,"%s: unsupported packed light cone version %u\n",filename.c_str(),hdr.nVersion);
+        abort();
+    }
+    return bPacked;
+}
+
+void read(const std::string &filename,int64_t iPixelBeg,int64_t iPixelEnd,std::vector<particle> &out) {
+    header hdr;
+    if (!read_header(filename,hdr)) {
+        fprintf(stderr,"%s: not a packed light cone file\n",filename.c_str());
+        abort();
+    }
+    std::vector<index> blocks(hdr.nBlocks);
+    auto fd = open(filename.c_str(),O_RDONLY);
+    if (fd<0 || !chkcompress::pread_all(fd,blocks.data(),blocks.size()*sizeof(index),hdr.iIndexOffset)) {
+        perror(filename.c_str());
+        abort();
+    }
+    auto first = std::lower_bound(blocks.begin(),blocks.end(),iPixelBeg,[](const index &b,int64_t i) {return b.iPixel < i;});
+    auto last  = std::lower_bound(first,blocks.end(),iPixelEnd,[](const index &b,int64_t i) {return b.iPixel < i;});
+    std::vector<char> data;
+    std::vector<uint8_t> planes;
+    for (auto b=first; b!=last; ++b) {
+        data.resize(b->nBytes);
+        if (!chkcompress::pread_all(fd,data.data(),data.size(),b->iOffset)) {
+            perror(filename.c_str());
+            abort();
+        }
+        decode_block(data.data(),data.data()+data.size(),planes,out);
+    }
+    close(fd);
+}
+
+} // namespace lcpcompress
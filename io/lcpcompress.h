@@ -0,0 +1,98 @@
+#ifndef E4B1C7A2_3F5D_4A8E_9C61_2D7B0F4E8A15
+#define E4B1C7A2_3F5D_4A8E_9C61_2D7B0F4E8A15
+/*  This file is part of PKDGRAV3 (http://www.pkdgrav.org/).
+ *  Copyright (c) 2001-2018 Joachim Stadel & Douglas Potter
+ *
+ *  PKDGRAV3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  PKDGRAV3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with PKDGRAV3.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <thread>
+
+// Packed light cone particle files.
+//
+// Each buffer of light cone particles is sorted by HEALPix pixel (ring scheme) and
+// then by particle ID, and each run of particles in the same pixel is written as a
+// block. Within a block the data is stored by column: ID deltas, positions quantized
+// relative to the corner of the block (it is a small piece of the shell that the
+// light cone crossed), velocities and potentials. Each byte of each column is stored
+// as a separate plane and entropy coded (see chkcompress::encode_plane). The file ends
+// with an index of the blocks sorted by pixel, so a patch of sky is read by reading
+// only the blocks of its pixels.
+namespace lcpcompress {
+
+struct particle {
+    uint64_t id;
+    float pos[3];
+    float vel[3];
+    float pot;
+};
+
+struct header {
+    char     magic[8];       // "PKDLCPZ"
+    uint32_t nVersion;
+    uint32_t nSide;          // HEALPix nside of the blocks (ring scheme)
+    uint64_t nParticles;
+    uint64_t nBlocks;
+    uint64_t iIndexOffset;   // Offset of index[nBlocks]
+    double   dQuantum;       // Requested position resolution
+};
+
+struct index {
+    int64_t  iPixel;
+    uint32_t nParticles;
+    uint32_t nBytes;
+    uint64_t iOffset;
+};
+
+struct block_header {
+    int64_t  iPixel;
+    uint32_t nParticles;
+    uint32_t reserved;
+    double   origin[3];      // Positions are origin + quantum * (uint32_t)
+    double   quantum;        // At least dQuantum; larger if the block is too big for 32 bits
+};
+
+// Writes the particles of one thread. Full buffers are packed and written by a
+// background thread, so the caller only waits if the previous buffer is not yet done.
+// The caller fills a second buffer in the meantime (double buffering).
+class writer {
+protected:
+    std::string filename;
+    int fd = -1;
+    header hdr;
+    std::vector<index> blocks;
+    std::thread thread;
+    void write(particle *p,size_t n);
+public:
+    writer(const char *filename,int nSide,double dQuantum);
+    ~writer();
+    // Starts writing the buffer. It is not modified (the particles are written in the
+    // order of a sorted index), but must not be touched until the next call to flush()
+    // or close() returns.
+    void flush(particle *p,size_t n);
+    // Writes the last buffer and the index, and closes the file
+    void close(particle *p,size_t n);
+};
+
+// Returns true (and the header) if the file is a packed light cone file
+bool read_header(const std::string &filename,header &hdr);
+
+// Read the particles in pixels [iPixelBeg,iPixelEnd) and append them to out
+void read(const std::string &filename,int64_t iPixelBeg,int64_t iPixelEnd,std::vector<particle> &out);
+
+} // namespace lcpcompress
+
+#endif /* E4B1C7A2_3F5D_4A8E_9C61_2D7B0F4E8A15 */
@@ -56,7 +56,7 @@ static int packGridK(void *vctx, int *id, size_t nSize, void *vBuff) {
     PKD pkd = ctx->pkd;
     if (mdlCore(pkd->mdl) == 0) {
         auto fftData = reinterpret_cast<COMPLEX *>(pkd->pLite) + ctx->iGrid * pkd->fft->kgrid->nLocal;
-        size_t nLocal = 1ul * pkd->fft->kgrid->a1 * pkd->fft->kgrid->n2 * pkd->fft->kgrid->nSlab;
+        size_t nLocal = mdlGridLocalCount(pkd->fft->kgrid);
         size_t nLeft = nLocal - ctx->iIndex;
         size_t n = nSize / sizeof(*fftData);
         if ( n > nLeft ) n = nLeft;
@@ -73,7 +73,7 @@ static int packGridR(void *vctx, int *id, size_t nSize, void *vBuff) {
     if (mdlCore(pkd->mdl) == 0) {
         auto fftData = reinterpret_cast<float *>(pkd->pLite) + ctx->iGrid * pkd->fft->rgrid->nLocal;
         auto pOutput = reinterpret_cast<float *>(vBuff);
-        size_t nLocal = 1ul * pkd->fft->rgrid->a1 * pkd->fft->rgrid->n2 * pkd->fft->rgrid->nSlab;
+        size_t nLocal = mdlGridLocalCount(pkd->fft->rgrid);
         size_t n = nSize / sizeof(*fftData);
         size_t iOutput = 0;
         while (ctx->iIndex < nLocal && iOutput + pkd->fft->rgrid->n1 <= n ) {
@@ -16,17 +16,38 @@
  */
 #include "restore.h"
 #include "io/iochunk.h"
+#include "io/chkcompress.h"
+#include "pkd_enumerations.h"
 
+void ServiceRestore::start(PST pst,uint64_t nElements,void *vin,int nIn) {
+    auto in = static_cast<input *>(vin);
+    iMethod = in->iMethod;
+}
 void ServiceRestore::Read(PST pst,uint64_t iElement,const std::string &filename,uint64_t iBeg,uint64_t iEnd) {
-    pst->plcl->pkd->Restore(iElement,filename,iBeg,iEnd);
+    pst->plcl->pkd->Restore(iElement,filename,iBeg,iEnd,iMethod);
 }
-void pkdContext::Restore(uint64_t iElement,const std::string &filename,uint64_t iBeg,uint64_t iEnd) {
+void pkdContext::Restore(uint64_t iElement,const std::string &filename,uint64_t iBeg,uint64_t iEnd,int iMethod) {
     void *pParticle = particles.Element(Local());
     auto iOffset = iBeg * particles.ParticleSize();
     auto nParts = iEnd-iBeg;
     auto nBytes = nParts * particles.ParticleSize();
     assert(iElement == Local());
     assert(Local()+nParts < FreeStore());
-    io_chunk_read(filename.c_str(), pParticle, nBytes, iOffset);
+    chkcompress::header hdr;
+    if (chkcompress::read_header(filename,hdr)) {
+        assert(hdr.nElementSize == particles.ParticleSize());
+        chkcompress::read(filename, pParticle, iBeg, iEnd);
+    }
+    else switch (RESTORE_IO(iMethod)) {
+        case RESTORE_IO::DIRECT: io_chunk_read_direct(filename.c_str(), pParticle, nBytes, iOffset); break;
+        case RESTORE_IO::MMAP:   io_chunk_read_mmap(filename.c_str(), pParticle, nBytes, iOffset);   break;
+        default:                 io_chunk_read(filename.c_str(), pParticle, nBytes, iOffset);
+        }
     AddLocal(nParts);
 }
+
+uint64_t ServiceCheckpointSizes::GetSize(const std::string &filename,uint64_t file_size) {
+    chkcompress::header hdr;
+    if (chkcompress::read_header(filename,hdr)) return hdr.nElements * hdr.nElementSize;
+    return file_size;
+}
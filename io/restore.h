@@ -22,9 +22,23 @@
 
 class ServiceRestore : public ServiceInput {
 public:
+    struct input {
+        int iMethod; // RESTORE_IO
+    };
     explicit ServiceRestore(PST pst)
-        : ServiceInput(pst,PST_RESTORE) {}
+        : ServiceInput(pst,PST_RESTORE,sizeof(input)) {}
     virtual void Read(PST pst,uint64_t iElement,const std::string &filename,uint64_t iBeg,uint64_t iEnd) override;
+    virtual void start(PST pst,uint64_t nElements,void *vin,int nIn) override;
+protected:
+    int iMethod = 0;
+};
+
+// Like ServiceFileSizes, but reports the uncompressed size of compressed checkpoints
+class ServiceCheckpointSizes : public ServiceFileSizes {
+public:
+    explicit ServiceCheckpointSizes(PST pst)
+        : ServiceFileSizes(pst,PST_CHECKPOINT_SIZES,"CheckpointSizes") {}
+    virtual uint64_t GetSize(const std::string &filename,uint64_t file_size) override;
 };
 
 #endif /* E5B60112_B4E2_46CB_AC8A_564BF342E5D3 */
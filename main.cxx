@@ -65,6 +65,7 @@
 #include "domains/freestore.h"
 #include "domains/olddd.h"
 #include "domains/reorder.h"
+#include "domains/sfcdd.h"
 #include "domains/getordsplits.h"
 
 #include "gravity/setsoft.h"
@@ -72,6 +73,7 @@
 #include "gravity/countrungs.h"
 #include "gravity/updaterung.h"
 #include "gravity/zeronewrung.h"
+#include "gravity/zerowork.h"
 
 time_t timeGlobalSignalTime = 0;
 int bGlobalOutput = 0;
@@ -122,6 +124,7 @@ void *worker_init(MDL vmdl) {
     mdl->AddService(std::make_unique<ServiceRemoveDeleted>(pst));
     mdl->AddService(std::make_unique<ServiceFileSizes>(pst));
     mdl->AddService(std::make_unique<ServiceRestore>(pst));
+    mdl->AddService(std::make_unique<ServiceCheckpointSizes>(pst));
     mdl->AddService(std::make_unique<ServiceCalcBound>(pst));
     mdl->AddService(std::make_unique<ServiceCombineBound>(pst));
     mdl->AddService(std::make_unique<ServiceDistribTopTree>(pst));
@@ -134,6 +137,7 @@ void *worker_init(MDL vmdl) {
     mdl->AddService(std::make_unique<ServiceCountRungs>(pst));
     mdl->AddService(std::make_unique<ServiceUpdateRung>(pst));
     mdl->AddService(std::make_unique<ServiceZeroNewRung>(pst));
+    mdl->AddService(std::make_unique<ServiceZeroWork>(pst));
     mdl->AddService(std::make_unique<ServiceGetOrdSplits>(pst));
 #ifdef HAVE_ROCKSTAR
     mdl->AddService(std::make_unique<ServiceRsHaloCount>(pst));
@@ -156,6 +160,8 @@ void *worker_init(MDL vmdl) {
     mdl->AddService(std::make_unique<OldDD::ServiceWeight>(pst));
     mdl->AddService(std::make_unique<OldDD::ServiceWeightWrap>(pst));
     mdl->AddService(std::make_unique<OldDD::ServiceOrdWeight>(pst));
+    mdl->AddService(std::make_unique<NewDD::ServiceSFCSample>(pst));
+    mdl->AddService(std::make_unique<NewDD::ServiceSFCExchange>(pst));
     return pst;
 }
 
@@ -100,11 +100,13 @@ namespace rockstar {
 #include "domains/dumptrees.h"
 #include "domains/olddd.h"
 #include "domains/reorder.h"
+#include "domains/sfcdd.h"
 #include "gravity/setsoft.h"
 #include "gravity/activerung.h"
 #include "gravity/countrungs.h"
 #include "gravity/updaterung.h"
 #include "gravity/zeronewrung.h"
+#include "gravity/zerowork.h"
 #ifdef STELLAR_EVOLUTION
     #include "stellarevolution/stellarevolution.h"
 #endif
@@ -296,6 +298,7 @@ uint64_t MSR::getMemoryModel() {
     }
     if (parameters.get_bDoDensity())       mMemoryModel |= PKD_MODEL_DENSITY;
     if (parameters.get_bMemIntegerPosition()) mMemoryModel |= PKD_MODEL_INTEGER_POS;
+    if (parameters.get_bMemHotFields())    mMemoryModel |= PKD_MODEL_HOT_FIELDS;
     if (parameters.get_bMemUnordered()&&parameters.get_bNewKDK()) mMemoryModel |= PKD_MODEL_UNORDERED;
     if (parameters.get_bMemParticleID())   mMemoryModel |= PKD_MODEL_PARTICLE_ID;
     if (parameters.get_bMemAcceleration() || parameters.get_bDoAccOutput()) mMemoryModel |= PKD_MODEL_ACCELERATION;
@@ -327,6 +330,7 @@ uint64_t MSR::getMemoryModel() {
 #endif
 
     if (parameters.get_bMemBall())             mMemoryModel |= PKD_MODEL_BALL;
+    if (parameters.get_bDomainWork())          mMemoryModel |= PKD_MODEL_WORK;
 
     return mMemoryModel;
 }
@@ -345,6 +349,9 @@ std::pair<int,int> MSR::InitializePStore(uint64_t *nSpecies,uint64_t mMemoryMode
     ps.nTreeBitsHi = parameters.get_nTreeBitsHi();
     ps.iCacheSize  = parameters.get_iCacheSize();
     ps.iCacheMaxInflight = parameters.get_iCacheMaxInflight();
+    ps.nSharedCacheSize = parameters.get_iSharedCacheSize();
+    ps.bCacheRMA = parameters.get_bCacheRMA();
+    ps.bCacheShm = parameters.get_bCacheShm();
     ps.iWorkQueueSize  = parameters.get_iWorkQueueSize();
     ps.fPeriod = parameters.get_dPeriod();
     ps.mMemoryModel = mMemoryModel | PKD_MODEL_VELOCITY;
@@ -352,12 +359,12 @@ std::pair<int,int> MSR::InitializePStore(uint64_t *nSpecies,uint64_t mMemoryMode
 
 #define SHOW(m) ((ps.mMemoryModel&PKD_MODEL_##m)?" " #m:"")
     print("Memory Models:{position}{unordered}{velocity}{acceleration}{potential}{groups}{mass}{density}{ball}{softening}{velsmooth}{mfm}{mfv}{new_sph}"
-          "{star}{particle_id}{bh}{globalgid}{node_moment}{node_accel}{node_vel}{node_sphbnds}{node_bnd}{node_vbnd}{node_bob}\n",
+          "{star}{particle_id}{bh}{globalgid}{hot_fields}{work}{node_moment}{node_accel}{node_vel}{node_sphbnds}{node_bnd}{node_vbnd}{node_bob}\n",
           "position"_a = parameters.get_bMemIntegerPosition() ? " INTEGER_POSITION" : " DOUBLE_POSITION",
           "unordered"_a = SHOW(UNORDERED), "velocity"_a = SHOW(VELOCITY), "acceleration"_a = SHOW(ACCELERATION), "potential"_a = SHOW(POTENTIAL),
           "groups"_a = SHOW(GROUPS), "mass"_a = SHOW(MASS), "density"_a = SHOW(DENSITY),
           "ball"_a = SHOW(BALL), "softening"_a = SHOW(SOFTENING), "velsmooth"_a = SHOW(VELSMOOTH), "mfm"_a = SHOW(MFM), "mfv"_a = SHOW(MFV), "new_sph"_a = SHOW(NEW_SPH),
-          "star"_a = SHOW(STAR), "particle_id"_a = SHOW(PARTICLE_ID), "bh"_a = SHOW(BH), "globalgid"_a = SHOW(GLOBALGID),
+          "star"_a = SHOW(STAR), "particle_id"_a = SHOW(PARTICLE_ID), "bh"_a = SHOW(BH), "globalgid"_a = SHOW(GLOBALGID), "hot_fields"_a = SHOW(HOT_FIELDS), "work"_a = SHOW(WORK),
           "node_moment"_a = SHOW(NODE_MOMENT), "node_accel"_a = SHOW(NODE_ACCEL), "node_vel"_a = SHOW(NODE_VEL), "node_sphbnds"_a = SHOW(NODE_SPHBNDS),
           "node_bnd"_a = SHOW(NODE_BND), "node_vbnd"_a = SHOW(NODE_VBND), "node_bob"_a = SHOW(NODE_BOB));
 #undef SHOW
@@ -375,9 +382,11 @@ std::pair<int,int> MSR::InitializePStore(uint64_t *nSpecies,uint64_t mMemoryMode
     e |= EphemeralMemory(8);
 #endif
     // We need one grid to measure P(k); two if we are interlacing
-    e |= EphemeralMemory(mdl,parameters.get_nGridPk(),parameters.get_bPkInterlace() ? 2 : 1);
+    e |= EphemeralMemory(mdl,parameters.get_nGridPk(),(parameters.get_bPkInterlace() ? 2 : 1) * PkFoldGroup());
     // Add some ephemeral memory (if needed) for the linGrid. 3 grids are stored : forceX, forceY, forceZ
     e |= EphemeralMemory(mdl,parameters.get_nGridLin(),3);
+    // The TreePM mesh force also needs three grids
+    e |= EphemeralMemory(mdl,parameters.get_nGridPM(),3);
 
     // Check all registered Python analysis routines and account for their memory requirements
     for ( msr_analysis_callback &i : analysis_callbacks) {
@@ -427,7 +436,7 @@ int64_t MSR::parallel_write_count() {
     return parallel_count(parameters.get_bParaWrite(),parameters.get_nParaWrite());
 }
 
-void MSR::stat_files(std::vector<uint64_t> &counts,const std::string_view &filename_template, uint64_t element_size) {
+void MSR::stat_files(std::vector<uint64_t> &counts,const std::string_view &filename_template, uint64_t element_size,int service_id) {
     ServiceFileSizes::input hdr;
 
     strncpy(hdr.filename,filename_template.data(),sizeof(hdr.filename));
@@ -436,7 +445,7 @@ void MSR::stat_files(std::vector<uint64_t> &counts,const std::string_view &filen
     hdr.nElementSize = 1;
 
     auto out = new ServiceFileSizes::output[ServiceFileSizes::max_files];
-    auto n = mdl->RunService(PST_FILE_SIZES,sizeof(hdr),&hdr,out);
+    auto n = mdl->RunService(service_id,sizeof(hdr),&hdr,out);
     n /= sizeof(ServiceFileSizes::output);
     counts.resize(n);
 
@@ -452,7 +461,7 @@ void MSR::Restore(const std::string &baseName,int nSizeParticle) {
     std::string filename_template = baseName + ".{i}";
     TimerStart(TIMER_NONE);
     print("Scanning Checkpoint files...\n");
-    stat_files(counts,filename_template,nSizeParticle);
+    stat_files(counts,filename_template,nSizeParticle,PST_CHECKPOINT_SIZES);
     TimerStop(TIMER_NONE);
     auto dsec = TimerGet(TIMER_NONE);
     print("... identified {} particles in {} files, Wallclock: {:.5f} secs.\n",
@@ -462,10 +471,13 @@ void MSR::Restore(const std::string &baseName,int nSizeParticle) {
     using mdl::ServiceBuffer;
     ServiceBuffer msg {
         ServiceBuffer::Field<ServiceInput::input>(),
-        ServiceBuffer::Field<ServiceInput::io_elements>(counts.size())
+        ServiceBuffer::Field<ServiceInput::io_elements>(counts.size()),
+        ServiceBuffer::Field<ServiceRestore::input>()
     };
     auto hdr = static_cast<ServiceInput::input *>(msg.data(0));
     auto elements = static_cast<ServiceInput::io_elements *>(msg.data(1));
+    auto in = static_cast<ServiceRestore::input *>(msg.data(2));
+    in->iMethod = int(parameters.get_iRestoreIO());
     hdr->nFiles = counts.size();
     hdr->nElements = std::accumulate(counts.begin(),counts.end(),uint64_t(0));
     std::copy(counts.begin(),counts.end(),elements);
@@ -475,7 +487,13 @@ void MSR::Restore(const std::string &baseName,int nSizeParticle) {
     hdr->io.nSimultaneous = parallel_read_count();
     hdr->io.nSegment = hdr->io.iThread = 0; // setup later
     hdr->io.iReaderWriter = 0;
+    TimerStart(TIMER_NONE);
     mdl->RunService(PST_RESTORE,msg);
+    TimerStop(TIMER_NONE);
+    dsec = TimerGet(TIMER_NONE);
+    double dGB = 1.0 * hdr->nElements * nSizeParticle / (1024.0*1024.0*1024.0);
+    if (dsec > 0.0) print("... restored {:.4} GB, Wallclock: {:.5f} secs ({:.3} GB/s, {:.3} GB/s per rank)\n",
+                              dGB, dsec, dGB/dsec, dGB/dsec/mdl->Procs());
 }
 
 template<>
@@ -647,7 +665,8 @@ void MSR::Restart(const char *filename,PyObject *kwargs,
         if (rate > 10000) { rate /= 1024;   units = "KB"; }
         if (rate > 10000) { rate /= 1024;   units = "MB"; }
         if (rate > 10000) { rate /= 1024;   units = "GB"; }
-        print_detail("Checkpoint Restart Complete @ a={a:g}, Wallclock: {seconds:.5} secs ({rate:.2} {units}/s)\n", "a"_a=dExp, "seconds"_a=dsec, "rate"_a=rate, "units"_a=units);
+        double rank_rate = N*nSizeParticle / dsec / mdl->Procs() / (1024.0*1024.0*1024.0);
+        print_detail("Checkpoint Restart Complete @ a={a:g}, Wallclock: {seconds:.5} secs ({rate:.2} {units}/s, {rank_rate:.3} GB/s per rank)\n", "a"_a=dExp, "seconds"_a=dsec, "rate"_a=rate, "units"_a=units, "rank_rate"_a=rank_rate);
     }
     else print_detail("Checkpoint Restart Complete @ a={a:g}, Wallclock: {seconds:.5} secs\n\n","a"_a=dExp,"seconds"_a=dsec);
 
@@ -779,7 +798,9 @@ void MSR::writeParameters(const std::string &baseName,int iStep,int nSteps,doubl
     Py_DECREF(species_list);
     Py_DECREF(classes_list);
     Py_DECREF(analysis_list);
+}
 
+void MSR::writeRestartFile(const std::string &baseName) {
     // ******************************************************************
     // Write the restart file
     // ******************************************************************
@@ -796,11 +817,35 @@ void MSR::writeParameters(const std::string &baseName,int iStep,int nSteps,doubl
 void MSR::Checkpoint(int iStep,int nSteps,double dTime,double dDelta) {
     struct inWrite in;
     double dsec;
+    bool bAsync = parameters.get_bAsyncCheckpoint();
+
+    /* A previous asynchronous checkpoint must be on disk before we start another */
+    CheckpointWait();
 
     auto filename = BuildCpName(iStep,".chk");
     assert(filename.size() < sizeof(in.achOutFile));
     strcpy(in.achOutFile,filename.c_str());
-    in.nProcessors = parallel_write_count();
+    /* Staging is a memory copy so every rank can do it at once; the writes that follow are still limited */
+    in.nProcessors = bAsync ? nThreads : parallel_write_count();
+    in.nWriters = parallel_write_count();
+    in.bAsync = bAsync;
+    in.bCompress = parameters.get_bCompressCheckpoint();
+    in.achBaseFile[0] = 0;
+    auto nIncremental = parameters.get_iIncrementalCheckpoints();
+    bool bReorder = in.bCompress && nIncremental > 0;
+    if (bReorder) {
+        /* Differences are taken block by block so particles must be in the same order each time */
+        Reorder();
+        if (!achCheckpointBase.empty() && nIncrementalCheckpoints < nIncremental) {
+            assert(achCheckpointBase.size() < sizeof(in.achBaseFile));
+            strcpy(in.achBaseFile,achCheckpointBase.c_str());
+            ++nIncrementalCheckpoints;
+        }
+        else {
+            achCheckpointBase = filename;
+            nIncrementalCheckpoints = 0;
+        }
+    }
     if (csm->val.bComove) {
         double dExp = csmTime2Exp(csm,dTime);
         print_detail("Writing checkpoint for Step: {step} Time:{time:g} Redshift:{z:g}\n",
@@ -814,6 +859,15 @@ void MSR::Checkpoint(int iStep,int nSteps,double dTime,double dDelta) {
 
     pstCheckpoint(pst,&in,sizeof(in),NULL,0);
 
+    /*
+    ** The particles have left their domains, so restore them and the tree as
+    ** after an output (the checkpoint has already been staged or written).
+    */
+    if (bReorder) {
+        DomainDecomp();
+        BuildTree(parameters.get_bEwald());
+    }
+
     writeParameters(filename,iStep,nSteps,dTime,dDelta);
 
     /* This is not necessary, but it means the bounds will be identical upon restore */
@@ -821,7 +875,30 @@ void MSR::Checkpoint(int iStep,int nSteps,double dTime,double dDelta) {
 
     TimerStop(TIMER_IO);
     dsec = TimerGet(TIMER_IO);
-    print_detail("Checkpoint has been successfully written, Wallclock: {seconds:.5} secs.\n","seconds"_a=dsec);
+    if (bAsync) {
+        /* The restart file is only written once all of the particles are on disk */
+        achPendingCheckpoint = filename;
+        print_detail("Checkpoint has been staged for writing, Wallclock: {seconds:.5} secs.\n","seconds"_a=dsec);
+    }
+    else {
+        writeRestartFile(filename);
+        print_detail("Checkpoint has been successfully written, Wallclock: {seconds:.5} secs.\n","seconds"_a=dsec);
+    }
+}
+
+/*
+** Wait for an outstanding asynchronous checkpoint to finish and then write
+** the restart file that makes it usable.
+*/
+void MSR::CheckpointWait() {
+    if (achPendingCheckpoint.empty()) return;
+    TimerStart(TIMER_IO);
+    pstCheckpointWait(pst,NULL,0,NULL,0);
+    writeRestartFile(achPendingCheckpoint);
+    achPendingCheckpoint.clear();
+    TimerStop(TIMER_IO);
+    auto dsec = TimerGet(TIMER_IO);
+    print_detail("Checkpoint has been successfully written, Wait: {seconds:.5} secs.\n","seconds"_a=dsec);
 }
 
 void MSR::SetDerivedParameters(bool bRestart) {
@@ -1242,6 +1319,7 @@ void MSR::DomainDecompOld(int iRung) {
 
     in.bDoRootFind = 1;
     in.bDoSplitDimFind = 1;
+    in.bSplitWork = parameters.get_bDomainWork();
     if (iRung > 0) {
         /*
         ** All of this could be calculated once for the case that the number
@@ -1439,8 +1517,81 @@ void MSR::DomainDecompOld(int iRung) {
     }
 }
 
+/*
+** Peano-Hilbert domain decomposition (see domains/sfcdd.h).
+*/
+void MSR::DomainDecompSFC(int iRung) {
+    using mdl::ServiceBuffer;
+    using mdl::ServiceBufferOut;
+    Bound bnd;
+    double dsec;
+
+    if (iRung > 0) {
+        uint64_t nActive = 0;
+        for (auto i=iRung; i<=iCurrMaxRung; ++i) nActive += nRung[i];
+        if (nActive < N*parameters.get_dFracNoDomainDecomp()) {
+            if (parameters.get_bVRungStat()) {
+                print("Skipping Domain Decomposition (nActive = {}/{}, iRung:{})\n",nActive,N,iRung);
+            }
+            return;  /* do absolutely nothing! */
+        }
+    }
+
+    auto period = parameters.get_dPeriod();
+    if (parameters.get_bPeriodic() && blitz::all(period < FLOAT_MAXVAL)) {
+        Bound::coord_type offset(0.5*period);
+        bnd = Bound(fCenter-offset,fCenter+offset);
+        mdl->RunService(PST_ENFORCEPERIODIC,sizeof(bnd),&bnd);
+    }
+    else CalcBound(bnd);
+    SetClasses();
+
+    print_detail("Peano-Hilbert Domain Decomposition... \n");
+    TimerStart(TIMER_DOMAIN);
+
+    NewDD::ServiceSFCSample::input in;
+    in.bnd = bnd;
+    in.bWork = parameters.get_bDomainWork();
+    ServiceBufferOut samples {
+        ServiceBufferOut::Field<NewDD::SFCSampleOutput>(nThreads)
+    };
+    ServiceBuffer msg {
+        ServiceBuffer::Field<NewDD::ServiceSFCExchange::input>(),
+        ServiceBuffer::Field<uint64_t>(nThreads+1)
+    };
+    auto pExchange = static_cast<NewDD::ServiceSFCExchange::input *>(msg.data(0));
+    pExchange->bnd = bnd;
+    /*
+    ** Normally the splits are kept (or recut once) and only particles that have
+    ** crossed a boundary move. The samples are only approximate when the particles
+    ** are not yet in their domains (e.g., at the start) so we then sample again.
+    */
+    for (auto iPass=0; iPass<3; ++iPass) {
+        mdl->RunService(PST_SFCSAMPLE,sizeof(in),&in,samples);
+        bool bChanged;
+        try {
+            bChanged = NewDD::SFCSplits(static_cast<NewDD::SFCSampleOutput *>(samples.data()),nThreads,
+                                        parameters.get_dDomainSFCImbalance(),sfcSplit);
+        }
+        catch (std::overflow_error &e) {
+            print_error("ERROR: {}; increase the particle store (dExtraStore)\n",e.what());
+            abort();
+        }
+        if (iPass > 0 && !bChanged) break;
+        std::copy(sfcSplit.begin(),sfcSplit.end(),static_cast<uint64_t *>(msg.data(1)));
+        Bound bndDomains;
+        mdl->RunService(PST_SFCEXCHANGE,msg,&bndDomains);
+        if (!bChanged) break;
+    }
+
+    TimerStop(TIMER_DOMAIN);
+    dsec = TimerGet(TIMER_DOMAIN);
+    print("Domain Decomposition complete, Wallclock: {:.5} secs\n\n",dsec);
+}
+
 void MSR::DomainDecomp(int iRung) {
-    DomainDecompOld(iRung);
+    if (parameters.get_bDomainSFC()) DomainDecompSFC(iRung);
+    else DomainDecompOld(iRung);
 }
 
 /*
@@ -1475,6 +1626,8 @@ void MSR::BuildTree(int bNeedEwald,uint32_t uRoot,uint32_t utRoot) {
     in.uRoot = uRoot;
     in.utRoot = utRoot;
     in.ddHonHLimit = ddHonHLimit;
+    in.nThreads = parameters.get_nTreeThreads();
+    in.bSort = parameters.get_bTreeSort();
     TimerStart(TIMER_TREE);
     nTopTree = pstBuildTree(pst,&in,sizeof(in),pkdn,nTopTree);
     pDistribTop->nTop = nTopTree / pkd->NodeSize();
@@ -2106,9 +2259,23 @@ uint8_t MSR::Gravity(uint8_t uRungLo, uint8_t uRungHi,int iRoot1,int iRoot2,
     in.bPeriodic = parameters.get_bPeriodic();
     in.bEwald = bEwald;
     in.bGPU = parameters.get_bGPU();
+    in.bCompactILP = parameters.get_bMemCompactILP();
     in.dEwCut = parameters.get_dEwCut();
     in.dEwhCut = parameters.get_dEwhCut();
     in.nReps = in.bPeriodic ? parameters.get_nReplicas() : 0;
+    in.nEwTable = parameters.get_nEwaldTable();
+    /*
+    ** With TreePM the tree only provides the short-range force: no Ewald,
+    ** and the nearest replicas are enough to cover the cut-off radius.
+    */
+    in.dPMrs = in.dPMCut = 0.0;
+    if (parameters.get_nGridPM() > 0) {
+        in.dPMrs = parameters.get_dPMSplit() * parameters.get_dPeriod()[0] / parameters.get_nGridPM();
+        in.dPMCut = parameters.get_dPMCut() * in.dPMrs;
+        in.bEwald = 0;
+        in.bGPU = 0;
+        in.nReps = 1;
+    }
 
     // Parameters related to timestepping
     in.ts.iTimeStepCrit = iTimeStepCrit;
@@ -2230,11 +2397,15 @@ uint8_t MSR::Gravity(uint8_t uRungLo, uint8_t uRungHi,int iRoot1,int iRoot2,
         PrintStat(outr.sFlop,          "  Gflop     load:",1);
         PrintStat(outr.sPart,          "  P-P per active:",2);
         PrintStat(outr.sCell,          "  P-C per active:",2);
+        PrintStat(outr.sWorkArena,     " work arena (MB):",2);
+        PrintStat(outr.sWorkPeak,      "  in flight (MB):",2);
+        print("  work units: {}, arena allocations: {}\n",outr.nWorkUnits,outr.nWorkArenaGrow);
 #ifdef INSTRUMENT
         PrintStat(outr.sComputing,     "     % computing:",3);
         PrintStat(outr.sWaiting,       "     %   waiting:",3);
         PrintStat(outr.sSynchronizing, "     %   syncing:",3);
 #endif
+        if (outr.sCommBusy.n) PrintStat(outr.sCommBusy, "   % comm thread:",2);
 #ifdef __linux__
         PrintStat(outr.sFreeMemory,    "free memory (GB):", 3);
         PrintStat(outr.sRSS,           "   resident size:",3);
@@ -2244,6 +2415,10 @@ uint8_t MSR::Gravity(uint8_t uRungLo, uint8_t uRungHi,int iRoot1,int iRoot2,
         PrintStat(outr.sCellNumAccess, "  C-cache access:",1);
         PrintStat(outr.sPartMissRatio, "  P-cache miss %:",2);
         PrintStat(outr.sCellMissRatio, "  C-cache miss %:",2);
+        PrintStat(outr.sPartSharedRatio,"  P-miss shared%:",2);
+        PrintStat(outr.sCellSharedRatio,"  C-miss shared%:",2);
+        if (in.nEwTable > 0 && in.bEwald && in.bPeriodic)
+            print("  Ewald table max relative force error: {:.3e}\n",outr.dEwaldTableError);
     }
     if (outr.nTilesTotal > 0) {
         print("Total tiles processed: {:.5e}, on the GPU: {:.5e}, ratio: {:.2f} %\n",(double)outr.nTilesTotal,(double)(outr.nTilesTotal - outr.nTilesCPU),100.0 - ((double)outr.nTilesCPU)/((double)outr.nTilesTotal)*100.0);
@@ -2497,6 +2672,16 @@ void MSR::ZeroNewRung(uint8_t uRungLo, uint8_t uRungHi, int uRung) {
     mdl->RunService(PST_ZERONEWRUNG,sizeof(in),&in);
 }
 
+/*
+** The work used by the domain decomposition is that measured over the last full
+** step. Every force and smoothing evaluation adds to the work of the current step;
+** at the start of the next step (before its rung 0 decomposition) that becomes the
+** last work, so the substep decompositions see the whole step and not part of it.
+*/
+void MSR::ZeroWork() {
+    if (parameters.get_bDomainWork()) mdl->RunService(PST_ZEROWORK);
+}
+
 /*
  * bGreater = 1 => activate all particles at this rung and greater.
  */
@@ -2665,6 +2850,8 @@ void MSR::LightConeOpen(int iStep) {
         }
         else lc.achOutFile[0] = 0;
         lc.nSideHealpix = parameters.get_nSideHealpix();
+        lc.nSidePacked = parameters.get_bLightConePacked() ? parameters.get_nSideLCP() : 0;
+        lc.dQuantumPacked = parameters.get_dQuantumLCP();
         pstLightConeOpen(pst,&lc,sizeof(lc),NULL,0);
     }
 }
@@ -2857,6 +3044,7 @@ int MSR::NewTopStepKDK(
         BuildTreeActive(bEwald,iRungDT);
     }
     else {
+        if (!uRung) ZeroWork();
         DomainDecomp(uRung);
         uRoot2 = 0;
 
@@ -2914,6 +3102,9 @@ int MSR::NewTopStepKDK(
             LinearKick(dTime,dDelta,1,bKickOpen);
             GridDeleteFFT();
         }
+#ifdef MDL_FFTW
+        if (parameters.get_nGridPM() > 0) MeshKick(dTime,dDelta,1,bKickOpen);
+#endif
 
         if (parameters.get_bFindGroups()) NewFof(parameters.get_dTau(),parameters.get_nMinMembers());
     }
@@ -3147,6 +3338,7 @@ void MSR::TopStepKDK(
 #endif
 
         ActiveRung(iKickRung,1);
+        if (!iKickRung) ZeroWork();
         DomainDecomp(iKickRung);
         if (parameters.get_bAddDelete()) RemoveDeleted();
         BuildTree(bEwald);
@@ -3549,6 +3741,9 @@ void MSR::NewFof(double dTau,int nMinMembers) {
     in.bPeriodic = parameters.get_bPeriodic();
     in.nReplicas = in.bPeriodic ? parameters.get_nReplicas() : 0;
     in.nBucket = parameters.get_nBucket();
+    in.bUnionFind = parameters.get_bFofUnionFind();
+    in.nThreads = parameters.get_nTreeThreads();
+    in.bDomainSFC = parameters.get_bDomainSFC();
 
     if (parameters.get_bVStep()) {
         print("Running FoF with linking length %g\n", dTau);
@@ -3563,14 +3758,17 @@ void MSR::NewFof(double dTau,int nMinMembers) {
         print("Initial FoF calculation complete in {:.5f} secs\n", dsec);
 
     TimerStart(TIMER_NONE);
-    i = 0;
-    do {
-        ++i;
-        assert(i<100);
-        pstFofPhases(pst,NULL,0,&out,sizeof(out));
-        if (parameters.get_bVStep())
-            print("... {} iteration{}\n", i, i==1?"":"s");
-    } while ( out.bMadeProgress );
+    if (in.bUnionFind) pstFofResolveLinks(pst,NULL,0,NULL,0);
+    else {
+        i = 0;
+        do {
+            ++i;
+            assert(i<100);
+            pstFofPhases(pst,NULL,0,&out,sizeof(out));
+            if (parameters.get_bVStep())
+                print("... {} iteration{}\n", i, i==1?"":"s");
+        } while ( out.bMadeProgress );
+    }
 
     TimerStop(TIMER_NONE);
     dsec = TimerGet(TIMER_NONE);
@@ -3973,6 +4171,16 @@ void MSR::OutputGrid(const char *filename, bool k, int iGrid, int nParaWrite) {
     print_detail("Grid has been successfully written, Wallclock: {seconds:.5} secs.\n\n", "seconds"_a=dsec);
 }
 
+// The number of P(k) foldings that are measured together (one or two grids each)
+int MSR::PkFoldGroup() {
+    int nFolds = parameters.has_nFoldPk() ? parameters.get_nFoldPk().size() : 1;
+    nFolds = std::min(nFolds,int(parameters.get_nPkFoldGroup()));
+#ifdef MDL_FFTW
+    nFolds = std::min(nFolds,PST_MAX_PK_FOLDS);
+#endif
+    return std::max(nFolds,1);
+}
+
 #ifdef MDL_FFTW
 void MSR::OutputPk(int iStep,double dTime) {
     double a, z, vfact, kfact;
@@ -3997,8 +4205,18 @@ void MSR::OutputPk(int iStep,double dTime) {
     if (parameters.has_nFoldPk()) nFoldPk = parameters.get_nFoldPk();
     else nFoldPk.push_back(1);
 
-    for (auto fold : nFoldPk) {
-        auto [nPk,fK,fPk,fPkAll] = MeasurePk(int(parameters.get_iPkOrder()),parameters.get_bPkInterlace(),nGridPk,a,nBinsPk,fold);
+    // Several foldings can be measured at once, each with its own grid(s)
+    std::vector<std::tuple<std::vector<uint64_t>,std::vector<float>,std::vector<float>,std::vector<float>>> measured;
+    std::size_t nGroup = PkFoldGroup();
+    for (std::size_t iFold=0; iFold<nFoldPk.size(); iFold+=nGroup) {
+        std::vector<int> folds(nFoldPk.begin()+iFold,nFoldPk.begin()+std::min(iFold+nGroup,nFoldPk.size()));
+        auto group = MeasurePkGrids(int(parameters.get_iPkOrder()),parameters.get_bPkInterlace(),nGridPk,a,nBinsPk,folds);
+        measured.insert(measured.end(),group.begin(),group.end());
+    }
+
+    for (std::size_t iFold=0; iFold<nFoldPk.size(); ++iFold) {
+        auto fold = nFoldPk[iFold];
+        auto &[nPk,fK,fPk,fPkAll] = measured[iFold];
 
         filename = BuildName(iStep,".pk");
         if (nFoldPk.size() > 1) filename = fmt::format("{name}.{fold}","name"_a=filename,"fold"_a=fold);
@@ -4720,38 +4938,50 @@ void MSR::GridDeleteFFT() {
     pstGridDeleteFFT(pst, NULL, 0, NULL, 0);
 }
 
-/* Important: call msrGridCreateFFT() before, and msrGridDeleteFFT() after */
 std::tuple<std::vector<uint64_t>,std::vector<float>,std::vector<float>,std::vector<float>> // nPk, fK, fPk, fPkAll
 MSR::MeasurePk(int iAssignment,int bInterlace,int nGrid,double a,int nBins, int fold) {
-    std::vector<uint64_t> nPk;
-    std::vector<float> fK, fPk, fPkAll;
+    return MeasurePkGrids(iAssignment,bInterlace,nGrid,a,nBins,std::vector<int> {fold}).front();
+}
+
+/*
+** Measure P(k) for one or more foldings at once. The mass is assigned to all of
+** the grids (two per fold when interlacing) in a single pass over the particles,
+** the FFTs are done back-to-back, and the interlacing, window correction and
+** binning are done in a single sweep over k-space.
+*/
+std::vector<std::tuple<std::vector<uint64_t>,std::vector<float>,std::vector<float>,std::vector<float>>> // nPk, fK, fPk, fPkAll for each fold
+MSR::MeasurePkGrids(int iAssignment,int bInterlace,int nGrid,double a,int nBins,const std::vector<int> &folds) {
+    std::vector<std::tuple<std::vector<uint64_t>,std::vector<float>,std::vector<float>,std::vector<float>>> result;
     double dsec;
+    int nFolds = folds.size();
 
     GridCreateFFT(nGrid);
 
     if (nGrid/2 < nBins) nBins = nGrid/2;
     assert(nBins <= PST_MAX_K_BINS);
+    assert(nFolds>0 && nFolds<=PST_MAX_PK_FOLDS);
 
     TimerStart(TIMER_NONE);
-    print("Measuring P(k) with grid size {grid} ({bins} bins)...\n", "grid"_a = nGrid, "bins"_a = nBins);
-
-    AssignMass(iAssignment,0,0.0,fold);
-    DensityContrast(0);
-    if (bInterlace) {
-        AssignMass(iAssignment,1,0.5,fold);
-        DensityContrast(1);
-        Interlace(0,1); // We no longer need grid 1
-    }
-    WindowCorrection(iAssignment,0);
-
-    std::tie(nPk,fK,fPk) = GridBinK(nBins,0);
-    if (csm->val.classData.bClass && parameters.get_nGridLin()>0 && parameters.get_achPkSpecies().length() > 0) {
-        AddLinearSignal(0,parameters.get_iSeed(),parameters.get_dBoxSize(),a,
-                        parameters.get_bFixedAmpIC(),parameters.get_dFixedAmpPhasePI() * M_PI);
-        std::tie(nPk,fK,fPkAll) = GridBinK(nBins,0);
-    }
-    else {
-        fPkAll.resize(nBins);
+    print("Measuring P(k) with grid size {grid} ({bins} bins, {folds} folds)...\n",
+          "grid"_a = nGrid, "bins"_a = nBins, "folds"_a = nFolds);
+
+    AssignMassGrids(iAssignment,folds,bInterlace);
+    auto binned = GridBinKGrids(nBins,iAssignment,nFolds,bInterlace);
+
+    bool bLinear = csm->val.classData.bClass && parameters.get_nGridLin()>0 && parameters.get_achPkSpecies().length() > 0;
+    for (auto f=0; f<nFolds; ++f) {
+        auto &[nPk,fK,fPk] = binned[f];
+        std::vector<float> fPkAll;
+        if (bLinear) {
+            int iGrid = bInterlace ? 2*f : f;
+            AddLinearSignal(iGrid,parameters.get_iSeed(),parameters.get_dBoxSize(),a,
+                            parameters.get_bFixedAmpIC(),parameters.get_dFixedAmpPhasePI() * M_PI);
+            std::tie(nPk,fK,fPkAll) = GridBinK(nBins,iGrid);
+        }
+        else {
+            fPkAll.resize(nBins);
+        }
+        result.emplace_back(nPk,fK,fPk,fPkAll);
     }
 
     GridDeleteFFT();
@@ -4759,7 +4989,7 @@ MSR::MeasurePk(int iAssignment,int bInterlace,int nGrid,double a,int nBins, int
     TimerStop(TIMER_NONE);
     dsec = TimerGet(TIMER_NONE);
     print("P(k) Calculated, Wallclock: {:.5} secs\n\n", dsec);
-    return { nPk,fK,fPk,fPkAll };
+    return result;
 }
 
 std::tuple<std::vector<uint64_t>,std::vector<float>,std::vector<float>> // nPk, fK, fPk
@@ -4826,8 +5056,8 @@ void MSR::SetLinGrid(double dTime, double dDelta,int nGrid, int bKickClose, int
     print("Force grids of linear species set, Wallclock: {:.5} secs\n\n", dsec);
 }
 
-/* First call SetLinGrid() to setup the grid */
-void MSR::LinearKick(double dTime, double dDelta, int bKickClose, int bKickOpen) {
+/* First call SetLinGrid() or SetPMGrid() to setup the grid */
+void MSR::LinearKick(double dTime, double dDelta, int bKickClose, int bKickOpen, int iAssignment) {
     struct inLinearKick in;
     double dt = 0.5*dDelta;
     double dsec;
@@ -4843,11 +5073,38 @@ void MSR::LinearKick(double dTime, double dDelta, int bKickClose, int bKickOpen)
         if (bKickClose) in.dtClose = dt;
         if (bKickOpen) in.dtOpen = dt;
     }
+    in.iAssignment = iAssignment;
     pstLinearKick(pst, &in, sizeof(in), NULL, 0);
     TimerStop(TIMER_NONE);
     dsec = TimerGet(TIMER_NONE);
     print("Linear Kick Applied, Wallclock: {:.5} secs\n\n", dsec);
 }
+
+/*
+** TreePM long-range kick: the filtered mesh force is computed on an
+** nGridPM^3 grid and applied to all particles, in the same way as the
+** linear species.
+*/
+void MSR::MeshKick(double dTime, double dDelta, int bKickClose, int bKickOpen) {
+    auto nGrid = parameters.get_nGridPM();
+    auto iAssignment = parameters.get_iPMOrder();
+    print("Computing TreePM mesh force with nGridPM = {}\n", nGrid);
+    double sec = MSR::Time();
+
+    GridCreateFFT(nGrid);
+    AssignMass(iAssignment,0,0.0f);
+    DensityContrast(0,true);
+
+    struct inSetPMGrid in;
+    in.dTotalMass = TotalMass();
+    in.dRs = parameters.get_dPMSplit() * parameters.get_dPeriod()[0] / nGrid;
+    in.iAssignment = iAssignment;
+    pstSetPMGrid(pst, &in, sizeof(in), NULL, 0);
+
+    LinearKick(dTime,dDelta,bKickClose,bKickOpen,iAssignment);
+    GridDeleteFFT();
+    print("TreePM mesh force applied, Wallclock: {:.5} secs\n\n", MSR::Time() - sec);
+}
 #endif
 
 mdl::ServiceBuffer MSR::GetParticles(std::vector<std::int64_t> &particle_ids) {
@@ -139,7 +139,7 @@ private:
 protected:
     int64_t parallel_read_count();
     int64_t parallel_write_count();
-    void stat_files(std::vector<uint64_t> &counts,const std::string_view &filename_template, uint64_t element_size);
+    void stat_files(std::vector<uint64_t> &counts,const std::string_view &filename_template, uint64_t element_size,int service_id=PST_FILE_SIZES);
     void Restore(const std::string &filename,int nSizeParticle);
     void PrintStat(const STAT &ps,char const *pszPrefix,int p);
 
@@ -157,6 +157,7 @@ public:
         PyObject *time = Py_None, PyObject *delta = Py_None, PyObject *E = Py_None, PyObject *U = Py_None, PyObject *Utime = Py_None);
     double Read(std::string_view achInFile);
     void Checkpoint(int iStep, int nSteps, double dTime, double dDelta);
+    void CheckpointWait();
     void Write(const std::string &pszFileName,double dTime,int bCheckpoint);
     void OutASCII(const char *pszFile,int iType,int nDims,int iFileType);
     void OutArray(const char *pszFile,int iType,int iFileType);
@@ -200,13 +201,18 @@ public:
     EphemeralMemory EphemeralMemoryGrid(int nGrid,int nCount);
     std::tuple<std::vector<uint64_t>,std::vector<float>,std::vector<float>,std::vector<float>> // nPk, fK, fPk, fPkAll
             MeasurePk(int iAssignment,int bInterlace,int nGrid,double a,int nBins,int fold=1);
+    std::vector<std::tuple<std::vector<uint64_t>,std::vector<float>,std::vector<float>,std::vector<float>>> // nPk, fK, fPk, fPkAll for each fold
+            MeasurePkGrids(int iAssignment,int bInterlace,int nGrid,double a,int nBins,const std::vector<int> &folds);
     void AssignMass(int iAssignment=3,int iGrid=0,float fDelta=0.0f,int fold=1);
+    void AssignMassGrids(int iAssignment,const std::vector<int> &folds,bool bInterlace);
     void DensityContrast(int nGrid,bool k=true);
     void WindowCorrection(int iAssignment,int iGrid);
     void Interlace(int iGridTarget,int iGridSource);
     void AddLinearSignal(int iGrid, int iSeed, double Lbox, double a, bool bFixed=false, float fPhase=0);
     std::tuple<std::vector<uint64_t>,std::vector<float>,std::vector<float>> // nPk, fK, fPk
             GridBinK(int nBins, int iGrid);
+    std::vector<std::tuple<std::vector<uint64_t>,std::vector<float>,std::vector<float>>> // nPk, fK, fPk for each fold
+            GridBinKGrids(int nBins, int iAssignment, int nFolds, bool bInterlace);
     void BispectrumSelect(int iGridTarget,int iGridSource,double kmin,double kmax);
     double BispectrumCalculate(int iGrid1,int iGrid2,int iGrid3);
     void GridCreateFFT(int nGrid);
@@ -339,6 +345,7 @@ public:
     std::vector<uint64_t> nRung;
     int iRungDD, iRungDT;
     int iLastRungRT,iLastRungDD;
+    std::vector<uint64_t> sfcSplit; /* Peano-Hilbert key of the start of each domain */
     uint64_t nActive;
     int nGroups;
     int nBins;
@@ -358,6 +365,9 @@ public:
     int iCheckpointStep;
     int nCheckpointThreads;
     char achCheckpointName[PST_FILENAME_SIZE];
+    std::string achPendingCheckpoint; // asynchronous checkpoint still being written
+    std::string achCheckpointBase;    // full checkpoint that incremental ones refer to
+    int nIncrementalCheckpoints = 0;  // written since achCheckpointBase
 protected:
     static double Time();
     static void Leader();
@@ -464,7 +474,8 @@ protected:
     void LightConeVel();
 #ifdef MDL_FFTW
     void SetLinGrid(double dTime, double dDelta, int nGrid, int bKickClose, int bKickOpen);
-    void LinearKick(double dTime, double dDelta, int bKickClose, int bKickOpen);
+    void LinearKick(double dTime, double dDelta, int bKickClose, int bKickOpen, int iAssignment=3);
+    void MeshKick(double dTime, double dDelta, int bKickClose, int bKickOpen);
 #endif
 
     // Timers
@@ -480,6 +491,7 @@ protected:
 
     void SmoothSetSMF(SMF *smf, double dTime, double dDelta, int nSmooth);
     void ZeroNewRung(uint8_t uRungLo, uint8_t uRungHi, int uRung);
+    void ZeroWork();
     void KickKDKOpen(double dTime,double dDelta,uint8_t uRungLo,uint8_t uRungHi);
     void KickKDKClose(double dTime,double dDelta,uint8_t uRungLo,uint8_t uRungHi);
     void UpdateRung(uint8_t uRung);
@@ -545,7 +557,9 @@ protected:
 
     void Initialize();
     void writeParameters(const std::string &baseName,int iStep,int nSteps,double dTime,double dDelta);
+    void writeRestartFile(const std::string &baseName);
     void DomainDecompOld(int iRung);
+    void DomainDecompSFC(int iRung);
 
     int CountRungs(uint64_t *nRungs);
     void SetSoft(double);
@@ -553,6 +567,7 @@ protected:
 
     std::tuple<std::vector<uint64_t>,std::vector<float>,std::vector<float>> // nPk, fK, fPk
             MeasureLinPk(int nGridLin,double a,double dBoxSize);
+    int PkFoldGroup();
     void OutputPk(int iStep,double dTime);
     void OutputLinPk(int iStep, double dTime);
 
@@ -24,6 +24,8 @@
 #include <algorithm>
 #include <vector>
 #include <tuple>
+#include <atomic>
+#include <memory>
 #include <boost/intrusive/list.hpp>
 
 namespace mdl {
@@ -51,6 +53,7 @@ public:
     virtual void *fetch(uint32_t uIndex,    uint32_t uId,bool bLock,bool bModify,bool bVirtual) = 0;
     virtual void *fetch(uint32_t uHash, const void *pKey,bool bLock,bool bModify,bool bVirtual) = 0;
     virtual void *inject(uint32_t uHash, uint32_t uId, const void *pKey) = 0;
+    virtual bool present(uint32_t uIndex, uint32_t uId) = 0;
     virtual void initialize(ARChelper *helper, uint32_t uCacheSizeInBytes,uint32_t uLineSizeInBytes,uint32_t nLineBits=0) = 0;
     virtual void release(void *vp) = 0;
     virtual void clear() = 0;
@@ -317,6 +320,8 @@ public:
     virtual void *fetch(uint32_t uIndex,    uint32_t uId,bool bLock,bool bModify,bool bVirtual) override;
     virtual void *fetch(uint32_t uHash, const void *pKey,bool bLock,bool bModify,bool bVirtual) override;
     virtual void *inject(uint32_t uHash, uint32_t uId, const void *pKey) override;
+    // True if the line with this element (simple key) is in the cache. Does not count as a hit.
+    virtual bool present(uint32_t uIndex, uint32_t uId) override;
 };
 
 /*****************************************************************************\
@@ -734,6 +739,14 @@ void *ARC<KEYS...>::inject(uint32_t uHash, uint32_t uId, const void *pKey) {
     return inject(uHash,uId,*static_cast<const KEY *>(pKey));
 }
 
+template<typename... KEYS>
+bool ARC<KEYS...>::present(uint32_t uIndex, uint32_t uId) {
+    if (sizeof(PAIR) != sizeof(CDB)) return false; // Only simple keys
+    uIndex >>= nLineBits;
+    auto pEntry = find_key(HashChains[hash::hash(uIndex,uId)&uHashMask],uIndex,uId);
+    return pEntry && get<CDB>(*pEntry).data != nullptr;
+}
+
 /*****************************************************************************\
 * ARC fetch
 \*****************************************************************************/
@@ -805,6 +818,141 @@ void *ARC<KEYS...>::fetch(uint32_t uIndex, uint32_t uId, bool bLock,bool bModify
     return fetch(uIndex,uId,KEY(),bLock,bModify,bVirtual);
 }
 
+/*****************************************************************************\
+* SHARC: node shared cache
+*
+* A second level cache for read-only caches shared by all threads of a process.
+* Each thread still has its own ARC cache (so element pointers stay valid until
+* the thread itself evicts them), but on an ARC miss the line is first looked up
+* here before a request is sent to the remote rank, and fetched lines are added.
+*
+* Lookups are lock free: every slot is protected by a sequence count. A reader
+* copies the line and then checks that the count did not change; if a writer
+* interfered the lookup is treated as a miss. The table is divided into shards,
+* each with its own lock that is only taken to insert. Lines live in small
+* set-associative buckets and are evicted with the CLOCK algorithm, as a hit only
+* needs to set a reference bit (moving an entry between ARC lists would need a lock).
+* Entries from a previous cache open are invalidated by bumping the generation.
+\*****************************************************************************/
+
+class SHARC {
+protected:
+    static constexpr uint32_t nWays = 8;     // Lines per bucket
+    static constexpr uint32_t nShardBits = 6; // Buckets are spread over 64 shards
+    struct alignas(64) SLOT {
+        std::atomic<uint32_t> seq {0};       // Odd while the line is being written
+        std::atomic<uint32_t> gen {0};       // Generation when written (0 is never valid)
+        std::atomic<uint64_t> key {0};       // Remote thread and line
+        std::atomic<bool>     ref {false};   // CLOCK reference bit
+    };
+    struct alignas(64) SHARD {
+        std::atomic_flag lock = ATOMIC_FLAG_INIT;
+    };
+    std::unique_ptr<SLOT[]> slots;
+    std::unique_ptr<uint8_t[]> hands;        // CLOCK hand for each bucket
+    std::vector<uint64_t> dataBase;
+    SHARD shards[1<<nShardBits];
+    std::atomic<uint32_t> generation {0};
+    uint32_t nBuckets = 0;
+    uint32_t uBucketMask = 0;
+    uint32_t uLineSizeInWords = 0;
+    uint32_t uLineSizeInBytes = 0;
+
+    static uint64_t make_key(uint32_t uLine,uint32_t uId) { return (uint64_t(uId)<<32) | uLine; }
+    uint64_t *line(uint32_t iSlot) { return &dataBase[uint64_t(iSlot)*uLineSizeInWords]; }
+public:
+    SHARC(const SHARC &)=delete;
+    SHARC &operator=(const SHARC &)=delete;
+    explicit SHARC() = default;
+
+    // Called by a single thread when a cache is opened (nobody else may access the cache).
+    // Previous entries become invalid. Returns false if the cache is too small to be useful.
+    bool initialize(uint64_t uCacheSizeInBytes,uint32_t uLineSizeInBytes) {
+        auto uLineSizeInWords = (uLineSizeInBytes+sizeof(uint64_t)-1) / sizeof(uint64_t);
+        uint64_t nLines = uCacheSizeInBytes / (uLineSizeInWords*sizeof(uint64_t));
+        uint32_t nBuckets = 1;
+        while (uint64_t(nBuckets)*2*nWays <= nLines && nBuckets < (1u<<31)) nBuckets *= 2;
+        if (uint64_t(nBuckets)*nWays > nLines) return false;
+        if (nBuckets != this->nBuckets || uLineSizeInWords != this->uLineSizeInWords) {
+            this->nBuckets = nBuckets;
+            this->uBucketMask = nBuckets - 1;
+            this->uLineSizeInWords = uLineSizeInWords;
+            slots.reset(new SLOT[nBuckets*nWays]);
+            hands.reset(new uint8_t[nBuckets]());
+            dataBase.resize(uint64_t(nBuckets)*nWays*uLineSizeInWords);
+        }
+        this->uLineSizeInBytes = uLineSizeInBytes;
+        if (++generation == 0) ++generation; // Zero marks a slot that was never written
+        return true;
+    }
+
+    // Copy the line to dst if it is present. Never blocks.
+    bool lookup(uint32_t uLine,uint32_t uId,void *dst) {
+        auto key = make_key(uLine,uId);
+        auto gen = generation.load(std::memory_order_relaxed);
+        auto iSlot = (hash::hash(uLine,uId) & uBucketMask) * nWays;
+        for (auto i=iSlot; i<iSlot+nWays; ++i) {
+            auto &slot = slots[i];
+            auto seq = slot.seq.load(std::memory_order_acquire);
+            if (slot.key.load(std::memory_order_relaxed) != key || slot.gen.load(std::memory_order_relaxed) != gen) continue;
+            if (seq & 1) return false; // Being replaced
+            std::memcpy(dst,line(i),uLineSizeInBytes);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) != seq) return false;
+            if (!slot.ref.load(std::memory_order_relaxed)) slot.ref.store(true,std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    // True if the line is (probably) present. Used to avoid prefetching a line twice.
+    bool contains(uint32_t uLine,uint32_t uId) {
+        auto key = make_key(uLine,uId);
+        auto gen = generation.load(std::memory_order_relaxed);
+        auto iSlot = (hash::hash(uLine,uId) & uBucketMask) * nWays;
+        for (auto i=iSlot; i<iSlot+nWays; ++i) {
+            if (slots[i].key.load(std::memory_order_relaxed) == key && slots[i].gen.load(std::memory_order_relaxed) == gen) return true;
+        }
+        return false;
+    }
+
+    // Add a line. If another thread is inserting into the same shard we simply skip it.
+    void insert(uint32_t uLine,uint32_t uId,const void *src) {
+        auto key = make_key(uLine,uId);
+        auto gen = generation.load(std::memory_order_relaxed);
+        auto iBucket = hash::hash(uLine,uId) & uBucketMask;
+        auto &shard = shards[iBucket & ((1<<nShardBits)-1)];
+        if (shard.lock.test_and_set(std::memory_order_acquire)) return;
+        auto iSlot = iBucket * nWays;
+        uint32_t iVictim = nWays;
+        for (auto i=0u; i<nWays; ++i) {
+            auto &slot = slots[iSlot+i];
+            auto slot_gen = slot.gen.load(std::memory_order_relaxed);
+            if (slot_gen == gen && slot.key.load(std::memory_order_relaxed) == key) { // Someone beat us to it
+                shard.lock.clear(std::memory_order_release);
+                return;
+            }
+            if (slot_gen != gen && iVictim == nWays) iVictim = i; // Free (or stale) slot
+        }
+        if (iVictim == nWays) { // CLOCK: give referenced lines a second chance
+            auto &hand = hands[iBucket];
+            while (slots[iSlot+hand].ref.exchange(false,std::memory_order_relaxed)) hand = (hand+1) % nWays;
+            iVictim = hand;
+            hand = (hand+1) % nWays;
+        }
+        auto &slot = slots[iSlot+iVictim];
+        auto seq = slot.seq.load(std::memory_order_relaxed);
+        slot.seq.store(seq+1,std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.key.store(key,std::memory_order_relaxed);
+        slot.gen.store(gen,std::memory_order_relaxed);
+        slot.ref.store(false,std::memory_order_relaxed);
+        std::memcpy(line(iSlot+iVictim),src,uLineSizeInBytes);
+        slot.seq.store(seq+2,std::memory_order_release);
+        shard.lock.clear(std::memory_order_release);
+    }
+};
+
 
 } // namespace mdl
 
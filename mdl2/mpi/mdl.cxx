@@ -16,6 +16,7 @@
  */
 
 #include "mdl.h"
+#include "mdlfftpencil.h"
 using namespace mdl;
 
 #include <algorithm>
@@ -23,6 +24,7 @@ using namespace mdl;
 #include <cstring>
 #include <set>
 #include <queue>
+#include <chrono>
 
 static inline int size_t_to_int(size_t v) {
     return (int)v;
@@ -153,6 +155,15 @@ void mdlROcache(MDL mdl,int cid,
             std::make_shared<CACHEhelper>(iDataSize));
 }
 
+// As mdlROcache, for data stored in tiles of 1<<nTileBits elements (e.g., a splitStore)
+extern "C"
+void mdlROcacheTiled(MDL mdl,int cid,
+                     void *(*getElt)(void *pData,int i,int iDataSize),
+                     void *pData,int iDataSize,int nData,int nTileBits) {
+    static_cast<mdlClass *>(mdl)->CacheInitialize(cid,getElt,pData,nData,
+            std::make_shared<CACHEhelper>(iDataSize),nTileBits);
+}
+
 // This opens a combiner (read/write) cache. Called from a worker outside of MDL
 extern "C"
 void mdlCOcache(MDL mdl,int cid,
@@ -176,7 +187,7 @@ CACHE *mdlClass::CacheInitialize(
     int cid,
     void *(*getElt)(void *pData,int i,int iDataSize),
     void *pData,int nData,
-    std::shared_ptr<CACHEhelper> helper) {
+    std::shared_ptr<CACHEhelper> helper,int nTileBits) {
 
     // We cannot reallocate this structure because there may be other threads accessing it.
     // This might be safe to do with an appropriate barrier, but it would shuffle CACHE objects.
@@ -186,9 +197,37 @@ CACHE *mdlClass::CacheInitialize(
 
     auto c = cache[cid].get();
     c->initialize(cacheSize,getElt,pData,nData,helper);
+    c->nTileBits = nTileBits;
+
+    // Read-only caches can share remote lines between the threads on this node
+    if (Core()==0) c->shared = helper->modify() || Cores()==1 ? nullptr : mpi->SharedCacheOpen(cid,c->iLineSize);
 
     /* Nobody should start using this cache until all threads have started it! */
     ThreadBarrier(true);
+    c->shared = pmdl[0]->cache[cid]->shared;
+    c->prefetched = c->shared;
+
+    /* Remote lines of a read-only cache can be read directly from an MPI window */
+    if (mpi->CacheRMA(c)) {
+        if (Core()==0) {
+            mdlMessageCacheWindow window(cid,true);
+            enqueueAndWait(window);
+            c->bRMA = window.bOpen; // False if the window could not be created
+        }
+        ThreadBarrier();
+        c->bRMA = pmdl[0]->cache[cid]->bRMA;
+    }
+
+    /* Elements of the other ranks on this node can be read directly from shared memory */
+    if (mpi->CacheNode(c)) {
+        if (Core()==0) {
+            mdlMessageCacheNode node(cid);
+            enqueueAndWait(node);
+            c->bNode = node.bOpen; // False if none of their data is shared
+        }
+        ThreadBarrier();
+        c->bNode = pmdl[0]->cache[cid]->bNode;
+    }
 
     /* We might need to resize the cache buffer */
     enqueueAndWait(mdlMessageCacheOpen());
@@ -390,10 +429,239 @@ MPI_Request *mpiClass::newRequest(mdlMessageMPI *message,MPI_Request request) {
     }
 }
 
+// Send cache traffic to a remote rank. Without communication threads this is
+// a normal MPI request tracked by finishRequests(). Otherwise the send is queued
+// to the thread that owns the rank. All sends from the MPI thread to a given rank
+// then come from the same thread, so MPI still delivers them in order. (Replies to
+// requests served by a communication thread need no order with respect to these.)
+void mpiClass::CacheSend(mdlMessageMPI *message,const void *buf,int count,int iProc,bool bSync,int tag) {
+    assert(iProc!=Proc());
+    if (commThreads.empty()) {
+        if (bSync) MPI_Issend(buf,count,MPI_BYTE,iProc,tag,commMDL,newRequest(message));
+        else MPI_Isend(buf,count,MPI_BYTE,iProc,tag,commMDL,newRequest(message));
+    }
+    else {
+        message->sendBuffer = buf;
+        message->sendCount = count;
+        message->sendRank = iProc;
+        message->sendTag = tag;
+        message->bSendSync = bSync;
+        commThreads[iProc % commThreads.size()]->send(message);
+    }
+}
+
+// Sends completed by the communication threads are finished here, on the MPI thread
+void mpiClass::finishCommSends() {
+    while (!queueCommDone.empty()) {
+        auto &M = dynamic_cast<mdlMessageMPI &>(queueCommDone.dequeue());
+        M.finish(this,MPI_REQUEST_NULL,M.sendStatus);
+    }
+}
+
+uint64_t mdlCommThread::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+mdlCommThread::mdlCommThread(mpiClass *mpi, MPI_Comm comm, mdlMessageQueue *queueDone)
+    : mpi(mpi), comm(comm), queueDone(queueDone) {
+    reset();
+}
+
+mdlCommThread::~mdlCommThread() {
+    assert(replyMessages.empty());
+    for (auto reply : replyFree) delete reply;
+}
+
+// Post any new sends and check for completions. Returns true if anything happened.
+bool mdlCommThread::progress() {
+    bool bBusy = false;
+    while (!queueSend.empty()) {
+        auto &M = dynamic_cast<mdlMessageMPI &>(queueSend.dequeue());
+        MPI_Request request;
+        if (M.bSendSync) MPI_Issend(M.sendBuffer,M.sendCount,MPI_BYTE,M.sendRank,M.sendTag,comm,&request);
+        else MPI_Isend(M.sendBuffer,M.sendCount,MPI_BYTE,M.sendRank,M.sendTag,comm,&request);
+        requests.push_back(request);
+        messages.push_back(&M);
+        bBusy = true;
+    }
+    if (!requests.empty()) {
+        int nDone;
+        if (statuses.size() < requests.size()) statuses.resize(requests.size());
+        if (indices.size() < requests.size()) indices.resize(requests.size());
+        auto rc = MPI_Testsome(requests.size(),requests.data(),&nDone,indices.data(),statuses.data());
+        assert(rc==MPI_SUCCESS);
+        assert(nDone != MPI_UNDEFINED);
+        if (nDone) {
+            for (auto i=0; i<nDone; ++i) {
+                auto M = messages[indices[i]];
+                M->sendStatus = statuses[i];
+                queueDone->enqueue(M);
+                messages[indices[i]] = nullptr;
+            }
+            // Completed requests are now MPI_REQUEST_NULL; remove them
+            size_t d = 0;
+            for (size_t s=0; s<requests.size(); ++s) {
+                if (messages[s]) {
+                    requests[d] = requests[s];
+                    messages[d] = messages[s];
+                    ++d;
+                }
+            }
+            requests.resize(d);
+            messages.resize(d);
+            bBusy = true;
+        }
+    }
+    if (serve()) bBusy = true;
+    return bBusy;
+}
+
+// Answer a remote cache request, and recycle the replies that have been delivered.
+// The reply is packed from the local data exactly as CacheReceiveRequest() does on
+// the MPI thread; this is read-only, and the cache cannot close while a remote
+// thread still waits for a reply.
+bool mdlCommThread::serve() {
+    bool bBusy = false;
+    if (requestRecv != MPI_REQUEST_NULL) {
+        int flag;
+        MPI_Status status;
+        MPI_Test(&requestRecv,&flag,&status);
+        if (flag) {
+            auto ph = reinterpret_cast<CacheHeader *>(bufferRecv.data());
+            assert(ph->mid == CacheMessageType::REQUEST);
+            mpiClass::BufferedCacheRequest request(ph,mpi->CacheRequestData(ph));
+            mdlMessageCacheReply *reply;
+            if (replyFree.empty()) reply = new mdlMessageCacheReply(mpi->iReplyBufSize);
+            else { reply = replyFree.back(); replyFree.pop_back(); }
+            reply->emptyBuffer();
+            reply->setRankTo(status.MPI_SOURCE);
+            mpi->BufferCacheResponse(reply,request);
+            replyRequests.emplace_back();
+            MPI_Issend(reply->getBuffer(),reply->getCount(),MPI_BYTE,status.MPI_SOURCE,MDL_TAG_CACHECOM,comm,&replyRequests.back());
+            replyMessages.push_back(reply);
+            MPI_Start(&requestRecv);
+            bBusy = true;
+        }
+    }
+    if (!replyRequests.empty()) {
+        int nDone;
+        if (indices.size() < replyRequests.size()) indices.resize(replyRequests.size());
+        MPI_Testsome(replyRequests.size(),replyRequests.data(),&nDone,indices.data(),MPI_STATUSES_IGNORE);
+        assert(nDone != MPI_UNDEFINED);
+        if (nDone) {
+            for (auto i=0; i<nDone; ++i) {
+                replyFree.push_back(replyMessages[indices[i]]);
+                replyMessages[indices[i]] = nullptr;
+            }
+            size_t d = 0;
+            for (size_t s=0; s<replyRequests.size(); ++s) {
+                if (replyMessages[s]) {
+                    replyRequests[d] = replyRequests[s];
+                    replyMessages[d] = replyMessages[s];
+                    ++d;
+                }
+            }
+            replyRequests.resize(d);
+            replyMessages.resize(d);
+            bBusy = true;
+        }
+    }
+    return bBusy;
+}
+
+// Called by the MPI thread
+void mdlCommThread::send(mdlMessageMPI *message) {
+    queueSend.enqueue(message);
+    wake();
+}
+
+void mdlCommThread::stop() {
+    bStop = true;
+    wake();
+}
+
+// Called by the MPI thread when the first cache is opened: requests can now arrive
+void mdlCommThread::open() {
+    bCacheOpen = true;
+    wake();
+}
+
+// Called by the MPI thread when the last cache is closed
+void mdlCommThread::close() {
+    bCacheOpen = false;
+}
+
+void mdlCommThread::wake() {
+    std::atomic_thread_fence(std::memory_order_seq_cst); // Pairs with the fence in sleep()
+    if (bSleeping.load()) {
+        std::lock_guard<std::mutex> lock(mutexSleep);
+        cvSleep.notify_one();
+    }
+}
+
+// Nothing is in flight and no cache is open, so wait for a send, an open (or stop)
+// instead of spinning. The flag is set before we check one last time so that a
+// wake() cannot be missed. A request that arrives early waits in MPI until we open.
+void mdlCommThread::sleep() {
+    std::unique_lock<std::mutex> lock(mutexSleep);
+    bSleeping = true;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    cvSleep.wait(lock,[this] {return !queueSend.empty() || bStop.load() || bCacheOpen.load();});
+    bSleeping = false;
+}
+
+void *mdlCommThread::run(void *vcomm) {
+    auto comm = static_cast<mdlCommThread *>(vcomm);
+    if (comm->mpi->bCommRequests) {
+        comm->bufferRecv.resize(comm->mpi->iCacheBufSize);
+        MPI_Recv_init(comm->bufferRecv.data(),comm->bufferRecv.size(),MPI_BYTE,MPI_ANY_SOURCE,
+                      MDL_TAG_CACHEREQ,comm->comm,&comm->requestRecv);
+        MPI_Start(&comm->requestRecv);
+    }
+    while (!comm->bStop.load(std::memory_order_relaxed) || !comm->requests.empty() || !comm->queueSend.empty()
+            || !comm->replyRequests.empty()) {
+        auto t = now();
+        if (comm->progress()) comm->nsBusy += now() - t;
+        else if (comm->requests.empty() && comm->replyRequests.empty() && !comm->bCacheOpen.load()) comm->sleep();
+        else {
+#if defined(HAVE_SCHED_YIELD)
+            sched_yield(); // MPI only progresses sends (and matches requests) if we keep testing
+#endif
+        }
+    }
+    if (comm->requestRecv != MPI_REQUEST_NULL) {
+        MPI_Cancel(&comm->requestRecv);
+        MPI_Wait(&comm->requestRecv,MPI_STATUS_IGNORE);
+        MPI_Request_free(&comm->requestRecv);
+    }
+    return nullptr;
+}
+
+void mdlCommThread::reset() {
+    nsBusyReset = nsBusy.load();
+    nsReset = now();
+}
+
+// Fraction of the time since the last reset that this thread was busy
+double mdlCommThread::busy() const {
+    auto dt = now() - nsReset.load();
+    return dt ? 1.0 * (nsBusy.load() - nsBusyReset.load()) / dt : 0.0;
+}
+
+void mpiClass::CommTimeReset(int iComm) {
+    if (iComm>=0 && iComm<CommThreads()) commThreads[iComm]->reset();
+}
+
+double mpiClass::CommTimeBusy(int iComm) const {
+    return (iComm>=0 && iComm<CommThreads()) ? commThreads[iComm]->busy() : 0.0;
+}
+
 // Open the cache by posting the receive if required
 void mpiClass::MessageCacheOpen(mdlMessageCacheOpen *message) {
+    assert(cacheClose==nullptr);
     if (nOpenCaches==0) {
         msgCacheReceive->action(this);
+        for (auto &comm : commThreads) comm->open();
         countCacheInflight.resize(Procs(),0);
         PendingRequests.set_capacity(Threads()); // This is very conservative, but uses some memory
 #ifdef DEBUG_COUNT_CACHE
@@ -455,6 +723,8 @@ void mpiClass::CacheReceive(int bytes, CacheHeader *ph, int iProcFrom) {
         case CacheMessageType::REQUEST: consumed = CacheReceiveRequest(bytes,ph,iProcFrom); break;
         case CacheMessageType::FLUSH:   consumed = CacheReceiveFlush(bytes,ph,iProcFrom);  break;
         case CacheMessageType::REPLY:   consumed = CacheReceiveReply(bytes,ph,iProcFrom);  break;
+        case CacheMessageType::PREFETCH:consumed = CacheReceiveRequest(bytes,ph,iProcFrom); break;
+        case CacheMessageType::PREFETCH_REPLY: consumed = CacheReceivePrefetch(bytes,ph,iProcFrom); break;
         default:
             assert(0);
         }
@@ -499,9 +769,11 @@ void CACHE::initialize(uint32_t cacheSize,
     if (nLineBits > 4) nLineBits = 4;
     iLineSize = getLineElementCount()*iDataSize;
     OneLine.resize(iLineSize);
+    SharedLine.resize(iLineSize);
 
-    nAccess = nMiss = 0; // Clear statistics. Are these even used any more?
+    nAccess = nMiss = nSharedHit = nPrefetch = 0; // Clear statistics. Are these even used any more?
 
+    nCacheSize = cacheSize;
     auto arc = arc_cache.get();
     if (!arc || typeid(*arc)!=typeid(ARC<>)) arc_cache.reset(new ARC<>());
     arc_cache->initialize(this,cacheSize,iLineSize,nLineBits);
@@ -517,7 +789,9 @@ void CACHE::initialize_advanced(uint32_t cacheSize,hash::GHASH *hash,int iDataSi
 
     nLineBits = 0;
     OneLine.resize(iDataSize);
-    nAccess = nMiss = 0; // Clear statistics. Are these even used any more?
+    shared = nullptr; // Only simple keys are shared
+    prefetched = nullptr;
+    nAccess = nMiss = nSharedHit = nPrefetch = 0; // Clear statistics. Are these even used any more?
 
     // Clone the table if it is not the same type as what we have
     auto arc = hash_table->clone(arc_cache.get());
@@ -530,6 +804,10 @@ void CACHE::close() {
     // Keep the arc cache for performance reasonses: arc_cache.reset();
     cache_helper.reset(); // Shared: we are finished with this
     hash_table = nullptr;
+    shared = nullptr;
+    prefetched = nullptr;
+    bRMA = false;
+    bNode = false;
 }
 
 /*****************************************************************************\
@@ -607,6 +885,10 @@ void *mdlClass::Access(int cid, uint32_t uIndex, int uId, bool bLock,bool bModif
         auto c = omdl->cache[cid].get();
         return c->getElement(uIndex); // Careful; we don't allow updates here (see ReadLock)
     }
+    /* The same is true for the other ranks on this node if their data is in shared memory */
+    if (c->bNode) {
+        if (auto p = mpi->NodeElement(cid,uIndex,uId,c->iDataSize)) return p;
+    }
     // Retreive the element from the ARC cache. If it is not present then the ARC class will
     // call invokeRequest to initiate the fetch, then finishRequest to copy the result into the cache
     return c->fetch(uIndex,uId,bLock,bModify,bVirtual); // Otherwise we look it up in the cache, or fetch it remotely
@@ -655,6 +937,11 @@ void *CACHE::invokeRequest(uint32_t uLine, uint32_t uId, uint32_t key_size, cons
 
     if (bVirtual) data = nullptr;
     else if (uCore < mdl->Cores()) data = getLocalData(uLine,uId,key_size,pKey);
+    else if (prefetched && key_size==0 && prefetched->lookup(uLine,uId,SharedLine.data())) {
+        bSharedHit = true; // Prefetched, or another thread on this node already fetched it; no request needed
+        ++nSharedHit;
+        data = nullptr;
+    }
     else { // Only send a request if non-Virtual and remote
         mdl->enqueue(CacheRequest.makeCacheRequest(getLineElementCount(), uId, uLine, key_size, pKey, OneLine.data()), mdl->queueCacheReply);
         data = nullptr;
@@ -665,6 +952,10 @@ void *CACHE::invokeRequest(uint32_t uLine, uint32_t uId, uint32_t key_size, cons
 // The MPI thread sends this to the remote node. This will not be returned until the reply has been received.
 void mpiClass::MessageCacheRequest(mdlMessageCacheRequest *message) {
     int iCoreFrom = message->header.idFrom - Self();
+    if (pmdl[iCoreFrom]->cache[message->header.cid]->bRMA) {
+        CacheRequestRMA(message);
+        return;
+    }
     assert(CacheRequestMessages[iCoreFrom]==nullptr);
     CacheRequestMessages[iCoreFrom] = message;
     assert(message->pLine);
@@ -682,7 +973,53 @@ void mpiClass::MessageCacheRequest(mdlMessageCacheRequest *message) {
 #ifdef DEBUG_COUNT_CACHE
         message->header.sequence = countCacheSend[iProc]++;
 #endif
-        MPI_Isend(&message->header,sizeof(message->header)+message->key_size,MPI_BYTE,iProc,MDL_TAG_CACHECOM, commMDL,newRequest(message));
+        CacheSend(message,&message->header,sizeof(message->header)+message->key_size,iProc,false,
+                  bCommRequests ? MDL_TAG_CACHEREQ : MDL_TAG_CACHECOM);
+    }
+}
+
+// Read a remote line directly from the window of a read-only cache. The gets are
+// only started here; they are completed (for all requests to the same rank at once)
+// in finishCacheGets() after the current batch of messages has been processed.
+void mpiClass::CacheRequestRMA(mdlMessageCacheRequest *message) {
+    auto &h = message->header;
+    auto c = pmdl[h.idFrom - Self()]->cache[h.cid].get();
+    auto &w = cacheWindows[h.cid];
+    auto iProc = ThreadToProc(h.idTo);
+    assert(iProc!=Proc());
+    auto dst = static_cast<char *>(message->pLine);
+    int64_t s = int64_t(h.iLine) << c->nLineBits;
+    int64_t e = s + c->getLineElementCount();
+    int64_t n = std::min<int64_t>(e,w.nData[h.idTo]);
+    // Elements past the end of the remote array are returned as zeros (see BufferCacheResponse)
+    if (n < e) memset(dst + std::max<int64_t>(n-s,0)*c->iDataSize,0,(e-std::max(n,s))*c->iDataSize);
+    if (s < n) {
+        auto first = w.segments.begin() + w.iSegment[h.idTo];
+        auto last  = w.segments.begin() + w.iSegment[h.idTo+1];
+        auto seg = std::upper_bound(first,last,s,[](int64_t i,const CacheSegment &g) {return i < g.iFirst;}) - 1;
+        // A line can span more than one segment (e.g., tree tiles)
+        for (; s < n; ++seg) {
+            auto next = seg+1 < last ? std::min(n,(seg+1)->iFirst) : n;
+            int nBytes = (next - s) * c->iDataSize;
+            MPI_Get(dst,nBytes,MPI_BYTE,iProc,MPI_Aint_add(seg->address,(s - seg->iFirst) * c->iDataSize),
+                    nBytes,MPI_BYTE,w.win);
+            dst += nBytes;
+            s = next;
+        }
+    }
+    h.nItems = 1;
+    if (std::find(w.targets.begin(),w.targets.end(),iProc) == w.targets.end()) w.targets.push_back(iProc);
+    w.pending.push_back(message);
+}
+
+// Complete the outstanding gets with one flush per target rank and return the lines
+void mpiClass::finishCacheGets() {
+    for (auto &w : cacheWindows) {
+        if (w.pending.empty()) continue;
+        for (auto iProc : w.targets) MPI_Win_flush_local(iProc,w.win);
+        w.targets.clear();
+        for (auto M : w.pending) M->sendBack();
+        w.pending.clear();
     }
 }
 
@@ -723,7 +1060,10 @@ void mpiClass::BufferCacheResponse(FlushBuffer *flush,BufferedCacheRequest &requ
     else { // SIMPLE KEY
         int s = request.header.iLine << c->nLineBits;
         int n = s + c->getLineElementCount();
-        flush->addBuffer(CacheMessageType::REPLY,request.header.cid,Self(),request.header.idFrom,request.header.iLine);
+        // A prefetched line is not matched with a waiting request, so the reply says who owns it
+        if (request.header.mid == CacheMessageType::PREFETCH)
+            flush->addBuffer(CacheMessageType::PREFETCH_REPLY,request.header.cid,request.header.idTo,request.header.idFrom,request.header.iLine);
+        else flush->addBuffer(CacheMessageType::REPLY,request.header.cid,Self(),request.header.idFrom,request.header.iLine);
         for (auto i=s; i<n; i++ ) {
             auto buffer = flush->getBuffer(pack_size);
             if (i<c->nData) {
@@ -743,24 +1083,13 @@ void mpiClass::BufferCacheResponse(FlushBuffer *flush,BufferedCacheRequest &requ
 // Instead, one is expected to initialize such data via the "init" function.
 int mpiClass::CacheReceiveRequest(int count, CacheHeader *ph, int iProcFrom) {
     assert( count >= sizeof(CacheHeader) );
-    assert( ph->mid == CacheMessageType::REQUEST );
+    assert( ph->mid == CacheMessageType::REQUEST || ph->mid == CacheMessageType::PREFETCH );
     int iCore = ph->idTo - Self();
     assert(iCore>=0 && iCore<Cores());
     auto c = pmdl[iCore]->cache[ph->cid].get();
-    assert(c->isActive());
     auto key_size = c->key_size();
     auto pack_size = c->cache_helper->pack_size();
-    assert(pack_size <= MDL_CACHE_DATA_SIZE);
-
-    // Find the data in the advanced cache if appropriate
-    const void *data;
-    if (key_size) { // ADVANCED KEY
-        assert(c->hash_table);
-        assert(c->getLineElementCount()==1);
-        data = c->hash_table->lookup(ph->iLine,ph+1);
-    }
-    else data = nullptr;
-    BufferedCacheRequest request(ph,data);
+    BufferedCacheRequest request(ph,CacheRequestData(ph));
     // Figure out which flush buffer to use
     mdlMessageCacheReply *reply;
     FlushBuffer *flush;
@@ -785,6 +1114,21 @@ int mpiClass::CacheReceiveRequest(int count, CacheHeader *ph, int iProcFrom) {
     return sizeof(CacheHeader) + key_size;
 }
 
+// Find the data in the advanced cache if appropriate (simple keys are read when packed)
+const void *mpiClass::CacheRequestData(const CacheHeader *ph) {
+    int iCore = ph->idTo - Self();
+    assert(iCore>=0 && iCore<Cores());
+    auto c = pmdl[iCore]->cache[ph->cid].get();
+    assert(c->isActive());
+    assert(c->cache_helper->pack_size() <= MDL_CACHE_DATA_SIZE);
+    if (c->key_size()) { // ADVANCED KEY
+        assert(c->hash_table);
+        assert(c->getLineElementCount()==1);
+        return c->hash_table->lookup(ph->iLine,ph+1);
+    }
+    else return nullptr;
+}
+
 // The reply message is sent back to the origin node, and added to the MPI request tracker.
 // This is the "action" routine.
 void mpiClass::MessageCacheReply(mdlMessageCacheReply *pFlush) {
@@ -795,8 +1139,7 @@ void mpiClass::MessageCacheReply(mdlMessageCacheReply *pFlush) {
     header->sequence = countCacheSend[iProc]++;
 #endif
     assert(iProc!=Proc());
-    MPI_Issend(pFlush->getBuffer(),pFlush->getCount(),MPI_BYTE,iProc,
-               MDL_TAG_CACHECOM,commMDL,newRequest(pFlush));
+    CacheSend(pFlush,pFlush->getBuffer(),pFlush->getCount(),iProc,true);
 }
 
 // When the send finishes, the buffer is added back to the list of free reply buffers
@@ -836,11 +1179,43 @@ int mpiClass::CacheReceiveReply(int count, CacheHeader *ph, int iProcFrom) {
     return sizeof(CacheHeader) + ph->nItems * iLineSize;
 }
 
+// A prefetched line has arrived. Nobody is waiting for it, so we add it to the node shared cache
+// (or the prefetch buffer of the requesting thread) where it will be found on a cache miss.
+int mpiClass::CacheReceivePrefetch(int count, CacheHeader *ph, int iProcFrom) {
+    assert( count >= sizeof(CacheHeader) );
+    assert( ph->mid == CacheMessageType::PREFETCH_REPLY );
+    int iCore = ph->idTo - Self();
+    assert(iCore>=0 && iCore<Cores());
+    auto c = pmdl[iCore]->cache[ph->cid].get();
+    assert(c->isActive());
+    auto pack_size = c->cache_helper->pack_size();
+    assert(pack_size <= MDL_CACHE_DATA_SIZE);
+    auto nLine = c->getLineElementCount();
+    if (c->prefetched && ph->nItems) {
+        PrefetchLine.resize(c->iLineSize);
+        auto pData = reinterpret_cast<const char *>(ph+1);
+        for (auto i=0; i<nLine; ++i) {
+            c->cache_helper->unpack(&PrefetchLine[i*c->iDataSize],&pData[i*pack_size],nullptr);
+        }
+        c->prefetched->insert(ph->iLine,ph->idFrom,PrefetchLine.data());
+    }
+    --c->nPrefetchInflight;
+    return sizeof(CacheHeader) + ph->nItems * nLine * pack_size;
+}
+
 // Later when we have found an empty cache element, this is called to wait for the result
 // and to copy it into the buffer area.
 void *CACHE::finishRequest(uint32_t uLine, uint32_t uId, uint32_t size, const void *pKey, bool bVirtual, void *dst, const void *src) {
+    if (bSharedHit) {
+        bSharedHit = false;
+        memcpy(dst,SharedLine.data(),iLineSize);
+        return dst;
+    }
     auto success = mdl->finishCacheRequest(iCID,uLine,uId,size,pKey,bVirtual,dst,src);
     mdl->TimeAddWaiting();
+    // Make the line available to the other threads on this node
+    uint32_t uCore = uId - mdl->mpi->Self();
+    if (shared && success && !bVirtual && size==0 && uCore >= mdl->Cores()) shared->insert(uLine,uId,dst);
     return success;
 }
 
@@ -958,7 +1333,7 @@ void mpiClass::expedite_flush(int iProc) {
         // Always expedite REPLY messages to avoid deadlock situations
         if (iFlush != flushHeadBusy.end()) {
             auto pFlush = *iFlush;
-            if (pFlush->contains(CacheMessageType::REPLY)) {
+            if (pFlush->contains(CacheMessageType::REPLY) || pFlush->contains(CacheMessageType::PREFETCH_REPLY)) {
                 ready.emplace(iProc);
             }
         }
@@ -966,7 +1341,7 @@ void mpiClass::expedite_flush(int iProc) {
         if (countCacheInflight[iProc]<iCacheMaxInflight) {
             if (iFlush != flushHeadBusy.end()) {
                 auto pFlush = *iFlush;
-                if (pFlush->contains(CacheMessageType::REQUEST)) {
+                if (pFlush->contains(CacheMessageType::REQUEST) || pFlush->contains(CacheMessageType::PREFETCH)) {
                     ready.emplace(iProc);
                 }
             }
@@ -1069,8 +1444,7 @@ void mpiClass::MessageFlushToRank(mdlMessageFlushToRank *pFlush) {
             header->sequence = countCacheSend[iProc]++;
 #endif
             assert(iProc!=Proc());
-            MPI_Issend(pFlush->getBuffer(),pFlush->getCount(),MPI_BYTE,iProc,
-                       MDL_TAG_CACHECOM,commMDL,newRequest(pFlush));
+            CacheSend(pFlush,pFlush->getBuffer(),pFlush->getCount(),iProc,true);
         }
     }
     else FinishFlushToRank(pFlush);
@@ -1197,6 +1571,7 @@ void mdlClass::FlushCache(int cid) {
     auto c = cache[cid].get();
 
     TimeAddComputing();
+    PrefetchDrain(cid);
     c->clear();
     flush_core_buffer();
     ThreadBarrier();
@@ -1237,6 +1612,110 @@ void mpiClass::MessageCacheFlushLocal(mdlMessageCacheFlushLocal *message) {
     message->sendBack();
 }
 
+/*****************************************************************************\
+* Prefetching: a thread can ask for remote lines of a read-only cache that it will
+* need soon. The requests are collected and sent as a batch by PrefetchFlush(); the
+* thread does not wait for the replies. They are added to the node shared cache as
+* they arrive where a later fetch will find them (if a line has not arrived yet, then
+* the fetch simply requests it as usual). Without a node shared cache the lines go to
+* a buffer belonging to the thread, a quarter the size of its cache.
+\*****************************************************************************/
+
+SHARC *CACHE::prefetch_cache() {
+    if (!prefetched) {
+        if (!prefetchBuffer) prefetchBuffer = std::make_unique<SHARC>();
+        if (prefetchBuffer->initialize(nCacheSize/4,iLineSize)) prefetched = prefetchBuffer.get();
+    }
+    return prefetched;
+}
+
+extern "C" void mdlPrefetch(MDL mdl,int cid,int iIndex,int id) { static_cast<mdlClass *>(mdl)->Prefetch(cid,iIndex,id); }
+void mdlClass::Prefetch(int cid,uint32_t uIndex,int uId) {
+    auto c = cache[cid].get();
+    uint32_t uCore = uId - mpi->Self();
+    if (uCore < Cores() || c->modify() || c->key_size()) return; // Only remote lines of read-only caches
+    if (c->bNode && mpi->NodeElement(cid,uIndex,uId,c->iDataSize)) return; // Read directly
+    auto prefetched = c->prefetch_cache();
+    if (!prefetched) return;
+    uint32_t uLine = uIndex >> c->nLineBits;
+    if (!PrefetchLines.empty()) { // Consecutive elements are usually on the same line
+        auto &last = PrefetchLines.back();
+        if (last.cid==cid && last.idTo==uId && last.iLine==uLine) return;
+    }
+    if (c->arc_cache->present(uIndex,uId) || prefetched->contains(uLine,uId)) return;
+    CacheHeader hdr {};
+    hdr.cid = cid;
+    hdr.mid = CacheMessageType::PREFETCH;
+    hdr.nItems = c->getLineElementCount();
+    hdr.idFrom = Self();
+    hdr.idTo = uId;
+    hdr.iLine = uLine;
+    PrefetchLines.push_back(hdr);
+}
+
+extern "C" void mdlPrefetchFlush(MDL mdl) { static_cast<mdlClass *>(mdl)->PrefetchFlush(); }
+void mdlClass::PrefetchFlush() {
+    if (PrefetchLines.empty()) return;
+    if (bPrefetchBusy) waitQueue(queueCachePrefetch); // Only waits for the previous batch to be sent
+    auto &lines = CachePrefetch.lines;
+    lines.swap(PrefetchLines);
+    PrefetchLines.clear();
+    // Group the requests by destination, and remove duplicates
+    auto order = [](const CacheHeader &a,const CacheHeader &b) {
+        return std::tie(a.idTo,a.cid,a.iLine) < std::tie(b.idTo,b.cid,b.iLine);
+    };
+    auto same = [](const CacheHeader &a,const CacheHeader &b) {
+        return a.idTo==b.idTo && a.cid==b.cid && a.iLine==b.iLine;
+    };
+    std::sort(lines.begin(),lines.end(),order);
+    lines.erase(std::unique(lines.begin(),lines.end(),same),lines.end());
+    for (auto &hdr : lines) {
+        auto c = cache[hdr.cid].get();
+        ++c->nPrefetch;
+        ++c->nPrefetchInflight; // Decremented by the MPI thread when the line arrives
+    }
+    enqueue(CachePrefetch,queueCachePrefetch);
+    bPrefetchBusy = true;
+}
+
+// Before a cache is flushed or closed all prefetched lines must have arrived
+void mdlClass::PrefetchDrain(int cid) {
+    auto c = cache[cid].get();
+    PrefetchLines.erase(std::remove_if(PrefetchLines.begin(),PrefetchLines.end(),
+                                       [cid](const CacheHeader &hdr) {return hdr.cid==cid;}),
+                        PrefetchLines.end());
+    if (bPrefetchBusy) {
+        waitQueue(queueCachePrefetch);
+        bPrefetchBusy = false;
+    }
+    while (c->nPrefetchInflight) {
+        checkMPI(); // Only does something on the MPI thread
+        bookkeeping();
+        yield();
+    }
+}
+
+// The requests are added to the flush buffer for each rank so requests to the same rank
+// are sent together, and the buffers are sent right away unless too many messages are inflight.
+void mpiClass::MessageCachePrefetch(mdlMessageCachePrefetch *message) {
+    std::set<int> ready;
+    for (auto &hdr : message->lines) {
+        flush_element(&hdr,0);
+        ready.emplace(ThreadToProc(hdr.idTo));
+    }
+    for (auto iProc : ready) {
+        if (iCacheMaxInflight && countCacheInflight[iProc]>=iCacheMaxInflight) continue; // expedite_flush() will send it
+        auto iFlush = flushBuffersByRank[iProc];
+        if (iFlush != flushHeadBusy.end()) {
+            auto pFlush = *iFlush;
+            flushHeadBusy.erase(iFlush);
+            flushBuffersByRank[iProc] = flushHeadBusy.end();
+            pFlush->action(this);
+        }
+    }
+    message->sendBack();
+}
+
 extern "C" void mdlFinishCache(MDL mdl,int cid) { static_cast<mdlClass *>(mdl)->FinishCache(cid); }
 void mdlClass::FinishCache(int cid) {
     auto c = cache[cid].get();
@@ -1245,6 +1724,7 @@ void mdlClass::FinishCache(int cid) {
     FlushCache(cid);
     enqueueAndWait(mdlMessageCacheClose());
     ThreadBarrier();
+    if (c->bRMA && Core()==0) enqueueAndWait(mdlMessageCacheWindow(cid,false));
     c->close();
     TimeAddSynchronizing();
 }
@@ -1254,33 +1734,327 @@ void mpiClass::MessageCacheClose(mdlMessageCacheClose *message) {
     assert(nOpenCaches > 0);
     --nOpenCaches;
     if (nOpenCaches == 0) {
-        // Make sure that there are no cache message inflight at this point; that would potentially be bad.
-        assert(std::all_of(countCacheInflight.begin(), countCacheInflight.end(), [](int i) { return i==0; }));
+        assert(cacheClose==nullptr);
+        cacheClose = message;
+        finish_cache_close();
+    }
+    else message->sendBack();
+}
+
+// All ranks have received every reply we sent (they waited for them before the barrier in
+// FlushCache), but we may not have seen the last (synchronous) sends complete. The close is
+// finished here once they have, either right away or from finishRequests().
+void mpiClass::finish_cache_close() {
+    if (std::any_of(countCacheInflight.begin(), countCacheInflight.end(), [](int i) { return i!=0; })) return;
 #ifdef DEBUG_COUNT_CACHE
-        std::vector<uint64_t> countRecvExpected(Procs());
-        MPI_Alltoall(countCacheSend.data(),1,MPI_UINT64_T,countRecvExpected.data(),1,MPI_UINT64_T,commMDL);
-        bool bBAD = false;
-        for (auto i=0; i<Procs(); ++i) {
-            if (countCacheRecv[i] != countRecvExpected[i]) {
-                printf("Rank %d received %" PRIu64 " from rank %d but expected %" PRIu64 "\n",
-                       Proc(), countCacheRecv[i], i, countRecvExpected[i]);
-                bBAD = true;
-            }
+    std::vector<uint64_t> countRecvExpected(Procs());
+    MPI_Alltoall(countCacheSend.data(),1,MPI_UINT64_T,countRecvExpected.data(),1,MPI_UINT64_T,commMDL);
+    bool bBAD = false;
+    for (auto i=0; i<Procs(); ++i) {
+        if (countCacheRecv[i] != countRecvExpected[i]) {
+            printf("Rank %d received %" PRIu64 " from rank %d but expected %" PRIu64 "\n",
+                   Proc(), countCacheRecv[i], i, countRecvExpected[i]);
+            bBAD = true;
         }
-        if (bBAD) {fflush(stdout); sleep(1); MPI_Abort(commMDL,1); }
+    }
+    if (bBAD) {fflush(stdout); sleep(1); MPI_Abort(commMDL,1); }
 #endif
-        for (auto i=SendReceiveMessages.begin(); i!=SendReceiveMessages.end(); ++i) {
-            if (dynamic_cast<mdlMessageCacheReceive *>(*i) != nullptr)
-                MPI_Cancel(&SendReceiveRequests[i-SendReceiveMessages.begin()]);
-        }
+    for (auto i=SendReceiveMessages.begin(); i!=SendReceiveMessages.end(); ++i) {
+        if (dynamic_cast<mdlMessageCacheReceive *>(*i) != nullptr)
+            MPI_Cancel(&SendReceiveRequests[i-SendReceiveMessages.begin()]);
     }
-    message->sendBack();
+    for (auto &comm : commThreads) comm->close();
+    cacheClose->sendBack();
+    cacheClose = nullptr;
 }
 
 void mdlClass::SetCacheMaxInflight(int iMax) {
     if (Core()==0) mpi->SetCacheMaxInflight(iMax);
 }
 
+void mdlClass::SetSharedCacheSize(uint64_t nBytes) {
+    if (Core()==0) mpi->SetSharedCacheSize(nBytes);
+}
+
+void mdlClass::SetCacheRMA(bool bRMA) {
+    if (Core()==0) mpi->SetCacheRMA(bRMA);
+}
+
+// This must be set before the main storage is allocated (see new_shared_array)
+void mdlClass::SetCacheShm(bool bShm) {
+    if (Core()==0) mpi->SetCacheShm(bShm);
+}
+
+// Only plain read-only caches can be read remotely; anything that packs, combines
+// or uses advanced keys needs code on the owning rank.
+bool mpiClass::CacheRMA(CACHE *c) {
+    return bCacheRMA && Procs()>1 && !c->hash_table && !c->modify()
+           && typeid(*c->cache_helper)==typeid(CACHEhelper);
+}
+
+// The elements are found with getElement() so split the data into contiguous pieces.
+// Each piece is given by its first element and the address of that element. A plain
+// array is one piece, and tiled data needs one lookup per tile. Only when we know
+// nothing about the layout do we need to look at every element.
+static void cacheSegments(CACHE *c,std::vector<std::pair<int64_t,char *>> &pieces) {
+    pieces.clear();
+    if (c->nData == 0) return;
+    int64_t nStep = c->nTileBits >= 0 ? int64_t(1) << c->nTileBits : 1;
+    if (c->isArray()) nStep = c->nData;
+    char *pNext = nullptr;
+    for (int64_t i=0; i<c->nData; i+=nStep) {
+        auto p = static_cast<char *>(c->getElement(i));
+        if (p != pNext) pieces.emplace_back(i,p);
+        pNext = p + std::min(nStep,c->nData - i) * c->iDataSize;
+    }
+}
+
+// Attach the data of every thread on this process to the window for this cache,
+// and learn where the data of every other thread is. This is collective, but it is
+// only called after a global barrier so nobody can be waiting for one of our replies.
+// The segments are only exchanged again if the layout on some rank has changed.
+void mpiClass::MessageCacheWindow(mdlMessageCacheWindow *message) {
+    auto cid = message->cid;
+    if (cacheWindows.size() <= size_t(cid)) cacheWindows.resize(cid+1);
+    auto &w = cacheWindows[cid];
+    if (message->bOpen) {
+        if (w.win == MPI_WIN_NULL) {
+            MPI_Win_create_dynamic(MPI_INFO_NULL,commMDL,&w.win);
+            MPI_Win_set_errhandler(w.win,MPI_ERRORS_RETURN);
+            MPI_Win_lock_all(MPI_MODE_NOCHECK,w.win);
+        }
+        int bAttached = 1;
+        std::vector<int> nData(Cores()), nSegments(Cores());
+        std::vector<CacheSegment> segments;
+        std::vector<std::pair<int64_t,char *>> pieces;
+        for (auto iCore=0; iCore<Cores(); ++iCore) {
+            auto c = pmdl[iCore]->cache[cid].get();
+            cacheSegments(c,pieces);
+            nData[iCore] = c->nData;
+            nSegments[iCore] = pieces.size();
+            for (size_t i=0; i<pieces.size(); ++i) {
+                auto [iFirst,base] = pieces[i];
+                auto iEnd = i+1 < pieces.size() ? pieces[i+1].first : c->nData;
+                // The number of attached regions can be limited (e.g., osc_rdma_max_attach in Open MPI)
+                if (bAttached && MPI_Win_attach(w.win,base,(iEnd - iFirst) * c->iDataSize)==MPI_SUCCESS)
+                    w.attached.push_back(base);
+                else bAttached = 0;
+                CacheSegment seg {iFirst,0};
+                MPI_Get_address(base,&seg.address);
+                segments.push_back(seg);
+            }
+        }
+        auto same = [](const CacheSegment &a,const CacheSegment &b) {return a.iFirst==b.iFirst && a.address==b.address;};
+        bool bSame = w.nLocalData == nData && w.nLocalSegments == nSegments
+                     && std::equal(segments.begin(),segments.end(),w.local.begin(),w.local.end(),same);
+        // If any rank could not attach its data then this cache uses messages instead
+        int flags[2] = {!bAttached, !bSame};
+        MPI_Allreduce(MPI_IN_PLACE,flags,2,MPI_INT,MPI_MAX,commMDL);
+        if (flags[0]) {
+            for (auto p : w.attached) MPI_Win_detach(w.win,p);
+            w.attached.clear();
+            w.local.clear();
+            w.nLocalData.clear();
+            w.nLocalSegments.clear();
+            message->bOpen = false;
+            message->sendBack();
+            return;
+        }
+        if (flags[1]) {
+            std::vector<int> counts(Procs()), displs(Procs()), nSegmentsAll(Threads());
+            for (auto i=0; i<Procs(); ++i) {
+                counts[i] = ProcToThread(i+1) - ProcToThread(i);
+                displs[i] = ProcToThread(i);
+            }
+            w.nData.resize(Threads());
+            MPI_Allgatherv(nData.data(),Cores(),MPI_INT,w.nData.data(),counts.data(),displs.data(),MPI_INT,commMDL);
+            MPI_Allgatherv(nSegments.data(),Cores(),MPI_INT,nSegmentsAll.data(),counts.data(),displs.data(),MPI_INT,commMDL);
+            w.iSegment.resize(Threads()+1);
+            w.iSegment[0] = 0;
+            for (auto i=0; i<Threads(); ++i) w.iSegment[i+1] = w.iSegment[i] + nSegmentsAll[i];
+            for (auto i=0; i<Procs(); ++i) {
+                counts[i] = (w.iSegment[ProcToThread(i+1)] - w.iSegment[ProcToThread(i)]) * sizeof(CacheSegment);
+                displs[i] = w.iSegment[ProcToThread(i)] * sizeof(CacheSegment);
+            }
+            w.segments.resize(w.iSegment.back());
+            MPI_Allgatherv(segments.data(),segments.size()*sizeof(CacheSegment),MPI_BYTE,
+                           w.segments.data(),counts.data(),displs.data(),MPI_BYTE,commMDL);
+            w.local = std::move(segments);
+            w.nLocalData = std::move(nData);
+            w.nLocalSegments = std::move(nSegments);
+        }
+    }
+    else {
+        assert(w.pending.empty());
+        for (auto p : w.attached) MPI_Win_detach(w.win,p);
+        w.attached.clear();
+    }
+    message->sendBack();
+}
+
+bool mpiClass::CacheNode(CACHE *c) {
+    return !nodeStores.empty() && !c->hash_table && !c->modify()
+           && typeid(*c->cache_helper)==typeid(CACHEhelper);
+}
+
+bool mpiClass::isNodeStore(const void *p) {
+    for (auto &s : nodeStores) if (p && p == s.pLocal) return true;
+    return false;
+}
+
+// Allocate the main storage of this process so that the other ranks on this node can read it.
+// This is collective on commNode, but every worker is allocating its storage (pkdInitialize),
+// and they have already forwarded any service requests that the other ranks are waiting for.
+// Several stores can exist at once; they are created (and freed) in the same order on every rank.
+void mpiClass::MessageNodeStore(mdlMessageNodeStore *message) {
+    uint64_t nPageSize = sysconf(_SC_PAGESIZE);
+    auto aligned = [nPageSize](void *p) { // The storage must be page aligned
+        auto q = static_cast<char *>(p);
+        return q + (nPageSize - reinterpret_cast<uintptr_t>(q) % nPageSize) % nPageSize;
+    };
+    MPI_Info info;
+    MPI_Info_create(&info);
+    MPI_Info_set(info,"alloc_shared_noncontig","true"); // Each rank's memory can be local to it
+    void *base;
+    NodeStore s;
+    auto rc = MPI_Win_allocate_shared(message->nBytes + nPageSize,1,info,commNode,&base,&s.win);
+    MPI_Info_free(&info);
+    if (rc == MPI_SUCCESS) {
+        s.bases.resize(nodeProc.size());
+        for (auto r=0; r<nodeProc.size(); ++r) {
+            MPI_Aint nBytes;
+            int iDisp;
+            MPI_Win_shared_query(s.win,r,&nBytes,&iDisp,&base);
+            s.bases[r] = aligned(base);
+        }
+        s.pLocal = s.bases[nodeRank[Proc()]];
+        s.nBytes = message->nBytes;
+        MPI_Win_lock_all(MPI_MODE_NOCHECK,s.win);
+        message->pStore = s.pLocal;
+        nodeStores.push_back(std::move(s));
+        ++iNodeStoreEpoch;
+    }
+    message->sendBack();
+}
+
+// Free a store from MessageNodeStore. Collective on commNode like the allocation: every worker
+// frees its storage when its context is destroyed (pkdInitialize again, or at the end).
+void mpiClass::MessageNodeStoreFree(mdlMessageNodeStoreFree *message) {
+    for (auto i=nodeStores.begin(); i!=nodeStores.end(); ++i) {
+        if (i->pLocal != message->pStore) continue;
+        MPI_Win_unlock_all(i->win);
+        MPI_Win_free(&i->win);
+        nodeStores.erase(i);
+        ++iNodeStoreEpoch;
+        break;
+    }
+    message->sendBack();
+}
+
+// Tell the other ranks on this node where the data of each of our threads is in our main storage,
+// and learn where theirs is. Like MessageCacheWindow, this is collective (on commNode) and is only
+// called after a global barrier. When no rank's layout has changed since the last time the cache
+// was opened the previous map is still valid and the exchange is skipped.
+void mpiClass::MessageCacheNode(mdlMessageCacheNode *message) {
+    struct NodeOffset {
+        int64_t iFirst;
+        int64_t iStore; // Which of nodeStores it is in, or -1 if it is elsewhere
+        int64_t offset; // From the start of the owner's storage
+    };
+    auto cid = message->cid;
+    if (cacheNodeMaps.size() <= size_t(cid)) cacheNodeMaps.resize(cid+1);
+    auto &m = cacheNodeMaps[cid];
+    std::vector<int> nSegments(Cores());
+    std::vector<NodeOffset> offsets;
+    std::vector<std::pair<int64_t,char *>> pieces;
+    for (auto iCore=0; iCore<Cores(); ++iCore) {
+        auto c = pmdl[iCore]->cache[cid].get();
+        cacheSegments(c,pieces);
+        for (size_t i=0; i<pieces.size(); ++i) {
+            auto [iFirst,base] = pieces[i];
+            auto iEnd = i+1 < pieces.size() ? pieces[i+1].first : c->nData;
+            NodeOffset o = {iFirst,-1,0};
+            for (size_t j=0; j<nodeStores.size(); ++j) {
+                auto &s = nodeStores[j];
+                if (base >= s.pLocal && base + (iEnd - iFirst) * c->iDataSize <= s.pLocal + s.nBytes) {
+                    o.iStore = j;
+                    o.offset = base - s.pLocal;
+                    break;
+                }
+            }
+            offsets.push_back(o);
+        }
+        offsets.push_back({c->nData,-1,0}); // Elements past the end are not shared
+        nSegments[iCore] = pieces.size() + 1;
+    }
+    for (auto &s : nodeStores) MPI_Win_sync(s.win);
+
+    auto pOffsets = reinterpret_cast<const char *>(offsets.data());
+    int bChanged = m.iEpoch != iNodeStoreEpoch || m.iSegment.empty()
+                   || !std::equal(m.local.begin(),m.local.end(),pOffsets,pOffsets + offsets.size()*sizeof(NodeOffset));
+    MPI_Allreduce(MPI_IN_PLACE,&bChanged,1,MPI_INT,MPI_MAX,commNode);
+    if (bChanged) {
+        // The ranks of commNode are in process order so this is also thread order
+        int nNode = nodeProc.size();
+        std::vector<int> counts(nNode), displs(nNode);
+        for (auto r=0,n=0; r<nNode; n+=counts[r++]) {
+            counts[r] = ProcToThread(nodeProc[r]+1) - ProcToThread(nodeProc[r]);
+            displs[r] = n;
+        }
+        std::vector<int> nSegmentsNode(displs.back() + counts.back());
+        MPI_Allgatherv(nSegments.data(),Cores(),MPI_INT,nSegmentsNode.data(),counts.data(),displs.data(),MPI_INT,commNode);
+        m.iSegment.assign(Threads()+1,0);
+        std::vector<int> nBytes(nNode), iBytes(nNode);
+        for (auto r=0,n=0; r<nNode; n+=nBytes[r++]) {
+            auto iThread = ProcToThread(nodeProc[r]);
+            int nRank = 0;
+            for (auto i=0; i<counts[r]; ++i) nRank += m.iSegment[iThread+i+1] = nSegmentsNode[displs[r]+i];
+            nBytes[r] = nRank * sizeof(NodeOffset);
+            iBytes[r] = n;
+        }
+        std::partial_sum(m.iSegment.begin(),m.iSegment.end(),m.iSegment.begin());
+        std::vector<NodeOffset> all(m.iSegment.back());
+        MPI_Allgatherv(offsets.data(),offsets.size()*sizeof(NodeOffset),MPI_BYTE,
+                       all.data(),nBytes.data(),iBytes.data(),MPI_BYTE,commNode);
+
+        // Convert the offsets to addresses in our own mapping of each rank's storage
+        m.bShared = false;
+        m.segments.resize(all.size());
+        for (auto r=0,k=0; r<nNode; ++r) {
+            for (auto i=0; i<nBytes[r]/int(sizeof(NodeOffset)); ++i,++k) {
+                auto &o = all[k];
+                char *p = o.iStore < 0 || nodeProc[r]==Proc() ? nullptr : nodeStores[o.iStore].bases[r] + o.offset;
+                m.segments[k] = {o.iFirst,p};
+                if (p) m.bShared = true;
+            }
+        }
+        m.local.assign(pOffsets,pOffsets + offsets.size()*sizeof(NodeOffset));
+        m.iEpoch = iNodeStoreEpoch;
+    }
+    for (auto &s : nodeStores) MPI_Win_sync(s.win);
+    message->bOpen = m.bShared;
+    message->sendBack();
+}
+
+// Returns the element if it can be read directly from the storage of another rank on this node
+void *mpiClass::NodeElement(int cid,uint32_t uIndex,uint32_t uId,uint32_t iDataSize) {
+    auto &m = cacheNodeMaps[cid];
+    auto first = m.segments.begin() + m.iSegment[uId];
+    auto last  = m.segments.begin() + m.iSegment[uId+1];
+    if (first == last) return nullptr; // On another node
+    auto seg = std::upper_bound(first,last,int64_t(uIndex),[](int64_t i,const NodeSegment &s) {return i < s.iFirst;});
+    if (seg == first || !(--seg)->p) return nullptr;
+    return seg->p + (uIndex - seg->iFirst) * iDataSize;
+}
+
+// Called by core zero when a read-only cache is opened (the other threads are waiting)
+SHARC *mpiClass::SharedCacheOpen(int cid,uint32_t uLineSizeInBytes) {
+    if (nSharedCacheSize == 0) return nullptr;
+    if (sharedCache.size() <= cid) sharedCache.resize(cid+1);
+    if (!sharedCache[cid]) sharedCache[cid] = std::make_unique<SHARC>();
+    return sharedCache[cid]->initialize(nSharedCacheSize,uLineSizeInBytes) ? sharedCache[cid].get() : nullptr;
+}
+
 /*****************************************************************************\
 *
 * The following is the MPI thread only functions
@@ -1638,26 +2412,41 @@ void mpiClass::MessageGridShare(mdlMessageGridShare *share) {
     MPI_Allgather(&share->grid->nSlab,sizeof(*share->grid->rn),MPI_BYTE,
                   share->grid->rn,sizeof(*share->grid->rn),MPI_BYTE,
                   commMDL);
+    MPI_Allgather(&share->grid->sPencil,sizeof(*share->grid->rs2),MPI_BYTE,
+                  share->grid->rs2,sizeof(*share->grid->rs2),MPI_BYTE,
+                  commMDL);
+    MPI_Allgather(&share->grid->nPencil,sizeof(*share->grid->rn2),MPI_BYTE,
+                  share->grid->rn2,sizeof(*share->grid->rn2),MPI_BYTE,
+                  commMDL);
     share->sendBack();
 }
 
 #ifdef MDL_FFTW
 // MPI thread: initiate a real to complex transform
 void mpiClass::MessageDFT_R2C(mdlMessageDFT_R2C *message) {
-    FFTW3(execute_dft_r2c)(message->fft->fplan,message->data,message->kdata);
+    if (message->fft->pencil) message->fft->pencil->forward(message->data);
+    else FFTW3(execute_dft_r2c)(message->fft->fplan,message->data,message->kdata);
     pthreadBarrierWait();
 }
 
 // MPI thread: initiate a complex to real transform
 void mpiClass::MessageDFT_C2R(mdlMessageDFT_C2R *message) {
-    FFTW3(execute_dft_c2r)(message->fft->iplan,message->kdata,message->data);
+    if (message->fft->pencil) message->fft->pencil->backward(message->kdata);
+    else FFTW3(execute_dft_c2r)(message->fft->iplan,message->kdata,message->data);
     pthreadBarrierWait();
 }
 
 void mpiClass::MessageFFT_Sizes(mdlMessageFFT_Sizes *sizes) {
-    sizes->nLocal = 2*FFTW3(mpi_local_size_3d_transposed)
-                    (sizes->n3,sizes->n2,sizes->n1/2+1,commMDL,
-                     &sizes->nz,&sizes->sz,&sizes->ny,&sizes->sy);
+    if (mdlFFTPencil::prefer(Procs(),sizes->n1,sizes->n2,sizes->n3)) {
+        mdlFFTPencil pencil(Procs(),Proc(),sizes->n1,sizes->n2,sizes->n3);
+        sizes->setPencil(pencil);
+    }
+    else {
+        sizes->nLocal = 2*FFTW3(mpi_local_size_3d_transposed)
+                        (sizes->n3,sizes->n2,sizes->n1/2+1,commMDL,
+                         &sizes->nz,&sizes->sz,&sizes->ny,&sizes->sy);
+        sizes->setSlab();
+    }
     sizes->sendBack();
 }
 
@@ -1665,23 +2454,49 @@ void mpiClass::MessageFFT_Plans(mdlMessageFFT_Plans *plans) {
     auto result = fft_plans.emplace(fft_plan_key(plans->n1,plans->n2,plans->n3),fft_plan_information());
     auto &info = result.first->second;
     if (result.second) { // Just inserted: we need to create the plan!
-        info.nLocal = 2*FFTW3(mpi_local_size_3d_transposed)
-                      (plans->n3,plans->n2,plans->n1/2+1,commMDL,
-                       &info.nz,&info.sz,&info.ny,&info.sy);
-        info.fplan = FFTW3(mpi_plan_dft_r2c_3d)(
-                         plans->n3,plans->n2,plans->n1,plans->data,plans->kdata,
-                         commMDL,FFTW_MPI_TRANSPOSED_OUT | (plans->data==NULL?FFTW_ESTIMATE:FFTW_MEASURE) );
-        info.iplan = FFTW3(mpi_plan_dft_c2r_3d)(
-                         plans->n3,plans->n2,plans->n1,plans->kdata,plans->data,
-                         commMDL,FFTW_MPI_TRANSPOSED_IN  | (plans->kdata==NULL?FFTW_ESTIMATE:FFTW_MEASURE) );
+        if (mdlFFTPencil::prefer(Procs(),plans->n1,plans->n2,plans->n3)) {
+            info.pencil = new mdlFFTPencil(Procs(),Proc(),plans->n1,plans->n2,plans->n3);
+            info.pencil->create(commMDL);
+            plans->setPencil(*info.pencil);
+            info.fplan = info.iplan = NULL;
+        }
+        else {
+            info.pencil = NULL;
+            plans->nLocal = 2*FFTW3(mpi_local_size_3d_transposed)
+                            (plans->n3,plans->n2,plans->n1/2+1,commMDL,
+                             &plans->nz,&plans->sz,&plans->ny,&plans->sy);
+            plans->setSlab();
+            info.fplan = FFTW3(mpi_plan_dft_r2c_3d)(
+                             plans->n3,plans->n2,plans->n1,plans->data,plans->kdata,
+                             commMDL,FFTW_MPI_TRANSPOSED_OUT | (plans->data==NULL?FFTW_ESTIMATE:FFTW_MEASURE) );
+            info.iplan = FFTW3(mpi_plan_dft_c2r_3d)(
+                             plans->n3,plans->n2,plans->n1,plans->kdata,plans->data,
+                             commMDL,FFTW_MPI_TRANSPOSED_IN  | (plans->kdata==NULL?FFTW_ESTIMATE:FFTW_MEASURE) );
+        }
+        info.nLocal = plans->nLocal;
+        info.nz = plans->nz;
+        info.sz = plans->sz;
+        info.ny = plans->ny;
+        info.sy = plans->sy;
+        info.nyr = plans->nyr;
+        info.syr = plans->syr;
+        info.nxk = plans->nxk;
+        info.sxk = plans->sxk;
+        info.nGroup = plans->nGroup;
     }
     plans->nLocal = info.nLocal;
     plans->nz = info.nz;
     plans->sz = info.sz;
     plans->ny = info.ny;
     plans->sy = info.sy;
+    plans->nyr = info.nyr;
+    plans->syr = info.syr;
+    plans->nxk = info.nxk;
+    plans->sxk = info.sxk;
+    plans->nGroup = info.nGroup;
     plans->fplan = info.fplan;
     plans->iplan = info.iplan;
+    plans->pencil = info.pencil;
     plans->sendBack();
 }
 #endif
@@ -1790,6 +2605,7 @@ void mpiClass::FinishReceiveReply(mdlMessageReceiveReply *send, MPI_Request requ
 
 void mpiClass::finishRequests() {
     int nDone = 1; // Prime the loop; we keep trying as long as we get work
+    finishCommSends(); // Sends progressed by the communication threads (if any)
     // If there are MPI send/recieve message pending then check if they are complete
     while (!SendReceiveRequests.empty() && nDone) {
         // Here we keep track of entries that we can reuse in newRequest()
@@ -1839,6 +2655,7 @@ void mpiClass::finishRequests() {
             }
         }
     }
+    if (cacheClose) finish_cache_close();
 }
 void mpiClass::processMessages() {
     /* These are messages from other threads */
@@ -1846,6 +2663,7 @@ void mpiClass::processMessages() {
         mdlMessage &M = queueMPInew.dequeue();
         M.action(this); // Action normally sends it back, but not always (see finish() below)
     }
+    finishCacheGets(); // One-sided cache reads started by the messages above
 }
 /*
 ** This routine must be called often by the MPI thread. It will drain
@@ -1881,6 +2699,7 @@ int mdlLaunch(int argc,char **argv,int (*fcnMaster)(MDL,void *),void *(*fcnWorke
 }
 int mpiClass::Launch(int (*fcnMaster)(MDL,void *),void *(*fcnWorkerInit)(MDL),void (*fcnWorkerDone)(MDL,void *)) {
     int i,j,n,bDiag,bDedicated,thread_support,rc,flag, *piTagUB;
+    int nCommThreads = 0;
     bool bThreads = false;
     char *p, ach[256];
     int exit_code = 0;
@@ -1929,6 +2748,9 @@ int mpiClass::Launch(int (*fcnMaster)(MDL,void *),void *(*fcnWorkerInit)(MDL),vo
             else if (!strcmp(argv[i], "+sharedmpi")) {
                 bDedicated = 2;
             }
+            else if (!strcmp(argv[i], "+commthreads")) { // Threads that send cache traffic and serve requests
+                if (argv[++i]) nCommThreads = atoi(argv[i]);
+            }
             else if (!strcmp(argv[i], "+d") && !bDiag) {
                 p = getenv("MDL_DIAGNOSTIC");
                 if (!p) p = getenv("HOME");
@@ -1956,12 +2778,19 @@ int mpiClass::Launch(int (*fcnMaster)(MDL,void *),void *(*fcnWorkerInit)(MDL),vo
     __itt_task_begin(domain, __itt_null, __itt_null, shMPITask);
 #endif
     commMDL = MPI_COMM_WORLD;
-    rc = MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED,&thread_support);
+    // Communication threads make MPI calls concurrently with the MPI thread
+    rc = MPI_Init_thread(&argc, &argv, nCommThreads>0 ? MPI_THREAD_MULTIPLE : MPI_THREAD_FUNNELED,&thread_support);
     if (rc!=MPI_SUCCESS) {
         MPI_Error_string(rc, ach, &i);
         perror(ach);
         MPI_Abort(commMDL,rc);
     }
+    if (nCommThreads>0 && thread_support<MPI_THREAD_MULTIPLE) {
+        fprintf(stderr,"WARNING: MPI_THREAD_MULTIPLE is not supported; +commthreads %d ignored\n",nCommThreads);
+        nCommThreads = 0;
+    }
+    // Cache requests are sent on their own tag only if every rank has a thread to serve them
+    MPI_Allreduce(MPI_IN_PLACE,&nCommThreads,1,MPI_INT,MPI_MIN,commMDL);
 #ifdef HAVE_SIGNAL_H
     signal(SIGINT,TERM_handler);
 #endif
@@ -1977,6 +2806,14 @@ int mpiClass::Launch(int (*fcnMaster)(MDL,void *),void *(*fcnWorkerInit)(MDL),vo
     MPI_Comm_size(commMDL, &layout.nProcs);
     MPI_Comm_rank(commMDL, &layout.iProc);
 
+    /* Find the ranks that can share memory with us (see MessageNodeStore) */
+    MPI_Comm_split_type(commMDL,MPI_COMM_TYPE_SHARED,Proc(),MPI_INFO_NULL,&commNode);
+    MPI_Comm_size(commNode,&n);
+    nodeProc.resize(n);
+    MPI_Allgather(&layout.iProc,1,MPI_INT,nodeProc.data(),1,MPI_INT,commNode);
+    nodeRank.assign(Procs(),-1);
+    for (auto r=0; r<n; ++r) nodeRank[nodeProc[r]] = r;
+
     /* Dedicate one of the threads for MPI, unless it would be senseless to do so */
     if (bDedicated == -1) {
         if (Procs()>0 && Cores()>3) bDedicated = 1;
@@ -2096,6 +2933,19 @@ int mpiClass::Launch(int (*fcnMaster)(MDL,void *),void *(*fcnWorkerInit)(MDL),vo
     __itt_string_handle *shPthreadTask = __itt_string_handle_create("pthread");
     __itt_task_begin(domain, __itt_null, __itt_null, shPthreadTask);
 #endif
+    /* Communication threads each own the ranks r with r % nCommThreads equal to their index.
+    ** They post and complete the cache sends to those ranks, and any of them can receive
+    ** and answer a remote cache request (see mdlCommThread). The cache statistics count
+    ** requests on the MPI thread, so the debug build leaves requests there. */
+    if (nCommThreads > Procs()) nCommThreads = Procs();
+#ifndef DEBUG_COUNT_CACHE
+    bCommRequests = nCommThreads > 0;
+#endif
+    for (i = 0; i < nCommThreads; ++i) {
+        commThreads.push_back(std::make_unique<mdlCommThread>(this,commMDL,&queueCommDone));
+        pthread_create(&commThreads.back()->thread,NULL,mdlCommThread::run,commThreads.back().get());
+    }
+
     nActiveCores = 0;
     if (Cores() > 1 || bDedicated) {
 #ifdef USE_HWLOC
@@ -2146,6 +2996,13 @@ int mpiClass::Launch(int (*fcnMaster)(MDL,void *),void *(*fcnWorkerInit)(MDL),vo
     }
     drainMPI();
 
+    for (auto &comm : commThreads) {
+        comm->stop();
+        pthread_join(comm->thread,NULL);
+    }
+    finishCommSends();
+    commThreads.clear();
+
     if (Cores() > 1 || bDedicated) {
         pthread_barrier_destroy(&barrier);
     }
@@ -2169,14 +3026,29 @@ int mpiClass::Launch(int (*fcnMaster)(MDL,void *),void *(*fcnWorkerInit)(MDL),vo
     // Cleanup for FFTW
     for (auto &plan : fft_plans) {
         auto &info = plan.second;
-        FFTW3(destroy_plan)(info.fplan);
-        FFTW3(destroy_plan)(info.iplan);
+        if (info.fplan) FFTW3(destroy_plan)(info.fplan);
+        if (info.iplan) FFTW3(destroy_plan)(info.iplan);
+        delete info.pencil;
     }
     fft_plans.clear();
     if (Cores()>1) FFTW3(cleanup_threads)();
     FFTW3(cleanup)();
 #endif
 
+    // The cache windows were created in the same order on every rank
+    for (auto &w : cacheWindows) {
+        if (w.win == MPI_WIN_NULL) continue;
+        MPI_Win_unlock_all(w.win);
+        MPI_Win_free(&w.win);
+    }
+    cacheWindows.clear();
+    for (auto &s : nodeStores) { // Any that were not freed by delete_shared_array
+        MPI_Win_unlock_all(s.win);
+        MPI_Win_free(&s.win);
+    }
+    nodeStores.clear();
+    MPI_Comm_free(&commNode);
+
     MPI_Barrier(commMDL);
     MPI_Finalize();
     return exit_code;
@@ -2700,7 +3572,12 @@ void mdlFree(MDL mdl,void *p) {
 }
 
 void mdlClass::delete_shared_array(void *p,uint64_t nBytes) {
-    if (Core()==0) munmap(p,nBytes);
+    if (Core()!=0) return;
+    if (mpi->isNodeStore(p)) { // Freed by the MPI thread (collective on the node like the allocation)
+        mdlMessageNodeStoreFree store(p);
+        enqueueAndWait(store);
+    }
+    else munmap(p,nBytes);
 }
 
 uint64_t mdlClass::new_shared_array(void **p, int nSegments, uint64_t *nElements,uint64_t *nBytesPerElement,uint64_t nMinTotalStore) {
@@ -2753,7 +3630,13 @@ uint64_t mdlClass::new_shared_array(void **p, int nSegments, uint64_t *nElements
         nTotalBytes = 0;
         for (auto t=0; t<Cores(); ++t) nTotalBytes += pmdl[t]->nMessageData;
         assert(nTotalBytes >= nMinTotalStore);
-        auto region = mmap(nullptr,nTotalBytes,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+        void *region = MAP_FAILED;
+        if (mpi->NodeShared()) { // Other ranks on this node read it directly (see mpiClass::MessageNodeStore)
+            mdlMessageNodeStore store(nTotalBytes);
+            enqueueAndWait(store);
+            if (store.pStore) region = store.pStore;
+        }
+        if (region==MAP_FAILED) region = mmap(nullptr,nTotalBytes,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
         if (region==MAP_FAILED) return 0;   // This likely means that there isn't enough memory.
 #ifdef __linux__
         madvise(region,nTotalBytes,MADV_DONTDUMP);
@@ -2870,6 +3753,16 @@ double mdlMissRatio(MDL cmdl,int cid) {
     else return (0.0);
 }
 
+// The fraction of misses that were found in the node shared cache (or prefetched) without a request
+double mdlSharedHitRatio(MDL cmdl,int cid) {
+    mdlClass *mdl = static_cast<mdlClass *>(cmdl);
+    auto c = mdl->cache[cid].get();
+    double dMiss = c->nMiss;
+
+    if (dMiss > 0.0) return (c->nSharedHit/dMiss);
+    else return (0.0);
+}
+
 /*
 ** GRID Geometry information.  The basic process is as follows:
 ** - Initialize: Create a MDLGRID giving the global geometry information (total grid size)
@@ -2894,10 +3787,18 @@ void mdlGridInitialize(MDL cmdl,MDLGRID *pgrid,int n1,int n2,int n3,int a1) {
     grid->id = CAST(uint32_t *,malloc(sizeof(*grid->id)*(grid->n3)));    assert(grid->id!=NULL);
     grid->rs = CAST(uint32_t *,mdlMalloc(cmdl,sizeof(*grid->rs)*mdl->Procs())); assert(grid->rs!=NULL);
     grid->rn = CAST(uint32_t *,mdlMalloc(cmdl,sizeof(*grid->rn)*mdl->Procs())); assert(grid->rn!=NULL);
+    grid->rs2 = CAST(uint32_t *,mdlMalloc(cmdl,sizeof(*grid->rs2)*mdl->Procs())); assert(grid->rs2!=NULL);
+    grid->rn2 = CAST(uint32_t *,mdlMalloc(cmdl,sizeof(*grid->rn2)*mdl->Procs())); assert(grid->rn2!=NULL);
+    grid->pid = CAST(uint32_t *,malloc(sizeof(*grid->pid)*(n1>n2?n1:n2))); assert(grid->pid!=NULL);
 
     /* The following need to be set to appropriate values still. */
     grid->sSlab = grid->nSlab = 0;
     grid->nLocal = 0;
+    /* By default the slabs are not shared (see mdlGridSetPencil) */
+    grid->iPencil = 2;
+    grid->sPencil = 0;
+    grid->nPencil = n2;
+    grid->nGroup = 1;
 }
 
 void mdlGridFinish(MDL cmdl, MDLGRID grid) {
@@ -2905,6 +3806,9 @@ void mdlGridFinish(MDL cmdl, MDLGRID grid) {
     if (grid->rs) free(grid->rs);
     if (grid->rn) free(grid->rn);
     if (grid->id) free(grid->id);
+    if (grid->rs2) free(grid->rs2);
+    if (grid->rn2) free(grid->rn2);
+    if (grid->pid) free(grid->pid);
     free(grid);
 }
 
@@ -2917,10 +3821,23 @@ void mdlGridSetLocal(MDL cmdl,MDLGRID grid,int s, int n, uint64_t nLocal) {
     grid->nLocal = nLocal;
 }
 
+void mdlGridSetPencil(MDL cmdl,MDLGRID grid,int iPencil,int s,int n,int nGroup) {
+    assert(iPencil==1 || iPencil==2);
+    uint32_t nDim = iPencil==1 ? grid->n1 : grid->n2;
+    assert( s>=0 && n>=0 && s+n<=nDim);
+    assert( nGroup>=1 );
+    grid->iPencil = iPencil;
+    grid->sPencil = s;
+    grid->nPencil = n;
+    grid->nGroup = nGroup;
+}
+
 /*
 ** Share the local GRID information with other processors by,
 **   - finding the starting slab and number of slabs on each processor
 **   - building a mapping from slab to processor id.
+** For pencils the slab maps to the first processor of the group and
+** "pid" gives the offset within the group (the same for every group).
 */
 extern "C" void mdlGridShare(MDL cmdl,MDLGRID grid) {return static_cast<mdlClass *>(cmdl)->GridShare(grid); }
 void mdlClass::GridShare(MDLGRID grid) {
@@ -2929,9 +3846,14 @@ void mdlClass::GridShare(MDLGRID grid) {
     enqueueAndWait(mdlMessageGridShare(grid));
 
     /* Calculate on which processor each slab can be found. */
-    for (id=0; id<Procs(); id++ ) {
+    for (id=Procs()-1; id>=0; id-- ) {
         for ( i=grid->rs[id]; i<grid->rs[id]+grid->rn[id]; i++ ) grid->id[i] = id;
     }
+    if (grid->nGroup > 1) {
+        for (id=0; id<grid->nGroup; id++ ) {
+            for ( i=grid->rs2[id]; i<grid->rs2[id]+grid->rn2[id]; i++ ) grid->pid[i] = id;
+        }
+    }
 }
 
 /*
@@ -2940,13 +3862,28 @@ void mdlClass::GridShare(MDLGRID grid) {
 void mdlGridCoordFirstLast(MDL cmdl,MDLGRID grid,mdlGridCoord *f,mdlGridCoord *l,int bCacheAlign) {
     mdlClass *mdl = static_cast<mdlClass *>(cmdl);
     uint64_t nPerCore, nThisCore;
-    uint64_t nLocal = (uint64_t)(grid->a1) * grid->n2 * grid->nSlab;
+    /* Local extents and offsets of the first two dimensions */
+    uint32_t a1 = grid->iPencil==1 ? grid->nPencil : grid->a1;
+    uint32_t n2 = grid->iPencil==2 ? grid->nPencil : grid->n2;
+    uint32_t s1 = grid->iPencil==1 ? grid->sPencil : 0;
+    uint32_t s2 = grid->iPencil==2 ? grid->sPencil : 0;
+    uint64_t nLocal = mdlGridLocalCount(grid);
+
+    if (nLocal == 0) { /* Nothing here: make an empty range */
+        f->II = l->II = 0;
+        f->i = l->i = 0;
+        f->x = l->x = s1;
+        f->y = l->y = s2;
+        f->z = l->z = grid->sSlab;
+        f->grid = l->grid = grid;
+        return;
+    }
 
     /* Number on each core with multiples of "a1" elments (complete pencils). */
     /* This needs to change to be complete MDL "cache lines" at some point. */
     uint64_t nAlign;
     if (bCacheAlign) nAlign = 1 << (int)(log2(MDL_CACHE_DATA_SIZE / sizeof(float)));
-    else nAlign = grid->a1;
+    else nAlign = a1;
 
     /*nPerCore = nLocal / mdlCores(mdl) + nAlign - 1;*/
     nPerCore = (nLocal-1) / mdlCores(mdl) + nAlign;
@@ -2963,17 +3900,21 @@ void mdlGridCoordFirstLast(MDL cmdl,MDLGRID grid,mdlGridCoord *f,mdlGridCoord *l
     l->II = f->II + nThisCore;
     f->i = 0;
     l->i = nThisCore;
-    f->z = f->II/(grid->a1*grid->n2);
-    f->y = f->II/grid->a1 - f->z * grid->n2;
-    f->x = f->II - grid->a1 * (f->z*grid->n2 + f->y);
+    f->z = f->II/(a1*n2);
+    f->y = f->II/a1 - f->z * n2;
+    f->x = f->II - a1 * (f->z*n2 + f->y);
     assert(bCacheAlign || f->x == 0); // MDL depends on this at the moment
+    f->x += s1;
+    f->y += s2;
     f->z += grid->sSlab;
     f->grid = grid;
 
-    l->z = l->II/(grid->a1*grid->n2);
-    l->y = l->II/grid->a1 - l->z * grid->n2;
-    l->x = l->II - grid->a1 * (l->z*grid->n2 + l->y);
+    l->z = l->II/(a1*n2);
+    l->y = l->II/a1 - l->z * n2;
+    l->x = l->II - a1 * (l->z*n2 + l->y);
     assert(bCacheAlign || l->x == 0); // MDL depends on this at the moment
+    l->x += s1;
+    l->y += s2;
     l->z += grid->sSlab;
     l->grid = grid;
 }
@@ -3019,6 +3960,7 @@ MDLFFT mdlClass::FFTNodeInitialize(int n1,int n2,int n3,int bMeasure,FFTW3(real)
 
     fft->fplan = plans.fplan;
     fft->iplan = plans.iplan;
+    fft->pencil = plans.pencil;
 
     /*
     ** Dimensions of k-space and r-space grid.  Note transposed order.
@@ -3029,6 +3971,11 @@ MDLFFT mdlClass::FFTNodeInitialize(int n1,int n2,int n3,int bMeasure,FFTW3(real)
     mdlGridInitialize(this,&fft->kgrid,n1/2+1,n3,n2,n1/2+1);
     mdlGridSetLocal(this,fft->rgrid,plans.sz,plans.nz,plans.nLocal);
     mdlGridSetLocal(this,fft->kgrid,plans.sy,plans.ny,plans.nLocal/2);
+    if (plans.nGroup > 1) {
+        /* r-space is split in y and k-space in kx (the first dimension) */
+        mdlGridSetPencil(this,fft->rgrid,2,plans.syr,plans.nyr,plans.nGroup);
+        mdlGridSetPencil(this,fft->kgrid,1,plans.sxk,plans.nxk,plans.nGroup);
+    }
     mdlGridShare(this,fft->rgrid);
     mdlGridShare(this,fft->kgrid);
     return fft;
@@ -3073,7 +4020,8 @@ void mdlClass::FFT( MDLFFT fft, FFTW3(real) *data ) {
     mdlMessageDFT_R2C trans(fft,data,(FFTW3(complex) *)data);
     ThreadBarrier();
     if (Core() == iCoreMPI) {
-        FFTW3(execute_dft_r2c)(fft->fplan,data,(FFTW3(complex) *)(data));
+        if (fft->pencil) fft->pencil->forward(data);
+        else FFTW3(execute_dft_r2c)(fft->fplan,data,(FFTW3(complex) *)(data));
     }
     else if (Core() == 0) {
         // NOTE: we do not receive a "reply" to this message, rather the synchronization
@@ -3089,7 +4037,8 @@ void mdlClass::IFFT( MDLFFT fft, FFTW3(complex) *kdata ) {
     mdlMessageDFT_C2R trans(fft,(FFTW3(real) *)kdata,kdata);
     ThreadBarrier();
     if (Core() == iCoreMPI) {
-        FFTW3(execute_dft_c2r)(fft->iplan,kdata,(FFTW3(real) *)(kdata));
+        if (fft->pencil) fft->pencil->backward(kdata);
+        else FFTW3(execute_dft_c2r)(fft->iplan,kdata,(FFTW3(real) *)(kdata));
     }
     else if (Core() == 0) {
         // NOTE: we do not receive a "reply" to this message, rather the synchronization
@@ -3137,6 +4086,13 @@ void mdlTimeReset(MDL mdl)             {        static_cast<mdlClass *>(mdl)->Ti
 double mdlTimeComputing(MDL mdl)       { return static_cast<mdlClass *>(mdl)->TimeComputing(); }
 double mdlTimeSynchronizing(MDL mdl)   { return static_cast<mdlClass *>(mdl)->TimeSynchronizing(); }
 double mdlTimeWaiting(MDL mdl)         { return static_cast<mdlClass *>(mdl)->TimeWaiting(); }
+int mdlCommThreads(MDL mdl)            { return static_cast<mdlClass *>(mdl)->mpi->CommThreads(); }
+// Each core resets the communication thread with the same index (if there is one)
+void mdlCommTimeReset(MDL mdl) {
+    auto cmdl = static_cast<mdlClass *>(mdl);
+    cmdl->mpi->CommTimeReset(cmdl->Core());
+}
+double mdlCommTimeBusy(MDL mdl,int iComm) { return static_cast<mdlClass *>(mdl)->mpi->CommTimeBusy(iComm); }
 
 #ifdef _MSC_VER
 double mdlWallTime(void *mdl) {
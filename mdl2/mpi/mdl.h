@@ -42,6 +42,9 @@
     #endif
     #include "rwlock.h"
     #include <memory>
+    #include <atomic>
+    #include <mutex>
+    #include <condition_variable>
     #include <tuple>
     #include <vector>
     #include <list>
@@ -64,8 +67,9 @@
 #define MDL_TAG_RPL     5 /* This is treated specially */
 #define MDL_TAG_SEND            6 /* NO   Yes */
 #define MDL_TAG_CACHECOM    7 /* Yes  Yes */
+#define MDL_TAG_CACHEREQ    8 /* NO   Yes: cache requests served by a communication thread */
 
-#define MDL_TAG_MAX             8
+#define MDL_TAG_MAX             9
 
 typedef int (*mdlWorkFunction)(void *ctx);
 typedef int (*mdlPack)(void *,int *,size_t,void *);
@@ -149,6 +153,15 @@ protected:
 protected:
     class mdlClass *const mdl;  // MDL is needed for cache operations
     mdlMessageCacheRequest CacheRequest;
+    SHARC *shared = nullptr;    // Node shared cache (read-only caches only)
+    SHARC *prefetched = nullptr; // Where prefetched lines arrive: the node shared cache or prefetchBuffer
+    std::unique_ptr<SHARC> prefetchBuffer; // Used when there is no node shared cache (created on first use)
+    uint32_t nCacheSize = 0;
+    std::vector<char> SharedLine;
+    bool bSharedHit = false;
+    bool bRMA = false;          // Remote lines are read with MPI_Get (see mpiClass::MessageCacheWindow)
+    bool bNode = false;         // Elements of other ranks on this node are read directly (see mpiClass::MessageCacheNode)
+    std::atomic<uint32_t> nPrefetchInflight {0}; // Prefetched lines that have not arrived yet
 public:
     void initialize(uint32_t cacheSize,
                     void *(*getElt)(void *pData,int i,int iDataSize),
@@ -156,6 +169,7 @@ public:
                     std::shared_ptr<CACHEhelper> helper);
 
     void initialize_advanced(uint32_t cacheSize,hash::GHASH *hash,int iDataSize,std::shared_ptr<CACHEhelper> helper);
+    SHARC *prefetch_cache();
 
 protected:
     void *(*getElt)(void *pData,int i,int iDataSize);
@@ -166,6 +180,7 @@ protected:
 public:
     int iDataSize;
     int nData;
+    int nTileBits = -1;         // Elements [k<<nTileBits,(k+1)<<nTileBits) are contiguous (-1 if unknown)
     uint32_t nLineBits;
     uint32_t getLineElementCount() const {return 1 << nLineBits;}
     uint32_t getLineMask()         const {return getLineElementCount()-1; }
@@ -176,6 +191,8 @@ public:
      */
     uint64_t nAccess;
     uint64_t nMiss;
+    uint64_t nSharedHit;
+    uint64_t nPrefetch;
 public:
     explicit CACHE(mdlClass *mdl,uint16_t iCID);
     virtual ~CACHE() = default;
@@ -184,6 +201,7 @@ public:
     bool modify() {assert(cache_helper); return cache_helper->modify();}
     uint32_t key_size() {return arc_cache->key_size();}
     void *getElement(int i) {return (*getElt)(pData,i,iDataSize);}
+    bool isArray() const {return getElt == getArrayElement;} // A single contiguous array
     void *WriteLock(int iIndex) {rwlock.lock_write(); return getElement(iIndex);}
     void WriteUnlock(const void *p) {rwlock.unlock_write();}
     void *ReadLock(int iIndex) {rwlock.lock_read(); return getElement(iIndex);}
@@ -243,6 +261,11 @@ public:
     mdlMessageFlushFromCore *coreFlushBuffer; // Active buffer
 
     mdlMessageQueue queueCacheReply; // Replies to cache requests
+    // Lines to prefetch are collected here, then sent as a batch (see PrefetchFlush)
+    std::vector<CacheHeader> PrefetchLines;
+    mdlMessageCachePrefetch CachePrefetch;
+    mdlMessageQueue queueCachePrefetch;
+    bool bPrefetchBusy = false;
     std::vector< std::unique_ptr<CACHE>>cache;
     mdlMessageQueue wqCacheFlush;
 
@@ -294,11 +317,14 @@ public:
                       int argc=0, char **argv=0);
     virtual ~mdlClass();
     void SetCacheMaxInflight(int iMax);
+    void SetSharedCacheSize(uint64_t nBytes);
+    void SetCacheRMA(bool bRMA);
+    void SetCacheShm(bool bShm);
 
     CACHE *CacheInitialize(int cid,
                            void *(*getElt)(void *pData,int i,int iDataSize),
                            void *pData,int nData,
-                           std::shared_ptr<CACHEhelper> helper);
+                           std::shared_ptr<CACHEhelper> helper,int nTileBits=-1);
     CACHE *CacheInitialize(int cid,
                            void *(*getElt)(void *pData,int i,int iDataSize),
                            void *pData,int nData,int iDataSize);
@@ -314,6 +340,9 @@ public:
 
     void FlushCache(int cid);
     void FinishCache(int cid);
+    void Prefetch(int cid,uint32_t uIndex,int uId);
+    void PrefetchFlush();
+    void PrefetchDrain(int cid);
     int ReqService(int id,int sid,void *vin,int nInBytes);
     int ReqService(int id,int sid) {
         return ReqService(id,sid,nullptr,0);
@@ -359,7 +388,60 @@ public:
     void delete_shared_array(void *p,uint64_t nBytes);
 };
 
+// Optional communication thread (see "+commthreads" in mpiClass::Launch).
+// The sends of cache traffic to the ranks it owns are posted and progressed here.
+// Sends arrive on queueSend, and completed messages are returned on queueDone
+// where the MPI thread calls finish() as usual.
+// Remote cache REQUEST messages (sent on MDL_TAG_CACHEREQ) are received here as
+// well, and the reply is packed from the local data and sent straight back, so a
+// remote miss is answered without waiting for the MPI thread. Everything else
+// (replies to our own requests, flushes, and requests bundled into flush buffers
+// with iCacheMaxInflight) is still received by the MPI thread.
+// When no cache is open and nothing is in flight the thread sleeps.
+class mdlCommThread {
+    friend class mpiClass;
+protected:
+    class mpiClass *mpi;
+    MPI_Comm comm;
+    mdlMessageQueue queueSend;  // Sends from the MPI thread
+    mdlMessageQueue *queueDone; // Completed sends back to the MPI thread
+    std::vector<MPI_Request>    requests;
+    std::vector<mdlMessageMPI *> messages;
+    std::vector<MPI_Status>     statuses;
+    std::vector<int>            indices;
+    // Remote cache requests and the replies we send for them
+    MPI_Request requestRecv = MPI_REQUEST_NULL;
+    std::vector<char> bufferRecv;
+    std::vector<MPI_Request> replyRequests;
+    std::vector<mdlMessageCacheReply *> replyMessages, replyFree;
+    pthread_t thread;
+    std::atomic<bool> bStop {false};
+    std::atomic<bool> bCacheOpen {false};
+    std::atomic<bool> bSleeping {false};
+    std::mutex mutexSleep;
+    std::condition_variable cvSleep;
+    std::atomic<uint64_t> nsBusy {0};      // Nanoseconds spent sending or serving requests
+    std::atomic<uint64_t> nsBusyReset {0}; // Value of nsBusy at the last reset
+    std::atomic<uint64_t> nsReset {0};     // Time of the last reset
+    static uint64_t now();
+    bool progress();
+    bool serve();
+    void sleep();
+    void wake();
+    static void *run(void *vcomm); // Called by pthread_create with an mdlCommThread *
+public:
+    mdlCommThread(class mpiClass *mpi, MPI_Comm comm, mdlMessageQueue *queueDone);
+    ~mdlCommThread();
+    void send(mdlMessageMPI *message);
+    void stop();
+    void open();
+    void close();
+    void reset();
+    double busy() const;
+};
+
 class mpiClass : public mdlClass {
+    friend class mdlCommThread;
 public:
     mdlMessageQueue queueWORK;
     mdlMessageQueue queueREGISTER;
@@ -391,12 +473,64 @@ protected:
     int iRequestTarget;
     int nActiveCores;
     int nOpenCaches;
+    mdlMessageCacheClose *cacheClose = nullptr; // Closing the last cache, but replies are still being sent
     // By setting this to a positive value, it limits the number of cache messages inflight
     // to each rank to the specified number. When enabled (not zero), all REQUEST and RESPONSE
     // messages are added to the flush buffer. The flush buffer is sent when below this limit.
     // To avoid deadlock, the flush buffer is sent if there is at least one REPLY message after
     // processing a batch of incoming REQUEST/REPLY/FLUSH messages.
     int iCacheMaxInflight = 0;
+    // When not zero, read-only caches share remote lines between the threads of this process
+    uint64_t nSharedCacheSize = 0;
+    std::vector<std::unique_ptr<SHARC>> sharedCache;
+    std::vector<char> PrefetchLine; // Prefetched lines are unpacked here
+    // When set, read-only caches expose their data in an MPI window and remote
+    // lines are read with MPI_Get instead of a request to the owning rank.
+    bool bCacheRMA = false;
+    struct CacheSegment {
+        int64_t iFirst;    // First element in this contiguous piece of memory
+        MPI_Aint address;  // Its address on the owning rank
+    };
+    struct CacheWindow {
+        MPI_Win win = MPI_WIN_NULL;
+        std::vector<void *> attached;           // Local memory attached to the window
+        std::vector<int> nData;                 // Number of elements of each thread
+        std::vector<int> iSegment;              // First segment of each thread [Threads()+1]
+        std::vector<CacheSegment> segments;     // Segments of all threads
+        std::vector<CacheSegment> local;        // Our segments when they were last exchanged
+        std::vector<int> nLocalData, nLocalSegments; // And the elements and segments of each core
+        std::vector<int> targets;               // Ranks with gets that have not been flushed
+        std::vector<mdlMessageCacheRequest *> pending; // Requests waiting for those gets
+    };
+    std::vector<CacheWindow> cacheWindows;
+    void CacheRequestRMA(mdlMessageCacheRequest *message);
+    void finishCacheGets();
+    // When set, the main storage (see mdlClass::new_shared_array) is allocated in memory shared
+    // by the ranks on this node, and read-only caches read the elements of those ranks directly.
+    bool bCacheShm = false;
+    MPI_Comm commNode = MPI_COMM_NULL;  // The ranks that share memory with us
+    std::vector<int> nodeRank;          // Rank of each process in commNode, or -1 if on another node
+    std::vector<int> nodeProc;          // Process of each rank in commNode
+    struct NodeStore {
+        MPI_Win win = MPI_WIN_NULL;     // The main storage of every rank on this node
+        char *pLocal = nullptr;         // Our own main storage (inside win)
+        uint64_t nBytes = 0;
+        std::vector<char *> bases;      // Main storage of each rank in commNode (in our address space)
+    };
+    std::vector<NodeStore> nodeStores;  // In allocation order, which is the same on every rank
+    uint64_t iNodeStoreEpoch = 0;       // Changes whenever a store is allocated or freed
+    struct NodeSegment {
+        int64_t iFirst;    // First element in this contiguous piece of memory
+        char *p;           // Where it is in our address space, or nullptr if it is not shared
+    };
+    struct CacheNodeMap {
+        std::vector<int> iSegment;              // First segment of each thread [Threads()+1]
+        std::vector<NodeSegment> segments;      // Segments of the threads on this node
+        std::vector<char> local;                // Our own segments as last exchanged
+        uint64_t iEpoch = 0;                    // iNodeStoreEpoch when they were exchanged
+        bool bShared = false;                   // Some segment of another rank can be read directly
+    };
+    std::vector<CacheNodeMap> cacheNodeMaps;
     int iCacheBufSize;  /* Cache input buffer size */
     int iReplyBufSize;  /* Cache reply buffer size */
     std::vector<MPI_Request>    SendReceiveRequests;
@@ -412,6 +546,7 @@ protected:
     };
     boost::circular_buffer<BufferedCacheRequest> PendingRequests;
     void BufferCacheResponse(FlushBuffer *flush,BufferedCacheRequest &request);
+    const void *CacheRequestData(const CacheHeader *ph);
 
 #ifndef NDEBUG
     uint64_t nRequestsCreated, nRequestsReaped;
@@ -424,11 +559,20 @@ protected:
     std::vector<uint64_t> countCacheSend, countCacheRecv;
 #endif
     std::list<mdlMessageCacheReply *> freeCacheReplies;
+    // Communication threads; rank iProc is owned by commThreads[iProc % commThreads.size()]
+    std::vector<std::unique_ptr<mdlCommThread>> commThreads;
+    mdlMessageQueue queueCommDone;
+    bool bCommRequests = false; // Cache requests are sent to the communication threads
+    void CacheSend(mdlMessageMPI *message,const void *buf,int count,int iProc,bool bSync,int tag=MDL_TAG_CACHECOM);
+    void finishCommSends();
 #ifdef MDL_FFTW
     // Cached FFTW plans
     struct fft_plan_information {
         ptrdiff_t nz, sz, ny, sy, nLocal;
+        ptrdiff_t nyr, syr, nxk, sxk;
+        int nGroup;
         FFTW3(plan) fplan, iplan;
+        mdlFFTPencil *pencil;
     };
     typedef std::tuple<ptrdiff_t,ptrdiff_t,ptrdiff_t> fft_plan_key;
     std::map<fft_plan_key,fft_plan_information> fft_plans;
@@ -458,14 +602,25 @@ protected:
     int CacheReceiveRequest(int count, CacheHeader *ph, int iProcFrom);
     int CacheReceiveReply(int count, CacheHeader *ph, int iProcFrom);
     int CacheReceiveFlush(int count, CacheHeader *ph, int iProcFrom);
+    int CacheReceivePrefetch(int count, CacheHeader *ph, int iProcFrom);
     friend class mdlMessageCacheOpen;
     void MessageCacheOpen(mdlMessageCacheOpen *message);
     friend class mdlMessageCacheClose;
     void MessageCacheClose(mdlMessageCacheClose *message);
+    friend class mdlMessageCacheWindow;
+    void MessageCacheWindow(mdlMessageCacheWindow *message);
+    friend class mdlMessageCacheNode;
+    void MessageCacheNode(mdlMessageCacheNode *message);
+    friend class mdlMessageNodeStore;
+    void MessageNodeStore(mdlMessageNodeStore *message);
+    friend class mdlMessageNodeStoreFree;
+    void MessageNodeStoreFree(mdlMessageNodeStoreFree *message);
     friend class mdlMessageCacheFlushOut;
     void MessageCacheFlushOut(mdlMessageCacheFlushOut *message);
     friend class mdlMessageCacheFlushLocal;
     void MessageCacheFlushLocal(mdlMessageCacheFlushLocal *message);
+    friend class mdlMessageCachePrefetch;
+    void MessageCachePrefetch(mdlMessageCachePrefetch *message);
     friend class mdlMessageGridShare;
     void MessageGridShare(mdlMessageGridShare *message);
 #ifdef MDL_FFTW
@@ -503,11 +658,21 @@ protected:
     virtual int checkMPI();
     void processMessages();
     void finishRequests();
+    void finish_cache_close();
 public:
     explicit mpiClass(int (*fcnMaster)(MDL,void *),void *(*fcnWorkerInit)(MDL),void (*fcnWorkerDone)(MDL,void *),
                       int argc=0, char **argv=0);
     virtual ~mpiClass();
     void SetCacheMaxInflight(int iMax) {iCacheMaxInflight = iMax;}
+    void SetSharedCacheSize(uint64_t nBytes) {nSharedCacheSize = nBytes;}
+    void SetCacheRMA(bool bRMA) {bCacheRMA = bRMA;}
+    bool CacheRMA(CACHE *c);
+    void SetCacheShm(bool bShm) {bCacheShm = bShm;}
+    bool NodeShared() {return bCacheShm && nodeProc.size() > 1;}
+    bool isNodeStore(const void *p);
+    bool CacheNode(CACHE *c);
+    void *NodeElement(int cid,uint32_t uIndex,uint32_t uId,uint32_t iDataSize);
+    SHARC *SharedCacheOpen(int cid,uint32_t uLineSizeInBytes);
     int Launch(int (*fcnMaster)(MDL,void *),void *(*fcnWorkerInit)(MDL),void (*fcnWorkerDone)(MDL,void *));
     void KillAll(int signo);
 #ifdef USE_CUDA
@@ -526,6 +691,9 @@ public:
     void enqueue(mdlMessage &M);
     void enqueue(const mdlMessage &M, basicQueue &replyTo, bool bWait=false);
     void pthreadBarrierWait();
+    int CommThreads() const {return commThreads.size();}
+    void CommTimeReset(int iComm);
+    double CommTimeBusy(int iComm) const;
 };
 } // namespace mdl
 #endif
@@ -555,13 +723,23 @@ static inline int mdlGridCoordCompare(const mdlGridCoord *a,const mdlGridCoord *
 }
 
 static inline mdlGridCoord *mdlGridCoordIncrement(mdlGridCoord *a) {
+    MDLGRID grid = a->grid;
     ++a->i;
     ++a->II;
-    if ( ++a->x == a->grid->n1 ) {
-        a->i += a->grid->a1 - a->grid->n1;
+    if (grid->iPencil == 1) { /* Local x pencils are stored without padding */
+        if ( ++a->x == grid->sPencil + grid->nPencil ) {
+            a->x = grid->sPencil;
+            if ( ++a->y == grid->n2 ) {
+                a->y = 0;
+                ++a->z;
+            }
+        }
+    }
+    else if ( ++a->x == grid->n1 ) {
+        a->i += grid->a1 - grid->n1;
         a->x = 0;
-        if ( ++a->y == a->grid->n2 ) {
-            a->y = 0;
+        if ( ++a->y == grid->sPencil + grid->nPencil ) {
+            a->y = grid->sPencil;
             ++a->z;
         }
     }
@@ -584,6 +762,11 @@ void mdlGridFinish(MDL mdl, MDLGRID grid);
 */
 void mdlGridSetLocal(MDL mdl,MDLGRID grid,int s, int n, uint64_t nLocal);
 /*
+** Sets the local pencils (dimension iPencil, 1 or 2) within the slab when
+** it is shared by a group of nGroup processors. Call after mdlGridSetLocal.
+*/
+void mdlGridSetPencil(MDL mdl,MDLGRID grid,int iPencil,int s,int n,int nGroup);
+/*
 ** Share the local geometry between processors.
 */
 void mdlGridShare(MDL mdl,MDLGRID grid);
@@ -595,19 +778,33 @@ void mdlGridShare(MDL mdl,MDLGRID grid);
 void *mdlGridMalloc(MDL mdl,MDLGRID grid,int nEntrySize);
 void mdlGridFree( MDL mdl, MDLGRID grid, void *p );
 /*
-** This gives the processor on which the given slab can be found.
+** Number of local elements (including padding) in the slab or pencil.
 */
-static inline int mdlGridId(MDL mdl,MDLGRID grid, uint32_t x, uint32_t y, uint32_t z) {
+static inline uint64_t mdlGridLocalCount(MDLGRID grid) {
+    if (grid->iPencil == 1) return (uint64_t)grid->nPencil * grid->n2 * grid->nSlab;
+    return (uint64_t)grid->a1 * grid->nPencil * grid->nSlab;
+}
+/*
+** This gives the processor on which the given slab (and pencil) can be found.
+*/
+static inline int mdlGridProc(MDLGRID grid, uint32_t x, uint32_t y, uint32_t z) {
     assert(z<grid->n3);
-    return mdlProcToThread(mdl,grid->id[z]);
+    int id = grid->id[z];
+    if (grid->nGroup > 1) id += grid->pid[grid->iPencil==1 ? x : y];
+    return id;
+}
+static inline int mdlGridId(MDL mdl,MDLGRID grid, uint32_t x, uint32_t y, uint32_t z) {
+    return mdlProcToThread(mdl,mdlGridProc(grid,x,y,z));
 }
 /*
 ** This returns the index into the array on the appropriate processor.
 */
 static inline int mdlGridIdx(MDL mdl,MDLGRID grid, uint32_t x, uint32_t y, uint32_t z) {
     assert(x<=grid->a1 && y<grid->n2 && z<grid->n3);
-    z -= grid->rs[grid->id[z]]; /* Make "z" zero based for its processor */
-    return x + grid->a1*(y + grid->n2*z); /* Local index */
+    int id = mdlGridProc(grid,x,y,z);
+    z -= grid->rs[id]; /* Make "z" zero based for its processor */
+    if (grid->iPencil == 1) return (x-grid->rs2[id]) + grid->rn2[id]*(y + grid->n2*z);
+    return x + grid->a1*((y-grid->rs2[id]) + grid->rn2[id]*z); /* Local index */
 }
 
 /*
@@ -650,6 +847,9 @@ int mdlCacheStatus(MDL mdl,int cid); /* zero means not open */
 void mdlROcache(MDL mdl,int cid,
                 void *(*getElt)(void *pData,int i,int iDataSize),
                 void *pData,int iDataSize,int nData);
+void mdlROcacheTiled(MDL mdl,int cid,
+                     void *(*getElt)(void *pData,int i,int iDataSize),
+                     void *pData,int iDataSize,int nData,int nTileBits);
 void mdlCOcache(MDL mdl,int cid,
                 void *(*getElt)(void *pData,int i,int iDataSize),
                 void *pData,int iDataSize,int nData,
@@ -677,6 +877,7 @@ void mdlFinishCache(MDL,int);
 void mdlCacheCheck(MDL);
 void mdlCacheBarrier(MDL,int);
 void mdlPrefetch(MDL mdl,int cid,int iIndex, int id);
+void mdlPrefetchFlush(MDL mdl);
 void *mdlAcquire(MDL mdl,int cid,int iIndex,int id);
 void *mdlFetch(MDL mdl,int cid,int iIndex,int id);
 void *mdlVirtualFetch(MDL mdl,int cid,int iIndex,int id);
@@ -693,6 +894,7 @@ void mdlReleaseWrite(MDL mdl,int cid,void *p);
  */
 double mdlNumAccess(MDL,int);
 double mdlMissRatio(MDL,int);
+double mdlSharedHitRatio(MDL,int);
 
 void mdlSetCudaBufferSize(MDL,int,int);
 int mdlCudaActive(MDL mdl);
@@ -701,6 +903,9 @@ void mdlTimeReset(MDL mdl);
 double mdlTimeComputing(MDL mdl);
 double mdlTimeSynchronizing(MDL mdl);
 double mdlTimeWaiting(MDL mdl);
+int mdlCommThreads(MDL mdl);
+void mdlCommTimeReset(MDL mdl);
+double mdlCommTimeBusy(MDL mdl,int iComm);
 double mdlWallTime(MDL mdl);
 void mdlprintf(MDL mdl, const char *format, ...);
 
@@ -13,6 +13,17 @@ typedef struct mdlGridContext {
     uint32_t *rs;  /* Starting slab for each processor */
     uint32_t *rn;  /* Number of slabs on each processor */
     uint32_t *id;  /* Which processor has this slab */
+    /*
+    ** Pencil decomposition: each slab is shared by a group of "nGroup"
+    ** consecutive processors, each with a range of dimension "iPencil"
+    ** (1 or 2). For slabs this is dimension 2 complete with nGroup=1.
+    */
+    int iPencil;
+    uint32_t sPencil, nPencil; /* Start and number of local pencils */
+    uint32_t nGroup;           /* Processors sharing each slab */
+    uint32_t *rs2; /* Starting pencil for each processor */
+    uint32_t *rn2; /* Number of pencils on each processor */
+    uint32_t *pid; /* Which processor in the group has this pencil */
 } *MDLGRID;
 
 typedef struct {
@@ -36,6 +47,7 @@ typedef struct mdlFFTContext {
     MDLGRID rgrid;
     MDLGRID kgrid;
     FFTW3(plan) fplan, iplan;
+    struct mdlFFTPencil *pencil; /* Pencil transform if not NULL */
 } *MDLFFT;
 #endif
 #endif
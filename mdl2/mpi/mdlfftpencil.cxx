@@ -0,0 +1,288 @@
+/*  This file is part of PKDGRAV3 (http://www.pkdgrav.org/).
+ *  Copyright (c) 2001-2018 Joachim Stadel & Douglas Potter
+ *
+ *  PKDGRAV3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  PKDGRAV3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with PKDGRAV3.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mdlfftpencil.h"
+#ifdef MDL_FFTW
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <assert.h>
+
+#ifdef USE_SINGLE
+    #define MDL_MPI_FFT_REAL MPI_FLOAT
+#else
+    #define MDL_MPI_FFT_REAL MPI_DOUBLE
+#endif
+
+bool mdlFFTPencil::prefer(int nProcs,int n1,int n2,int n3) {
+#ifdef MDL_FFT_PENCIL
+    return nProcs > 1;
+#else
+    // Slabs leave processors idle once there are more processors than planes
+    return nProcs > n3 || nProcs > n2;
+#endif
+}
+
+// The most square processor grid that gives everyone some of the grid
+bool mdlFFTPencil::factor(int nProcs,int n1,int n2,int n3,int &P3,int &P2) {
+    int n1h = n1/2 + 1;
+    double dBest = -1.0;
+    for (auto p2=1; p2<=nProcs; ++p2) {
+        if (nProcs % p2) continue;
+        auto p3 = nProcs / p2;
+        if (p3 > n3 || p3 > n2 || p2 > n2 || p2 > n1h) continue;
+        double d = std::abs(std::log(1.0 * p3 / p2));
+        if (dBest < 0.0 || d < dBest) {
+            dBest = d;
+            P3 = p3;
+            P2 = p2;
+        }
+    }
+    return dBest >= 0.0;
+}
+
+mdlFFTPencil::mdlFFTPencil(int nProcs,int iProc,int n1,int n2,int n3)
+    : n1(n1), n2(n2), n3(n3), n1h(n1/2+1) {
+    if (!factor(nProcs,n1,n2,n3,P3,P2)) {
+        fprintf(stderr,"ERROR: a %d x %d x %d FFT cannot be decomposed over %d processors\n",
+                n1,n2,n3,nProcs);
+        abort();
+    }
+    i3 = iProc / P2;
+    i2 = iProc % P2;
+    Z  = block(n3,P3,i3);
+    Y  = block(n2,P2,i2);
+    X  = block(n1h,P2,i2);
+    YK = block(n2,P3,i3);
+    ptrdiff_t nA = (ptrdiff_t)n1h * Y.n * Z.n;  // r-space (complex after the x transform)
+    ptrdiff_t nB = (ptrdiff_t)n2 * X.n * Z.n;   // complete y
+    ptrdiff_t nC = (ptrdiff_t)n3 * X.n * YK.n;  // k-space
+    nLocal = 2 * std::max({nA,nB,nC});
+}
+
+mdlFFTPencil::~mdlFFTPencil() {
+    for (auto i=0; i<2; ++i) {
+        if (planX[i]) FFTW3(destroy_plan)(planX[i]);
+        if (planY[i]) FFTW3(destroy_plan)(planY[i]);
+        if (planZ[i]) FFTW3(destroy_plan)(planZ[i]);
+    }
+    if (work) FFTW3(free)(work);
+    if (typeComplex != MPI_DATATYPE_NULL) MPI_Type_free(&typeComplex);
+    if (commRow != MPI_COMM_NULL) MPI_Comm_free(&commRow);
+    if (commCol != MPI_COMM_NULL) MPI_Comm_free(&commCol);
+}
+
+void mdlFFTPencil::create(MPI_Comm comm) {
+    int iProc;
+    MPI_Comm_rank(comm,&iProc);
+    assert(iProc == i3*P2 + i2);
+    MPI_Comm_split(comm,i3,i2,&commRow);
+    MPI_Comm_split(comm,i2,i3,&commCol);
+    MPI_Type_contiguous(2,MDL_MPI_FFT_REAL,&typeComplex);
+    MPI_Type_commit(&typeComplex);
+
+    // The counts are for the forward transform; the backward swaps send and receive.
+    rowSend.resize(P2); rowSendDisp.resize(P2);
+    rowRecv.resize(P2); rowRecvDisp.resize(P2);
+    for (auto b=0; b<P2; ++b) {
+        rowSend[b] = block(n1h,P2,b).n * Y.n * Z.n;
+        rowRecv[b] = X.n * block(n2,P2,b).n * Z.n;
+        rowSendDisp[b] = b ? rowSendDisp[b-1] + rowSend[b-1] : 0;
+        rowRecvDisp[b] = b ? rowRecvDisp[b-1] + rowRecv[b-1] : 0;
+    }
+    colSend.resize(P3); colSendDisp.resize(P3);
+    colRecv.resize(P3); colRecvDisp.resize(P3);
+    for (auto c=0; c<P3; ++c) {
+        colSend[c] = block(n2,P3,c).n * X.n * Z.n;
+        colRecv[c] = YK.n * X.n * block(n3,P3,c).n;
+        colSendDisp[c] = c ? colSendDisp[c-1] + colSend[c-1] : 0;
+        colRecvDisp[c] = c ? colRecvDisp[c-1] + colRecv[c-1] : 0;
+    }
+
+    // The plans are made in-place on the work array, but are executed on other arrays
+    work = FFTW3(alloc_complex)(nLocal/2);
+    auto rwork = reinterpret_cast<FFTW3(real) *>(work);
+    unsigned flags = FFTW_ESTIMATE | FFTW_UNALIGNED;
+    if (Y.n && Z.n) {
+        planX[0] = FFTW3(plan_many_dft_r2c)(1,&n1,Y.n*Z.n,rwork,NULL,1,2*n1h,work,NULL,1,n1h,flags);
+        planX[1] = FFTW3(plan_many_dft_c2r)(1,&n1,Y.n*Z.n,work,NULL,1,n1h,rwork,NULL,1,2*n1h,flags);
+    }
+    if (X.n && Z.n) {
+        planY[0] = FFTW3(plan_many_dft)(1,&n2,X.n*Z.n,work,NULL,1,n2,work,NULL,1,n2,FFTW_FORWARD,flags);
+        planY[1] = FFTW3(plan_many_dft)(1,&n2,X.n*Z.n,work,NULL,1,n2,work,NULL,1,n2,FFTW_BACKWARD,flags);
+    }
+    if (X.n && YK.n) {
+        FFTW3(iodim) dim = {n3,X.n,X.n};
+        FFTW3(iodim) loop[2] = {{X.n,1,1},{YK.n,X.n*n3,X.n*n3}};
+        planZ[0] = FFTW3(plan_guru_dft)(1,&dim,2,loop,work,work,FFTW_FORWARD,flags);
+        planZ[1] = FFTW3(plan_guru_dft)(1,&dim,2,loop,work,work,FFTW_BACKWARD,flags);
+    }
+}
+
+/*
+** Local layouts (all complex):
+**   A: [z][y][kx]   kx complete (n1h), y in Y, z in Z
+**   B: [z][kx][y]   y complete, kx in X, z in Z
+**   C: [y][z][kx]   z complete, kx in X, y in YK
+** The exchanged blocks are always ordered with z outermost.
+*/
+void mdlFFTPencil::packRow(const FFTW3(complex) *A,FFTW3(complex) *out) {
+    for (auto b=0; b<P2; ++b) {
+        auto Xb = block(n1h,P2,b);
+        for (auto z=0; z<Z.n; ++z) {
+            for (auto y=0; y<Y.n; ++y) {
+                memcpy(out,A + n1h*(y + (ptrdiff_t)Y.n*z) + Xb.s,sizeof(*out)*Xb.n);
+                out += Xb.n;
+            }
+        }
+    }
+}
+
+void mdlFFTPencil::unpackRow(const FFTW3(complex) *in,FFTW3(complex) *B) {
+    for (auto b=0; b<P2; ++b) {
+        auto Yb = block(n2,P2,b);
+        for (auto z=0; z<Z.n; ++z) {
+            for (auto y=Yb.s; y<Yb.s+Yb.n; ++y) {
+                for (auto x=0; x<X.n; ++x) {
+                    auto *p = B[y + n2*(x + (ptrdiff_t)X.n*z)];
+                    p[0] = (*in)[0];
+                    p[1] = (*in)[1];
+                    ++in;
+                }
+            }
+        }
+    }
+}
+
+void mdlFFTPencil::packCol(const FFTW3(complex) *B,FFTW3(complex) *out) {
+    for (auto c=0; c<P3; ++c) {
+        auto YKc = block(n2,P3,c);
+        for (auto z=0; z<Z.n; ++z) {
+            for (auto x=0; x<X.n; ++x) {
+                memcpy(out,B + n2*(x + (ptrdiff_t)X.n*z) + YKc.s,sizeof(*out)*YKc.n);
+                out += YKc.n;
+            }
+        }
+    }
+}
+
+void mdlFFTPencil::unpackCol(const FFTW3(complex) *in,FFTW3(complex) *C) {
+    for (auto c=0; c<P3; ++c) {
+        auto Zc = block(n3,P3,c);
+        for (auto z=Zc.s; z<Zc.s+Zc.n; ++z) {
+            for (auto x=0; x<X.n; ++x) {
+                for (auto y=0; y<YK.n; ++y) {
+                    auto *p = C[x + X.n*(z + (ptrdiff_t)n3*y)];
+                    p[0] = (*in)[0];
+                    p[1] = (*in)[1];
+                    ++in;
+                }
+            }
+        }
+    }
+}
+
+void mdlFFTPencil::packColBack(const FFTW3(complex) *C,FFTW3(complex) *out) {
+    for (auto c=0; c<P3; ++c) {
+        auto Zc = block(n3,P3,c);
+        for (auto z=Zc.s; z<Zc.s+Zc.n; ++z) {
+            for (auto x=0; x<X.n; ++x) {
+                for (auto y=0; y<YK.n; ++y) {
+                    auto *p = C[x + X.n*(z + (ptrdiff_t)n3*y)];
+                    (*out)[0] = p[0];
+                    (*out)[1] = p[1];
+                    ++out;
+                }
+            }
+        }
+    }
+}
+
+void mdlFFTPencil::unpackColBack(const FFTW3(complex) *in,FFTW3(complex) *B) {
+    for (auto c=0; c<P3; ++c) {
+        auto YKc = block(n2,P3,c);
+        for (auto z=0; z<Z.n; ++z) {
+            for (auto x=0; x<X.n; ++x) {
+                memcpy(B + n2*(x + (ptrdiff_t)X.n*z) + YKc.s,in,sizeof(*in)*YKc.n);
+                in += YKc.n;
+            }
+        }
+    }
+}
+
+void mdlFFTPencil::packRowBack(const FFTW3(complex) *B,FFTW3(complex) *out) {
+    for (auto b=0; b<P2; ++b) {
+        auto Yb = block(n2,P2,b);
+        for (auto z=0; z<Z.n; ++z) {
+            for (auto y=Yb.s; y<Yb.s+Yb.n; ++y) {
+                for (auto x=0; x<X.n; ++x) {
+                    auto *p = B[y + n2*(x + (ptrdiff_t)X.n*z)];
+                    (*out)[0] = p[0];
+                    (*out)[1] = p[1];
+                    ++out;
+                }
+            }
+        }
+    }
+}
+
+void mdlFFTPencil::unpackRowBack(const FFTW3(complex) *in,FFTW3(complex) *A) {
+    for (auto b=0; b<P2; ++b) {
+        auto Xb = block(n1h,P2,b);
+        for (auto z=0; z<Z.n; ++z) {
+            for (auto y=0; y<Y.n; ++y) {
+                memcpy(A + n1h*(y + (ptrdiff_t)Y.n*z) + Xb.s,in,sizeof(*in)*Xb.n);
+                in += Xb.n;
+            }
+        }
+    }
+}
+
+// r-space (data) to k-space (in place)
+void mdlFFTPencil::forward(FFTW3(real) *data) {
+    auto A = reinterpret_cast<FFTW3(complex) *>(data);
+    if (planX[0]) FFTW3(execute_dft_r2c)(planX[0],data,A);
+    packRow(A,work);
+    MPI_Alltoallv(work,rowSend.data(),rowSendDisp.data(),typeComplex,
+                  A,   rowRecv.data(),rowRecvDisp.data(),typeComplex,commRow);
+    unpackRow(A,work);
+    if (planY[0]) FFTW3(execute_dft)(planY[0],work,work);
+    packCol(work,A);
+    MPI_Alltoallv(A,   colSend.data(),colSendDisp.data(),typeComplex,
+                  work,colRecv.data(),colRecvDisp.data(),typeComplex,commCol);
+    unpackCol(work,A);
+    if (planZ[0]) FFTW3(execute_dft)(planZ[0],A,A);
+}
+
+// k-space (kdata) to r-space (in place)
+void mdlFFTPencil::backward(FFTW3(complex) *kdata) {
+    auto C = kdata;
+    if (planZ[1]) FFTW3(execute_dft)(planZ[1],C,C);
+    packColBack(C,work);
+    MPI_Alltoallv(work,colRecv.data(),colRecvDisp.data(),typeComplex,
+                  C,   colSend.data(),colSendDisp.data(),typeComplex,commCol);
+    unpackColBack(C,work);
+    if (planY[1]) FFTW3(execute_dft)(planY[1],work,work);
+    packRowBack(work,C);
+    MPI_Alltoallv(C,   rowRecv.data(),rowRecvDisp.data(),typeComplex,
+                  work,rowSend.data(),rowSendDisp.data(),typeComplex,commRow);
+    unpackRowBack(work,C);
+    if (planX[1]) FFTW3(execute_dft_c2r)(planX[1],C,reinterpret_cast<FFTW3(real) *>(C));
+}
+#endif
@@ -0,0 +1,89 @@
+/*  This file is part of PKDGRAV3 (http://www.pkdgrav.org/).
+ *  Copyright (c) 2001-2018 Joachim Stadel & Douglas Potter
+ *
+ *  PKDGRAV3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  PKDGRAV3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with PKDGRAV3.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MDLFFTPENCIL_H
+#define MDLFFTPENCIL_H
+#include "mdl_config.h"
+#include "mdlfft.h"
+#ifdef MDL_FFTW
+#include "mpi.h"
+#include <vector>
+
+/*
+** Distributed 3D real FFT with a two dimensional ("pencil") decomposition.
+**
+** The P processors form a P3 x P2 grid and processor p = i3*P2 + i2.
+**   r-space: x complete (padded to 2*(n1/2+1)), y in Y[i2], z in Z[i3]
+**   k-space: kx in X[i2], z complete, y in YK[i3] (stored kx,z,y)
+** With P2 = 1 this is the FFTW transposed slab layout. Slabs limit the number
+** of processors to the grid size; pencils allow up to n^2 processors.
+**
+** The transform is three batches of 1D FFTs separated by two all-to-all
+** exchanges, the first within a row (same i3) and the second within a column
+** (same i2) of the processor grid. A work array of the same size as the grid
+** is used for the exchanges.
+*/
+struct mdlFFTPencil {
+    struct range {
+        int s, n;
+    };
+    // Balanced block decomposition of n elements into p pieces
+    static range block(int n,int p,int i) {
+        int s = (int64_t)n * i / p;
+        return range {s, (int)((int64_t)n * (i+1) / p) - s};
+    }
+    // Choose the processor grid; returns false if the grid is too small
+    static bool factor(int nProcs,int n1,int n2,int n3,int &P3,int &P2);
+    // Should this transform use pencils rather than FFTW slabs?
+    static bool prefer(int nProcs,int n1,int n2,int n3);
+
+    int n1, n2, n3, n1h;
+    int P3, P2, i3, i2;
+    range Z, Y;     // r-space: local z slab and y pencil
+    range X, YK;    // k-space: local kx pencil and y slab
+    ptrdiff_t nLocal; // Local elements in units of FFTW3(real)
+
+    // Layout only: this is enough to answer size queries
+    mdlFFTPencil(int nProcs,int iProc,int n1,int n2,int n3);
+    ~mdlFFTPencil();
+    // Collective over "comm": create the communicators, plans and work array
+    void create(MPI_Comm comm);
+    mdlFFTPencil(const mdlFFTPencil &) = delete;
+    mdlFFTPencil &operator=(const mdlFFTPencil &) = delete;
+
+    void forward(FFTW3(real) *data);
+    void backward(FFTW3(complex) *kdata);
+
+protected:
+    MPI_Comm commRow = MPI_COMM_NULL, commCol = MPI_COMM_NULL;
+    MPI_Datatype typeComplex = MPI_DATATYPE_NULL;
+    FFTW3(plan) planX[2] = {}, planY[2] = {}, planZ[2] = {}; // [0]: forward, [1]: backward
+    FFTW3(complex) *work = nullptr;
+    std::vector<int> rowSend, rowSendDisp, rowRecv, rowRecvDisp;
+    std::vector<int> colSend, colSendDisp, colRecv, colRecvDisp;
+
+    void packRow(const FFTW3(complex) *A,FFTW3(complex) *out);
+    void unpackRow(const FFTW3(complex) *in,FFTW3(complex) *B);
+    void packCol(const FFTW3(complex) *B,FFTW3(complex) *out);
+    void unpackCol(const FFTW3(complex) *in,FFTW3(complex) *C);
+    void packColBack(const FFTW3(complex) *C,FFTW3(complex) *out);
+    void unpackColBack(const FFTW3(complex) *in,FFTW3(complex) *B);
+    void packRowBack(const FFTW3(complex) *B,FFTW3(complex) *out);
+    void unpackRowBack(const FFTW3(complex) *in,FFTW3(complex) *A);
+};
+#endif
+#endif
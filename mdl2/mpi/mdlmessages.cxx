@@ -1,5 +1,6 @@
 #include "mdlmessages.h"
 #include "mdl.h"
+#include "mdlfftpencil.h"
 #include <string.h>
 
 namespace mdl {
@@ -66,8 +67,13 @@ void mdlMessageSTOP::action(class mpiClass *mpi)        { mpi->MessageSTOP(this)
 void mdlMessageFlushFromCore::action(class mpiClass *mpi) { mpi->MessageFlushFromCore(this); }
 void mdlMessageCacheOpen::action(class mpiClass *mpi)   { mpi->MessageCacheOpen(this); }
 void mdlMessageCacheClose::action(class mpiClass *mpi)  { mpi->MessageCacheClose(this); }
+void mdlMessageCacheWindow::action(class mpiClass *mpi) { mpi->MessageCacheWindow(this); }
+void mdlMessageCacheNode::action(class mpiClass *mpi)   { mpi->MessageCacheNode(this); }
+void mdlMessageNodeStore::action(class mpiClass *mpi)   { mpi->MessageNodeStore(this); }
+void mdlMessageNodeStoreFree::action(class mpiClass *mpi) { mpi->MessageNodeStoreFree(this); }
 void mdlMessageCacheFlushOut::action(class mpiClass *mpi)  { mpi->MessageCacheFlushOut(this); }
 void mdlMessageCacheFlushLocal::action(class mpiClass *mpi) { mpi->MessageCacheFlushLocal(this); }
+void mdlMessageCachePrefetch::action(class mpiClass *mpi) { mpi->MessageCachePrefetch(this); }
 void mdlMessageGridShare::action(class mpiClass *mpi)   { mpi->MessageGridShare(this); }
 #ifdef MDL_FFTW
 void mdlMessageDFT_R2C::action(class mpiClass *mpi)     { mpi->MessageDFT_R2C(this); }
@@ -87,6 +93,28 @@ mdlMessageFFT_Sizes::mdlMessageFFT_Sizes(int n1, int n2, int n3)
     : n1(n1), n2(n2), n3(n3) {}
 mdlMessageFFT_Plans::mdlMessageFFT_Plans(int n1, int n2, int n3,FFTW3(real) *data,FFTW3(complex) *kdata)
     : mdlMessageFFT_Sizes(n1,n2,n3), data(data), kdata(kdata) {}
+
+// The slab sizes (nz,sz,ny,sy,nLocal) must already be set
+void mdlMessageFFT_Sizes::setSlab() {
+    nyr = n2;
+    syr = 0;
+    nxk = n1/2 + 1;
+    sxk = 0;
+    nGroup = 1;
+}
+
+void mdlMessageFFT_Sizes::setPencil(const mdlFFTPencil &pencil) {
+    nLocal = pencil.nLocal;
+    nz = pencil.Z.n;
+    sz = pencil.Z.s;
+    ny = pencil.YK.n;
+    sy = pencil.YK.s;
+    nyr = pencil.Y.n;
+    syr = pencil.Y.s;
+    nxk = pencil.X.n;
+    sxk = pencil.X.s;
+    nGroup = pencil.P2;
+}
 #endif
 
 } // namespace mdl
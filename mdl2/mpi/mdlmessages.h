@@ -10,6 +10,8 @@ enum class CacheMessageType : uint8_t {
     REQUEST = 0,
     REPLY = 1,
     FLUSH = 2,
+    PREFETCH = 3,       // A REQUEST that nobody waits for
+    PREFETCH_REPLY = 4, // Its reply is added to the node shared cache
     UNKNOWN,
 };
 
@@ -121,6 +123,49 @@ public:
     virtual void action(class mpiClass *mdl);
 };
 
+// Attach (or detach) this process's data for a read-only cache to its MPI window
+class mdlMessageCacheWindow : public mdlMessage {
+    friend class mdlClass;
+    friend class mpiClass;
+protected:
+    int cid;
+    bool bOpen;
+public:
+    virtual void action(class mpiClass *mdl);
+    explicit mdlMessageCacheWindow(int cid,bool bOpen) : cid(cid), bOpen(bOpen) {}
+};
+
+class mdlMessageCacheNode : public mdlMessage {
+    friend class mdlClass;
+    friend class mpiClass;
+protected:
+    int cid;
+    bool bOpen = true;
+public:
+    virtual void action(class mpiClass *mdl);
+    explicit mdlMessageCacheNode(int cid) : cid(cid) {}
+};
+
+class mdlMessageNodeStore : public mdlMessage {
+    friend class mdlClass;
+    friend class mpiClass;
+protected:
+    uint64_t nBytes;
+    void *pStore = nullptr;
+public:
+    virtual void action(class mpiClass *mdl);
+    explicit mdlMessageNodeStore(uint64_t nBytes) : nBytes(nBytes) {}
+};
+
+class mdlMessageNodeStoreFree : public mdlMessage {
+    friend class mpiClass;
+protected:
+    void *pStore;
+public:
+    virtual void action(class mpiClass *mdl);
+    explicit mdlMessageNodeStoreFree(void *pStore) : pStore(pStore) {}
+};
+
 class mdlMessageCacheFlushOut : public mdlMessage {
 public:
     virtual void action(class mpiClass *mdl);
@@ -131,6 +176,16 @@ public:
     virtual void action(class mpiClass *mdl);
 };
 
+// A batch of cache lines to request without waiting for the result
+class mdlMessageCachePrefetch : public mdlMessage {
+    friend class mdlClass;
+    friend class mpiClass;
+protected:
+    std::vector<CacheHeader> lines;
+public:
+    virtual void action(class mpiClass *mdl);
+};
+
 class mdlMessageGridShare : public mdlMessage {
     friend class mdlClass;
     friend class mpiClass;
@@ -173,6 +228,11 @@ protected: // Input fields
     int n1,n2,n3;
 protected: // Output fields
     ptrdiff_t nz, sz, ny, sy, nLocal;
+    ptrdiff_t nyr, syr;   // r-space y pencil
+    ptrdiff_t nxk, sxk;   // k-space x pencil
+    int nGroup;           // Processors sharing a slab (1 for slabs)
+    void setSlab();
+    void setPencil(const struct mdlFFTPencil &pencil);
 public:
     virtual void action(class mpiClass *mdl);
     explicit mdlMessageFFT_Sizes(int n1, int n2, int n3);
@@ -186,6 +246,7 @@ protected: // Input fields
     FFTW3(complex) *kdata;
 protected: // Output fields
     FFTW3(plan) fplan, iplan;
+    struct mdlFFTPencil *pencil;
 public:
     virtual void action(class mpiClass *mdl);
     explicit mdlMessageFFT_Plans(int n1, int n2, int n3,FFTW3(real) *data=0,FFTW3(complex) *kdata=0);
@@ -8,6 +8,14 @@ class mdlMessageMPI : public mdlMessage {
 protected:
     friend class mdlClass;
     friend class mpiClass;
+    friend class mdlCommThread;
+    // Used when the send is handed to a communication thread (see mpiClass::CacheSend)
+    const void *sendBuffer = nullptr;
+    int sendCount = 0;
+    int sendRank = -1;
+    int sendTag = 0;
+    bool bSendSync = false;
+    MPI_Status sendStatus;
 public:
     virtual void action(class mpiClass *mpi) override = 0;
     virtual void finish(class mpiClass *mpi, MPI_Request request, MPI_Status status);
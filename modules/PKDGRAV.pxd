@@ -137,6 +137,8 @@ cdef extern from "master.h":
         void AddLinearSignal(int iGrid, int iSeed, double Lbox, double a, bool bFixed, float fPhase)
         double Read(string achInFile)
         void Write(string pszFileName,double dTime,bool bCheckpoint)
+        void Checkpoint(int iStep, int nSteps, double dTime, double dDelta)
+        void CheckpointWait()
         void DomainDecomp(int iRung)
         void BuildTree(bool bNeedEwald)
         void Reorder()
@@ -157,6 +159,7 @@ cdef extern from "master.h":
         void *GridBinK(int nBins, int iGrid)
         void GridCreateFFT(int nGrid)
         void GridDeleteFFT()
+        void MeshKick(double dTime, double dDelta, int bKickClose, int bKickOpen)
         void AssignMass(int iAssignment,int iGrid,float fDelta,int fold)
         void DensityContrast(int nGrid,bool k)
         void WindowCorrection(int iAssignment,int iGrid);
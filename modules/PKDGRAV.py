@@ -115,6 +115,19 @@ def load_checkpoint(filename,species=None,classes=None,step=None,steps=None,time
     """
     return read_checkpoint(filename,kwargs,species,classes,step,steps,time,delta,E,U,Utime)
 
+def checkpoint(step,time=1.0,delta=0.0,steps=0):
+    """
+    Write a checkpoint (and restart file) as a simulation would at this step.
+    Any asynchronous writes are finished before returning.
+
+    :param integer step: the step number (used in the file name)
+    :param number time: simulation time
+    :param number delta: time step
+    :param integer steps: total number of steps
+    """
+    msr0.Checkpoint(step,steps,time,delta)
+    msr0.CheckpointWait()
+
 def domain_decompose(rung=0):
     """
     Particles are ordered spatially across all nodes and cores using
@@ -152,6 +165,18 @@ def gravity(time=0.0,delta=0.0,theta=0.7,rung=0,ewald=None,step=0.0,kick_close=T
                         bGravStep,nPartRhoLoc,iTimeStepCrit)
     # return r
 
+def mesh_kick(time=0.0,delta=0.0,kick_close=True,kick_open=False):
+    """
+    Apply the TreePM long-range force computed on an nGridPM mesh.
+    The tree must have been built.
+
+    :param number time: simulation time
+    :param number delta: time step
+    :param Boolean kick_close: apply the closing half kick
+    :param Boolean kick_open: apply the opening half kick
+    """
+    msr0.MeshKick(time,delta,kick_close,kick_open)
+
 def simulate(**kwargs):
     """
     Directly enter simulation mode. Normally simulation mode is disabled
@@ -54,6 +54,10 @@
 #endif
 #include <numeric>
 #include <algorithm>
+#include <memory>
+#include <new>
+#include <mutex>
+#include <condition_variable>
 #include <boost/range/adaptor/reversed.hpp>
 #include <gsl/gsl_spline.h>
 
@@ -67,6 +71,7 @@
 #include "gravity/grav.h"
 #include "mdl.h"
 #include "io/outtype.h"
+#include "io/chkcompress.h"
 #include "cosmo.h"
 #include "SPH/SPHEOS.h"
 #include "SPH/SPHpredict.h"
@@ -314,7 +319,7 @@ void pkdContext::set_factor(std::uint32_t factor) {
 pkdContext::pkdContext(mdl::mdlClass *mdl,
                        int nStore,uint64_t nMinTotalStore,uint64_t nMinEphemeral,uint32_t nEphemeralBytes,
                        int nTreeBitsLo, int nTreeBitsHi,
-                       int iCacheSize,int iCacheMaxInflight,int iWorkQueueSize,
+                       int iCacheSize,int iCacheMaxInflight,uint64_t nSharedCacheSize,bool bCacheRMA,bool bCacheShm,int iWorkQueueSize,
                        const TinyVector<double,3> &fPeriod,uint64_t nDark,uint64_t nGas,uint64_t nStar,uint64_t nBH,
                        uint64_t mMemoryModel, uint32_t nIntegerFactor) : mdl(mdl),
     pLightCone(nullptr), pHealpixData(nullptr), csm(nullptr) {
@@ -414,10 +419,24 @@ pkdContext::pkdContext(mdl::mdlClass *mdl,
         particles.add<int32_t>(PKD_FIELD::oGroup,"group");
     }
 
+    if ( mMemoryModel & PKD_MODEL_WORK ) {
+        particles.add<float>(PKD_FIELD::oWork,"work");
+        particles.add<float>(PKD_FIELD::oLastWork,"last_work");
+    }
+
     if ( mMemoryModel & PKD_MODEL_POTENTIAL ) {
         particles.add<float>(PKD_FIELD::oPotential,"phi");
     }
+    if ( mMemoryModel & PKD_MODEL_HOT_FIELDS ) {
+        // The kick and drift touch only these, so they must fit in the first cache line
+        static_assert(sizeof(PARTICLE) + 3*sizeof(double) + 3*sizeof(float) + 3*sizeof(float) <= 64);
+        particles.hot(PKD_FIELD::oPosition);
+        particles.hot(PKD_FIELD::oVelocity);
+        particles.hot(PKD_FIELD::oAcceleration);
+    }
     particles.commit();
+    assert(!(mMemoryModel & PKD_MODEL_HOT_FIELDS) || !particles.present(PKD_FIELD::oAcceleration)
+           || particles.offset(PKD_FIELD::oAcceleration) + 3*sizeof(float) <= 64);
 
     /*
     ** Tree node memory models
@@ -503,6 +522,7 @@ pkdContext::pkdContext(mdl::mdlClass *mdl,
     uint64_t nElements[3] = {uint64_t(nStore+1),nEphemeral,0};
     uint64_t nBytesPerElement[3] = {particles.ParticleSize(),nEphemeralBytes,sizeof(uint64_t)};
     void *pSegments[3];
+    mdl->SetCacheShm(bCacheShm); // Decides how the storage is allocated
     storageSize = mdl->new_shared_array(pSegments,3,nElements,nBytesPerElement,nMinTotalStore);
     if (storageSize == 0) {
         fprintf(stderr, "ERROR: unable to allocate main storage\n");
@@ -532,6 +552,8 @@ pkdContext::pkdContext(mdl::mdlClass *mdl,
 
     if ( iCacheSize > 0 ) mdlSetCacheSize(this->mdl,iCacheSize);
     mdl->SetCacheMaxInflight(iCacheMaxInflight);
+    mdl->SetSharedCacheSize(nSharedCacheSize);
+    mdl->SetCacheRMA(bCacheRMA);
 
     // This is cheeserific - chooses the largest specified
 #if defined(USE_CUDA)
@@ -602,6 +624,7 @@ int pkdContext::AddLocal(int n) {
 pkdContext::~pkdContext() {
     int ism;
 
+    pkdCheckpointWait(this);
     /*
     ** Close caching space and free up nodes.
     */
@@ -634,11 +657,14 @@ pkdContext::~pkdContext() {
         mdl->delete_shared_array(storageBase,storageSize);
     }
     free(pTempPRIVATE);
+    lcpWriter.reset();
     if (pLightCone) {
 #ifdef _MSC_VER
         _aligned_free(pLightCone);
+        _aligned_free(pLightConeSpare);
 #else
         free(pLightCone);
+        free(pLightConeSpare);
 #endif
     }
     if (pHealpixData) free(pHealpixData);
@@ -668,7 +694,7 @@ size_t pkdClMemory(PKD pkd) {
 }
 
 size_t pkdIlpMemory(PKD pkd) {
-    return pkd->ilp.memory();
+    return pkd->ilp.memory() + pkd->ilpg.memory();
 }
 
 size_t pkdIlcMemory(PKD pkd) {
@@ -709,9 +735,23 @@ void pkdReadFIO(PKD pkd,FIO fio,uint64_t iFirst,int nLocal,double dvFac, double
     fMass = 0.0f;
     fSoft = 0.0f;
 
-    fioSeek(fio,iFirst,FIO_SPECIES_ALL);
-    for (auto i = 0; i < nLocal; ++i) {
-        auto p = pkd->particles[pkd->Local()+i];
+    // Dark particles are read in blocks into these arrays
+    constexpr int nDarkBlock = 4096;
+    std::vector<uint64_t> blkID(nDarkBlock);
+    std::vector<double> blkPos(3*nDarkBlock), blkVel(3*nDarkBlock);
+    std::vector<float> blkMass(nDarkBlock), blkSoft(nDarkBlock), blkPot(nDarkBlock), blkDen(nDarkBlock);
+    fioDarkBlock blk;
+    blk.piParticleID = blkID.data();
+    for (auto d=0; d<3; ++d) {
+        blk.pdPos[d] = blkPos.data() + d*nDarkBlock;
+        blk.pdVel[d] = blkVel.data() + d*nDarkBlock;
+    }
+    blk.pfMass = blkMass.data();
+    blk.pfSoft = blkSoft.data();
+    blk.pfPot = blkPot.data();
+    blk.pfDen = blkDen.data();
+
+    auto initialize = [pkd](auto &p) {
         /*
         ** General initialization.
         */
@@ -725,7 +765,7 @@ void pkdReadFIO(PKD pkd,FIO fio,uint64_t iFirst,int nLocal,double dvFac, double
         ** get funny uninitialized values!
         */
         if ( p.have_acceleration() ) p.acceleration() = 0;
-        float *pPot = p.have_potential() ? &p.potential() : &dummypot;
+        if ( p.have_work() ) p.work() = p.last_work() = 0;
         p.set_group(0);
 
         /* Initialize New SPH fields if present */
@@ -748,6 +788,50 @@ void pkdReadFIO(PKD pkd,FIO fio,uint64_t iFirst,int nLocal,double dvFac, double
             Star.fTimer = 0;
             /*      Star.iGasOrder = IORDERMAX;*/
         }
+    };
+
+    auto finalize = [pkd,dvFac](auto &p,uint64_t iParticleID,const TinyVector<double,3> &r,const TinyVector<double,3> &vel) {
+        p.set_position(r);
+        if (!pkd->bNoParticleOrder) p.set_order(iParticleID);
+        if (p.have_particle_id()) p.ParticleID() = iParticleID;
+
+        if (p.have_velocity()) {
+            auto &v = p.velocity();
+            if (!p.is_gas()) {
+                // IA: dvFac = a*a, and for the gas we already provide
+                // the peculiar velocity in the IC
+                v = vel * dvFac;
+            }
+            else {
+                v = vel * sqrt(dvFac);
+            }
+        }
+    };
+
+    fioSeek(fio,iFirst,FIO_SPECIES_ALL);
+    for (auto i = 0; i < nLocal;) {
+        if (fioSpecies(fio) == FIO_SPECIES_DARK) {
+            auto n = fioReadDarkN(fio,std::min(nDarkBlock,nLocal-i),&blk);
+            mdlassert(pkd->mdl,n>0);
+            for (auto j = 0; j < n; ++j) {
+                auto p = pkd->particles[pkd->Local()+i+j];
+                initialize(p);
+                if (p.have_potential()) p.potential() = blkPot[j];
+                pkd->particles.setClass(blkMass[j],blkSoft[j],0,FIO_SPECIES_DARK,&p);
+                p.set_density(blkDen[j]);
+                for (auto d=0; d<3; ++d) {
+                    r[d] = blk.pdPos[d][j];
+                    vel[d] = blk.pdVel[d][j];
+                }
+                finalize(p,blkID[j],r,vel);
+            }
+            i += n;
+            continue;
+        }
+
+        auto p = pkd->particles[pkd->Local()+i];
+        initialize(p);
+        float *pPot = p.have_potential() ? &p.potential() : &dummypot;
 
         eSpecies = fioSpecies(fio);
         switch (eSpecies) {
@@ -819,11 +903,6 @@ void pkdReadFIO(PKD pkd,FIO fio,uint64_t iFirst,int nLocal,double dvFac, double
                 }
             }
             break;
-        case FIO_SPECIES_DARK:
-            fioReadDark(fio,&iParticleID,r.data(),vel.data(),&fMass,&fSoft,pPot,&fDensity);
-            pkd->particles.setClass(fMass,fSoft,0,eSpecies,&p);
-            p.set_density(fDensity);
-            break;
         case FIO_SPECIES_STAR:
             ;
             float afStarOtherData[4];
@@ -871,21 +950,8 @@ void pkdReadFIO(PKD pkd,FIO fio,uint64_t iFirst,int nLocal,double dvFac, double
             fprintf(stderr,"Unsupported particle type: %d\n",eSpecies);
             assert(0);
         }
-        p.set_position(r);
-        if (!pkd->bNoParticleOrder) p.set_order(iParticleID);
-        if (p.have_particle_id()) p.ParticleID() = iParticleID;
-
-        if (p.have_velocity()) {
-            auto &v = p.velocity();
-            if (!p.is_gas()) {
-                // IA: dvFac = a*a, and for the gas we already provide
-                // the peculiar velocity in the IC
-                v = vel * dvFac;
-            }
-            else {
-                v = vel * sqrt(dvFac);
-            }
-        }
+        finalize(p,iParticleID,r,vel);
+        ++i;
     }
 
     pkd->AddLocal(nLocal);
@@ -1041,12 +1107,25 @@ uint64_t hilbert3d(float x,float y,float z) {
     return s;
 }
 
+/*
+** The predicted cost of particles iFrom to iTo-1 over the next multistep cycle.
+*/
+static double pkdWorkSum(PKD pkd,int iFrom,int iTo) {
+    double fWork = 0.0;
+    for (auto i=iFrom; i<iTo; ++i) {
+        auto p = pkd->particles[i];
+        fWork += pkdPredictedWork(p.last_work(),p.rung());
+    }
+    return fWork;
+}
+
 /*
 ** Partition particles between iFrom and iTo into those < fSplit and
 ** those >= to fSplit.  Find number and weight in each partition.
+** The weight is the number of particles, or the predicted work if bWork.
 */
 int pkdWeight(PKD pkd,int d,double fSplit,int iSplitSide,int iFrom,int iTo,
-              int *pnLow,int *pnHigh,double *pfLow,double *pfHigh) {
+              int *pnLow,int *pnHigh,double *pfLow,double *pfHigh,int bWork) {
     int iPart;
     double fLower,fUpper;
 
@@ -1067,8 +1146,14 @@ int pkdWeight(PKD pkd,int d,double fSplit,int iSplitSide,int iFrom,int iTo,
     ** Calculate the lower weight and upper weight BETWEEN the particles
     ** iFrom to iTo!
     */
-    fLower = iPart - iFrom;
-    fUpper = iTo - iPart + 1;
+    if (bWork && pkd->particles.present(PKD_FIELD::oWork)) {
+        fLower = pkdWorkSum(pkd,iFrom,iPart);
+        fUpper = pkdWorkSum(pkd,iPart,iTo+1);
+    }
+    else {
+        fLower = iPart - iFrom;
+        fUpper = iTo - iPart + 1;
+    }
     if (iSplitSide) {
         *pfLow = fUpper;
         *pfHigh = fLower;
@@ -1305,9 +1390,8 @@ void pkdLocalOrder(PKD pkd,uint64_t iMinOrder, uint64_t iMaxOrder) {
 
 #define MAX_IO_BUFFER_SIZE (8*1024*1024)
 
-void pkdCheckpoint(PKD pkd,const char *fname) {
+static void writeCheckpoint(const char *fname,char *pBuffer,size_t nFileSize) {
     asyncFileInfo info;
-    size_t nFileSize;
     int fd;
     io_init(&info, IO_MAX_ASYNC_COUNT, 0, IO_AIO|IO_LIBAIO);
     fd = io_create(&info, fname);
@@ -1315,8 +1399,6 @@ void pkdCheckpoint(PKD pkd,const char *fname) {
         perror(fname);
         abort();
     }
-    nFileSize = pkd->particles.ParticleSize() * pkd->Local();
-    char *pBuffer = (char *)pkd->particles.Element(0);
     while (nFileSize) {
         size_t count = nFileSize > MAX_IO_BUFFER_SIZE ? MAX_IO_BUFFER_SIZE : nFileSize;
         io_write(&info, pBuffer, count);
@@ -1326,6 +1408,77 @@ void pkdCheckpoint(PKD pkd,const char *fname) {
     io_close(&info);
 }
 
+static void writeCheckpoint(const char *fname,char *pBuffer,uint64_t nLocal,uint32_t nParticleSize,
+                            int bCompress,uint32_t oDelta,const char *baseFile) {
+    if (bCompress) chkcompress::write(fname,pBuffer,nLocal,nParticleSize,oDelta,baseFile);
+    else writeCheckpoint(fname,pBuffer,nLocal*nParticleSize);
+}
+
+/*
+** Background checkpoint writers of this process. Staging is done by all
+** threads at once, but at most nWriters of them are writing to disk.
+*/
+static struct {
+    std::mutex mutex;
+    std::condition_variable cv;
+    int nActive = 0;
+    void acquire(int nWriters) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock,[this,nWriters] {return nActive < nWriters;});
+        ++nActive;
+    }
+    void release() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --nActive;
+        }
+        cv.notify_one();
+    }
+} checkpointWriters;
+
+/*
+** Write the local particle store to a checkpoint file. In asynchronous mode
+** the store is first copied to a staging buffer which is then drained to disk
+** (and compressed if requested) by a background thread while the simulation
+** continues; nWriters limits how many threads of this process write at once.
+** If the staging buffer cannot be allocated we fall back to a blocking write. A compressed checkpoint is written as the difference to
+** baseFile if it is given (see chkcompress).
+*/
+void pkdCheckpoint(PKD pkd,const char *fname,int bAsync,int nWriters,int bCompress,const char *baseFile) {
+    uint64_t nLocal = pkd->Local();
+    uint32_t nParticleSize = pkd->particles.ParticleSize();
+    size_t nFileSize = nParticleSize * nLocal;
+    char *pBuffer = (char *)pkd->particles.Element(0);
+    /* Integer positions are delta encoded; they are close together along the tree order */
+    uint32_t oDelta = pkd->particles.integerized() ? pkd->particles.offset(PKD_FIELD::oPosition) : 0;
+    pkdCheckpointWait(pkd);
+    if (bAsync) {
+        std::unique_ptr<char[]> pStage(new (std::nothrow) char[nFileSize ? nFileSize : 1]);
+        if (pStage) {
+            memcpy(pStage.get(),pBuffer,nFileSize);
+            pkd->checkpointThread = std::thread(
+            [filename=std::string(fname),base=std::string(baseFile ? baseFile : ""),
+                      pStage=std::move(pStage),nLocal,nParticleSize,bCompress,oDelta,nWriters]() {
+                checkpointWriters.acquire(nWriters);
+                writeCheckpoint(filename.c_str(),pStage.get(),nLocal,nParticleSize,bCompress,oDelta,
+                                base.empty() ? nullptr : base.c_str());
+                checkpointWriters.release();
+            });
+            return;
+        }
+        fprintf(stderr,"%d: unable to stage %zu bytes for asynchronous checkpoint, writing synchronously\n",
+                pkd->Self(),nFileSize);
+    }
+    writeCheckpoint(fname,pBuffer,nLocal,nParticleSize,bCompress,oDelta,baseFile);
+}
+
+/*
+** Block until any outstanding asynchronous checkpoint has reached the disk.
+*/
+void pkdCheckpointWait(PKD pkd) {
+    if (pkd->checkpointThread.joinable()) pkd->checkpointThread.join();
+}
+
 /*****************************************************************************\
 * Write particles received from another node
 \*****************************************************************************/
@@ -1883,9 +2036,9 @@ void extensiveMarkerTest(PKD pkd, struct pkdTimestepParameters *ts, SPHOptions *
 
 void pkdGravAll(PKD pkd,
                 struct pkdKickParameters *kick,struct pkdLightconeParameters *lc,struct pkdTimestepParameters *ts,
-                double dTime,int nReps,int bPeriodic,int bGPU,
+                double dTime,int nReps,int bPeriodic,int bGPU,int bCompactILP,
                 int bEwald,int iRoot1, int iRoot2,
-                double fEwCut,double fEwhCut,double dThetaMin,SPHOptions *SPHoptions,
+                double fEwCut,double fEwhCut,int nEwTable,double dPMrs,double dPMCut,double dThetaMin,SPHOptions *SPHoptions,
                 uint64_t *pnActive,
                 double *pdPart,double *pdPartNumAccess,double *pdPartMissRatio,
                 double *pdCell,double *pdCellNumAccess,double *pdCellMissRatio,
@@ -1910,13 +2063,22 @@ void pkdGravAll(PKD pkd,
 #if defined(INSTRUMENT) && defined(HAVE_TICK_COUNTER)
     mdlTimeReset(pkd->mdl);
 #endif
+    mdlCommTimeReset(pkd->mdl);
 
     /*
     ** Set up Ewald tables and stuff.
     */
     if (bPeriodic && bEwald && SPHoptions->doGravity) {
-        pkdEwaldInit(pkd,nReps,fEwCut,fEwhCut,bGPU); /* ignored in Flop count! */
+        pkdEwaldInit(pkd,nReps,fEwCut,fEwhCut,nEwTable,bGPU); /* ignored in Flop count! */
+    }
+    /*
+    ** With TreePM the tree only supplies the short-range force.
+    */
+    if (dPMrs > 0.0) {
+        pkd->fPMi2rs = 0.5 / dPMrs;
+        pkd->fPMCut2 = dPMCut * dPMCut;
     }
+    else pkd->fPMi2rs = pkd->fPMCut2 = 0.0f;
     pkdCopySPHOptionsToDevice(pkd, SPHoptions, bGPU);
     /*
     ** Start particle caching space (cell cache already active).
@@ -1943,7 +2105,7 @@ void pkdGravAll(PKD pkd,
     pkd->nTilesCPU = 0;
 
     *pnActive = pkdGravWalk(pkd,kick,lc,ts,
-                            dTime,nReps,bPeriodic && bEwald,bGPU,
+                            dTime,nReps,bPeriodic && bEwald,bGPU,bCompactILP,
                             iRoot1,iRoot2,0,dThetaMin,pdFlop,&dPartSum,&dCellSum,SPHoptions);
 
     assert(pkd->nWpPending == 0);
@@ -2009,8 +2171,14 @@ void pkdCalcEandL(PKD pkd,double &T,double &U,double &Eth,TinyVector<double,3> &
 }
 
 static void flushLightCone(PKD pkd) {
-    size_t count = pkd->nLightCone * sizeof(LIGHTCONEP);
-    io_write(&pkd->afiLightCone,pkd->pLightCone,count);
+    if (pkd->lcpWriter) { // Packed in the background while we fill the other buffer
+        pkd->lcpWriter->flush(pkd->pLightCone,pkd->nLightCone);
+        std::swap(pkd->pLightCone,pkd->pLightConeSpare);
+    }
+    else {
+        size_t count = pkd->nLightCone * sizeof(LIGHTCONEP);
+        io_write(&pkd->afiLightCone,pkd->pLightCone,count);
+    }
     pkd->nLightCone = 0;
 }
 
@@ -2038,6 +2206,11 @@ static void combHealpix(void *vctx, void *v1, const void *v2) {
 void pkdLightConeClose(PKD pkd,const char *healpixname) {
     int i;
     size_t nWrite;
+    if (pkd->lcpWriter) {
+        pkd->lcpWriter->close(pkd->pLightCone,pkd->nLightCone);
+        pkd->lcpWriter.reset();
+        pkd->nLightCone = 0;
+    }
     if (pkd->afiLightCone.fd > 0) {
         flushLightCone(pkd);
         io_close(&pkd->afiLightCone);
@@ -2063,15 +2236,30 @@ void pkdLightConeClose(PKD pkd,const char *healpixname) {
     }
 }
 
-void pkdLightConeOpen(PKD pkd,const char *fname,int nSideHealpix) {
+void pkdLightConeOpen(PKD pkd,const char *fname,int nSideHealpix,int nSidePacked,double dQuantumPacked) {
     int i;
-    if (fname[0]) {
+    pkd->afiLightCone.fd = -1;
+    if (fname[0] && nSidePacked > 0) {
+        /* The packed writer needs a second buffer to fill while the first is written */
+        if (pkd->pLightConeSpare == NULL) {
+            uint64_t nLightConeBytes = pkd->nLightConeMax * sizeof(LIGHTCONEP);
+#ifdef _MSC_VER
+            pkd->pLightConeSpare = static_cast<LIGHTCONEP *>(_aligned_malloc(nLightConeBytes, 512));
+#else
+            void *v;
+            if (posix_memalign(&v, sysconf(_SC_PAGESIZE), nLightConeBytes)) v = NULL;
+            pkd->pLightConeSpare = static_cast<LIGHTCONEP *>(v);
+#endif
+            mdlassert(pkd->mdl,pkd->pLightConeSpare != NULL);
+        }
+        pkd->lcpWriter = std::make_unique<lcpcompress::writer>(fname,nSidePacked,dQuantumPacked);
+    }
+    else if (fname[0]) {
         if (io_create(&pkd->afiLightCone,fname) < 0) {
             perror(fname);
             abort();
         }
     }
-    else pkd->afiLightCone.fd = -1;
 
     pkd->nSideHealpix = nSideHealpix;
     if (pkd->nSideHealpix) {
@@ -2095,7 +2283,7 @@ void pkdLightConeOpen(PKD pkd,const char *fname,int nSideHealpix) {
 void addToLightCone(PKD pkd,double dvFac,double *r,float fPot,PARTICLE *p,int bParticleOutput) {
     auto P = pkd->particles[p];
     const auto &v = P.velocity();
-    if (pkd->afiLightCone.fd>0 && bParticleOutput) {
+    if ((pkd->afiLightCone.fd>0 || pkd->lcpWriter) && bParticleOutput) {
         LIGHTCONEP *pLC = pkd->pLightCone;
         pLC[pkd->nLightCone].id = P.order();
         pLC[pkd->nLightCone].pos[0] = r[0];
@@ -2213,6 +2401,32 @@ void pkdDrift(PKD pkd,int iRoot,double dTime,double dDelta,double dDeltaVPred,do
             }
         }
     }
+    else if (!pkd->bIntegerPosition) {
+        // Double positions are updated in place with the offsets and stride hoisted
+        // out of the loop, and the bounds kept as scalar min/max reductions.
+        auto pBase = static_cast<char *>(static_cast<void *>(pkd->particles));
+        const auto nSize = pkd->particles.ElementSize();
+        const auto oPos = pkd->particles.offset(PKD_FIELD::oPosition);
+        const auto oVel = pkd->particles.offset(PKD_FIELD::oVelocity);
+        double xMin = dMin[0], yMin = dMin[1], zMin = dMin[2];
+        double xMax = dMax[0], yMax = dMax[1], zMax = dMax[2];
+        for (i=pLower; i<=pUpper; ++i) {
+            auto pp = pBase + uint64_t(i)*nSize;
+            auto r = reinterpret_cast<double *>(pp + oPos);
+            auto v = reinterpret_cast<const float *>(pp + oVel);
+            double x = r[0] + dDelta*v[0];
+            double y = r[1] + dDelta*v[1];
+            double z = r[2] + dDelta*v[2];
+            r[0] = x; r[1] = y; r[2] = z;
+            assert(isfinite(x));
+            assert(isfinite(y));
+            assert(isfinite(z));
+            xMin = std::min(xMin,x); yMin = std::min(yMin,y); zMin = std::min(zMin,z);
+            xMax = std::max(xMax,x); yMax = std::max(yMax,y); zMax = std::max(zMax,z);
+        }
+        dMin[0] = xMin; dMin[1] = yMin; dMin[2] = zMin;
+        dMax[0] = xMax; dMax[1] = yMax; dMax[2] = zMax;
+    }
     else {
         for (i=pLower; i<=pUpper; ++i) {
             auto p = pkd->particles[i];
@@ -2251,7 +2465,7 @@ void pkdReorderWithinNodes(PKD pkd) {
         }
     }
     if (mdlCacheStatus(pkd->mdl,CID_CELL)) mdlFinishCache(pkd->mdl,CID_CELL);
-    mdlROcache(pkd->mdl,CID_CELL,pkdTreeNodeGetElement,pkd,pkd->NodeSize(),pkd->Nodes());
+    mdlROcacheTiled(pkd->mdl,CID_CELL,pkdTreeNodeGetElement,pkd,pkd->NodeSize(),pkd->Nodes(),pkd->tree.TileBits());
 }
 #endif
 
@@ -2439,12 +2653,27 @@ void pkdKick(PKD pkd,double dTime,double dDelta,int bDoGas,double dDeltaVPred,do
         }
     }
     else {
-        for (auto &p : pkd->particles) {
-            if (p.is_rung_range(uRungLo,uRungHi)) {
-                auto &a = p.acceleration();
-                auto &v = p.velocity();
-                v += a*dDelta;
-            }
+        // Walk the store directly: the offsets and stride are loop invariant so this
+        // is a simple strided loop (velocity and acceleration lead the particle with -Mhot).
+        // The fields are not split into separate arrays (SoA) which would vectorize this:
+        // the MDL caches, swaps, sorts and I/O all move particles as whole elements.
+        auto pBase = static_cast<char *>(static_cast<void *>(pkd->particles));
+        const auto nSize = pkd->particles.ElementSize();
+        const auto oVel = pkd->particles.offset(PKD_FIELD::oVelocity);
+        const auto oAcc = pkd->particles.offset(PKD_FIELD::oAcceleration);
+        const auto nLocal = pkd->Local();
+        for (auto i=0; i<nLocal; ++i) {
+            auto pp = pBase + uint64_t(i)*nSize;
+            auto uRung = reinterpret_cast<const PARTICLE *>(pp)->uRung;
+            if (uRung < uRungLo || uRung > uRungHi) continue;
+            auto v = reinterpret_cast<float *>(pp + oVel);
+            auto a = reinterpret_cast<const float *>(pp + oAcc);
+            v[0] += a[0]*dDelta;
+            v[1] += a[1]*dDelta;
+            v[2] += a[2]*dDelta;
+            assert(isfinite(v[0]));
+            assert(isfinite(v[1]));
+            assert(isfinite(v[2]));
         }
     }
 
@@ -2907,21 +3136,26 @@ void pkdOutPsGroup(PKD pkd,char *pszFileName,int iType) {
         assert(0);
 }
 
+/*
+** Local particles are partitioned in place by every tree build, so rather than
+** maintaining an index of them we sort the (usually much shorter) list of
+** requested IDs and search it once per particle.
+*/
 int pkdGetParticles(PKD pkd, int nIn, uint64_t *ID, struct outGetParticles *out) {
     assert(!pkd->bNoParticleOrder); /* We need particle IDs */
     int nOut = 0;
+    if (nIn == 0) return nOut;
+    std::vector<uint64_t> ids(ID,ID+nIn);
+    std::sort(ids.begin(),ids.end());
     for (auto &p : pkd->particles) {
-        for (auto j=0; j<nIn; ++j) {
-            if (ID[j] == p.order()) {
-                out[nOut].id = ID[j];
-                out[nOut].mass = p.mass();
-                out[nOut].phi = p.have_potential() ? p.potential() : 0.0;
-                out[nOut].r = p.position();
-                out[nOut].v = p.velocity();
-                ++nOut;
-                break;
-            }
-        }
+        auto iOrder = p.order();
+        if (!std::binary_search(ids.begin(),ids.end(),iOrder)) continue;
+        out[nOut].id = iOrder;
+        out[nOut].mass = p.mass();
+        out[nOut].phi = p.have_potential() ? p.potential() : 0.0;
+        out[nOut].r = p.position();
+        out[nOut].v = p.velocity();
+        ++nOut;
     }
     return nOut;
 }
@@ -21,6 +21,9 @@
 #include <stdint.h>
 #include <string.h>
 #include <vector>
+#include <thread>
+#include <memory>
+#include <cmath>
 
 #include "mdl.h"
 #ifdef USE_CUDA
@@ -32,6 +35,7 @@
 #include "gravity/ilp.h"
 #include "gravity/ilc.h"
 #include "gravity/cl.h"
+#include "gravity/workarena.h"
 #include "gravity/moments.h"
 #include "cosmo.h"
 #include "units.h"
@@ -40,6 +44,7 @@
 #include "core/integerize.h"
 #include "core/treenode.h"
 #include "io/iomodule.h"
+#include "io/lcpcompress.h"
 #include "SPH/SPHOptions.h"
 #ifdef HAVE_EOSLIB_H
     #include <EOSlib.h>
@@ -82,9 +87,11 @@ typedef uint_fast64_t total_t; /* Count of particles globally (total number) */
 #define CID_GridLinFx   2
 #define CID_GridLinFy   10
 #define CID_GridLinFz   11
+#define CID_PK_GRIDS    12 /* Up to PST_MAX_PK_GRIDS consecutive ids */
 #define CID_PNG         2
 #define CID_SADDLE_BUF  3
 #define CID_TREE_ROOT   3
+#define CID_FOF_LINKS   3
 
 #define MAX_TIMERS      10
 
@@ -109,6 +116,8 @@ typedef uint_fast64_t total_t; /* Count of particles globally (total number) */
 #define PKD_MODEL_INTEGER_POS  (1<<16) /* Particles do not have an order */
 #define PKD_MODEL_BH           (1<<17) /* BH fields */
 #define PKD_MODEL_GLOBALGID    (1<<18) /* Global group identifier per particle */
+#define PKD_MODEL_HOT_FIELDS   (1<<19) /* Position, velocity and acceleration first */
+#define PKD_MODEL_WORK         (1<<20) /* Measured work for domain decomposition */
 
 #define PKD_MODEL_NODE_MOMENT  (1<<24) /* Include moment in the tree */
 #define PKD_MODEL_NODE_ACCEL   (1<<25) /* mean accel on cell (for grav step) */
@@ -140,12 +149,7 @@ typedef uint_fast64_t total_t; /* Count of particles globally (total number) */
 #define ROOT        1
 #define NRESERVED_NODES MAX_RUNG+1
 
-typedef struct partLightCone {
-    uint64_t id;
-    float pos[3];
-    float vel[3];
-    float pot;
-} LIGHTCONEP;
+typedef lcpcompress::particle LIGHTCONEP;
 
 #define NMAX_OPENCALC   1000
 
@@ -368,7 +372,7 @@ public:
     explicit pkdContext(
         mdl::mdlClass *mdl,int nStore,uint64_t nMinTotalStore,uint64_t nMinEphemeral,uint32_t nEphemeralBytes,
         int nTreeBitsLo, int nTreeBitsHi,
-        int iCacheSize,int iCacheMaxInflight,int iWorkQueueSize,const blitz::TinyVector<double,3> &fPeriod,uint64_t nDark,uint64_t nGas,uint64_t nStar,uint64_t nBH,
+        int iCacheSize,int iCacheMaxInflight,uint64_t nSharedCacheSize,bool bCacheRMA,bool bCacheShm,int iWorkQueueSize,const blitz::TinyVector<double,3> &fPeriod,uint64_t nDark,uint64_t nGas,uint64_t nStar,uint64_t nBH,
         uint64_t mMemoryModel, uint32_t nIntegerFactor);
     virtual ~pkdContext();
     void set_factor(std::uint32_t factor);
@@ -433,7 +437,7 @@ public:
     }
 // I/O
 public:
-    void Restore(uint64_t iElement,const std::string &filename,uint64_t iBeg,uint64_t iEnd);
+    void Restore(uint64_t iElement,const std::string &filename,uint64_t iBeg,uint64_t iEnd,int iMethod=0);
 
 // Rockstar Analysis
 protected:
@@ -481,12 +485,15 @@ public:
     double *lcOffset2;
     asyncFileInfo afiLightCone;
     LIGHTCONEP *pLightCone;
+    LIGHTCONEP *pLightConeSpare = nullptr; // Filled while pLightCone is written by lcpWriter
+    std::unique_ptr<lcpcompress::writer> lcpWriter; // Packed light cone particle output
     int nLightCone, nLightConeMax;
     int64_t nHealpixPerDomain;
     int64_t nSideHealpix;
     healpixData *pHealpixData;
     gsl_spline *interp_scale; // interpolation table for 1/a given r in the lightcone
     gsl_interp_accel *interp_accel = gsl_interp_accel_alloc();
+    std::thread checkpointThread; // drains an asynchronous checkpoint to disk
 
     void *pLite;
     /*
@@ -501,6 +508,7 @@ public:
     int nMaxStack;
     CSTACK *S;
     ilpList ilp;
+    ilpgList ilpg;  // compact P-P list used for gravity only walks
     ilcList ilc;
     ilcList ill;
     clList::free_list clFreeList;
@@ -511,6 +519,7 @@ public:
     double dFlopSingleGPU, dFlopDoubleGPU;
     int nWpPending;
     uint64_t nTilesTotal, nTilesCPU;
+    workArena wpArena; /* workParticle storage, rewound every walk */
     /*
     ** Opening angle table for mass weighting.
     */
@@ -533,6 +542,24 @@ public:
     */
     struct EwaldVariables ew;
     EwaldTable ewt;
+    /*
+    ** Optional tabulated Ewald correction over the local domain.
+    ** Each node holds Pot, a[3] and the symmetric Jacobian da/dx[6].
+    */
+    struct EwaldGrid {
+        int n[3] = {0,0,0};
+        double r0[3] = {0,0,0};
+        double h = 0, ih = 0;
+        double dMaxError = 0;   // Relative force error now
+        double dBuildError = 0; // ... and when the table was built
+        std::vector<float> data;
+    } ewg;
+    /*
+    ** TreePM short-range split: 1/(2 r_s) and the squared cut-off radius.
+    ** The split is off when fPMi2rs is zero.
+    */
+    float fPMi2rs = 0.0f;
+    float fPMCut2 = 0.0f;
 #ifdef USE_SIMD_EWALD
     ewaldSIMD es;
 #endif
@@ -662,11 +689,21 @@ static inline int pkdIsNew(PKD pkd,PARTICLE *p) {
     return (p->iOrder == IORDERMAX);
 }
 
+/*
+** The predicted cost of a particle over the next multistep cycle. The work is
+** that of all of its force and smoothing evaluations over the last full step
+** (see MSR::ZeroWork), which already counts its 2^rung evaluations.
+** A particle that has not been measured still costs one interaction each time.
+*/
+static inline double pkdPredictedWork(float fWork,uint8_t uRung) {
+    return std::max<double>(fWork,std::ldexp(COST_FLOP_PP,uRung));
+}
+
 /*
 ** From tree.c:
 */
 void pkdVATreeBuild(PKD pkd,int nBucket);
-void pkdTreeBuild(PKD pkd,int nBucket,int nGroup,uint32_t uRoot,uint32_t uTemp,double ddHonHLimit);
+void pkdTreeBuild(PKD pkd,int nBucket,int nGroup,uint32_t uRoot,uint32_t uTemp,double ddHonHLimit,int nThreads=1,int bSort=0);
 uint32_t pkdDistribTopTree(PKD pkd, uint32_t uRoot, uint32_t nTop, KDN *pTop, int allocateMemory);
 void pkdOpenCloseCaches(PKD pkd,int bOpen,int bFixed);
 void pkdTreeInitMarked(PKD pkd);
@@ -691,7 +728,7 @@ void pkdSetSmooth(PKD pkd,double dSmooth);
 void pkdSetCrit(PKD pkd,double dCrit);
 void pkdEnforcePeriodic(PKD,Bound);
 void pkdPhysicalSoft(PKD pkd,double dSoftMax,double dFac,int bSoftMaxMul);
-int pkdWeight(PKD,int,double,int,int,int,int *,int *,double *,double *);
+int pkdWeight(PKD,int,double,int,int,int,int *,int *,double *,double *,int);
 void pkdCountVA(PKD,int,double,int *,int *);
 double pkdTotalMass(PKD pkd);
 uint8_t pkdGetMinDt(PKD pkd);
@@ -707,7 +744,8 @@ int pkdActiveOrder(PKD);
 
 /*#define PEANO_HILBERT_KEY_MAX 0x3ffffffffffull*/ /* 2d */
 #define PEANO_HILBERT_KEY_MAX 0x7fffffffffffffffull /* 3d */
-void pkdPeanoHilbertDecomp(PKD pkd, int nRungs, int iMethod);
+uint64_t hilbert2d(float x,float y);
+uint64_t hilbert3d(float x,float y,float z);
 void pkdRungOrder(PKD pkd, int iRung, total_t *nMoved);
 int pkdColRejects(PKD,int);
 int pkdColRejects_Old(PKD,int,double,double,int);
@@ -719,7 +757,8 @@ int pkdInactive(PKD);
 
 int pkdColOrdRejects(PKD,uint64_t,int);
 void pkdLocalOrder(PKD,uint64_t iMinOrder,uint64_t iMaxOrder);
-void pkdCheckpoint(PKD pkd,const char *fname);
+void pkdCheckpoint(PKD pkd,const char *fname,int bAsync,int nWriters,int bCompress,const char *baseFile=nullptr);
+void pkdCheckpointWait(PKD pkd);
 void pkdWriteHeaderFIO(PKD pkd, FIO fio, double dScaleFactor, double dTime,
                        uint64_t nDark, uint64_t nGas, uint64_t nStar, uint64_t nBH,
                        double dBoxSize, double h, int nProcessors, UNITS units);
@@ -731,9 +770,9 @@ void pkdSendArray(PKD pkd, int iNode, PKD_FIELD field, int iUnitSize,double dvFa
 void *pkdRecvArray(PKD pkd,int iNode, void *pDest, int iUnitSize);
 void pkdGravAll(PKD pkd,
                 struct pkdKickParameters *kick,struct pkdLightconeParameters *lc,struct pkdTimestepParameters *ts,
-                double dTime,int nReps,int bPeriodic,int bGPU,
+                double dTime,int nReps,int bPeriodic,int bGPU,int bCompactILP,
                 int bEwald,int iRoot1, int iRoot2,
-                double fEwCut,double fEwhCut,double dThetaMin,SPHOptions *SPHoptions,
+                double fEwCut,double fEwhCut,int nEwTable,double dPMrs,double dPMCut,double dThetaMin,SPHOptions *SPHoptions,
                 uint64_t *pnActive,
                 double *pdPart,double *pdPartNumAccess,double *pdPartMissRatio,
                 double *pdCell,double *pdCellNumAccess,double *pdCellMissRatio,
@@ -742,11 +781,12 @@ void pkdCalcEandL(PKD pkd,double &T,double &U,double &Eth,blitz::TinyVector<doub
 void pkdProcessLightCone(PKD pkd,PARTICLE *p,float fPot,double dLookbackFac,double dLookbackFacLCP,
                          double dDriftDelta,double dKickDelta,double dBoxSize,int bLightConeParticles,
                          blitz::TinyVector<double,3> hlcp,double tanalpha2);
-void pkdGravEvalPP(const PINFOIN &Part, ilpTile &tile, PINFOOUT &Out );
+void pkdGravEvalPP(const PINFOIN &Part, ilpTile &tile, PINFOOUT &Out, float i2rs=0.0f );
+void pkdGravEvalPP(const PINFOIN &Part, ilpgTile &tile, PINFOOUT &Out, float i2rs=0.0f );
 void pkdDensityEval(const PINFOIN &Part, ilpTile &tile,  PINFOOUT &Out, SPHOptions *SPHoptions);
 void pkdDensityCorrectionEval(const PINFOIN &Part, ilpTile &tile,  PINFOOUT &Out, SPHOptions *SPHoptions);
 void pkdSPHForcesEval(const PINFOIN &Part, ilpTile &tile,  PINFOOUT &Out, SPHOptions *SPHoptions);
-void pkdGravEvalPC(const PINFOIN &pPart, ilcTile &tile, PINFOOUT &pOut );
+void pkdGravEvalPC(const PINFOIN &pPart, ilcTile &tile, PINFOOUT &pOut, float i2rs=0.0f );
 void pkdDrift(PKD pkd,int iRoot,double dTime,double dDelta,double,double,int bDoGas);
 void pkdEndTimestepIntegration(PKD pkd, struct inEndTimestep in);
 #ifdef OPTIM_REORDER_IN_NODES
@@ -824,6 +864,9 @@ void pkdUpdateGasValues(PKD pkd, struct pkdKickParameters *kick, SPHOptions *SPH
 void pkdTreeUpdateFlagBounds(PKD pkd,uint32_t uRoot,SPHOptions *SPHoptions);
 #ifdef MDL_FFTW
 void pkdAssignMass(PKD pkd, uint32_t iLocalRoot, int iAssignment, int iGrid, float dDelta, int fold);
+void pkdAssignMassGrids(PKD pkd, uint32_t iLocalRoot, int iAssignment, int nGrids,
+                        const int *fold, const float *fDelta);
+void pkdDensityContrast(PKD pkd,double dTotalMass,int iGrid,bool k);
 void pkdInterlace(PKD pkd, int iGridTarget, int iGridSource);
 float getLinAcc(PKD pkd, MDLFFT fft,int cid, double r[3]);
 void pkdSetLinGrid(PKD pkd,double a0, double a, double a1, double dBSize, int nGrid, int iSeed,
@@ -834,7 +877,7 @@ void pkdMeasureLinPk(PKD pkd, int nGrid, double dA, double dBoxSize,
 #endif
 void pkdOutPsGroup(PKD pkd,char *pszFileName,int iType);
 
-void pkdLightConeOpen(PKD pkd, const char *fname,int nSideHealpix);
+void pkdLightConeOpen(PKD pkd, const char *fname,int nSideHealpix,int nSidePacked,double dQuantumPacked);
 void pkdLightConeClose(PKD pkd, const char *healpixname);
 void pkdLightCone(PKD pkd,uint8_t uRungLo,uint8_t uRungHi,
                   double dLookbackFac,double dLookbackFacLCP,
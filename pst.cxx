@@ -31,6 +31,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <cinttypes>
+#include <algorithm>
 #ifdef __linux__
     #include <unistd.h>
 #endif
@@ -91,6 +92,8 @@ void pstAddServices(PST pst,MDL mdl) {
                   sizeof(struct inSendArray),0);
     mdlAddService(mdl,PST_CHECKPOINT,pst,(fcnService_t *)pstCheckpoint,
                   sizeof(struct inWrite),0);
+    mdlAddService(mdl,PST_CHECKPOINTWAIT,pst,(fcnService_t *)pstCheckpointWait,
+                  0,0);
     mdlAddService(mdl,PST_OUTPUT,pst,(fcnService_t *)pstOutput,
                   sizeof(struct inOutput),0);
     mdlAddService(mdl,PST_OUTPUT_SEND,pst,(fcnService_t *)pstOutputSend,
@@ -245,6 +248,8 @@ void pstAddServices(PST pst,MDL mdl) {
                   sizeof(struct inNewFof),0);
     mdlAddService(mdl,PST_FOF_PHASES,pst,(fcnService_t *)pstFofPhases,
                   0,sizeof(struct outFofPhases));
+    mdlAddService(mdl,PST_FOF_RESOLVE_LINKS,pst,(fcnService_t *)pstFofResolveLinks,
+                  0,0);
     mdlAddService(mdl,PST_FOF_FINISH_UP,pst,(fcnService_t *)pstFofFinishUp,
                   sizeof(struct inFofFinishUp),sizeof(uint64_t));
     mdlAddService(mdl,PST_INITIALIZEPSTORE,pst,(fcnService_t *)pstInitializePStore,
@@ -306,6 +311,10 @@ void pstAddServices(PST pst,MDL mdl) {
                   sizeof(struct inInterlace), 0);
     mdlAddService(mdl,PST_GRID_BIN_K,pst,(fcnService_t *)pstGridBinK,
                   sizeof(struct inGridBinK), sizeof(struct outGridBinK));
+    mdlAddService(mdl,PST_ASSIGN_MASS_GRIDS,pst,(fcnService_t *)pstAssignMassGrids,
+                  sizeof(struct inAssignMassGrids), 0);
+    mdlAddService(mdl,PST_GRID_BIN_K_GRIDS,pst,(fcnService_t *)pstGridBinKGrids,
+                  sizeof(struct inGridBinKGrids), sizeof(struct outGridBinKGrids));
     mdlAddService(mdl,PST_BISPECTRUM_SELECT,pst,(fcnService_t *)pstBispectrumSelect,
                   sizeof(struct inBispectrumSelect), 0);
     mdlAddService(mdl,PST_BISPECTRUM_CALCULATE,pst,(fcnService_t *)pstBispectrumCalculate,
@@ -314,6 +323,8 @@ void pstAddServices(PST pst,MDL mdl) {
                   sizeof(struct inLinearKick), 0);
     mdlAddService(mdl,PST_SETLINGRID, pst,(fcnService_t *)pstSetLinGrid,
                   sizeof(struct inSetLinGrid), 0);
+    mdlAddService(mdl,PST_SETPMGRID, pst,(fcnService_t *)pstSetPMGrid,
+                  sizeof(struct inSetPMGrid), 0);
     mdlAddService(mdl,PST_MEASURELINPK,pst,(fcnService_t *)pstMeasureLinPk,
                   sizeof(struct inMeasureLinPk), sizeof(struct outMeasureLinPk));
 #endif
@@ -364,7 +375,7 @@ static void initializePStore(PKD *ppkd,MDL mdl,struct inInitializePStore *in) {
     *ppkd = new pkdContext(
         static_cast<mdl::mdlClass *>(mdl),in->nStore,in->nMinTotalStore,in->nMinEphemeral,in->nEphemeralBytes,
         in->nTreeBitsLo,in->nTreeBitsHi,
-        in->iCacheSize,in->iCacheMaxInflight,in->iWorkQueueSize,in->fPeriod,
+        in->iCacheSize,in->iCacheMaxInflight,in->nSharedCacheSize,in->bCacheRMA,in->bCacheShm,in->iWorkQueueSize,in->fPeriod,
         in->nSpecies[FIO_SPECIES_DARK],in->nSpecies[FIO_SPECIES_SPH],in->nSpecies[FIO_SPECIES_STAR], in->nSpecies[FIO_SPECIES_BH],
         in->mMemoryModel,in->nIntegerFactor);
 }
@@ -659,8 +670,25 @@ int pstCheckpoint(PST pst,void *vin,int nIn,void *vout,int nOut) {
     else {
         PKD pkd = pst->plcl->pkd;
         char achOutFile[PST_FILENAME_SIZE];
+        char achBaseFile[PST_FILENAME_SIZE];
         makeName(achOutFile,sizeof(achOutFile),in->achOutFile,mdlSelf(pkd->mdl),"");
-        pkdCheckpoint(pkd,achOutFile);
+        if (in->achBaseFile[0]) makeName(achBaseFile,sizeof(achBaseFile),in->achBaseFile,mdlSelf(pkd->mdl),"");
+        /* Our share of the writers; every process gets at least one */
+        int nWriters = std::max(1,in->nWriters * mdlCores(pkd->mdl) / mdlThreads(pkd->mdl));
+        pkdCheckpoint(pkd,achOutFile,in->bAsync,nWriters,in->bCompress,in->achBaseFile[0] ? achBaseFile : nullptr);
+    }
+    return 0;
+}
+
+int pstCheckpointWait(PST pst,void *vin,int nIn,void *vout,int nOut) {
+    mdlassert(pst->mdl,nIn == 0);
+    if (pstNotCore(pst)) {
+        int rID = pst->mdl->ReqService(pst->idUpper,PST_CHECKPOINTWAIT,vin,nIn);
+        pstCheckpointWait(pst->pstLower,vin,nIn,NULL,0);
+        pst->mdl->GetReply(rID);
+    }
+    else {
+        pkdCheckpointWait(pst->plcl->pkd);
     }
     return 0;
 }
@@ -824,7 +852,7 @@ int pstBuildTree(PST pst,void *vin,int nIn,void *vout,int nOut) {
     else {
         auto pRoot = pkd->tree[uRoot];
         pkd->TreeAlignNode();
-        pkdTreeBuild(plcl->pkd,in->nBucket,in->nGroup,in->uRoot,in->utRoot,in->ddHonHLimit);
+        pkdTreeBuild(plcl->pkd,in->nBucket,in->nGroup,in->uRoot,in->utRoot,in->ddHonHLimit,in->nThreads,in->bSort);
         *pTop = *pRoot;
         /* Get our cell ready */
         pTop->set_remote(pst->idSelf);
@@ -1224,10 +1252,15 @@ int pstGravity(PST pst,void *vin,int nIn,void *vout,int nOut) {
         pstCombStat(&outr->sPart,&tmp.sPart);
         pstCombStat(&outr->sPartNumAccess,&tmp.sPartNumAccess);
         pstCombStat(&outr->sPartMissRatio,&tmp.sPartMissRatio);
+        pstCombStat(&outr->sPartSharedRatio,&tmp.sPartSharedRatio);
         pstCombStat(&outr->sCell,&tmp.sCell);
         pstCombStat(&outr->sCellNumAccess,&tmp.sCellNumAccess);
         pstCombStat(&outr->sCellMissRatio,&tmp.sCellMissRatio);
+        pstCombStat(&outr->sCellSharedRatio,&tmp.sCellSharedRatio);
         pstCombStat(&outr->sFlop,&tmp.sFlop);
+        pstCombStat(&outr->sCommBusy,&tmp.sCommBusy);
+        pstCombStat(&outr->sWorkArena,&tmp.sWorkArena);
+        pstCombStat(&outr->sWorkPeak,&tmp.sWorkPeak);
 #if defined(INSTRUMENT) && defined(HAVE_TICK_COUNTER)
         pstCombStat(&outr->sComputing,&tmp.sComputing);
         pstCombStat(&outr->sWaiting,&tmp.sWaiting);
@@ -1245,8 +1278,11 @@ int pstGravity(PST pst,void *vin,int nIn,void *vout,int nOut) {
         outr->dFlopDoubleCPU += tmp.dFlopDoubleCPU;
         outr->dFlopSingleGPU += tmp.dFlopSingleGPU;
         outr->dFlopDoubleGPU += tmp.dFlopDoubleGPU;
+        outr->dEwaldTableError = std::max(outr->dEwaldTableError,tmp.dEwaldTableError);
         outr->nTilesTotal    += tmp.nTilesTotal;
         outr->nTilesCPU      += tmp.nTilesCPU;
+        outr->nWorkUnits     += tmp.nWorkUnits;
+        outr->nWorkArenaGrow += tmp.nWorkArenaGrow;
     }
     else {
 #ifdef __linux__
@@ -1255,8 +1291,8 @@ int pstGravity(PST pst,void *vin,int nIn,void *vout,int nOut) {
 #endif
         PKD pkd = plcl->pkd;
         pkdGravAll(pkd,&in->kick,&in->lc,&in->ts,
-                   in->dTime,in->nReps,in->bPeriodic,in->bGPU,
-                   in->bEwald,in->iRoot1,in->iRoot2,in->dEwCut,in->dEwhCut,in->dTheta,&in->SPHoptions,
+                   in->dTime,in->nReps,in->bPeriodic,in->bGPU,in->bCompactILP,
+                   in->bEwald,in->iRoot1,in->iRoot2,in->dEwCut,in->dEwhCut,in->nEwTable,in->dPMrs,in->dPMCut,in->dTheta,&in->SPHoptions,
                    &outr->nActive,
                    &outr->sPart.dSum,&outr->sPartNumAccess.dSum,&outr->sPartMissRatio.dSum,
                    &outr->sCell.dSum,&outr->sCellNumAccess.dSum,&outr->sCellMissRatio.dSum,
@@ -1265,8 +1301,13 @@ int pstGravity(PST pst,void *vin,int nIn,void *vout,int nOut) {
         outr->dFlopDoubleCPU = 1e-9*pkd->dFlopDoubleCPU;
         outr->dFlopSingleGPU = 1e-9*pkd->dFlopSingleGPU;
         outr->dFlopDoubleGPU = 1e-9*pkd->dFlopDoubleGPU;
+        outr->dEwaldTableError = pkd->ewg.dMaxError;
         outr->nTilesTotal    = pkd->nTilesTotal;
         outr->nTilesCPU      = pkd->nTilesCPU;
+        outr->nWorkUnits     = pkd->wpArena.units();
+        outr->nWorkArenaGrow = pkd->wpArena.grown();
+        outr->sWorkArena.dSum = pkd->wpArena.capacity()*1.0/1024/1024;
+        outr->sWorkPeak.dSum = pkd->wpArena.peakBytes()*1.0/1024/1024;
         outr->sLocal.dSum = plcl->pkd->Local();
         outr->sActive.dSum = (double)outr->nActive;
 #ifdef __linux__
@@ -1319,7 +1360,22 @@ int pstGravity(PST pst,void *vin,int nIn,void *vout,int nOut) {
         pstInitStat(&outr->sCell,pst->idSelf);
         pstInitStat(&outr->sCellNumAccess,pst->idSelf);
         pstInitStat(&outr->sCellMissRatio,pst->idSelf);
+        /*
+        ** Misses that the node shared cache answered without a request.
+        */
+        outr->sCellSharedRatio.dSum = 100.0*mdlSharedHitRatio(pst->mdl,CID_CELL);     /* as a percentage */
+        outr->sPartSharedRatio.dSum = 100.0*mdlSharedHitRatio(pst->mdl,CID_PARTICLE); /* as a percentage */
+        pstInitStat(&outr->sPartSharedRatio,pst->idSelf);
+        pstInitStat(&outr->sCellSharedRatio,pst->idSelf);
         pstInitStat(&outr->sFlop,pst->idSelf);
+        pstInitStat(&outr->sWorkArena,pst->idSelf);
+        pstInitStat(&outr->sWorkPeak,pst->idSelf);
+        /*
+        ** Each communication thread is reported by the core with the same index.
+        */
+        outr->sCommBusy.dSum = 100.0*mdlCommTimeBusy(pst->mdl,mdlCore(pst->mdl)); /* as a percentage */
+        pstInitStat(&outr->sCommBusy,pst->idSelf);
+        if (mdlCore(pst->mdl) >= mdlCommThreads(pst->mdl)) outr->sCommBusy.n = 0;
 #if defined(INSTRUMENT) && defined(HAVE_TICK_COUNTER)
         outr->sComputing.dSum     = mdlTimeComputing(pst->mdl);
         outr->sWaiting.dSum       = mdlTimeWaiting(pst->mdl);
@@ -1336,9 +1392,11 @@ int pstGravity(PST pst,void *vin,int nIn,void *vout,int nOut) {
             outr->sPart.n = 0;
             outr->sPartNumAccess.n = 0;
             outr->sPartMissRatio.n = 0;
+            outr->sPartSharedRatio.n = 0;
             outr->sCell.n = 0;
             outr->sCellNumAccess.n = 0;
             outr->sCellMissRatio.n = 0;
+            outr->sCellSharedRatio.n = 0;
         }
     }
     return sizeof(struct outGravityReduct);
@@ -1804,7 +1862,8 @@ int pstNewFof(PST pst,void *vin,int nIn,void *vout,int nOut) {
     }
     else {
         LCL *plcl = pst->plcl;
-        pkdNewFof(plcl->pkd,in->dTau2,in->nMinMembers,in->bPeriodic,in->nReplicas,in->nBucket);
+        pkdNewFof(plcl->pkd,in->dTau2,in->nMinMembers,in->bPeriodic,in->nReplicas,in->nBucket,
+                  in->bUnionFind,in->nThreads,in->bDomainSFC);
     }
     return 0;
 }
@@ -1828,6 +1887,20 @@ int pstFofPhases(PST pst,void *vin,int nIn,void *vout,int nOut) {
     return sizeof(struct outFofPhases);
 }
 
+int pstFofResolveLinks(PST pst,void *vin,int nIn,void *vout,int nOut) {
+    mdlassert(pst->mdl,nIn == 0);
+    if (pst->nLeaves > 1) {
+        int rID = pst->mdl->ReqService(pst->idUpper,PST_FOF_RESOLVE_LINKS,vin,nIn);
+        pstFofResolveLinks(pst->pstLower,vin,nIn,vout,nOut);
+        pst->mdl->GetReply(rID);
+    }
+    else {
+        LCL *plcl = pst->plcl;
+        pkdFofResolveLinks(plcl->pkd);
+    }
+    return 0;
+}
+
 /*
 ** This is an almost identical copy of HopFinishUp.
 ** JST: added the count of lower subtree number of local groups.
@@ -2285,7 +2358,7 @@ int pstLightConeOpen(PST pst,void *vin,int nIn,void *vout,int nOut) {
         char achOutFile[PST_FILENAME_SIZE];
         if (in->achOutFile[0]) makeName(achOutFile,sizeof(achOutFile),in->achOutFile,mdlSelf(pkd->mdl),"lcp.");
         else achOutFile[0] = 0;
-        pkdLightConeOpen(pkd, achOutFile, in->nSideHealpix);
+        pkdLightConeOpen(pkd, achOutFile, in->nSideHealpix, in->nSidePacked, in->dQuantumPacked);
     }
     return 0;
 }
@@ -91,6 +91,8 @@ enum pst_service {
     PST_REORDER,
     PST_DOMAINORDER,
     PST_LOCALORDER,
+    PST_SFCSAMPLE,
+    PST_SFCEXCHANGE,
     PST_COMPRESSASCII,
     PST_SENDPARTICLES,
     PST_SENDARRAY,
@@ -99,7 +101,9 @@ enum pst_service {
     PST_OUTPUT,
     PST_OUTPUT_SEND,
     PST_CHECKPOINT,
+    PST_CHECKPOINTWAIT,
     PST_RESTORE,
+    PST_CHECKPOINT_SIZES,
     PST_BUILDTREE,
     PST_DISTRIBTOPTREE,
     PST_DUMPTREES,
@@ -146,6 +150,7 @@ enum pst_service {
     PST_INITCOSMOLOGY,
     PST_INITLIGHTCONE,
     PST_ZERONEWRUNG,
+    PST_ZEROWORK,
     PST_ACTIVERUNG,
     PST_COUNTRUNGS,
     PST_ACCELSTEP,
@@ -174,6 +179,7 @@ enum pst_service {
     PST_SETNPARTS,
     PST_NEW_FOF,
     PST_FOF_PHASES,
+    PST_FOF_RESOLVE_LINKS,
     PST_FOF_FINISH_UP,
     PST_HOP_LINK,
     PST_HOP_JOIN,
@@ -222,12 +228,15 @@ enum pst_service {
     PST_MEASURELINPK,
     PST_SETLINGRID,
     PST_LINEARKICK,
+    PST_SETPMGRID,
 #endif
     PST_ASSIGN_MASS,
     PST_DENSITY_CONTRAST,
     PST_WINDOW_CORRECTION,
     PST_INTERLACE,
     PST_GRID_BIN_K,
+    PST_ASSIGN_MASS_GRIDS,
+    PST_GRID_BIN_K_GRIDS,
     PST_BISPECTRUM_SELECT,
     PST_BISPECTRUM_CALCULATE,
     PST_TOTALMASS,
@@ -259,7 +268,10 @@ struct inInitializePStore {
     blitz::TinyVector<double,3> fPeriod;
     uint64_t nMinEphemeral;
     uint64_t nMinTotalStore;
+    uint64_t nSharedCacheSize;
     uint32_t nIntegerFactor;
+    int bCacheRMA;
+    int bCacheShm;
     int nEphemeralBytes;
     int nTreeBitsLo;
     int nTreeBitsHi;
@@ -331,7 +343,11 @@ struct inWrite {
     int iLower, iUpper;
     int bHDF5;
     int mFlags;
+    int bAsync;
+    int nWriters; /* Asynchronous checkpoint: threads writing to disk at once */
+    int bCompress;
     char achOutFile[PST_FILENAME_SIZE];
+    char achBaseFile[PST_FILENAME_SIZE]; /* Full checkpoint for an incremental one (or empty) */
 };
 int pstWrite(PST,void *,int,void *,int);
 
@@ -351,6 +367,9 @@ int pstSendArray(PST,void *,int,void *,int);
 /* PST_CHECKPOINT */
 int pstCheckpoint(PST,void *,int,void *,int);
 
+/* PST_CHECKPOINTWAIT */
+int pstCheckpointWait(PST,void *,int,void *,int);
+
 struct inOutput {
     int iProcessor;   /* Output number: 0 to nParaWrite */
     int nProcessor;   /* Number of processors left in parallel */
@@ -374,6 +393,8 @@ struct inBuildTree {
     uint32_t uRoot;   /* Which root node to use */
     uint32_t utRoot;  /* Template tree */
     double ddHonHLimit;
+    int nThreads;     /* Threads used to build each local tree */
+    int bSort;        /* Build by sorting the particles on tree keys */
 };
 int pstBuildTree(PST,void *,int,void *,int);
 
@@ -539,10 +560,14 @@ struct inGravity {
     double dEwCut;
     double dEwhCut;
     double dTheta;
+    double dPMrs;   /* TreePM split scale; zero for pure tree */
+    double dPMCut;
     int nReps;
+    int nEwTable;
     int bPeriodic;
     int bEwald;
     int bGPU;
+    int bCompactILP;
     int iRoot1;
     int iRoot2;
     struct pkdKickParameters kick;
@@ -569,10 +594,15 @@ struct outGravityReduct {
     STAT sPart;
     STAT sPartNumAccess;
     STAT sPartMissRatio;
+    STAT sPartSharedRatio;
     STAT sCell;
     STAT sCellNumAccess;
     STAT sCellMissRatio;
+    STAT sCellSharedRatio;
     STAT sFlop;
+    STAT sCommBusy;
+    STAT sWorkArena;
+    STAT sWorkPeak;
 #ifdef INSTRUMENT
     STAT sComputing;
     STAT sWaiting;
@@ -586,10 +616,13 @@ struct outGravityReduct {
     double dFlopDoubleCPU;
     double dFlopSingleGPU;
     double dFlopDoubleGPU;
+    double dEwaldTableError;
     uint64_t nActive;
     uint64_t nRung[IRUNGMAX+1];
     uint64_t nTilesTotal;
     uint64_t nTilesCPU;
+    uint64_t nWorkUnits;
+    uint64_t nWorkArenaGrow;
 };
 int pstGravity(PST,void *,int,void *,int);
 
@@ -772,6 +805,9 @@ struct inNewFof {
     int bPeriodic;
     int nReplicas;
     int nBucket;
+    int bUnionFind;
+    int nThreads;
+    int bDomainSFC;
 };
 int pstNewFof(PST,void *,int,void *,int);
 
@@ -781,6 +817,9 @@ struct outFofPhases {
 };
 int pstFofPhases(PST,void *,int,void *,int);
 
+/* PST_FOF_RESOLVE_LINKS */
+int pstFofResolveLinks(PST,void *,int,void *,int);
+
 /* PST_FOF_FINISH_UP */
 struct inFofFinishUp {
     int nMinGroupSize;
@@ -1046,6 +1085,30 @@ struct inAssignMass {
     int fold;
 };
 int pstAssignMass(PST pst,void *vin,int nIn,void *vout,int nOut);
+/* PST_ASSIGN_MASS_GRIDS */
+#define PST_MAX_PK_FOLDS 4
+#define PST_MAX_PK_GRIDS (2*PST_MAX_PK_FOLDS)
+struct inAssignMassGrids {
+    int iAssignment;
+    int nGrids;
+    int fold[PST_MAX_PK_GRIDS];
+    float fDelta[PST_MAX_PK_GRIDS];
+    double dTotalMass;
+};
+int pstAssignMassGrids(PST pst,void *vin,int nIn,void *vout,int nOut);
+/* PST_GRID_BIN_K_GRIDS */
+struct inGridBinKGrids {
+    int nBins;
+    int iAssignment;
+    int nFolds;
+    int bInterlace;
+};
+struct outGridBinKGrids {
+    double fK[PST_MAX_PK_FOLDS][PST_MAX_K_BINS];
+    double fPower[PST_MAX_PK_FOLDS][PST_MAX_K_BINS];
+    uint64_t nPower[PST_MAX_PK_FOLDS][PST_MAX_K_BINS];
+};
+int pstGridBinKGrids(PST pst,void *vin,int nIn,void *vout,int nOut);
 /* PST_DENSITY_CONTRAST */
 struct inDensityContrast {
     int iGrid;
@@ -1080,6 +1143,7 @@ int pstBispectrumCalculate(PST pst,void *vin,int nIn,void *vout,int nOut);
 /* PST_LINEARKICK */
 struct inLinearKick {
     vel_t dtOpen, dtClose;
+    int iAssignment;
 };
 int pstLinearKick(PST pst,void *vin,int nIn,void *vout,int nOut);
 /* PST_SETLINGRID */
@@ -1095,6 +1159,13 @@ struct inSetLinGrid {
     float fPhase;
 };
 int pstSetLinGrid(PST pst,void *vin,int nIn,void *vout,int nOut);
+/* PST_SETPMGRID */
+struct inSetPMGrid {
+    double dTotalMass;
+    double dRs;
+    int iAssignment;
+};
+int pstSetPMGrid(PST pst,void *vin,int nIn,void *vout,int nOut);
 /* PST_MEASURELINPK */
 struct inMeasureLinPk {
     double dA;
@@ -1128,6 +1199,8 @@ int pstSetGlobalDt(PST pst,void *vin,int nIn,void *vout,int nOut);
 
 struct inLightConeOpen {
     int nSideHealpix;
+    int nSidePacked;        /* Packed particle output sorted by these pixels (0 for raw) */
+    double dQuantumPacked;  /* Position resolution of packed particle output */
     char achOutFile[PST_FILENAME_SIZE];
 };
 int pstLightConeOpen(PST pst,void *vin,int nIn,void *vout,int nOut);
@@ -253,6 +253,9 @@ void MSR::Simulate(double dTime,int iStartStep,bool bRestart) {
             LinearKick(dTime,dDelta,bKickClose,bKickOpen);
             GridDeleteFFT();
         }
+#ifdef MDL_FFTW
+        if (parameters.get_nGridPM() > 0) MeshKick(dTime,dDelta,bKickClose,bKickOpen);
+#endif
     }
 
     const bool bDoStartOutput = parameters.get_bWriteIC() && !parameters.has_nGrid() && !NewSPH();
@@ -405,6 +408,9 @@ void MSR::Simulate(double dTime,int iStartStep,bool bRestart) {
                     LinearKick(dTime,dDelta,bKickClose,bKickOpen);
                     GridDeleteFFT();
                 }
+#ifdef MDL_FFTW
+                if (parameters.get_nGridPM() > 0) MeshKick(dTime,dDelta,bKickClose,bKickOpen);
+#endif
                 bKickOpen = 0; /* clear the opening kicking flag */
             }
             NewTopStepKDK(ddTime,dDelta,dTheta,nSteps,0,0,&diStep,&uRungMax,&bDoCheckpoint,&bDoOutput,&bKickOpen);
@@ -453,6 +459,7 @@ void MSR::Simulate(double dTime,int iStartStep,bool bRestart) {
         }
         TimerDump(iStep);
     }
+    CheckpointWait();
 }
 
 /******************************************************************************\
@@ -834,5 +841,23 @@ int MSR::ValidateParameters() {
         print_error("ERROR: you must specify nGridLin when running with linear species\n");
         abort();
     }
+    if (parameters.get_nGridPM() > 0) {
+#ifndef MDL_FFTW
+        print_error("ERROR: nGridPM requires FFTW support\n");
+        return false;
+#endif
+        if (!parameters.get_bPeriodic() || !parameters.get_bNewKDK()) {
+            print_error("ERROR: nGridPM requires bPeriodic and bNewKDK\n");
+            return false;
+        }
+        if (parameters.get_iPMOrder() < 0 || parameters.get_iPMOrder() > 3) {
+            print_error("ERROR: iPMOrder must be between 0 and 3\n");
+            return false;
+        }
+        if (parameters.get_dPMCut() * parameters.get_dPMSplit() / parameters.get_nGridPM() >= 0.5) {
+            print_error("ERROR: the TreePM cut-off must be less than half the box\n");
+            return false;
+        }
+    }
     return success;
 }
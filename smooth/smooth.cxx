@@ -46,6 +46,9 @@
     #include "stellarevolution/stellarevolution.h"
 #endif
 #include <sys/stat.h>
+#include <algorithm>
+#include <numeric>
+#include "core/simd.h"
 
 using blitz::TinyVector;
 using blitz::floor;
@@ -54,174 +57,63 @@ using blitz::abs;
 using blitz::all;
 using blitz::any;
 
-const int primes[1000] = {
-    2,     3,     5,     7,    11,    13,    17,    19,    23,    29,
-    31,    37,    41,    43,    47,    53,    59,    61,    67,    71,
-    73,    79,    83,    89,    97,   101,   103,   107,   109,   113,
-    127,   131,   137,   139,   149,   151,   157,   163,   167,   173,
-    179,   181,   191,   193,   197,   199,   211,   223,   227,   229,
-    233,   239,   241,   251,   257,   263,   269,   271,   277,   281,
-    283,   293,   307,   311,   313,   317,   331,   337,   347,   349,
-    353,   359,   367,   373,   379,   383,   389,   397,   401,   409,
-    419,   421,   431,   433,   439,   443,   449,   457,   461,   463,
-    467,   479,   487,   491,   499,   503,   509,   521,   523,   541,
-    547,   557,   563,   569,   571,   577,   587,   593,   599,   601,
-    607,   613,   617,   619,   631,   641,   643,   647,   653,   659,
-    661,   673,   677,   683,   691,   701,   709,   719,   727,   733,
-    739,   743,   751,   757,   761,   769,   773,   787,   797,   809,
-    811,   821,   823,   827,   829,   839,   853,   857,   859,   863,
-    877,   881,   883,   887,   907,   911,   919,   929,   937,   941,
-    947,   953,   967,   971,   977,   983,   991,   997,  1009,  1013,
-    1019,  1021,  1031,  1033,  1039,  1049,  1051,  1061,  1063,  1069,
-    1087,  1091,  1093,  1097,  1103,  1109,  1117,  1123,  1129,  1151,
-    1153,  1163,  1171,  1181,  1187,  1193,  1201,  1213,  1217,  1223,
-    1229,  1231,  1237,  1249,  1259,  1277,  1279,  1283,  1289,  1291,
-    1297,  1301,  1303,  1307,  1319,  1321,  1327,  1361,  1367,  1373,
-    1381,  1399,  1409,  1423,  1427,  1429,  1433,  1439,  1447,  1451,
-    1453,  1459,  1471,  1481,  1483,  1487,  1489,  1493,  1499,  1511,
-    1523,  1531,  1543,  1549,  1553,  1559,  1567,  1571,  1579,  1583,
-    1597,  1601,  1607,  1609,  1613,  1619,  1621,  1627,  1637,  1657,
-    1663,  1667,  1669,  1693,  1697,  1699,  1709,  1721,  1723,  1733,
-    1741,  1747,  1753,  1759,  1777,  1783,  1787,  1789,  1801,  1811,
-    1823,  1831,  1847,  1861,  1867,  1871,  1873,  1877,  1879,  1889,
-    1901,  1907,  1913,  1931,  1933,  1949,  1951,  1973,  1979,  1987,
-    1993,  1997,  1999,  2003,  2011,  2017,  2027,  2029,  2039,  2053,
-    2063,  2069,  2081,  2083,  2087,  2089,  2099,  2111,  2113,  2129,
-    2131,  2137,  2141,  2143,  2153,  2161,  2179,  2203,  2207,  2213,
-    2221,  2237,  2239,  2243,  2251,  2267,  2269,  2273,  2281,  2287,
-    2293,  2297,  2309,  2311,  2333,  2339,  2341,  2347,  2351,  2357,
-    2371,  2377,  2381,  2383,  2389,  2393,  2399,  2411,  2417,  2423,
-    2437,  2441,  2447,  2459,  2467,  2473,  2477,  2503,  2521,  2531,
-    2539,  2543,  2549,  2551,  2557,  2579,  2591,  2593,  2609,  2617,
-    2621,  2633,  2647,  2657,  2659,  2663,  2671,  2677,  2683,  2687,
-    2689,  2693,  2699,  2707,  2711,  2713,  2719,  2729,  2731,  2741,
-    2749,  2753,  2767,  2777,  2789,  2791,  2797,  2801,  2803,  2819,
-    2833,  2837,  2843,  2851,  2857,  2861,  2879,  2887,  2897,  2903,
-    2909,  2917,  2927,  2939,  2953,  2957,  2963,  2969,  2971,  2999,
-    3001,  3011,  3019,  3023,  3037,  3041,  3049,  3061,  3067,  3079,
-    3083,  3089,  3109,  3119,  3121,  3137,  3163,  3167,  3169,  3181,
-    3187,  3191,  3203,  3209,  3217,  3221,  3229,  3251,  3253,  3257,
-    3259,  3271,  3299,  3301,  3307,  3313,  3319,  3323,  3329,  3331,
-    3343,  3347,  3359,  3361,  3371,  3373,  3389,  3391,  3407,  3413,
-    3433,  3449,  3457,  3461,  3463,  3467,  3469,  3491,  3499,  3511,
-    3517,  3527,  3529,  3533,  3539,  3541,  3547,  3557,  3559,  3571,
-    3581,  3583,  3593,  3607,  3613,  3617,  3623,  3631,  3637,  3643,
-    3659,  3671,  3673,  3677,  3691,  3697,  3701,  3709,  3719,  3727,
-    3733,  3739,  3761,  3767,  3769,  3779,  3793,  3797,  3803,  3821,
-    3823,  3833,  3847,  3851,  3853,  3863,  3877,  3881,  3889,  3907,
-    3911,  3917,  3919,  3923,  3929,  3931,  3943,  3947,  3967,  3989,
-    4001,  4003,  4007,  4013,  4019,  4021,  4027,  4049,  4051,  4057,
-    4073,  4079,  4091,  4093,  4099,  4111,  4127,  4129,  4133,  4139,
-    4153,  4157,  4159,  4177,  4201,  4211,  4217,  4219,  4229,  4231,
-    4241,  4243,  4253,  4259,  4261,  4271,  4273,  4283,  4289,  4297,
-    4327,  4337,  4339,  4349,  4357,  4363,  4373,  4391,  4397,  4409,
-    4421,  4423,  4441,  4447,  4451,  4457,  4463,  4481,  4483,  4493,
-    4507,  4513,  4517,  4519,  4523,  4547,  4549,  4561,  4567,  4583,
-    4591,  4597,  4603,  4621,  4637,  4639,  4643,  4649,  4651,  4657,
-    4663,  4673,  4679,  4691,  4703,  4721,  4723,  4729,  4733,  4751,
-    4759,  4783,  4787,  4789,  4793,  4799,  4801,  4813,  4817,  4831,
-    4861,  4871,  4877,  4889,  4903,  4909,  4919,  4931,  4933,  4937,
-    4943,  4951,  4957,  4967,  4969,  4973,  4987,  4993,  4999,  5003,
-    5009,  5011,  5021,  5023,  5039,  5051,  5059,  5077,  5081,  5087,
-    5099,  5101,  5107,  5113,  5119,  5147,  5153,  5167,  5171,  5179,
-    5189,  5197,  5209,  5227,  5231,  5233,  5237,  5261,  5273,  5279,
-    5281,  5297,  5303,  5309,  5323,  5333,  5347,  5351,  5381,  5387,
-    5393,  5399,  5407,  5413,  5417,  5419,  5431,  5437,  5441,  5443,
-    5449,  5471,  5477,  5479,  5483,  5501,  5503,  5507,  5519,  5521,
-    5527,  5531,  5557,  5563,  5569,  5573,  5581,  5591,  5623,  5639,
-    5641,  5647,  5651,  5653,  5657,  5659,  5669,  5683,  5689,  5693,
-    5701,  5711,  5717,  5737,  5741,  5743,  5749,  5779,  5783,  5791,
-    5801,  5807,  5813,  5821,  5827,  5839,  5843,  5849,  5851,  5857,
-    5861,  5867,  5869,  5879,  5881,  5897,  5903,  5923,  5927,  5939,
-    5953,  5981,  5987,  6007,  6011,  6029,  6037,  6043,  6047,  6053,
-    6067,  6073,  6079,  6089,  6091,  6101,  6113,  6121,  6131,  6133,
-    6143,  6151,  6163,  6173,  6197,  6199,  6203,  6211,  6217,  6221,
-    6229,  6247,  6257,  6263,  6269,  6271,  6277,  6287,  6299,  6301,
-    6311,  6317,  6323,  6329,  6337,  6343,  6353,  6359,  6361,  6367,
-    6373,  6379,  6389,  6397,  6421,  6427,  6449,  6451,  6469,  6473,
-    6481,  6491,  6521,  6529,  6547,  6551,  6553,  6563,  6569,  6571,
-    6577,  6581,  6599,  6607,  6619,  6637,  6653,  6659,  6661,  6673,
-    6679,  6689,  6691,  6701,  6703,  6709,  6719,  6733,  6737,  6761,
-    6763,  6779,  6781,  6791,  6793,  6803,  6823,  6827,  6829,  6833,
-    6841,  6857,  6863,  6869,  6871,  6883,  6899,  6907,  6911,  6917,
-    6947,  6949,  6959,  6961,  6967,  6971,  6977,  6983,  6991,  6997,
-    7001,  7013,  7019,  7027,  7039,  7043,  7057,  7069,  7079,  7103,
-    7109,  7121,  7127,  7129,  7151,  7159,  7177,  7187,  7193,  7207,
-    7211,  7213,  7219,  7229,  7237,  7243,  7247,  7253,  7283,  7297,
-    7307,  7309,  7321,  7331,  7333,  7349,  7351,  7369,  7393,  7411,
-    7417,  7433,  7451,  7457,  7459,  7477,  7481,  7487,  7489,  7499,
-    7507,  7517,  7523,  7529,  7537,  7541,  7547,  7549,  7559,  7561,
-    7573,  7577,  7583,  7589,  7591,  7603,  7607,  7621,  7639,  7643,
-    7649,  7669,  7673,  7681,  7687,  7691,  7699,  7703,  7717,  7723,
-    7727,  7741,  7753,  7757,  7759,  7789,  7793,  7817,  7823,  7829,
-    7841,  7853,  7867,  7873,  7877,  7879,  7883,  7901,  7907,  7919
-};
+/*
+** The remote particle hash is an open addressing (linear probing) table of size
+** a power of two. Particle addresses are spread with a Fibonacci multiplier.
+*/
+static inline uint32_t smHashIndex(SMX smx,void *p) {
+    return (reinterpret_cast<uintptr_t>(p) * UINT64_C(0x9E3779B97F4A7C15)) >> (64 - smx->nHashBits);
+}
 
 /*
 ** Assumes that p does not already occur in the hash table!!!
 */
 void smHashAdd(SMX smx,void *p) {
-    struct hashElement *t;
-    uint32_t i = ((intptr_t)(p))%smx->nHash;
-    if (!smx->pHash[i].p) {
-        smx->pHash[i].p = p;
-    }
-    else {
-        t = smx->pFreeHash;
-        assert(t != NULL);
-        smx->pFreeHash = t->coll;
-        t->coll = smx->pHash[i].coll;
-        smx->pHash[i].coll = t;
-        t->p = p;
-    }
+    auto pHash = smx->pHash;
+    uint32_t i = smHashIndex(smx,p);
+    while (pHash[i].uGen == smx->uHashGen) i = (i+1) & smx->nHashMask;
+    pHash[i].p = p;
+    pHash[i].uGen = smx->uHashGen;
 }
 
 /*
 ** Assumes that p is definitely in the hash table!!!
+** Entries following the deleted one are shifted back so no tombstones are needed.
 */
 void smHashDel(SMX smx,void *p) {
-    struct hashElement *t, *tt;
-    uint32_t i = ((intptr_t)(p))%smx->nHash;
-
-    if (!smx->pHash[i].coll) {
-        /*
-        ** It has to be the first element.
-        */
-        smx->pHash[i].p = NULL;
-    }
-    else if (smx->pHash[i].p == p) {
-        /*
-        ** It is the first element, but there are others!
-        */
-        t = smx->pHash[i].coll;
-        smx->pHash[i].coll = t->coll;
-        smx->pHash[i].p = t->p;
-        t->coll = smx->pFreeHash;
-        smx->pFreeHash = t;
-    }
-    else {
-        tt = &smx->pHash[i];
-        while (tt->coll->p != p) tt = tt->coll;
-        t = tt->coll;
-        tt->coll = t->coll; /* unlink */
-        t->coll = smx->pFreeHash;
-        smx->pFreeHash = t;
+    auto pHash = smx->pHash;
+    auto uGen = smx->uHashGen;
+    uint32_t i = smHashIndex(smx,p);
+    while (pHash[i].p != p || pHash[i].uGen != uGen) i = (i+1) & smx->nHashMask;
+    for (uint32_t j = (i+1) & smx->nHashMask; pHash[j].uGen == uGen; j = (j+1) & smx->nHashMask) {
+        uint32_t k = smHashIndex(smx,pHash[j].p);
+        /* Move the entry back unless its home slot lies cyclically in (i,j] */
+        if ( (i<j) ? (k<=i || k>j) : (k<=i && k>j) ) {
+            pHash[i] = pHash[j];
+            i = j;
+        }
     }
+    pHash[i].uGen = uGen - 1;
 }
 
 int smHashPresent(SMX smx,void *p) {
-    struct hashElement *t;
-    uint32_t i = ((intptr_t)(p))%smx->nHash;
-
-    if (smx->pHash[i].p == p) return 1;
-    t = smx->pHash[i].coll;
-    while (t) {
-        if (t->p == p) return 1;
-        else t = t->coll;
+    auto pHash = smx->pHash;
+    for (uint32_t i = smHashIndex(smx,p); pHash[i].uGen == smx->uHashGen; i = (i+1) & smx->nHashMask) {
+        if (pHash[i].p == p) return 1;
     }
     return 0;
 }
 
+/*
+** Empty the hash table by moving to the next generation.
+*/
+void smHashClear(SMX smx) {
+    if (++smx->uHashGen == 0) {
+        for (uint32_t i=0; i<=smx->nHashMask; ++i) smx->pHash[i].uGen = 0;
+        smx->uHashGen = 1;
+    }
+}
+
 static int smInitializeBasic(SMX *psmx,PKD pkd,SMF *smf,int nSmooth,int bPeriodic,int bSymmetric,int iSmoothType,int bMakeCache) {
     SMX smx;
     void (*initParticle)(void *,void *) = NULL;
@@ -233,7 +125,6 @@ static int smInitializeBasic(SMX *psmx,PKD pkd,SMF *smf,int nSmooth,int bPeriodi
     bool bPacked = false;
     uint32_t iPackSize = 0;
     uint32_t iFlushSize = 0;
-    int i;
 
     smx = new struct smContext;
     assert(smx != NULL);
@@ -513,33 +404,17 @@ static int smInitializeBasic(SMX *psmx,PKD pkd,SMF *smf,int nSmooth,int bPeriodi
     assert(smx->pq != NULL);
     PQ_INIT(smx->pq,nSmooth);
     /*
-    ** Allocate hash table entries.
-    ** The constant here just sets the hash table loading factor, for numbers larger than
-    ** the 1000'th prime we end up using the result here as the hash table modulus.
+    ** Allocate hash table entries. The table is kept at most half full.
     */
-    smx->nHash = (int)floor(nSmooth*1.543765241931);
-    for (i=0; i<1000; ++i) {
-        if (primes[i] > smx->nHash) {
-            smx->nHash = primes[i];
-            break;
-        }
-    }
-    smx->pHash = static_cast<struct hashElement *>(malloc((smx->nHash+nSmooth)*sizeof(struct hashElement)));
+    for (smx->nHashBits=4; (1u<<smx->nHashBits) < 2u*nSmooth; ++smx->nHashBits) {}
+    smx->nHashMask = (1u<<smx->nHashBits) - 1;
+    smx->uHashGen = 1;
+    smx->pHash = static_cast<struct hashElement *>(malloc((smx->nHashMask+1)*sizeof(struct hashElement)));
     assert(smx->pHash != NULL);
-    for (i=0; i<smx->nHash; ++i) {
-        smx->pHash[i].p = NULL;
-        smx->pHash[i].coll = NULL;
-    }
-    /*
-    ** set up the extra entries that may be needed for collision chains
-    */
-    smx->pFreeHash = &smx->pHash[i];
-    for (; i<(smx->nHash+nSmooth-1); ++i) {
-        smx->pHash[i].p = NULL;
-        smx->pHash[i].coll = &smx->pHash[i+1];
+    for (uint32_t j=0; j<=smx->nHashMask; ++j) {
+        smx->pHash[j].p = NULL;
+        smx->pHash[j].uGen = 0;
     }
-    smx->pHash[i].p = NULL;
-    smx->pHash[i].coll = NULL;
     /*
     ** Allocate special stacks for searching within the tree.
     ** 1024 is more than enough.
@@ -586,12 +461,18 @@ void smFinish(SMX smx,SMF *smf) {
     snprintf(achOut, sizeof(achOut), "    Miss ratio: %g\n",
              mdlMissRatio(smx->pkd->mdl,CID_CELL));
     mdlDiag(smx->pkd->mdl, achOut);
+    snprintf(achOut, sizeof(achOut), "    Shared hit ratio: %g\n",
+             mdlSharedHitRatio(smx->pkd->mdl,CID_CELL));
+    mdlDiag(smx->pkd->mdl, achOut);
     snprintf(achOut, sizeof(achOut), "Particle Accesses: %g\n",
              mdlNumAccess(smx->pkd->mdl,CID_PARTICLE));
     mdlDiag(smx->pkd->mdl, achOut);
     snprintf(achOut, sizeof(achOut), "    Miss ratio: %g\n",
              mdlMissRatio(smx->pkd->mdl,CID_PARTICLE));
     mdlDiag(smx->pkd->mdl, achOut);
+    snprintf(achOut, sizeof(achOut), "    Shared hit ratio: %g\n",
+             mdlSharedHitRatio(smx->pkd->mdl,CID_PARTICLE));
+    mdlDiag(smx->pkd->mdl, achOut);
     /*
     ** Stop particle caching space.
     */
@@ -763,13 +644,17 @@ void smSmoothFinish(SMX smx) {
             smx->pkd->particles[smx->pq[i].iIndex].set_marked(true);
         }
         else {
-            smHashDel(smx,smx->pq[i].pPart);
             mdlRelease(smx->pkd->mdl,CID_PARTICLE,smx->pq[i].pPart);
         }
     }
+    smHashClear(smx);
 }
 
-float smSmoothSingle(SMX smx,SMF *smf,particleStore::ParticleReference &p,int iRoot1, int iRoot2) {
+/*
+** Find the nSmooth nearest neighbours of the position p_r. The neighbours are
+** left in the priority queue (smx->pq) and the distance to the furthest is returned.
+*/
+static double smSearchSingle(SMX smx,TinyVector<double,3> p_r,int iRoot1, int iRoot2) {
     PKD pkd = smx->pkd;
     int ix,iy,iz;
     TinyVector<double,3> r;
@@ -777,8 +662,6 @@ float smSmoothSingle(SMX smx,SMF *smf,particleStore::ParticleReference &p,int iR
     int j;
     PQ *pq;
 
-    auto p_r = p.position();
-
     /*
     ** Correct distances and rebuild priority queue.
     */
@@ -824,7 +707,19 @@ float smSmoothSingle(SMX smx,SMF *smf,particleStore::ParticleReference &p,int iR
             }
         }
     }
-    fBall = sqrt(pq->fDist2);
+    return sqrt(pq->fDist2);
+}
+
+/*
+** Each neighbour adds about the cost of one particle interaction to the
+** measured work of the particle (see the domain decomposition).
+*/
+static inline void smAddWork(const particleStore::ParticleReference &p,int nSmooth) {
+    if (p.have_work()) p.work() += nSmooth*COST_FLOP_PP;
+}
+
+float smSmoothSingle(SMX smx,SMF *smf,particleStore::ParticleReference &p,int iRoot1, int iRoot2) {
+    double fBall = smSearchSingle(smx,p.position(),iRoot1,iRoot2);
 
     /* IA: I do not fully understand this fBall, so I will compute my own kernel length such that it encloses
      * all the particles in the neighbor list. This means that h > 0.5*max(dist). I have taken 0.501 as a safe
@@ -840,12 +735,194 @@ float smSmoothSingle(SMX smx,SMF *smf,particleStore::ParticleReference &p,int iR
     ** Apply smooth funtion to the neighbor list.
     */
     smx->fcnSmooth(&p,fBall,smx->nSmooth,smx->pq,smf);
+    smAddWork(p,smx->nSmooth);
     return fBall;
 }
 
+/*
+** Collect every particle within sqrt(fRadius2) of the box (bc,ba) into the shared
+** candidate list. Candidate positions are shifted by offset (the periodic replica).
+*/
+static void smGatherBucket(SMX smx,TinyVector<double,3> bc,TinyVector<double,3> ba,
+                           double fRadius2,TinyVector<double,3> offset,int iRoot) {
+    PKD pkd = smx->pkd;
+    MDL mdl = pkd->mdl;
+    int idSelf = pkd->Self();
+    struct smContext::stStack *S = smx->ST;
+    int sp = 0;
+    int id = idSelf;
+    int iCell = pkd->iTopTree[iRoot];
+    TinyVector<double,3> r, x;
+
+    while (1) {
+        auto kdn = getCell(pkd,iCell,id);
+        auto bnd = kdn->bound();
+        x = abs(bnd.center() - bc) - bnd.apothem() - ba;
+        x = blitz::where(x>0.0,x,0.0);
+        if (dot(x,x) <= fRadius2) {
+            if (kdn->is_cell()) {
+                auto [iLower,idLower,iUpper,idUpper] = kdn->get_child_cells(id);
+                S[sp].id = idUpper;
+                S[sp].iCell = iUpper;
+                ++sp;
+                id = idLower;
+                iCell = iLower;
+                continue;
+            }
+            auto pStart = kdn->lower();
+            auto pEnd = kdn->upper() + 1;
+            for (auto pj = pStart; pj < pEnd; ++pj) {
+                auto p = (id == idSelf) ? pkd->particles[pj]
+                         : pkd->particles[static_cast<PARTICLE *>(mdlFetch(mdl,CID_PARTICLE,pj,id))];
+                if (smx->bSearchGasOnly && !p.is_gas()) continue;
+                r = p.position();
+                x = abs(r - bc) - ba;
+                x = blitz::where(x>0.0,x,0.0);
+                if (dot(x,x) > fRadius2) continue;
+                r += offset;
+                smx->cx.push_back(r[0]);
+                smx->cy.push_back(r[1]);
+                smx->cz.push_back(r[2]);
+                smx->cIndex.push_back(pj);
+                smx->cPid.push_back(id);
+            }
+        }
+        if (sp) {
+            --sp;
+            id = S[sp].id;
+            iCell = S[sp].iCell;
+        }
+        else break;
+    }
+}
+
+static inline bool smIsTarget(SMF *smf,particleStore::ParticleReference &p) {
+    return !smf->bMeshlessHydro || p.is_active();
+}
+
+/*
+** Smooth all particles of a local bucket together. The k-th neighbour distance at the
+** centre of the bucket plus the distance from the centre to the furthest particle bounds
+** the k-th neighbour distance of every particle in the bucket, so a single tree walk
+** gives a candidate list shared by the whole bucket. The distances from each particle
+** to all candidates are computed with SIMD and the nSmooth nearest are selected with
+** nth_element. Buckets where this does not pay (or is not exact) use smSmoothSingle.
+*/
+static void smSmoothBucket(SMX smx,SMF *smf,int iBucket) {
+    PKD pkd = smx->pkd;
+    MDL mdl = pkd->mdl;
+    int idSelf = pkd->Self();
+    const int nSmooth = smx->nSmooth;
+    auto kdn = pkd->tree[iBucket];
+    auto pLower = kdn->lower();
+    auto pUpper = kdn->upper();
+    TinyVector<double,3> lo(HUGE_VAL), hi(-HUGE_VAL);
+    int nTarget = 0;
+
+    for (auto pj = pLower; pj <= pUpper; ++pj) {
+        auto p = pkd->particles[pj];
+        if (!smIsTarget(smf,p)) continue;
+        lo = blitz::min(lo,p.position());
+        hi = blitz::max(hi,p.position());
+        ++nTarget;
+    }
+    if (nTarget == 0) return;
+
+    auto smoothSingle = [&]() {
+        for (auto pj = pLower; pj <= pUpper; ++pj) {
+            auto p = pkd->particles[pj];
+            if (!smIsTarget(smf,p)) continue;
+            float fBall = smSmoothSingle(smx,smf,p,ROOT,0);
+            if (smf->bMeshlessHydro && smf->bUpdateBall) p.set_ball(fBall);
+            mdlCacheCheck(mdl);
+        }
+    };
+    if (nTarget < 4) return smoothSingle();
+
+    TinyVector<double,3> bc = 0.5*(lo + hi);
+    TinyVector<double,3> ba = 0.5*(hi - lo);
+    double fRadius = smSearchSingle(smx,bc,ROOT,0) + sqrt(dot(ba,ba));
+    for (auto j=0; j<nSmooth; ++j) {
+        if (smx->pq[j].pPart == smx->pSentinel) return smoothSingle();
+    }
+
+    /*
+    ** Each periodic image may contribute a particle only once.
+    */
+    TinyVector<int,3> iStart(0), iEnd(0);
+    if (smx->bPeriodic) {
+        if (any(2.0*(ba + fRadius) >= pkd->fPeriod)) return smoothSingle();
+        iStart = floor((bc - ba - fRadius) / pkd->fPeriod + 0.5);
+        iEnd   = floor((bc + ba + fRadius) / pkd->fPeriod + 0.5);
+    }
+
+    smx->cx.clear();
+    smx->cy.clear();
+    smx->cz.clear();
+    smx->cIndex.clear();
+    smx->cPid.clear();
+    TinyVector<double,3> offset;
+    for (auto ix=iStart[0]; ix<=iEnd[0]; ++ix) {
+        offset[0] = ix*pkd->fPeriod[0];
+        for (auto iy=iStart[1]; iy<=iEnd[1]; ++iy) {
+            offset[1] = iy*pkd->fPeriod[1];
+            for (auto iz=iStart[2]; iz<=iEnd[2]; ++iz) {
+                offset[2] = iz*pkd->fPeriod[2];
+                smGatherBucket(smx,bc-offset,ba,fRadius*fRadius,offset,ROOT);
+            }
+        }
+    }
+    int nCand = smx->cIndex.size();
+    if (nCand < nSmooth) return smoothSingle();
+
+    /* Pad to the SIMD width with candidates that can never be selected */
+    int nPadded = (nCand + dvec::width() - 1) / dvec::width() * dvec::width();
+    smx->cx.resize(nPadded,HUGE_VAL);
+    smx->cy.resize(nPadded,HUGE_VAL);
+    smx->cz.resize(nPadded,HUGE_VAL);
+    smx->cDist2.resize(nPadded);
+    smx->cOrder.resize(nCand);
+    smx->nnBucket.resize(nSmooth);
+    auto &nn = smx->nnBucket;
+    auto &d2 = smx->cDist2;
+
+    for (auto pj = pLower; pj <= pUpper; ++pj) {
+        auto p = pkd->particles[pj];
+        if (!smIsTarget(smf,p)) continue;
+        auto r = p.position();
+        dvec tx = r[0], ty = r[1], tz = r[2];
+        for (auto i=0; i<nPadded; i+=dvec::width()) {
+            dvec dx = tx - dvec(&smx->cx[i]);
+            dvec dy = ty - dvec(&smx->cy[i]);
+            dvec dz = tz - dvec(&smx->cz[i]);
+            dvec dd = dx*dx + dy*dy + dz*dz;
+            dd.store(&d2[i]);
+        }
+        std::iota(smx->cOrder.begin(),smx->cOrder.end(),0);
+        std::nth_element(smx->cOrder.begin(),smx->cOrder.begin()+nSmooth-1,smx->cOrder.end(),
+                         [&d2](int a,int b) {return d2[a] < d2[b];});
+        double fBall = sqrt(d2[smx->cOrder[nSmooth-1]]);
+        for (auto j=0; j<nSmooth; ++j) {
+            auto c = smx->cOrder[j];
+            nn[j].fDist2 = d2[c];
+            nn[j].dr = r[0] - smx->cx[c], r[1] - smx->cy[c], r[2] - smx->cz[c];
+            nn[j].iIndex = smx->cIndex[c];
+            nn[j].iPid = smx->cPid[c];
+            nn[j].pPart = (nn[j].iPid == idSelf) ? pkd->particles.Element(nn[j].iIndex)
+                          : static_cast<PARTICLE *>(mdlAcquire(mdl,CID_PARTICLE,nn[j].iIndex,nn[j].iPid));
+        }
+        smx->fcnSmooth(&p,fBall,nSmooth,nn.data(),smf);
+        smAddWork(p,nSmooth);
+        if (smf->bMeshlessHydro && smf->bUpdateBall) p.set_ball(fBall);
+        for (auto j=0; j<nSmooth; ++j) {
+            if (nn[j].iPid != idSelf) mdlRelease(mdl,CID_PARTICLE,nn[j].pPart);
+        }
+        mdlCacheCheck(mdl);
+    }
+}
+
 void smSmooth(SMX smx,SMF *smf) {
     PKD pkd = smx->pkd;
-    float fBall;
 
     /*
     ** Initialize the bInactive flags for all local particles.
@@ -893,23 +970,25 @@ void smSmooth(SMX smx,SMF *smf) {
         break;
 #endif
     default:
-        for (auto &p : pkd->particles) {
-            if (!smf->bMeshlessHydro ) {
-                smSmoothSingle(smx,smf,p,ROOT,0);
-                //p.set_ball(smSmoothSingle(smx,smf,p,ROOT,0));
-            }
-            else {
-                if (p.is_active()) {
-                    fBall = smSmoothSingle(smx,smf,p,ROOT,0);
-                    if (smf->bUpdateBall) {
-                        p.set_ball(fBall);
-                    }
+        /*
+        ** Process the particles a bucket at a time (see smSmoothBucket).
+        ** mdlCacheCheck is called for every particle to make sure we are making progress!
+        */
+        {
+            int iCell = ROOT;
+            while (pkd->tree[iCell]->is_remote()) iCell = pkd->tree[iCell]->lchild();
+            std::vector<int> stack {iCell};
+            while (!stack.empty()) {
+                iCell = stack.back();
+                stack.pop_back();
+                auto kdn = pkd->tree[iCell];
+                if (kdn->is_bucket()) smSmoothBucket(smx,smf,iCell);
+                else {
+                    auto [iLower,idLower,iUpper,idUpper] = kdn->get_child_cells(pkd->Self());
+                    stack.push_back(iUpper);
+                    stack.push_back(iLower);
                 }
             }
-            /*
-            ** Call mdlCacheCheck to make sure we are making progress!
-            */
-            mdlCacheCheck(pkd->mdl);
         }
     }
     smSmoothFinish(smx);
@@ -1072,6 +1151,7 @@ void smReSmoothSingle(SMX smx,SMF *smf,particleStore::ParticleReference &p,doubl
     ** Apply smooth funtion to the neighbor list.
     */
     smx->fcnSmooth(&p,fBall,smx->nnListSize,smx->nnList,smf);
+    smAddWork(p,smx->nnListSize);
     /*
     ** Release acquired pointers.
     */
@@ -1420,6 +1500,7 @@ int smReSmoothNode(SMX smx,SMF *smf, int iSmoothType) {
                     else {
                         smx->fcnSmooth(&partj,partj.ball(),nCnt_p,nnList_p,smf);
                     }
+                    smAddWork(partj,nCnt_p);
 
                     for (auto pk = 0; pk < nCnt_p; ++pk) {
                         if (nnList_p[pk].iPid != pkd->Self()) {
@@ -26,12 +26,13 @@ extern "C" {
 #include "hydro/hydro.h"
 #include "group/group.h"
 #include "blitz/array.h"
+#include <vector>
 
 #define NNLIST_INCREMENT    200     /* number of extra neighbor elements added to nnList */
 
 struct hashElement {
     void *p;
-    struct hashElement *coll;
+    uint32_t uGen;  /* slot is occupied only if this is the current generation */
 };
 
 struct smExtraArray {
@@ -75,9 +76,10 @@ typedef struct smContext {
     ** Hash table to indicate whether a remote particle is already present in the
     ** priority queue.
     */
-    int nHash;  /* should be a prime number > nSmooth */
+    int nHashBits;       /* table size is 1<<nHashBits >= 2*nSmooth */
+    uint32_t nHashMask;
+    uint32_t uHashGen;   /* current generation; bumping it empties the table */
     struct hashElement *pHash;
-    struct hashElement *pFreeHash;
     int nnListSize;
     int nnListMax;
     NN *nnList;
@@ -92,6 +94,13 @@ typedef struct smContext {
         double min;
     } *ST;
     /*
+    ** Shared candidate list for the bucket batched neighbour search. Positions
+    ** are stored by component and padded to the SIMD width.
+    */
+    std::vector<double> cx, cy, cz, cDist2;
+    std::vector<int> cIndex, cPid, cOrder;
+    std::vector<NN> nnBucket;
+    /*
     ** Context for nearest neighbor lists.
     */
     LCODE lcmp;
@@ -21,6 +21,8 @@
 #include <assert.h>
 #include <cstdint>
 #include <array>
+#include <memory>
+#include <vector>
 
 namespace {
 
@@ -74,6 +76,11 @@ enum services {
     SET_ADD,
     TEST_HASH,
     TEST_RO,
+    TEST_SHARED_RO,
+    TEST_PREFETCH_RO,
+    TEST_PREFETCH_BUFFER_RO,
+    TEST_RMA_RO,
+    TEST_NODE_RO,
     TEST_FLUSH,
     TEST_FLUSH_AFTER_READ,
     TEST_ADVANCED_RO,
@@ -232,6 +239,239 @@ TEST_F(CacheTest, CacheReadWorks) {
 }
 } // namespace test_ro
 
+namespace shared_ro {
+constexpr int SERVICE = worker::TEST_SHARED_RO;
+// Same as the read-only test, but threads on a node share remote lines. Each thread starts
+// reading at a different place so that it finds lines already fetched by the other threads.
+int test(worker::Context *ctx,void *vin,int nIn,void *vout,int nOut) {
+    auto mdl = static_cast<mdl::mdlClass *>(ctx->getMDL());
+    auto pnBAD = reinterpret_cast<std::uint64_t *>(vout);
+    std::uint64_t nBAD;
+    if (ctx->getLeaves() > 1) {
+        int rID = mdl->ReqService(ctx->getUpper(),SERVICE,NULL,0);
+        test(ctx->getLower(),vin,nIn,vout,nOut);
+        nOut = mdl->GetReply(rID,nBAD);
+        *pnBAD += nBAD;
+    }
+    else {
+        int idSelf = mdlSelf(ctx->getMDL());
+        int nData = cacheSize;
+        auto pData = new std::uint64_t[nData];
+        for (auto i=0; i<nData; ++i) pData[i] = ((1UL*idSelf)<<33) + 10 + i;
+        mdl->SetSharedCacheSize(4*cacheSize*sizeof(pData[0]));
+        mdlROcache(ctx->getMDL(),0,NULL,pData,sizeof(pData[0]),nData);
+
+        nBAD = 0;
+        auto iStart = mdlCore(ctx->getMDL()) * nData / mdlCores(ctx->getMDL());
+        for (auto iProc=0; iProc<mdlThreads(ctx->getMDL()); ++iProc) {
+            for (auto j=0; j<nData; ++j) {
+                auto i = (iStart + j) % nData;
+                auto pRemote = reinterpret_cast<std::uint64_t *>(mdlFetch(ctx->getMDL(),0,i,iProc));
+                auto expect = ((1UL*iProc)<<33) + 10 + i;
+                if (*pRemote != expect) ++nBAD;
+            }
+        }
+        mdlFinishCache(ctx->getMDL(),0);
+        mdl->SetSharedCacheSize(0);
+        delete[] pData;
+        *pnBAD = nBAD;
+    }
+
+    return sizeof(*pnBAD);
+}
+TEST_F(CacheTest, SharedCacheReadWorks) {
+    auto ctx = reinterpret_cast<worker::Context *>(mdlWORKER());
+    std::uint64_t nBAD;
+    test::shared_ro::test(ctx,NULL,0,&nBAD,sizeof(nBAD));
+    EXPECT_EQ(nBAD,0);
+}
+} // namespace shared_ro
+
+namespace prefetch_ro {
+constexpr int SERVICE = worker::TEST_PREFETCH_RO;
+// Prefetch the lines of each thread before reading them. The last batch is never read
+// so we also check that the cache can be closed with prefetches outstanding.
+int prefetch(worker::Context *ctx,void *vout,int iService,std::uint64_t nSharedCacheSize) {
+    auto mdl = static_cast<mdl::mdlClass *>(ctx->getMDL());
+    auto pnBAD = reinterpret_cast<std::uint64_t *>(vout);
+    std::uint64_t nBAD;
+    if (ctx->getLeaves() > 1) {
+        int rID = mdl->ReqService(ctx->getUpper(),iService,NULL,0);
+        prefetch(ctx->getLower(),vout,iService,nSharedCacheSize);
+        mdl->GetReply(rID,nBAD);
+        *pnBAD += nBAD;
+    }
+    else {
+        int idSelf = mdlSelf(ctx->getMDL());
+        int nData = cacheSize;
+        auto pData = new std::uint64_t[nData];
+        for (auto i=0; i<nData; ++i) pData[i] = ((1UL*idSelf)<<33) + 10 + i;
+        mdl->SetSharedCacheSize(nSharedCacheSize);
+        mdlROcache(ctx->getMDL(),0,NULL,pData,sizeof(pData[0]),nData);
+
+        nBAD = 0;
+        for (auto iProc=0; iProc<mdlThreads(ctx->getMDL()); ++iProc) {
+            for (auto i=0; i<nData; ++i) mdlPrefetch(ctx->getMDL(),0,i,iProc);
+            mdlPrefetchFlush(ctx->getMDL());
+            for (auto i=0; i<nData; ++i) {
+                auto pRemote = reinterpret_cast<std::uint64_t *>(mdlFetch(ctx->getMDL(),0,i,iProc));
+                auto expect = ((1UL*iProc)<<33) + 10 + i;
+                if (*pRemote != expect) ++nBAD;
+            }
+        }
+        for (auto i=0; i<nData; ++i) mdlPrefetch(ctx->getMDL(),0,i,(idSelf+mdlCores(ctx->getMDL()))%mdlThreads(ctx->getMDL()));
+        mdlPrefetchFlush(ctx->getMDL());
+        mdlFinishCache(ctx->getMDL(),0);
+        mdl->SetSharedCacheSize(0);
+        delete[] pData;
+        *pnBAD = nBAD;
+    }
+
+    return sizeof(*pnBAD);
+}
+int test(worker::Context *ctx,void *vin,int nIn,void *vout,int nOut) {
+    return prefetch(ctx,vout,SERVICE,4*cacheSize*sizeof(std::uint64_t));
+}
+TEST_F(CacheTest, PrefetchReadWorks) {
+    auto ctx = reinterpret_cast<worker::Context *>(mdlWORKER());
+    std::uint64_t nBAD;
+    test::prefetch_ro::test(ctx,NULL,0,&nBAD,sizeof(nBAD));
+    EXPECT_EQ(nBAD,0);
+}
+
+namespace buffer {
+constexpr int SERVICE = worker::TEST_PREFETCH_BUFFER_RO;
+// Without a node shared cache the prefetched lines go to a buffer of the thread
+int test(worker::Context *ctx,void *vin,int nIn,void *vout,int nOut) {
+    return prefetch(ctx,vout,SERVICE,0);
+}
+TEST_F(CacheTest, PrefetchBufferReadWorks) {
+    auto ctx = reinterpret_cast<worker::Context *>(mdlWORKER());
+    std::uint64_t nBAD;
+    test::prefetch_ro::buffer::test(ctx,NULL,0,&nBAD,sizeof(nBAD));
+    EXPECT_EQ(nBAD,0);
+}
+} // namespace buffer
+} // namespace prefetch_ro
+
+namespace rma_ro {
+constexpr int SERVICE = worker::TEST_RMA_RO;
+constexpr int tileBits = 14;
+// The data is split into tiles (like the tree) so remote lines are read from several pieces
+static void *getTileElement(void *vData,int i,int iDataSize) {
+    auto tiles = reinterpret_cast<std::uint64_t **>(vData);
+    return tiles[i>>tileBits] + (i & ((1<<tileBits)-1));
+}
+int test(worker::Context *ctx,void *vin,int nIn,void *vout,int nOut) {
+    auto mdl = static_cast<mdl::mdlClass *>(ctx->getMDL());
+    auto pnBAD = reinterpret_cast<std::uint64_t *>(vout);
+    std::uint64_t nBAD;
+    if (ctx->getLeaves() > 1) {
+        int rID = mdl->ReqService(ctx->getUpper(),SERVICE,NULL,0);
+        test(ctx->getLower(),vin,nIn,vout,nOut);
+        nOut = mdl->GetReply(rID,nBAD);
+        *pnBAD += nBAD;
+    }
+    else {
+        int idSelf = mdlSelf(ctx->getMDL());
+        int nData = cacheSize + 3; // The last tile (and line) is partial
+        std::vector<std::unique_ptr<std::uint64_t[]>> tiles;
+        std::vector<std::uint64_t *> pTiles;
+        for (auto i=0; i<nData; i += 1<<tileBits) {
+            tiles.emplace_back(new std::uint64_t[1<<tileBits]);
+            pTiles.push_back(tiles.back().get());
+        }
+        for (auto i=0; i<nData; ++i)
+            *reinterpret_cast<std::uint64_t *>(getTileElement(pTiles.data(),i,0)) = ((1UL*idSelf)<<33) + 10 + i;
+        mdl->SetCacheRMA(true);
+        nBAD = 0;
+        // Find the segments element by element, then by tile with the same layout (so the
+        // segments are not exchanged again) and finally with a layout that has changed.
+        for (auto [n,bTiled] : {std::make_pair(nData,false),std::make_pair(nData,true),std::make_pair(nData-1,true)}) {
+            if (bTiled) mdlROcacheTiled(ctx->getMDL(),0,getTileElement,pTiles.data(),sizeof(std::uint64_t),n,tileBits);
+            else mdlROcache(ctx->getMDL(),0,getTileElement,pTiles.data(),sizeof(std::uint64_t),n);
+            for (auto iProc=0; iProc<mdlThreads(ctx->getMDL()); ++iProc) {
+                for (auto i=0; i<n; ++i) {
+                    auto pRemote = reinterpret_cast<std::uint64_t *>(mdlFetch(ctx->getMDL(),0,i,iProc));
+                    auto expect = ((1UL*iProc)<<33) + 10 + i;
+                    if (*pRemote != expect) ++nBAD;
+                }
+            }
+            mdlFinishCache(ctx->getMDL(),0);
+        }
+        mdl->SetCacheRMA(false);
+        *pnBAD = nBAD;
+    }
+
+    return sizeof(*pnBAD);
+}
+TEST_F(CacheTest, RMACacheReadWorks) {
+    auto ctx = reinterpret_cast<worker::Context *>(mdlWORKER());
+    std::uint64_t nBAD;
+    test::rma_ro::test(ctx,NULL,0,&nBAD,sizeof(nBAD));
+    EXPECT_EQ(nBAD,0);
+}
+} // namespace rma_ro
+
+namespace node_ro {
+constexpr int SERVICE = worker::TEST_NODE_RO;
+using rma_ro::tileBits;
+using rma_ro::getTileElement;
+int test(worker::Context *ctx,void *vin,int nIn,void *vout,int nOut) {
+    auto mdl = static_cast<mdl::mdlClass *>(ctx->getMDL());
+    auto pnBAD = reinterpret_cast<std::uint64_t *>(vout);
+    std::uint64_t nBAD;
+    if (ctx->getLeaves() > 1) {
+        int rID = mdl->ReqService(ctx->getUpper(),SERVICE,NULL,0);
+        test(ctx->getLower(),vin,nIn,vout,nOut);
+        nOut = mdl->GetReply(rID,nBAD);
+        *pnBAD += nBAD;
+    }
+    else {
+        int idSelf = mdlSelf(ctx->getMDL());
+        int nData = cacheSize + 3; // The last (partial) tile is not in shared memory
+        mdl->SetCacheShm(true);
+        void *pStore, *pOther; // The elements are in the second of two node stores
+        std::uint64_t nElements = cacheSize, nBytesPerElement = sizeof(std::uint64_t);
+        auto nOtherBytes = mdl->new_shared_array(&pOther,1,&nElements,&nBytesPerElement);
+        auto nStoreBytes = mdl->new_shared_array(&pStore,1,&nElements,&nBytesPerElement);
+        std::unique_ptr<std::uint64_t[]> last(new std::uint64_t[1<<tileBits]);
+        std::vector<std::uint64_t *> pTiles;
+        for (auto i=0; i<cacheSize; i += 1<<tileBits) pTiles.push_back(static_cast<std::uint64_t *>(pStore) + i);
+        pTiles.push_back(last.get());
+        for (auto i=0; i<nData; ++i)
+            *reinterpret_cast<std::uint64_t *>(getTileElement(pTiles.data(),i,0)) = ((1UL*idSelf)<<33) + 10 + i;
+
+        nBAD = 0;
+        for (auto iPass=0; iPass<2; ++iPass) { // The second open reuses the map of the first
+            mdlROcache(ctx->getMDL(),0,getTileElement,pTiles.data(),sizeof(std::uint64_t),nData);
+            for (auto iProc=0; iProc<mdlThreads(ctx->getMDL()); ++iProc) {
+                for (auto i=0; i<nData; ++i) {
+                    auto pRemote = reinterpret_cast<std::uint64_t *>(mdlAcquire(ctx->getMDL(),0,i,iProc));
+                    auto expect = ((1UL*iProc)<<33) + 10 + i;
+                    if (*pRemote != expect) ++nBAD;
+                    mdlRelease(ctx->getMDL(),0,pRemote);
+                }
+            }
+            mdlFinishCache(ctx->getMDL(),0);
+        }
+        mdl->SetCacheShm(false);
+        mdlThreadBarrier(ctx->getMDL());
+        mdl->delete_shared_array(pOther,nOtherBytes);
+        mdl->delete_shared_array(pStore,nStoreBytes);
+        *pnBAD = nBAD;
+    }
+
+    return sizeof(*pnBAD);
+}
+TEST_F(CacheTest, NodeCacheReadWorks) {
+    auto ctx = reinterpret_cast<worker::Context *>(mdlWORKER());
+    std::uint64_t nBAD;
+    test::node_ro::test(ctx,NULL,0,&nBAD,sizeof(nBAD));
+    EXPECT_EQ(nBAD,0);
+}
+} // namespace node_ro
+
 namespace flush {
 static void initFlush(void *vctx, void *g) {
     //auto ctx = reinterpret_cast<worker::Context*>(vctx);
@@ -540,6 +780,11 @@ void *worker_init(MDL mdl) {
     mdlAddService(mdl,worker::SET_ADD,ctx,(fcnService_t *)SetAdd::serviceSetAdd, sizeof(SetAdd::inSetAdd),0);
     mdlAddService(mdl,test::hash::SERVICE,ctx,(fcnService_t *)test::hash::test, 0,sizeof(std::uint64_t));
     mdlAddService(mdl,test::ro::SERVICE,ctx,(fcnService_t *)test::ro::test,0,sizeof(std::uint64_t));
+    mdlAddService(mdl,test::shared_ro::SERVICE,ctx,(fcnService_t *)test::shared_ro::test,0,sizeof(std::uint64_t));
+    mdlAddService(mdl,test::prefetch_ro::SERVICE,ctx,(fcnService_t *)test::prefetch_ro::test,0,sizeof(std::uint64_t));
+    mdlAddService(mdl,test::prefetch_ro::buffer::SERVICE,ctx,(fcnService_t *)test::prefetch_ro::buffer::test,0,sizeof(std::uint64_t));
+    mdlAddService(mdl,test::rma_ro::SERVICE,ctx,(fcnService_t *)test::rma_ro::test,0,sizeof(std::uint64_t));
+    mdlAddService(mdl,test::node_ro::SERVICE,ctx,(fcnService_t *)test::node_ro::test,0,sizeof(std::uint64_t));
     mdlAddService(mdl,test::flush::SERVICE,ctx,(fcnService_t *)test::flush::test, 0,sizeof(std::uint64_t));
     mdlAddService(mdl,test::flush::after_read::SERVICE,ctx,(fcnService_t *)test::flush::after_read::test,0,sizeof(std::uint64_t));
     mdlAddService(mdl,test::advanced::ro::SERVICE,ctx,(fcnService_t *)test::advanced::ro::test,0,sizeof(std::uint64_t));
@@ -0,0 +1,41 @@
+from __future__ import division
+import os
+import numpy as np
+import unittest
+import xmlrunner
+import PKDGRAV as msr
+
+@unittest.skipIf(not os.path.isfile('b0-final.std'), "missing b0-final.std")
+class TestIncrementalCheckpoint(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        cls.time = msr.load('b0-final.std',achOutName='chktest',bCompressCheckpoint=True,iIncrementalCheckpoints=2,
+                            bPeriodic=True,bEwald=True,nReplicas=2,bMemIntegerPosition=True)
+
+    def forces(self,step=None):
+        msr.domain_decompose()
+        msr.build_tree(ewald=True)
+        # An incremental checkpoint reorders the particles; the tree must still be usable
+        if step is not None: msr.checkpoint(step,time=self.time)
+        msr.gravity(time=self.time,theta=0.55)
+        msr.reorder()
+        return msr.get_array(field=msr.FIELD_ACCELERATION,time=self.time)
+
+    def testForcesUnchanged(self):
+        a = self.forces()
+        maga = np.linalg.norm(a,axis=1)
+        for step in (1,2): # A full checkpoint and then an incremental one
+            relerr = np.linalg.norm(self.forces(step) - a,axis=1) / maga
+            print('max',np.max(relerr))
+            self.assertLess(np.max(relerr),1e-5)
+        self.assertTrue(os.path.isfile('chktest.00002.chk.pkl'))
+
+        # The incremental checkpoint reads back the same particles
+        r = msr.get_array(field=msr.FIELD_POSITION,time=self.time)
+        msr.load_checkpoint('chktest.00002.chk')
+        msr.reorder()
+        self.assertTrue(np.array_equal(msr.get_array(field=msr.FIELD_POSITION,time=self.time),r))
+
+if __name__ == '__main__':
+    print('Running test')
+    unittest.main(verbosity=2,testRunner=xmlrunner.XMLTestRunner(output='test-reports'))
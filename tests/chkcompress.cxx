@@ -0,0 +1,164 @@
+#include "gtest/gtest.h"
+#include "io/chkcompress.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<uint8_t> round_trip(const std::vector<uint8_t> &in) {
+    std::vector<uint8_t> rans, out(in.size());
+    std::vector<char> coded;
+    chkcompress::encode_plane(in.data(),in.size(),rans,coded);
+    auto end = coded.data() + coded.size();
+    EXPECT_EQ(chkcompress::decode_plane(coded.data(),end,out.data(),out.size()),end);
+    return out;
+}
+
+// A particle: some fields that are the same for all, an integer position and a velocity
+struct particle {
+    uint64_t iOrder;
+    int32_t r[3];
+    float v[3];
+    uint8_t species;
+    uint8_t pad[3];
+};
+
+std::vector<particle> make_particles(uint64_t n) {
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int32_t> step(-1000,1000);
+    std::normal_distribution<float> vel(0.0,100.0);
+    std::vector<particle> p(n);
+    int32_t r[3] = {0,0,0};
+    for (uint64_t i=0; i<n; ++i) {
+        memset(&p[i],0,sizeof(p[i]));
+        p[i].iOrder = i;
+        for (auto j=0; j<3; ++j) {
+            r[j] += step(rng); // Neighbours are close together
+            p[i].r[j] = r[j];
+            p[i].v[j] = vel(rng);
+        }
+        p[i].species = 1;
+    }
+    return p;
+}
+
+std::vector<particle> read_all(const std::string &filename,uint64_t iBeg,uint64_t iEnd) {
+    std::vector<particle> p(iEnd-iBeg);
+    chkcompress::read(filename,p.data(),iBeg,iEnd);
+    return p;
+}
+
+bool same(const particle *a,const particle *b,uint64_t n) {
+    return memcmp(a,b,n*sizeof(particle))==0;
+}
+
+uint64_t file_size(const std::string &filename) {
+    auto fp = fopen(filename.c_str(),"rb");
+    fseek(fp,0,SEEK_END);
+    uint64_t n = ftell(fp);
+    fclose(fp);
+    return n;
+}
+
+constexpr uint32_t oPosition = offsetof(particle,r);
+
+} // namespace
+
+TEST(ChkCompress, ConstantPlane) {
+    std::vector<uint8_t> in(1000,7);
+    EXPECT_EQ(round_trip(in),in);
+}
+
+TEST(ChkCompress, RandomPlane) {
+    std::mt19937 rng(1);
+    std::vector<uint8_t> in(4096);
+    for (auto &v : in) v = rng();
+    EXPECT_EQ(round_trip(in),in);
+}
+
+TEST(ChkCompress, SkewedPlane) {
+    std::mt19937 rng(2);
+    std::geometric_distribution<int> geo(0.3);
+    std::vector<uint8_t> in(100000);
+    for (auto &v : in) v = std::min(255,geo(rng));
+    EXPECT_EQ(round_trip(in),in);
+    std::vector<uint8_t> rans;
+    std::vector<char> coded;
+    chkcompress::encode_plane(in.data(),in.size(),rans,coded);
+    EXPECT_LT(coded.size(),in.size()/2);
+}
+
+TEST(ChkCompress, ShortPlanes) {
+    for (auto n : {1,2,3,17}) {
+        std::vector<uint8_t> in(n);
+        for (auto i=0; i<n; ++i) in[i] = 3*i + 1;
+        EXPECT_EQ(round_trip(in),in);
+    }
+}
+
+TEST(ChkCompress, FileRoundTrip) {
+    const std::string filename = "chkcompress_test.chk";
+    auto p = make_particles(10000);
+    chkcompress::write(filename.c_str(),p.data(),p.size(),sizeof(particle),oPosition,nullptr,1000);
+    chkcompress::header hdr;
+    ASSERT_TRUE(chkcompress::read_header(filename,hdr));
+    EXPECT_EQ(hdr.nElements,p.size());
+    EXPECT_EQ(hdr.nBaseName,0);
+    EXPECT_LT(file_size(filename),p.size()*sizeof(particle));
+    EXPECT_TRUE(same(read_all(filename,0,p.size()).data(),p.data(),p.size()));
+    // Ranges that start and end inside of blocks (as a restore with a different number of ranks)
+    EXPECT_TRUE(same(read_all(filename,123,4567).data(),p.data()+123,4567-123));
+    EXPECT_TRUE(same(read_all(filename,9999,10000).data(),p.data()+9999,1));
+    remove(filename.c_str());
+}
+
+TEST(ChkCompress, IncrementalRoundTrip) {
+    const std::string full = "chkcompress_test_full.chk", incr = "chkcompress_test_incr.chk";
+    auto p = make_particles(10000);
+    chkcompress::write(full.c_str(),p.data(),p.size(),sizeof(particle),oPosition,nullptr,1000);
+    for (auto &q : p) { // Only the positions and velocities change
+        for (auto j=0; j<3; ++j) {
+            q.r[j] += 3;
+            q.v[j] *= 1.01f;
+        }
+    }
+    chkcompress::write(incr.c_str(),p.data(),p.size(),sizeof(particle),oPosition,full.c_str(),1000);
+    chkcompress::header hdr;
+    ASSERT_TRUE(chkcompress::read_header(incr,hdr));
+    EXPECT_EQ(hdr.nBaseName,full.size());
+    EXPECT_TRUE(same(read_all(incr,0,p.size()).data(),p.data(),p.size()));
+    EXPECT_TRUE(same(read_all(incr,1500,8500).data(),p.data()+1500,8500-1500));
+    remove(incr.c_str());
+
+    // A base with a different layout results in a full checkpoint
+    p.pop_back();
+    chkcompress::write(incr.c_str(),p.data(),p.size(),sizeof(particle),oPosition,full.c_str(),1000);
+    ASSERT_TRUE(chkcompress::read_header(incr,hdr));
+    EXPECT_EQ(hdr.nBaseName,0);
+    EXPECT_TRUE(same(read_all(incr,0,p.size()).data(),p.data(),p.size()));
+    remove(incr.c_str());
+    remove(full.c_str());
+}
+
+TEST(ChkCompressDeathTest, CorruptPlanes) {
+    std::vector<uint8_t> in(1000), out(1000), rans;
+    for (auto i=0; i<1000; ++i) in[i] = i % 5;
+    std::vector<char> coded;
+    chkcompress::encode_plane(in.data(),in.size(),rans,coded);
+    auto p = coded.data();
+    EXPECT_DEATH(chkcompress::decode_plane(p,p+coded.size()-1,out.data(),out.size()),"Corrupt");
+    EXPECT_DEATH(chkcompress::decode_plane(p,p+3,out.data(),out.size()),"Corrupt");
+    auto bad = coded;
+    bad[0] = 99; // Unknown mode
+    EXPECT_DEATH(chkcompress::decode_plane(bad.data(),bad.data()+bad.size(),out.data(),out.size()),"Corrupt");
+    bad = coded;
+    bad[5] ^= 0x55; // Frequency table no longer sums to the scale
+    EXPECT_DEATH(chkcompress::decode_plane(bad.data(),bad.data()+bad.size(),out.data(),out.size()),"Corrupt");
+}
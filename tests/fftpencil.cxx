@@ -0,0 +1,128 @@
+/*  This file is part of PKDGRAV3 (http://www.pkdgrav.org/).
+ *  Copyright (c) 2001-2018 Joachim Stadel & Douglas Potter
+ *
+ *  PKDGRAV3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  PKDGRAV3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with PKDGRAV3.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mdlfftpencil.h"
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "gtest/gtest.h"
+
+namespace {
+typedef FFTW3(real) real;
+typedef FFTW3(complex) cplx;
+#ifdef USE_SINGLE
+    const auto MPI_REAL_TYPE = MPI_FLOAT;
+#else
+    const auto MPI_REAL_TYPE = MPI_DOUBLE;
+#endif
+
+// Smooth enough to have power everywhere, but not separable
+real value(int x,int y,int z) {
+    return std::sin(0.3*x + 1.1*y*y + 0.7*z) + 0.1*((x*7 + y*13 + z*29) % 11);
+}
+
+// The transform is unnormalized, so the error scales with the grid size
+real tolerance(int n1,int n2,int n3) {
+    return 100 * std::numeric_limits<real>::epsilon() * n1 * n2 * n3;
+}
+
+class FFTPencil : public ::testing::TestWithParam<std::tuple<int,int,int>> {
+protected:
+    int nProcs, iProc;
+    int n1, n2, n3;
+    virtual void SetUp() {
+        MPI_Comm_size(MPI_COMM_WORLD,&nProcs);
+        MPI_Comm_rank(MPI_COMM_WORLD,&iProc);
+        std::tie(n1,n2,n3) = GetParam();
+    }
+    // r-space: x complete (padded), y in Y, z in Z
+    void fill(const mdlFFTPencil &fft,real *data) {
+        for (auto z=0; z<fft.Z.n; ++z)
+            for (auto y=0; y<fft.Y.n; ++y)
+                for (auto x=0; x<n1; ++x)
+                    data[x + 2*fft.n1h*(y + fft.Y.n*z)] = value(x,fft.Y.s+y,fft.Z.s+z);
+    }
+};
+
+TEST_P(FFTPencil, RoundTrip) {
+    mdlFFTPencil fft(nProcs,iProc,n1,n2,n3);
+    fft.create(MPI_COMM_WORLD);
+    std::vector<real> data(fft.nLocal);
+    fill(fft,data.data());
+    fft.forward(data.data());
+    fft.backward(reinterpret_cast<cplx *>(data.data()));
+    real fNorm = 1.0 / (1.0 * n1 * n2 * n3);
+    for (auto z=0; z<fft.Z.n; ++z)
+        for (auto y=0; y<fft.Y.n; ++y)
+            for (auto x=0; x<n1; ++x)
+                EXPECT_NEAR(data[x + 2*fft.n1h*(y + fft.Y.n*z)] * fNorm,value(x,fft.Y.s+y,fft.Z.s+z),
+                            tolerance(n1,n2,n3) * fNorm);
+}
+
+// The pencil k-space must be the same as the FFTW transposed slab k-space
+TEST_P(FFTPencil, MatchesSlab) {
+    int n1h = n1/2 + 1;
+    auto nk = 2 * n1h * n2 * n3;
+
+    // Each rank contributes its part of k-space: [y][z][kx]
+    std::vector<real> kPencil(nk), kSlab(nk);
+    mdlFFTPencil fft(nProcs,iProc,n1,n2,n3);
+    fft.create(MPI_COMM_WORLD);
+    std::vector<real> data(fft.nLocal);
+    fill(fft,data.data());
+    fft.forward(data.data());
+    auto C = reinterpret_cast<cplx *>(data.data());
+    for (auto y=0; y<fft.YK.n; ++y)
+        for (auto z=0; z<n3; ++z)
+            for (auto x=0; x<fft.X.n; ++x)
+                for (auto i=0; i<2; ++i)
+                    kPencil[i + 2*(fft.X.s+x + n1h*(z + n3*(fft.YK.s+y)))] = C[x + fft.X.n*(z + n3*y)][i];
+
+    ptrdiff_t nz, sz, ny, sy;
+    auto nLocal = 2*FFTW3(mpi_local_size_3d_transposed)(n3,n2,n1h,MPI_COMM_WORLD,&nz,&sz,&ny,&sy);
+    auto slab = FFTW3(alloc_real)(nLocal);
+    auto plan = FFTW3(mpi_plan_dft_r2c_3d)(n3,n2,n1,slab,reinterpret_cast<cplx *>(slab),
+                                           MPI_COMM_WORLD,FFTW_MPI_TRANSPOSED_OUT | FFTW_ESTIMATE);
+    for (auto z=0; z<nz; ++z)
+        for (auto y=0; y<n2; ++y)
+            for (auto x=0; x<n1; ++x)
+                slab[x + 2*n1h*(y + n2*z)] = value(x,y,sz+z);
+    FFTW3(execute)(plan);
+    for (auto i=0; i<2*n1h*n3*ny; ++i) kSlab[i + 2*n1h*n3*sy] = slab[i];
+    FFTW3(destroy_plan)(plan);
+    FFTW3(free)(slab);
+
+    MPI_Allreduce(MPI_IN_PLACE,kPencil.data(),nk,MPI_REAL_TYPE,MPI_SUM,MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE,kSlab.data(),nk,MPI_REAL_TYPE,MPI_SUM,MPI_COMM_WORLD);
+    for (auto i=0; i<nk; ++i) EXPECT_NEAR(kPencil[i],kSlab[i],tolerance(n1,n2,n3));
+}
+
+INSTANTIATE_TEST_SUITE_P(Grids, FFTPencil, ::testing::Values(
+                             std::make_tuple(8,8,8),
+                             std::make_tuple(12,10,6),
+                             std::make_tuple(7,9,11)));
+}
+
+int main(int argc, char **argv) {
+    MPI_Init(&argc,&argv);
+    FFTW3(mpi_init)();
+    ::testing::InitGoogleTest(&argc, argv);
+    int rc = RUN_ALL_TESTS();
+    FFTW3(mpi_cleanup)();
+    MPI_Finalize();
+    return rc;
+}
@@ -11,12 +11,15 @@ import PKDGRAV as msr # Once PKDGRAV is imported, simulation mode is no longer a
 @unittest.skipIf(not os.path.isfile('b0-final.std'), "missing b0-final.std")
 @unittest.skipIf(not os.path.isfile('b0-final-ref.grp.npy'), "missing b0-final-ref.grp.npy")
 class TestFof(unittest.TestCase):
-    def testFof(self):
+    @data((False,False,1),(True,False,1),(False,True,1),(True,True,1),(False,True,2))
+    @unpack
+    def testFof(self,bDomainSFC,bFofUnionFind,nTreeThreads):
         # for the unit test these values are fixed!
         name = 'b0-final.std'
         dTau = 0.0004098
         nMinMembers = 10
-        time = msr.load(name,bFindGroups = True,bMemGlobalGid = True,nMemEphemeral=8)
+        time = msr.load(name,bFindGroups = True,bMemGlobalGid = True,nMemEphemeral=8,bDomainSFC=bDomainSFC,
+                        bFofUnionFind=bFofUnionFind,nTreeThreads=nTreeThreads)
         msr.domain_decompose()
         msr.build_tree()
         msr.fof(dTau,nMinMembers)
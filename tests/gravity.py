@@ -58,10 +58,12 @@ class TestGravityB0Periodic(unittest.TestCase):
         cls.a = np.load('b0-final-p0.10-asym-k1.acc.npy')
         cls.maga = np.linalg.norm(cls.a,axis=1)
 
-    @data([0.70,0.0012],[0.60,0.00055],[0.55,0.0004],[0.40,0.0001],)
+    @data([0.70,0.0012,0],[0.60,0.00055,0],[0.55,0.0004,0],[0.40,0.0001,0],
+          [0.55,0.0004,32],[0.40,0.0001,64],)
     @unpack
-    def testGravityPeriodic(self,theta,target_rms):
-        msr.set_parameters(bPeriodic=True,bEwald=True,nReplicas=2,bEpsAccStep=True,bMemIntegerPosition=True)
+    def testGravityPeriodic(self,theta,target_rms,nEwaldTable):
+        msr.set_parameters(bPeriodic=True,bEwald=True,nReplicas=2,bEpsAccStep=True,bMemIntegerPosition=True,
+                           nEwaldTable=nEwaldTable)
         msr.domain_decompose()
         msr.build_tree(ewald=True)
         msr.gravity(time=self.time,theta=theta) 
@@ -72,6 +74,43 @@ class TestGravityB0Periodic(unittest.TestCase):
         print('rms',rms)
         self.assertLess(rms,target_rms)
 
+@unittest.skipIf(not os.path.isfile('b0-final.std'), "missing b0-final.std")
+@unittest.skipIf(not os.path.isfile('b0-final-p0.10-asym-k1.acc.npy'), "missing b0-final-p0.10-asym-k1.acc.npy")
+class TestGravityB0TreePM(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        cls.csm = CSM(dOmega0=0.32,dLambda=0.68,dSigma8=0.83,ns=0.96)
+        cls.time = msr.load('b0-final.std',nGridPM=64)
+        cls.a = np.load('b0-final-p0.10-asym-k1.acc.npy')
+        cls.maga = np.linalg.norm(cls.a,axis=1)
+
+    def testMeshKick(self):
+        # Short-range part from the tree (no kick as delta is zero)
+        msr.set_parameters(bPeriodic=True,bEwald=True,nReplicas=2,bEpsAccStep=True,bMemIntegerPosition=True)
+        msr.domain_decompose()
+        msr.build_tree()
+        msr.gravity(time=self.time,theta=0.55)
+        msr.reorder()
+        a=msr.get_array(field=msr.FIELD_ACCELERATION,time=self.time)
+        v0=msr.get_array(field=msr.FIELD_VELOCITY,time=self.time)
+
+        # Long-range part from the mesh is applied directly to the velocities
+        msr.domain_decompose()
+        msr.build_tree()
+        delta = 1e-3
+        msr.mesh_kick(time=self.time,delta=delta)
+        msr.reorder()
+        dv=msr.get_array(field=msr.FIELD_VELOCITY,time=self.time) - v0
+        self.assertGreater(np.max(np.linalg.norm(dv,axis=1)),0.0)
+
+        # The mesh kick only closes the step, so (non-comoving) it spans half of delta.
+        # It must supply what the tree left out of the Ewald reference to within 1% rms.
+        k = 0.5*delta
+        relerr = np.linalg.norm(a + dv/k - self.a,axis=1) / self.maga
+        rms = np.std(relerr)
+        print('rms',rms)
+        self.assertLess(rms,0.01)
+
 if __name__ == '__main__':
     print('Running test')
     unittest.main(verbosity=2,testRunner=xmlrunner.XMLTestRunner(output='test-reports'))
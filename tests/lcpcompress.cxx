@@ -0,0 +1,113 @@
+#include "gtest/gtest.h"
+#include "io/lcpcompress.h"
+extern "C" {
+#include "core/healpix.h"
+}
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int nSide = 16;
+constexpr double dQuantum = 1e-6;
+
+// Particles in a thin shell around the observer, as the light cone produces them
+std::vector<lcpcompress::particle> make_particles(uint64_t n,uint64_t iFirst,int seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> dir(0.0,1.0), vel(0.0,300.0);
+    std::uniform_real_distribution<float> radius(0.49,0.5);
+    std::vector<lcpcompress::particle> p(n);
+    for (uint64_t i=0; i<n; ++i) {
+        float r[3] = {dir(rng),dir(rng),dir(rng)};
+        float s = radius(rng) / std::sqrt(r[0]*r[0] + r[1]*r[1] + r[2]*r[2]);
+        p[i].id = iFirst + 3*i; // Not contiguous
+        for (auto j=0; j<3; ++j) {
+            p[i].pos[j] = r[j] * s;
+            p[i].vel[j] = vel(rng);
+        }
+        p[i].pot = -vel(rng);
+    }
+    return p;
+}
+
+int64_t pixel(const lcpcompress::particle &p) {
+    double r[3] = {p.pos[0],p.pos[1],p.pos[2]};
+    return vec2pix_ring64(nSide,r);
+}
+
+void sort_by_id(std::vector<lcpcompress::particle> &p) {
+    std::sort(p.begin(),p.end(),[](const auto &a,const auto &b) {return a.id < b.id;});
+}
+
+void expect_same(std::vector<lcpcompress::particle> a,std::vector<lcpcompress::particle> b) {
+    ASSERT_EQ(a.size(),b.size());
+    sort_by_id(a);
+    sort_by_id(b);
+    for (size_t i=0; i<a.size(); ++i) {
+        ASSERT_EQ(a[i].id,b[i].id);
+        for (auto j=0; j<3; ++j) {
+            EXPECT_NEAR(a[i].pos[j],b[i].pos[j],dQuantum + 1e-7);
+            EXPECT_EQ(a[i].vel[j],b[i].vel[j]);
+        }
+        EXPECT_EQ(a[i].pot,b[i].pot);
+    }
+}
+
+} // namespace
+
+TEST(LcpCompress, RoundTrip) {
+    const std::string filename = "lcpcompress_test.lcp";
+    // Two buffers, as the double buffering in the light cone output does
+    auto p1 = make_particles(20000,0,1), p2 = make_particles(15000,1,2);
+    auto c1 = p1, c2 = p2;
+    {
+        lcpcompress::writer w(filename.c_str(),nSide,dQuantum);
+        w.flush(p1.data(),p1.size());
+        w.close(p2.data(),p2.size());
+    }
+    // The buffers are written through an index and are not changed
+    EXPECT_EQ(memcmp(p1.data(),c1.data(),p1.size()*sizeof(p1[0])),0);
+    EXPECT_EQ(memcmp(p2.data(),c2.data(),p2.size()*sizeof(p2[0])),0);
+
+    lcpcompress::header hdr;
+    ASSERT_TRUE(lcpcompress::read_header(filename,hdr));
+    EXPECT_EQ(hdr.nParticles,p1.size()+p2.size());
+    EXPECT_EQ(hdr.nSide,nSide);
+
+    auto all = p1;
+    all.insert(all.end(),p2.begin(),p2.end());
+    std::vector<lcpcompress::particle> out;
+    lcpcompress::read(filename,0,12*nSide*nSide,out);
+    expect_same(all,out);
+
+    // A patch of sky only returns the particles of its pixels
+    int64_t iBeg = 100, iEnd = 700;
+    std::vector<lcpcompress::particle> patch;
+    for (auto &q : all) if (pixel(q) >= iBeg && pixel(q) < iEnd) patch.push_back(q);
+    ASSERT_FALSE(patch.empty());
+    out.clear();
+    lcpcompress::read(filename,iBeg,iEnd,out);
+    expect_same(patch,out);
+    remove(filename.c_str());
+}
+
+TEST(LcpCompress, Empty) {
+    const std::string filename = "lcpcompress_empty.lcp";
+    {
+        lcpcompress::writer w(filename.c_str(),nSide,dQuantum);
+        w.close(nullptr,0);
+    }
+    lcpcompress::header hdr;
+    ASSERT_TRUE(lcpcompress::read_header(filename,hdr));
+    EXPECT_EQ(hdr.nParticles,0);
+    std::vector<lcpcompress::particle> out;
+    lcpcompress::read(filename,0,12*nSide*nSide,out);
+    EXPECT_TRUE(out.empty());
+    remove(filename.c_str());
+}
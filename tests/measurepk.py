@@ -0,0 +1,48 @@
+from __future__ import division
+import os
+import numpy as np
+import unittest
+from ddt import ddt, data, unpack
+import xmlrunner
+import PKDGRAV as msr
+
+@ddt
+@unittest.skipIf(not os.path.isfile('b0-final.std'), "missing b0-final.std")
+class TestMeasurePk(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        # The ephemeral memory must be large enough for two grids
+        cls.grid = 64
+        cls.time = msr.load('b0-final.std',bPeriodic=True,nGridPk=cls.grid,bPkInterlace=True,bMemIntegerPosition=True)
+
+    # The P(k) from one grid at a time with the separate steps
+    def single(self,order,interlace,bins):
+        msr.grid_create(self.grid)
+        msr.assign_mass(order=order,grid_index=0,delta=0.0)
+        msr.density_contrast(grid_index=0)
+        if interlace:
+            msr.assign_mass(order=order,grid_index=1,delta=0.5)
+            msr.density_contrast(grid_index=1)
+            msr.grid_interlace(0,1)
+        msr.window_correction(grid_index=0,order=order)
+        (npk,k,pk) = msr.grid_bin_k(bins,0)
+        msr.grid_delete()
+        return (npk,pk)
+
+    # The fused measurement must match per bin. The only differences are the
+    # order of the single precision sums, so 1e-4 relative is ample.
+    @data([3,True],[3,False],[2,True],[1,True],[0,False])
+    @unpack
+    def testFusedMatchesSingle(self,order,interlace):
+        bins = self.grid // 2
+        msr.domain_decompose()
+        msr.build_tree()
+        (k,pk,npk,lpk) = msr.measure_pk(self.grid,bins=bins,interlace=interlace,order=order)
+        (npk1,pk1) = self.single(order,interlace,bins)
+        self.assertTrue(np.array_equal(npk,npk1))
+        print('max',np.max(np.abs(pk-pk1)/np.maximum(np.abs(pk1),1e-30)))
+        self.assertTrue(np.allclose(pk,pk1,rtol=1e-4,atol=0.0))
+
+if __name__ == '__main__':
+    print('Running test')
+    unittest.main(verbosity=2,testRunner=xmlrunner.XMLTestRunner(output='test-reports'))
@@ -0,0 +1,132 @@
+/*  This file is part of PKDGRAV3 (http://www.pkdgrav.org/).
+ *  Copyright (c) 2001-2018 Joachim Stadel & Douglas Potter
+ *
+ *  PKDGRAV3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  PKDGRAV3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with PKDGRAV3.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtest/gtest.h"
+#include "domains/sfcsplits.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+using NewDD::SFCSampleOutput;
+using NewDD::SFC_SAMPLES;
+
+namespace {
+
+// Each thread samples an equal slice of the key line with SFC_SAMPLES segments of nCount particles.
+// The weight of each segment is given by a function of its position on the key line.
+template<typename F>
+std::vector<SFCSampleOutput> makeSamples(int nThreads,uint32_t nCount,uint64_t nStore,F weight) {
+    std::vector<SFCSampleOutput> samples(nThreads);
+    const uint64_t nSegments = uint64_t(nThreads) * SFC_SAMPLES;
+    const uint64_t dKey = (uint64_t(1) << 60) / nSegments;
+    for (auto i=0; i<nThreads; ++i) {
+        auto &s = samples[i];
+        s.nStore = nStore;
+        s.nLocal = nCount * SFC_SAMPLES;
+        s.nSamples = SFC_SAMPLES;
+        s.fWeight = 0.0;
+        for (auto j=0; j<SFC_SAMPLES; ++j) {
+            double x = double(i*SFC_SAMPLES + j) / nSegments;
+            s.samples[j].uKey = (i*SFC_SAMPLES + j + 1) * dKey - 1;
+            s.samples[j].nCount = nCount;
+            s.samples[j].fWeight = weight(x);
+            s.fWeight += s.samples[j].fWeight;
+        }
+    }
+    return samples;
+}
+
+// Particles in each domain according to the samples
+std::vector<uint64_t> domainCounts(const std::vector<SFCSampleOutput> &samples,const std::vector<uint64_t> &split) {
+    std::vector<uint64_t> n(split.size()-1,0);
+    for (auto &s : samples) {
+        for (auto j=0; j<s.nSamples; ++j) {
+            auto d = std::upper_bound(split.begin(),split.end(),s.samples[j].uKey) - split.begin() - 1;
+            n[d] += s.samples[j].nCount;
+        }
+    }
+    return n;
+}
+
+// Weight in each domain according to the samples
+std::vector<double> domainWeights(const std::vector<SFCSampleOutput> &samples,const std::vector<uint64_t> &split) {
+    std::vector<double> w(split.size()-1,0.0);
+    for (auto &s : samples) {
+        for (auto j=0; j<s.nSamples; ++j) {
+            auto d = std::upper_bound(split.begin(),split.end(),s.samples[j].uKey) - split.begin() - 1;
+            w[d] += s.samples[j].fWeight;
+        }
+    }
+    return w;
+}
+
+} // namespace
+
+TEST(SFCSplits, EqualWeights) {
+    const int nThreads = 8;
+    auto samples = makeSamples(nThreads,100,1000000,[](double) {return 1.0;});
+    std::vector<uint64_t> split;
+    EXPECT_TRUE(NewDD::SFCSplits(samples.data(),nThreads,0.05,split));
+    ASSERT_EQ(split.size(),nThreads+1);
+    EXPECT_TRUE(std::is_sorted(split.begin(),split.end()));
+    for (auto n : domainCounts(samples,split)) EXPECT_EQ(n,100*SFC_SAMPLES);
+    // Balanced splits are kept
+    EXPECT_FALSE(NewDD::SFCSplits(samples.data(),nThreads,0.05,split));
+}
+
+TEST(SFCSplits, WorkWeighted) {
+    // The work rises steeply along the key line (as for a cluster on deep rungs).
+    // Each domain must get the same work to within one segment, and therefore
+    // the domains with the costly particles get fewer of them.
+    const int nThreads = 8;
+    auto weight = [](double x) {return 1.0 + 99.0*x*x;};
+    auto samples = makeSamples(nThreads,100,1000000,weight);
+    std::vector<uint64_t> split;
+    EXPECT_TRUE(NewDD::SFCSplits(samples.data(),nThreads,0.05,split));
+    ASSERT_EQ(split.size(),nThreads+1);
+    double fTotal = 0.0;
+    for (auto &s : samples) fTotal += s.fWeight;
+    for (auto w : domainWeights(samples,split)) EXPECT_NEAR(w,fTotal/nThreads,weight(1.0));
+    auto n = domainCounts(samples,split);
+    EXPECT_GT(n.front(),n.back());
+    // Balanced splits are kept
+    EXPECT_FALSE(NewDD::SFCSplits(samples.data(),nThreads,0.05,split));
+}
+
+TEST(SFCSplits, LastDomainIsCapped) {
+    // Nearly all of the work is at the start of the key line, so balancing by
+    // weight alone would leave most of the particles to the last domain.
+    const int nThreads = 4;
+    const uint64_t nStore = 100 * SFC_SAMPLES * 3 / 2;
+    auto samples = makeSamples(nThreads,100,nStore,[](double x) {return x < 0.1 ? 100.0 : 0.001;});
+    std::vector<uint64_t> split;
+    EXPECT_TRUE(NewDD::SFCSplits(samples.data(),nThreads,0.05,split));
+    uint64_t nTotal = 0;
+    for (auto n : domainCounts(samples,split)) {
+        EXPECT_LE(n,nStore);
+        nTotal += n;
+    }
+    EXPECT_EQ(nTotal,uint64_t(100)*SFC_SAMPLES*nThreads);
+}
+
+TEST(SFCSplits, TooManyParticles) {
+    const int nThreads = 4;
+    auto samples = makeSamples(nThreads,100,100*SFC_SAMPLES-1,[](double) {return 1.0;});
+    std::vector<uint64_t> split;
+    EXPECT_THROW(NewDD::SFCSplits(samples.data(),nThreads,0.05,split),std::overflow_error);
+}
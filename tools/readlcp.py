@@ -0,0 +1,89 @@
+#!/usr/bin/env python
+# Read light cone particle files, either raw (LIGHTCONEP records) or packed
+# (see io/lcpcompress.h). For packed files a range of HEALPix pixels (ring
+# scheme, nside of the file) can be given, and only those blocks are read.
+# Decoding is done in Python; for large files use utility/lcpunpack instead.
+import numpy as np
+import pandas as pd
+from sys import argv,exit
+
+particle_type = np.dtype([('id','=u8'), ('x','=f4'),('y','=f4'),('z','=f4'), ('vx','=f4'),('vy','=f4'),('vz','=f4'),
+                          ('pot','=f4')], align=True)
+header_type = np.dtype([('magic','S8'), ('nVersion','=u4'), ('nSide','=u4'), ('nParticles','=u8'), ('nBlocks','=u8'),
+                        ('iIndexOffset','=u8'), ('dQuantum','=f8')])
+index_type = np.dtype([('iPixel','=i8'), ('nParticles','=u4'), ('nBytes','=u4'), ('iOffset','=u8')])
+block_type = np.dtype([('iPixel','=i8'), ('nParticles','=u4'), ('reserved','=u4'), ('origin','=f8',3), ('quantum','=f8')])
+row_type = np.dtype([('dId','=u8'), ('q','=u4',3), ('vel','=f4',3), ('pot','=f4')], align=True)
+assert row_type.itemsize == particle_type.itemsize
+
+PLANE_RAW, PLANE_CONSTANT, PLANE_RANS = 0, 1, 2
+prob_bits = 12
+rans_lower = 1 << 23
+
+def rans_decode(data,n):
+    freq = np.frombuffer(data,dtype='<u2',count=256)
+    cum = np.concatenate(([0],np.cumsum(freq)[:-1])).tolist()
+    symbol = np.repeat(np.arange(256),freq).tolist()
+    freq = freq.tolist()
+    x = int.from_bytes(data[512:516],'little')
+    i = 516
+    out = bytearray(n)
+    mask = (1 << prob_bits) - 1
+    for k in range(n):
+        slot = x & mask
+        s = symbol[slot]
+        out[k] = s
+        x = freq[s] * (x >> prob_bits) + slot - cum[s]
+        while x < rans_lower:
+            x = (x << 8) | data[i]
+            i += 1
+    return out
+
+def decode_plane(data,i,n):
+    mode = data[i]
+    nBytes = int.from_bytes(data[i+1:i+5],'little')
+    payload = data[i+5:i+5+nBytes]
+    if mode == PLANE_RAW: plane = payload
+    elif mode == PLANE_CONSTANT: plane = bytes(payload[:1]) * n
+    elif mode == PLANE_RANS: plane = rans_decode(payload,n)
+    else: raise ValueError('corrupt packed light cone block')
+    return np.frombuffer(plane,dtype=np.uint8), i + 5 + nBytes
+
+def decode_block(data):
+    bh = np.frombuffer(data,dtype=block_type,count=1)[0]
+    m = int(bh['nParticles'])
+    planes = np.empty((row_type.itemsize,m),dtype=np.uint8)
+    i = block_type.itemsize
+    for j in range(row_type.itemsize):
+        planes[j],i = decode_plane(data,i,m)
+    rows = np.frombuffer(np.ascontiguousarray(planes.T).tobytes(),dtype=row_type)
+    p = np.zeros(m,dtype=particle_type)
+    p['id'] = np.cumsum(rows['dId'],dtype=np.uint64)
+    for j,x in enumerate('xyz'):
+        p[x] = bh['origin'][j] + bh['quantum'] * rows['q'][:,j]
+        p['v'+x] = rows['vel'][:,j]
+    p['pot'] = rows['pot']
+    return p
+
+def read_lcp(filename,iPixelBeg=0,iPixelEnd=None):
+    with open(filename,'rb') as f:
+        hdr = np.fromfile(f,dtype=header_type,count=1)
+        if len(hdr)==0 or hdr[0]['magic'] != b'PKDLCPZ':
+            return np.fromfile(filename,dtype=particle_type) # Raw file: no pixel selection
+        hdr = hdr[0]
+        f.seek(int(hdr['iIndexOffset']))
+        blocks = np.fromfile(f,dtype=index_type,count=int(hdr['nBlocks']))
+        if iPixelEnd is None: iPixelEnd = 12 * int(hdr['nSide'])**2
+        first,last = np.searchsorted(blocks['iPixel'],[iPixelBeg,iPixelEnd])
+        parts = [np.zeros(0,dtype=particle_type)]
+        for b in blocks[first:last]:
+            f.seek(int(b['iOffset']))
+            parts.append(decode_block(f.read(int(b['nBytes']))))
+        return np.concatenate(parts)
+
+if __name__ == '__main__':
+    if len(argv) not in (2,4):
+        print('Usage: {} file [first end]'.format(argv[0]))
+        exit(1)
+    p = read_lcp(argv[1],*[int(a) for a in argv[2:]])
+    print(pd.DataFrame(p,columns=p.dtype.names))
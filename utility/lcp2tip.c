@@ -55,6 +55,7 @@ int main(int argc, char *argv[]) {
     tipsyDark d;
 
     if (argc!=3) {
+        /* Packed light cone files are unpacked with lcpunpack files | lcp2tip outfile mass */
         fprintf(stderr,"Usage: cat files | %s outfile mass\n", argv[0]);
         return EINVAL;
     }
@@ -0,0 +1,73 @@
+/*  This file is part of PKDGRAV3 (http://www.pkdgrav.org/).
+ *  Copyright (c) 2001-2018 Joachim Stadel & Douglas Potter
+ *
+ *  PKDGRAV3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  PKDGRAV3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with PKDGRAV3.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+** Write the particles of packed light cone files to stdout as raw LIGHTCONEP
+** records, optionally only those in HEALPix pixels [first,end) of the file.
+** Raw files are passed through, so the result can be piped into lcp2tip or
+** read by the analysis tools in either case:
+**
+**   lcpunpack [-p first end] files | lcp2tip outfile mass
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <vector>
+#include "io/lcpcompress.h"
+
+static void copy_raw(const char *filename) {
+    FILE *fp = fopen(filename,"rb");
+    if (fp==NULL) {
+        perror(filename);
+        abort();
+    }
+    char buffer[64*1024];
+    size_t n;
+    while ((n=fread(buffer,1,sizeof(buffer),fp)) > 0) fwrite(buffer,1,n,stdout);
+    fclose(fp);
+}
+
+int main(int argc, char *argv[]) {
+    int64_t iPixelBeg = 0, iPixelEnd = INT64_MAX;
+    int i = 1;
+    if (argc > 1 && strcmp(argv[1],"-p")==0) {
+        if (argc < 4) i = argc;
+        else {
+            iPixelBeg = atoll(argv[2]);
+            iPixelEnd = atoll(argv[3]);
+            i = 4;
+        }
+    }
+    if (i >= argc) {
+        fprintf(stderr,"Usage: %s [-p first end] files > outfile\n", argv[0]);
+        return EINVAL;
+    }
+
+    std::vector<lcpcompress::particle> particles;
+    for (; i<argc; ++i) {
+        lcpcompress::header hdr;
+        if (lcpcompress::read_header(argv[i],hdr)) {
+            particles.clear();
+            lcpcompress::read(argv[i],iPixelBeg,iPixelEnd,particles);
+            fwrite(particles.data(),sizeof(particles[0]),particles.size(),stdout);
+        }
+        else copy_raw(argv[i]); /* The pixel range cannot be applied to raw files */
+    }
+    return 0;
+}